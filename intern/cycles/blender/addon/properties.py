@@ -295,6 +295,28 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 min=0.0, max=1.0,
                 default=0.05,
                 )
+        cls.use_light_tree = BoolProperty(
+                name="Light Tree",
+                description="Pick lights based on their estimated contribution, for scenes with many lights "
+                            "(not used when sampling all lights)",
+                default=False,
+                )
+
+        cls.adaptive_threshold = FloatProperty(
+                name="Adaptive Threshold",
+                description="Stop sampling pixels once their noise is below this threshold, "
+                            "zero disables adaptive sampling (CPU final renders only)",
+                min=0.0, max=1.0,
+                default=0.0,
+                precision=4,
+                )
+        cls.adaptive_min_samples = IntProperty(
+                name="Adaptive Min Samples",
+                description="Minimum number of samples before pixels can stop, "
+                            "zero picks a minimum from the number of samples",
+                min=0, max=4096,
+                default=0,
+                )
 
         cls.caustics_reflective = BoolProperty(
                 name="Reflective Caustics",
@@ -544,6 +566,19 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 description="Use embree as ray accelerator",
                 default=False,
                 )
+        cls.use_bvh_cache = BoolProperty(
+                name="Cache BVH",
+                description="Store object BVHs on disk and reuse them while the geometry does not change, "
+                            "skipping BVH build on later frames and re-renders",
+                default=False,
+                )
+        cls.bvh_cache_path = StringProperty(
+                name="BVH Cache Path",
+                description="Directory for cached BVHs, can be shared between computers "
+                            "(leave empty to use the user cache directory)",
+                subtype='DIR_PATH',
+                default="",
+                )
         cls.tile_order = EnumProperty(
                 name="Tile Order",
                 description="Tile order for rendering",
@@ -661,6 +696,14 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
             description="Automatically convert textures to .tx files for optimal texture cache performance"
         )
 
+        cls.texture_auto_convert_path = StringProperty(
+            name="Converted Textures Path",
+            description="Directory for converted .tx files, can be shared between computers "
+                        "(leave empty to write them next to the source textures)",
+            subtype='DIR_PATH',
+            default="",
+        )
+
         cls.texture_accept_unmipped = BoolProperty(
             name="Accept Unmipped",
             default=True,
@@ -731,7 +774,16 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         cls.debug_use_cpu_sse41 = BoolProperty(name="SSE41", default=True)
         cls.debug_use_cpu_sse3 = BoolProperty(name="SSE3", default=True)
         cls.debug_use_cpu_sse2 = BoolProperty(name="SSE2", default=True)
-        cls.debug_use_qbvh = BoolProperty(name="QBVH", default=True)
+        cls.debug_bvh_layout = EnumProperty(
+            name="BVH Layout",
+            description="Memory layout of the BVH, wider layouts are only used when the CPU supports them",
+            default='BVH8',
+            items=(
+                ('BVH2', "BVH2", ""),
+                ('BVH4', "BVH4", "Needs SSE2"),
+                ('BVH8', "BVH8", "Needs AVX2"),
+                ),
+            )
         cls.debug_use_cpu_split_kernel = BoolProperty(name="Split Kernel", default=False)
 
         cls.debug_use_cuda_adaptive_compile = BoolProperty(name="Adaptive Compile", default=False)
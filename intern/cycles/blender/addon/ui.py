@@ -227,6 +227,13 @@ class CyclesRender_PT_sampling(CyclesButtonsPanel, Panel):
         sub.prop(cscene, "sample_clamp_direct")
         sub.prop(cscene, "sample_clamp_indirect")
         sub.prop(cscene, "light_sampling_threshold")
+        sub.prop(cscene, "use_light_tree")
+
+        sub = col.column(align=True)
+        sub.prop(cscene, "adaptive_threshold")
+        subsub = sub.row(align=True)
+        subsub.active = cscene.adaptive_threshold > 0.0
+        subsub.prop(cscene, "adaptive_min_samples", text="Min Samples")
 
         if cscene.progressive == 'PATH' or use_branched_path(context) is False:
             col = split.column()
@@ -471,6 +478,9 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         sub.label(text="Texture Cache:")
         sub.prop(cscene, "texture_cache_size")
         sub.prop(cscene, "texture_auto_convert")
+        row = sub.row()
+        row.active = cscene.texture_auto_convert
+        row.prop(cscene, "texture_auto_convert_path", text="")
         sub.prop(cscene, "texture_accept_unmipped")
         sub.prop(cscene, "texture_accept_untiled")
         sub.prop(cscene, "texture_auto_mip")
@@ -507,6 +517,13 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         row.active = not cscene.debug_use_spatial_splits and not cscene.use_bvh_embree
         row.prop(cscene, "debug_bvh_time_steps")
 
+        row = col.row()
+        row.active = not cscene.use_bvh_embree
+        row.prop(cscene, "use_bvh_cache")
+        row = col.row()
+        row.active = cscene.use_bvh_cache and not cscene.use_bvh_embree
+        row.prop(cscene, "bvh_cache_path", text="")
+
 class CyclesRender_AOV_add(bpy.types.Operator):
     """Add an AOV pass"""
     bl_idname="scenerenderlayer.aov_add"
@@ -1705,7 +1722,7 @@ class CyclesRender_PT_debug(CyclesButtonsPanel, Panel):
         row.prop(cscene, "debug_use_cpu_sse41", toggle=True)
         row.prop(cscene, "debug_use_cpu_avx", toggle=True)
         row.prop(cscene, "debug_use_cpu_avx2", toggle=True)
-        col.prop(cscene, "debug_use_qbvh")
+        col.prop(cscene, "debug_bvh_layout")
         col.prop(cscene, "debug_use_cpu_split_kernel")
 
         col = layout.column()
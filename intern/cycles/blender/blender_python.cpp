@@ -66,7 +66,17 @@ bool debug_flags_sync_from_scene(BL::Scene b_scene)
 	flags.cpu.sse41 = get_boolean(cscene, "debug_use_cpu_sse41");
 	flags.cpu.sse3 = get_boolean(cscene, "debug_use_cpu_sse3");
 	flags.cpu.sse2 = get_boolean(cscene, "debug_use_cpu_sse2");
-	flags.cpu.qbvh = get_boolean(cscene, "debug_use_qbvh");
+	switch(get_enum(cscene, "debug_bvh_layout")) {
+		case 0:
+			flags.cpu.bvh_layout = DebugFlags::CPU::BVH2;
+			break;
+		case 1:
+			flags.cpu.bvh_layout = DebugFlags::CPU::BVH4;
+			break;
+		case 2:
+			flags.cpu.bvh_layout = DebugFlags::CPU::BVH8;
+			break;
+	}
 	flags.cpu.split_kernel = get_boolean(cscene, "debug_use_cpu_split_kernel");
 	/* Synchronize CUDA flags. */
 	flags.cuda.adaptive_compile = get_boolean(cscene, "debug_use_cuda_adaptive_compile");
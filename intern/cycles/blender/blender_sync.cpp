@@ -36,6 +36,7 @@
 #include "util/util_debug.h"
 #include "util/util_foreach.h"
 #include "util/util_opengl.h"
+#include "util/util_optimization.h"
 #include "util/util_hash.h"
 
 CCL_NAMESPACE_BEGIN
@@ -65,6 +66,7 @@ BlenderSync::BlenderSync(BL::RenderEngine& b_engine,
   is_cpu(is_cpu),
   dicing_rate(1.0f),
   max_subdivisions(12),
+  dicing_camera(new Camera()),
   progress(progress)
 {
 	PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
@@ -74,6 +76,7 @@ BlenderSync::BlenderSync(BL::RenderEngine& b_engine,
 
 BlenderSync::~BlenderSync()
 {
+	delete dicing_camera;
 }
 
 /* Sync */
@@ -143,6 +146,15 @@ bool BlenderSync::sync_recalc()
 			max_subdivisions = updated_max_subdivisions;
 			dicing_prop_changed = true;
 		}
+
+		/* edge factors depend on the camera, so dice again when it moved
+		 * since the last sync. viewport navigation alone does not sync, the
+		 * meshes are diced again on the next update. patches with unchanged
+		 * edge factors are reused from the dice cache */
+		if(dicing_camera_modified()) {
+			*dicing_camera = *scene->camera;
+			dicing_prop_changed = true;
+		}
 	}
 
 	BL::BlendData::objects_iterator b_ob;
@@ -211,6 +223,19 @@ bool BlenderSync::sync_recalc()
 	return recalc;
 }
 
+bool BlenderSync::dicing_camera_modified()
+{
+	if(!experimental)
+		return false;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(mesh->subdivision_type != Mesh::SUBDIVISION_NONE)
+			return scene->camera->modified(*dicing_camera);
+	}
+
+	return false;
+}
+
 void BlenderSync::sync_data(BL::RenderSettings& b_render,
                             BL::SpaceView3D& b_v3d,
                             BL::Object& b_override,
@@ -321,6 +346,10 @@ void BlenderSync::sync_integrator()
 	integrator->sample_all_lights_direct = get_boolean(cscene, "sample_all_lights_direct");
 	integrator->sample_all_lights_indirect = get_boolean(cscene, "sample_all_lights_indirect");
 	integrator->light_sampling_threshold = get_float(cscene, "light_sampling_threshold");
+	integrator->use_light_tree = get_boolean(cscene, "use_light_tree");
+
+	integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
 
 	int diffuse_samples = get_int(cscene, "diffuse_samples");
 	int glossy_samples = get_int(cscene, "glossy_samples");
@@ -360,6 +389,10 @@ void BlenderSync::sync_integrator()
 
 	if(integrator->modified(previntegrator))
 		integrator->tag_update(scene);
+
+	/* Light tree is built by the light manager. */
+	if(integrator->use_light_tree_sampling() != previntegrator.use_light_tree_sampling())
+		scene->light_manager->tag_update(scene);
 }
 
 /* Film */
@@ -646,6 +679,9 @@ void BlenderSync::sync_film(BL::RenderLayer& b_rlay,
 			b_engine.add_pass(passname.c_str(), is_color? 3: 1, is_color? "RGB": "X", b_srlay.name().c_str(), 0);
 		} RNA_END
 
+		PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
+		passes.adaptive_passes = (get_float(cscene, "adaptive_threshold") > 0.0f);
+
 		passes.denoising_passes = get_boolean(crp, "write_denoising_data");
 		if(passes.denoising_passes) {
 			b_engine.add_pass("Denoising Normal", 3, "XYZ", b_srlay.name().c_str(), 0);
@@ -668,7 +704,8 @@ void BlenderSync::sync_film(BL::RenderLayer& b_rlay,
 
 /* Scene Parameters */
 
-SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
+SceneParams BlenderSync::get_scene_params(BL::BlendData& b_data,
+                                          BL::Scene& b_scene,
                                           bool background,
                                           bool is_cpu)
 {
@@ -700,6 +737,10 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 	else {
 		params.use_bvh_embree = false;
 	}
+	params.use_bvh_cache = RNA_boolean_get(&cscene, "use_bvh_cache");
+	params.bvh_cache_path = blender_absolute_path(b_data,
+	                                              b_scene,
+	                                              get_string(cscene, "bvh_cache_path"));
 
 	if(background && params.shadingsystem != SHADINGSYSTEM_OSL)
 		params.persistent_data = r.use_persistent_data();
@@ -722,6 +763,9 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 
 	params.texture.cache_size = RNA_int_get(&cscene, "texture_cache_size");
 	params.texture.auto_convert = RNA_boolean_get(&cscene, "texture_auto_convert");
+	params.texture.tx_cache_path = blender_absolute_path(b_data,
+	                                                     b_scene,
+	                                                     get_string(cscene, "texture_auto_convert_path"));
 	params.texture.accept_unmipped = RNA_boolean_get(&cscene, "texture_accept_unmipped");
 	params.texture.accept_untiled = RNA_boolean_get(&cscene, "texture_accept_untiled");
 	params.texture.tile_size = RNA_int_get(&cscene, "texture_tile_size");
@@ -732,12 +776,35 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 	
 #if !(defined(__GNUC__) && (defined(i386) || defined(_M_IX86)))
 	if(is_cpu) {
-		params.use_qbvh = DebugFlags().cpu.qbvh && system_cpu_support_sse2();
+		switch(DebugFlags().cpu.bvh_layout) {
+			case DebugFlags::CPU::BVH2:
+				params.bvh_layout = BVH_LAYOUT_BVH2;
+				break;
+			case DebugFlags::CPU::BVH4:
+				params.bvh_layout = BVH_LAYOUT_BVH4;
+				break;
+			case DebugFlags::CPU::BVH8:
+				params.bvh_layout = BVH_LAYOUT_BVH8;
+				break;
+		}
+		/* Fall back to a narrower layout when there is no kernel which is
+		 * able to traverse the requested one on this CPU. */
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+		const bool has_bvh8_kernel = system_cpu_support_avx2();
+#else
+		const bool has_bvh8_kernel = false;
+#endif
+		if(params.bvh_layout == BVH_LAYOUT_BVH8 && !has_bvh8_kernel) {
+			params.bvh_layout = BVH_LAYOUT_BVH4;
+		}
+		if(params.bvh_layout == BVH_LAYOUT_BVH4 && !system_cpu_support_sse2()) {
+			params.bvh_layout = BVH_LAYOUT_BVH2;
+		}
 	}
 	else
 #endif
 	{
-		params.use_qbvh = false;
+		params.bvh_layout = BVH_LAYOUT_BVH2;
 	}
 
 	return params;
@@ -878,6 +945,9 @@ SessionParams BlenderSync::get_session_params(BL::RenderEngine& b_engine,
 		params.tile_order = TILE_BOTTOM_TO_TOP;
 	}
 
+	/* save buffers write tiles to a file with the same tiles as Blender */
+	params.split_tiles = !b_scene.render().use_save_buffers();
+
 	params.start_resolution = get_int(cscene, "preview_start_resolution");
 
 	/* other parameters */
@@ -93,7 +93,8 @@ public:
 	inline int get_layer_bound_samples() { return render_layer.bound_samples; }
 
 	/* get parameters */
-	static SceneParams get_scene_params(BL::Scene& b_scene,
+	static SceneParams get_scene_params(BL::BlendData& b_data,
+	                                    BL::Scene& b_scene,
 	                                    bool background,
 	                                    bool is_cpu);
 	static SessionParams get_session_params(BL::RenderEngine& b_engine,
@@ -121,6 +122,7 @@ private:
 	                 int width, int height,
 	                 void **python_thread_state);
 	void sync_film();
+	bool dicing_camera_modified();
 	void sync_view();
 	void sync_world(bool update_all);
 	void sync_shaders();
@@ -209,6 +211,8 @@ private:
 
 	float dicing_rate;
 	int max_subdivisions;
+	/* Camera the subdivided meshes were last synced for. */
+	Camera *dicing_camera;
 
 	struct RenderLayerInfo {
 		RenderLayerInfo()
@@ -22,11 +22,16 @@
 
 #include "bvh/bvh2.h"
 #include "bvh/bvh4.h"
+#include "bvh/bvh8.h"
 #include "bvh/bvh_build.h"
 #include "bvh/bvh_node.h"
 
+#include "util/util_atomic.h"
+#include "util/util_cache.h"
 #include "util/util_foreach.h"
+#include "util/util_logging.h"
 #include "util/util_progress.h"
+#include "util/util_task.h"
 
 #ifdef WITH_EMBREE
 #  include "bvh_embree.h"
@@ -34,6 +39,9 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Source of BVH::revision, unique across all BVH's. */
+static uint64_t bvh_revision_counter = 0;
+
 /* Pack Utility */
 
 BVHStackEntry::BVHStackEntry(const BVHNode *n, int i)
@@ -49,8 +57,12 @@ int BVHStackEntry::encodeIdx() const
 /* BVH */
 
 BVH::BVH(const BVHParams& params_, const vector<Object*>& objects_)
-: params(params_), objects(objects_)
+: params(params_),
+  objects(objects_),
+  build_leaf_sah_cost(0.0f),
+  refit_parallel_depth(0)
 {
+	revision = atomic_add_and_fetch_uint64(&bvh_revision_counter, 1);
 }
 
 BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
@@ -59,16 +71,42 @@ BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 	if(params.use_bvh_embree)
 		return new BVHEmbree(params, objects);
 #endif
-	if(params.use_qbvh)
-		return new BVH4(params, objects);
-	else
-		return new BVH2(params, objects);
+	switch(params.bvh_layout) {
+		case BVH_LAYOUT_BVH8:
+			return new BVH8(params, objects);
+		case BVH_LAYOUT_BVH4:
+			return new BVH4(params, objects);
+		case BVH_LAYOUT_BVH2:
+		default:
+			return new BVH2(params, objects);
+	}
 }
 
 /* Building */
 
 void BVH::build(Progress& progress, Stats*)
 {
+	revision = atomic_add_and_fetch_uint64(&bvh_revision_counter, 1);
+
+	/* Only object level BVHs are cached, the top level one depends on object
+	 * transforms and gets instance BVHs merged into it. */
+	const bool use_cache = params.use_cache && !params.top_level;
+	CacheData key;
+
+	if(use_cache) {
+		progress.set_substatus("Looking in BVH cache");
+		cache_key(key);
+
+		if(cache_read(key)) {
+			progress.set_substatus("Packing BVH triangles and strands");
+			pack_primitives();
+			if(params.refit_sah_threshold > 0.0f) {
+				build_leaf_sah_cost = leaf_sah_cost();
+			}
+			return;
+		}
+	}
+
 	progress.set_substatus("Building BVH");
 
 	/* build nodes */
@@ -101,19 +139,318 @@ void BVH::build(Progress& progress, Stats*)
 
 	/* free build nodes */
 	root->deleteSubtree();
+
+	if(params.refit_sah_threshold > 0.0f && !params.top_level) {
+		build_leaf_sah_cost = leaf_sah_cost();
+	}
+
+	if(use_cache) {
+		progress.set_substatus("Writing BVH cache");
+		cache_write(key);
+	}
+}
+
+/* Disk Cache */
+
+void BVH::cache_key(CacheData& key)
+{
+	/* Build parameters, added field by field since the struct has padding. */
+	key.add(&params.use_spatial_split, sizeof(params.use_spatial_split));
+	key.add(&params.spatial_split_alpha, sizeof(params.spatial_split_alpha));
+	key.add(&params.unaligned_split_threshold, sizeof(params.unaligned_split_threshold));
+	key.add(&params.sah_node_cost, sizeof(params.sah_node_cost));
+	key.add(&params.sah_primitive_cost, sizeof(params.sah_primitive_cost));
+	key.add(&params.min_leaf_size, sizeof(params.min_leaf_size));
+	key.add(&params.max_triangle_leaf_size, sizeof(params.max_triangle_leaf_size));
+	key.add(&params.max_motion_triangle_leaf_size, sizeof(params.max_motion_triangle_leaf_size));
+	key.add(&params.max_curve_leaf_size, sizeof(params.max_curve_leaf_size));
+	key.add(&params.max_motion_curve_leaf_size, sizeof(params.max_motion_curve_leaf_size));
+	key.add(&params.bvh_layout, sizeof(params.bvh_layout));
+	key.add(&params.primitive_mask, sizeof(params.primitive_mask));
+	key.add(&params.use_unaligned_nodes, sizeof(params.use_unaligned_nodes));
+	key.add(&params.num_motion_curve_steps, sizeof(params.num_motion_curve_steps));
+	key.add(&params.num_motion_triangle_steps, sizeof(params.num_motion_triangle_steps));
+
+	/* Geometry, including motion steps. */
+	foreach(Object *ob, objects) {
+		Mesh *mesh = ob->mesh;
+
+		key.add(&ob->visibility, sizeof(ob->visibility));
+		key.add(mesh->verts);
+		key.add(mesh->triangles);
+		key.add(mesh->curve_keys);
+		key.add(mesh->curve_radius);
+		key.add(mesh->curve_first_key);
+
+		const bool has_motion_blur = mesh->has_motion_blur();
+		key.add(&has_motion_blur, sizeof(has_motion_blur));
+		if(has_motion_blur) {
+			key.add(&mesh->motion_steps, sizeof(mesh->motion_steps));
+
+			Attribute *attr_mP = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+			if(attr_mP) {
+				key.add(attr_mP->buffer);
+			}
+			Attribute *curve_attr_mP = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+			if(curve_attr_mP) {
+				key.add(curve_attr_mP->buffer);
+			}
+		}
+	}
+}
+
+bool BVH::cache_read(CacheData& key)
+{
+	Cache cache(params.cache_path);
+	CacheData value;
+
+	if(!cache.lookup(key, value)) {
+		return false;
+	}
+
+	/* Primitive data which doesn't depend on the build is recreated by
+	 * pack_primitives() afterwards. */
+	if(!(value.read(&pack.root_index, sizeof(pack.root_index)) &&
+	     value.read(pack.nodes) &&
+	     value.read(pack.leaf_nodes) &&
+	     value.read(pack.prim_type) &&
+	     value.read(pack.prim_index) &&
+	     value.read(pack.prim_object) &&
+	     value.read(pack.prim_time)))
+	{
+		VLOG(1) << "Failed to read BVH from cache, rebuilding.";
+		pack = PackedBVH();
+		return false;
+	}
+
+	VLOG(1) << "Read BVH from cache, "
+	        << pack.prim_index.size() << " primitives, "
+	        << pack.nodes.size() << " node items.";
+	return true;
+}
+
+void BVH::cache_write(CacheData& key)
+{
+	Cache cache(params.cache_path);
+	CacheData value;
+
+	value.add(&pack.root_index, sizeof(pack.root_index));
+	value.add(pack.nodes);
+	value.add(pack.leaf_nodes);
+	value.add(pack.prim_type);
+	value.add(pack.prim_index);
+	value.add(pack.prim_object);
+	value.add(pack.prim_time);
+
+	cache.insert(key, value);
 }
 
 /* Refitting */
 
-void BVH::refit(Progress& progress)
+bool BVH::refit(Progress& progress)
 {
+	revision = atomic_add_and_fetch_uint64(&bvh_revision_counter, 1);
+
 	progress.set_substatus("Packing BVH primitives");
 	pack_primitives();
 
-	if(progress.get_cancel()) return;
+	if(progress.get_cancel()) return true;
+
+	/* Enough subtrees for all threads to take part, when it's worth it. */
+	refit_parallel_depth = 0;
+	if(pack.prim_index.size() >= BVH_REFIT_PARALLEL_SIZE) {
+		switch(params.bvh_layout) {
+			case BVH_LAYOUT_BVH8:
+				refit_parallel_depth = 2;
+				break;
+			case BVH_LAYOUT_BVH4:
+				refit_parallel_depth = 3;
+				break;
+			case BVH_LAYOUT_BVH2:
+			default:
+				refit_parallel_depth = 6;
+				break;
+		}
+	}
 
 	progress.set_substatus("Refitting BVH nodes");
-	refit_nodes();
+	float cost = refit_nodes();
+
+	if(build_leaf_sah_cost > 0.0f && params.refit_sah_threshold > 0.0f) {
+		VLOG(2) << "Refitted BVH leaf SAH cost " << cost
+		        << ", built " << build_leaf_sah_cost << ".";
+		if(cost > build_leaf_sah_cost * params.refit_sah_threshold) {
+			VLOG(1) << "Refitted BVH SAH cost grew from " << build_leaf_sah_cost
+			        << " to " << cost << ", rebuilding.";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void BVH::refit_primitives(int start, int end, BoundBox& bbox, uint& visibility)
+{
+	for(int prim = start; prim < end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* Object instance. */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* Primitives. */
+			const Mesh *mesh = ob->mesh;
+
+			if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
+				/* Curves. */
+				int str_offset = (params.top_level)? mesh->curve_offset: 0;
+				Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
+				int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
+
+				curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
+
+				visibility |= PATH_RAY_CURVE;
+
+				/* Motion curves. */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->curve_keys.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *key_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
+					}
+				}
+			}
+			else {
+				/* Triangles. */
+				int tri_offset = (params.top_level)? mesh->tri_offset: 0;
+				Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
+				const float3 *vpos = &mesh->verts[0];
+
+				triangle.bounds_grow(vpos, bbox);
+
+				/* Motion triangles. */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->verts.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *vert_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
+					}
+				}
+			}
+		}
+
+		visibility |= ob->visibility;
+	}
+}
+
+void BVH::refit_children(const int *child,
+                         int num,
+                         BoundBox *child_bbox,
+                         uint *child_visibility,
+                         float& leaf_cost,
+                         int level)
+{
+	float child_leaf_cost[8] = {0.0f};
+	assert(num <= 8);
+
+	if(level < refit_parallel_depth) {
+		TaskPool pool;
+		for(int i = 0; i < num; i++) {
+			if(child[i] != 0) {
+				pool.push(function_bind(&BVH::refit_child,
+				                        this,
+				                        child[i],
+				                        &child_bbox[i],
+				                        &child_visibility[i],
+				                        &child_leaf_cost[i],
+				                        level + 1));
+			}
+		}
+		pool.wait_work();
+	}
+	else {
+		for(int i = 0; i < num; i++) {
+			if(child[i] != 0) {
+				refit_child(child[i],
+				            &child_bbox[i],
+				            &child_visibility[i],
+				            &child_leaf_cost[i],
+				            level + 1);
+			}
+		}
+	}
+
+	/* Sum in order, so the cost doesn't depend on threading. */
+	for(int i = 0; i < num; i++) {
+		leaf_cost += child_leaf_cost[i];
+	}
+}
+
+void BVH::refit_child(int child,
+                      BoundBox *bbox,
+                      uint *visibility,
+                      float *leaf_cost,
+                      int level)
+{
+	refit_node((child < 0)? -child-1: child, (child < 0),
+	           *bbox, *visibility, *leaf_cost, level);
+}
+
+void BVH::leaf_sah_cost_range(size_t start, size_t end, BoundBox *bounds, float *cost)
+{
+	for(size_t i = start; i < end; i++) {
+		const int4 c = pack.leaf_nodes[i];
+		BoundBox bbox = BoundBox::empty;
+		uint visibility = 0;
+		refit_primitives(c.x, c.y, bbox, visibility);
+		*cost += bbox.safe_area() * (c.y - c.x);
+		bounds->grow(bbox);
+	}
+}
+
+float BVH::leaf_sah_cost()
+{
+	/* All layouts store a leaf in a single int4 with the primitive range, so
+	 * leaves can be visited without walking the tree. */
+	const size_t num_leaves = pack.leaf_nodes.size();
+	const size_t block_size = 4096;
+	const size_t num_blocks = divide_up(num_leaves, block_size);
+	vector<BoundBox> block_bounds(num_blocks, BoundBox::empty);
+	vector<float> block_cost(num_blocks, 0.0f);
+	TaskPool pool;
+
+	for(size_t b = 0; b < num_blocks; b++) {
+		pool.push(function_bind(&BVH::leaf_sah_cost_range,
+		                        this,
+		                        b*block_size,
+		                        min((b + 1)*block_size, num_leaves),
+		                        &block_bounds[b],
+		                        &block_cost[b]));
+	}
+	pool.wait_work();
+
+	BoundBox bounds = BoundBox::empty;
+	float cost = 0.0f;
+	for(size_t b = 0; b < num_blocks; b++) {
+		bounds.grow(block_bounds[b]);
+		cost += block_cost[b];
+	}
+
+	const float area = bounds.safe_area();
+	return (area > 0.0f)? cost / area: 0.0f;
 }
 
 /* Triangles */
@@ -185,13 +522,60 @@ void BVH::pack_primitives()
 
 /* Pack Instances */
 
-void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
+bool BVHInstanceBlock::operator==(const BVHInstanceBlock& other) const
+{
+	return mesh == other.mesh &&
+	       revision == other.revision &&
+	       tri_offset == other.tri_offset &&
+	       curve_offset == other.curve_offset &&
+	       nodes_offset == other.nodes_offset &&
+	       nodes_size == other.nodes_size &&
+	       leaf_nodes_offset == other.leaf_nodes_offset &&
+	       leaf_nodes_size == other.leaf_nodes_size &&
+	       prim_offset == other.prim_offset &&
+	       prim_size == other.prim_size &&
+	       prim_tri_verts_offset == other.prim_tri_verts_offset &&
+	       prim_tri_verts_size == other.prim_tri_verts_size;
+}
+
+void BVH::steal_instances(BVH *from)
+{
+	assert(params.top_level && from->params.top_level);
+
+	/* Packed nodes differ between layouts, and primitive time only exists
+	 * with motion steps. */
+	if(from->params.bvh_layout != params.bvh_layout ||
+	   from->params.use_bvh_embree || params.use_bvh_embree ||
+	   from->params.num_motion_curve_steps != params.num_motion_curve_steps ||
+	   from->params.num_motion_triangle_steps != params.num_motion_triangle_steps)
+	{
+		return;
+	}
+
+	instance_blocks.swap(from->instance_blocks);
+	from->instance_blocks.clear();
+
+	instance_pack.nodes.steal_data(from->pack.nodes);
+	instance_pack.leaf_nodes.steal_data(from->pack.leaf_nodes);
+	instance_pack.prim_tri_index.steal_data(from->pack.prim_tri_index);
+	instance_pack.prim_tri_verts.steal_data(from->pack.prim_tri_verts);
+	instance_pack.prim_type.steal_data(from->pack.prim_type);
+	instance_pack.prim_visibility.steal_data(from->pack.prim_visibility);
+	instance_pack.prim_index.steal_data(from->pack.prim_index);
+	instance_pack.prim_object.steal_data(from->pack.prim_object);
+	instance_pack.prim_time.steal_data(from->pack.prim_time);
+}
+
+void BVH::pack_instances()
 {
 	/* The BVH's for instances are built separately, but for traversal all
-	 * BVH's are stored in global arrays. This function merges them into the
-	 * top level BVH, adjusting indexes and offsets where appropriate.
+	 * BVH's are stored in global arrays. This function merges them in front
+	 * of the top level BVH, adjusting indexes and offsets where appropriate.
+	 *
+	 * Instances stay at the same place in the arrays as long as the meshes
+	 * before them don't change, so for the next top level BVH only changed
+	 * instances and the top level nodes need to be packed.
 	 */
-	const bool use_qbvh = params.use_qbvh;
 
 	/* Adjust primitive index to point to the triangle in the global array, for
 	 * meshes with transform applied and already in the top level BVH.
@@ -204,77 +588,22 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 				pack.prim_index[i] += objects[pack.prim_object[i]]->mesh->tri_offset;
 		}
 
-	/* track offsets of instanced BVH data in global array */
-	size_t prim_offset = pack.prim_index.size();
-	size_t nodes_offset = nodes_size;
-	size_t nodes_leaf_offset = leaf_nodes_size;
-
-	/* clear array that gives the node indexes for instanced objects */
-	pack.object_node.clear();
-
-	/* reserve */
-	size_t prim_index_size = pack.prim_index.size();
-	size_t prim_tri_verts_size = pack.prim_tri_verts.size();
-
-	size_t pack_prim_index_offset = prim_index_size;
-	size_t pack_prim_tri_verts_offset = prim_tri_verts_size;
-	size_t pack_nodes_offset = nodes_size;
-	size_t pack_leaf_nodes_offset = leaf_nodes_size;
-	size_t object_offset = 0;
-
+	/* Lay out instance BVH's, each mesh only once. */
+	vector<BVHInstanceBlock> blocks;
 	map<Mesh*, int> mesh_map;
+	BVHInstanceBlock top = {NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-	foreach(Object *ob, objects) {
-		Mesh *mesh = ob->mesh;
-		BVH *bvh = mesh->bvh;
-
-		if(mesh->need_build_bvh()) {
-			if(mesh_map.find(mesh) == mesh_map.end()) {
-				prim_index_size += bvh->pack.prim_index.size();
-				prim_tri_verts_size += bvh->pack.prim_tri_verts.size();
-				nodes_size += bvh->pack.nodes.size();
-				leaf_nodes_size += bvh->pack.leaf_nodes.size();
-
-				mesh_map[mesh] = 1;
-			}
-		}
-	}
-
-	mesh_map.clear();
-
-	pack.prim_index.resize(prim_index_size);
-	pack.prim_type.resize(prim_index_size);
-	pack.prim_object.resize(prim_index_size);
-	pack.prim_visibility.resize(prim_index_size);
-	pack.prim_tri_verts.resize(prim_tri_verts_size);
-	pack.prim_tri_index.resize(prim_index_size);
-	pack.nodes.resize(nodes_size);
-	pack.leaf_nodes.resize(leaf_nodes_size);
+	pack.object_node.clear();
 	pack.object_node.resize(objects.size());
 
-	if(params.num_motion_curve_steps > 0 || params.num_motion_triangle_steps > 0) {
-		pack.prim_time.resize(prim_index_size);
-	}
-
-	int *pack_prim_index = (pack.prim_index.size())? &pack.prim_index[0]: NULL;
-	int *pack_prim_type = (pack.prim_type.size())? &pack.prim_type[0]: NULL;
-	int *pack_prim_object = (pack.prim_object.size())? &pack.prim_object[0]: NULL;
-	uint *pack_prim_visibility = (pack.prim_visibility.size())? &pack.prim_visibility[0]: NULL;
-	float4 *pack_prim_tri_verts = (pack.prim_tri_verts.size())? &pack.prim_tri_verts[0]: NULL;
-	uint *pack_prim_tri_index = (pack.prim_tri_index.size())? &pack.prim_tri_index[0]: NULL;
-	int4 *pack_nodes = (pack.nodes.size())? &pack.nodes[0]: NULL;
-	int4 *pack_leaf_nodes = (pack.leaf_nodes.size())? &pack.leaf_nodes[0]: NULL;
-	float2 *pack_prim_time = (pack.prim_time.size())? &pack.prim_time[0]: NULL;
-
-	/* merge */
-	foreach(Object *ob, objects) {
-		Mesh *mesh = ob->mesh;
+	for(size_t i = 0; i < objects.size(); i++) {
+		Mesh *mesh = objects[i]->mesh;
 
 		/* We assume that if mesh doesn't need own BVH it was already included
 		 * into a top-level BVH and no packing here is needed.
 		 */
 		if(!mesh->need_build_bvh()) {
-			pack.object_node[object_offset++] = 0;
+			pack.object_node[i] = 0;
 			continue;
 		}
 
@@ -282,134 +611,285 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 		 * node offset for this object */
 		map<Mesh*, int>::iterator it = mesh_map.find(mesh);
 
-		if(mesh_map.find(mesh) != mesh_map.end()) {
-			int noffset = it->second;
-			pack.object_node[object_offset++] = noffset;
+		if(it != mesh_map.end()) {
+			pack.object_node[i] = it->second;
 			continue;
 		}
 
-		BVH *bvh = mesh->bvh;
-
-		int noffset = nodes_offset;
-		int noffset_leaf = nodes_leaf_offset;
-		int mesh_tri_offset = mesh->tri_offset;
-		int mesh_curve_offset = mesh->curve_offset;
+		const PackedBVH& mesh_pack = mesh->bvh->pack;
+		BVHInstanceBlock block;
+
+		block.mesh = mesh;
+		block.revision = mesh->bvh->revision;
+		block.tri_offset = mesh->tri_offset;
+		block.curve_offset = mesh->curve_offset;
+		block.nodes_offset = top.nodes_offset;
+		block.nodes_size = mesh_pack.nodes.size();
+		block.leaf_nodes_offset = top.leaf_nodes_offset;
+		block.leaf_nodes_size = mesh_pack.leaf_nodes.size();
+		block.prim_offset = top.prim_offset;
+		block.prim_size = mesh_pack.prim_index.size();
+		block.prim_tri_verts_offset = top.prim_tri_verts_offset;
+		block.prim_tri_verts_size = mesh_pack.prim_tri_verts.size();
+		blocks.push_back(block);
+
+		top.nodes_offset += block.nodes_size;
+		top.leaf_nodes_offset += block.leaf_nodes_size;
+		top.prim_offset += block.prim_size;
+		top.prim_tri_verts_offset += block.prim_tri_verts_size;
 
 		/* fill in node indexes for instances */
-		if(bvh->pack.root_index == -1)
-			pack.object_node[object_offset++] = -noffset_leaf-1;
+		if(mesh_pack.root_index == -1)
+			pack.object_node[i] = -(int)block.leaf_nodes_offset-1;
 		else
-			pack.object_node[object_offset++] = noffset;
-
-		mesh_map[mesh] = pack.object_node[object_offset-1];
-
-		/* merge primitive, object and triangle indexes */
-		if(bvh->pack.prim_index.size()) {
-			size_t bvh_prim_index_size = bvh->pack.prim_index.size();
-			int *bvh_prim_index = &bvh->pack.prim_index[0];
-			int *bvh_prim_type = &bvh->pack.prim_type[0];
-			uint *bvh_prim_visibility = &bvh->pack.prim_visibility[0];
-			uint *bvh_prim_tri_index = &bvh->pack.prim_tri_index[0];
-			float2 *bvh_prim_time = bvh->pack.prim_time.size()? &bvh->pack.prim_time[0]: NULL;
-
-			for(size_t i = 0; i < bvh_prim_index_size; i++) {
-				if(bvh->pack.prim_type[i] & PRIMITIVE_ALL_CURVE) {
-					pack_prim_index[pack_prim_index_offset] = bvh_prim_index[i] + mesh_curve_offset;
-					pack_prim_tri_index[pack_prim_index_offset] = -1;
-				}
-				else {
-					pack_prim_index[pack_prim_index_offset] = bvh_prim_index[i] + mesh_tri_offset;
-					pack_prim_tri_index[pack_prim_index_offset] =
-					        bvh_prim_tri_index[i] + pack_prim_tri_verts_offset;
-				}
+			pack.object_node[i] = block.nodes_offset;
 
-				pack_prim_type[pack_prim_index_offset] = bvh_prim_type[i];
-				pack_prim_visibility[pack_prim_index_offset] = bvh_prim_visibility[i];
-				pack_prim_object[pack_prim_index_offset] = 0;  // unused for instances
-				if(bvh_prim_time != NULL) {
-					pack_prim_time[pack_prim_index_offset] = bvh_prim_time[i];
-				}
-				pack_prim_index_offset++;
-			}
+		mesh_map[mesh] = pack.object_node[i];
+	}
+
+	if(blocks.empty()) {
+		instance_blocks.clear();
+		instance_pack = PackedBVH();
+		return;
+	}
+
+	/* Move the top level BVH aside, and continue with the arrays of the
+	 * previous top level BVH, which have the instances at the start. */
+	PackedBVH top_pack;
+	top_pack.nodes.steal_data(pack.nodes);
+	top_pack.leaf_nodes.steal_data(pack.leaf_nodes);
+	top_pack.prim_tri_index.steal_data(pack.prim_tri_index);
+	top_pack.prim_tri_verts.steal_data(pack.prim_tri_verts);
+	top_pack.prim_type.steal_data(pack.prim_type);
+	top_pack.prim_visibility.steal_data(pack.prim_visibility);
+	top_pack.prim_index.steal_data(pack.prim_index);
+	top_pack.prim_object.steal_data(pack.prim_object);
+	top_pack.prim_time.steal_data(pack.prim_time);
+	top_pack.root_index = pack.root_index;
+
+	pack.nodes.steal_data(instance_pack.nodes);
+	pack.leaf_nodes.steal_data(instance_pack.leaf_nodes);
+	pack.prim_tri_index.steal_data(instance_pack.prim_tri_index);
+	pack.prim_tri_verts.steal_data(instance_pack.prim_tri_verts);
+	pack.prim_type.steal_data(instance_pack.prim_type);
+	pack.prim_visibility.steal_data(instance_pack.prim_visibility);
+	pack.prim_index.steal_data(instance_pack.prim_index);
+	pack.prim_object.steal_data(instance_pack.prim_object);
+	pack.prim_time.steal_data(instance_pack.prim_time);
+
+	/* Resizing keeps the instances which are already in place. */
+	top.nodes_size = top_pack.nodes.size();
+	top.leaf_nodes_size = top_pack.leaf_nodes.size();
+	top.prim_size = top_pack.prim_index.size();
+	top.prim_tri_verts_size = top_pack.prim_tri_verts.size();
+
+	const size_t prim_size = top.prim_offset + top.prim_size;
+	pack.nodes.resize(top.nodes_offset + top.nodes_size);
+	pack.leaf_nodes.resize(top.leaf_nodes_offset + top.leaf_nodes_size);
+	pack.prim_index.resize(prim_size);
+	pack.prim_type.resize(prim_size);
+	pack.prim_object.resize(prim_size);
+	pack.prim_visibility.resize(prim_size);
+	pack.prim_tri_index.resize(prim_size);
+	pack.prim_tri_verts.resize(top.prim_tri_verts_offset + top.prim_tri_verts_size);
+	if(params.num_motion_curve_steps > 0 || params.num_motion_triangle_steps > 0) {
+		pack.prim_time.resize(prim_size);
+	}
+	else {
+		pack.prim_time.clear();
+	}
+
+	/* Pack instances which changed or moved, and the top level BVH. */
+	TaskPool pool;
+	size_t num_packed = 0;
+
+	for(size_t i = 0; i < blocks.size(); i++) {
+		if(i < instance_blocks.size() && blocks[i] == instance_blocks[i]) {
+			continue;
 		}
 
-		/* Merge triangle vertices data. */
-		if(bvh->pack.prim_tri_verts.size()) {
-			const size_t prim_tri_size = bvh->pack.prim_tri_verts.size();
-			memcpy(pack_prim_tri_verts + pack_prim_tri_verts_offset,
-			       &bvh->pack.prim_tri_verts[0],
-			       prim_tri_size*sizeof(float4));
-			pack_prim_tri_verts_offset += prim_tri_size;
+		pool.push(function_bind(&BVH::pack_instance, this, blocks[i]));
+		num_packed++;
+	}
+
+	pool.push(function_bind(&BVH::pack_top_level, this, &top_pack, top));
+	pool.wait_work();
+
+	VLOG(2) << "Packed " << num_packed << " of " << blocks.size()
+	        << " instance BVHs into the top level BVH.";
+
+	/* root index to start traversal at, moved along with the top level BVH */
+	pack.root_index = (top_pack.root_index < 0)
+	                      ? top_pack.root_index - (int)top.leaf_nodes_offset
+	                      : top_pack.root_index + (int)top.nodes_offset;
+
+	instance_blocks.swap(blocks);
+	instance_pack = PackedBVH();
+}
+
+void BVH::pack_instance(const BVHInstanceBlock& block)
+{
+	const PackedBVH& bvh_pack = block.mesh->bvh->pack;
+	const size_t prim_offset = block.prim_offset;
+	const size_t pack_prim_tri_verts_offset = block.prim_tri_verts_offset;
+
+	/* merge primitive, object and triangle indexes */
+	for(size_t i = 0; i < block.prim_size; i++) {
+		const size_t pack_prim_index_offset = prim_offset + i;
+
+		if(bvh_pack.prim_type[i] & PRIMITIVE_ALL_CURVE) {
+			pack.prim_index[pack_prim_index_offset] = bvh_pack.prim_index[i] + block.curve_offset;
+			pack.prim_tri_index[pack_prim_index_offset] = -1;
+		}
+		else {
+			pack.prim_index[pack_prim_index_offset] = bvh_pack.prim_index[i] + block.tri_offset;
+			pack.prim_tri_index[pack_prim_index_offset] =
+			        bvh_pack.prim_tri_index[i] + pack_prim_tri_verts_offset;
 		}
 
-		/* merge nodes */
-		if(bvh->pack.leaf_nodes.size()) {
-			int4 *leaf_nodes_offset = &bvh->pack.leaf_nodes[0];
-			size_t leaf_nodes_offset_size = bvh->pack.leaf_nodes.size();
-			for(size_t i = 0, j = 0;
-			    i < leaf_nodes_offset_size;
-			    i += BVH_NODE_LEAF_SIZE, j++)
-			{
-				int4 data = leaf_nodes_offset[i];
-				data.x += prim_offset;
-				data.y += prim_offset;
-				pack_leaf_nodes[pack_leaf_nodes_offset] = data;
-				for(int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
-					pack_leaf_nodes[pack_leaf_nodes_offset + j] = leaf_nodes_offset[i + j];
-				}
-				pack_leaf_nodes_offset += BVH_NODE_LEAF_SIZE;
-			}
+		pack.prim_type[pack_prim_index_offset] = bvh_pack.prim_type[i];
+		pack.prim_visibility[pack_prim_index_offset] = bvh_pack.prim_visibility[i];
+		pack.prim_object[pack_prim_index_offset] = 0;  // unused for instances
+		if(bvh_pack.prim_time.size() && pack.prim_time.size()) {
+			pack.prim_time[pack_prim_index_offset] = bvh_pack.prim_time[i];
 		}
+	}
 
-		if(bvh->pack.nodes.size()) {
-			int4 *bvh_nodes = &bvh->pack.nodes[0];
-			size_t bvh_nodes_size = bvh->pack.nodes.size();
-
-			for(size_t i = 0, j = 0; i < bvh_nodes_size; j++) {
-				size_t nsize, nsize_bbox;
-				if(bvh_nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
-					nsize = use_qbvh
-					            ? BVH_UNALIGNED_QNODE_SIZE
-					            : BVH_UNALIGNED_NODE_SIZE;
-					nsize_bbox = (use_qbvh)? 13: 0;
-				}
-				else {
-					nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
-					nsize_bbox = (use_qbvh)? 7: 0;
-				}
+	/* Merge triangle vertices data. */
+	if(block.prim_tri_verts_size) {
+		memcpy(&pack.prim_tri_verts[pack_prim_tri_verts_offset],
+		       &bvh_pack.prim_tri_verts[0],
+		       block.prim_tri_verts_size*sizeof(float4));
+	}
+
+	/* merge nodes */
+	for(size_t i = 0; i < block.leaf_nodes_size; i += BVH_NODE_LEAF_SIZE) {
+		int4 data = bvh_pack.leaf_nodes[i];
+		data.x += prim_offset;
+		data.y += prim_offset;
+		pack.leaf_nodes[block.leaf_nodes_offset + i] = data;
+		for(int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
+			pack.leaf_nodes[block.leaf_nodes_offset + i + j] = bvh_pack.leaf_nodes[i + j];
+		}
+	}
+
+	if(block.nodes_size) {
+		pack_instance_nodes(&bvh_pack.nodes[0],
+		                    block.nodes_size,
+		                    &pack.nodes[block.nodes_offset],
+		                    block.nodes_offset,
+		                    block.leaf_nodes_offset);
+	}
+}
 
-				memcpy(pack_nodes + pack_nodes_offset,
-				       bvh_nodes + i,
-				       nsize_bbox*sizeof(int4));
+void BVH::pack_top_level(const PackedBVH *top, const BVHInstanceBlock& block)
+{
+	const size_t prim_offset = block.prim_offset;
+
+	for(size_t i = 0; i < block.prim_size; i++) {
+		const size_t pack_prim_index_offset = prim_offset + i;
+		const int tri_index = top->prim_tri_index[i];
+
+		pack.prim_index[pack_prim_index_offset] = top->prim_index[i];
+		pack.prim_tri_index[pack_prim_index_offset] =
+		        (tri_index == -1)? -1: tri_index + block.prim_tri_verts_offset;
+		pack.prim_type[pack_prim_index_offset] = top->prim_type[i];
+		pack.prim_visibility[pack_prim_index_offset] = top->prim_visibility[i];
+		pack.prim_object[pack_prim_index_offset] = top->prim_object[i];
+		if(top->prim_time.size() && pack.prim_time.size()) {
+			pack.prim_time[pack_prim_index_offset] = top->prim_time[i];
+		}
+	}
 
-				/* Modify offsets into arrays */
-				int4 data = bvh_nodes[i + nsize_bbox];
+	if(block.prim_tri_verts_size) {
+		memcpy(&pack.prim_tri_verts[block.prim_tri_verts_offset],
+		       &top->prim_tri_verts[0],
+		       block.prim_tri_verts_size*sizeof(float4));
+	}
 
-				data.z += (data.z < 0)? -noffset_leaf: noffset;
-				data.w += (data.w < 0)? -noffset_leaf: noffset;
+	for(size_t i = 0; i < block.leaf_nodes_size; i += BVH_NODE_LEAF_SIZE) {
+		int4 data = top->leaf_nodes[i];
+		if(data.x < 0) {
+			/* object leaf, x is ~prim and y is unused */
+			data.x -= (int)prim_offset;
+		}
+		else {
+			data.x += prim_offset;
+			data.y += prim_offset;
+		}
+		pack.leaf_nodes[block.leaf_nodes_offset + i] = data;
+		for(int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
+			pack.leaf_nodes[block.leaf_nodes_offset + i + j] = top->leaf_nodes[i + j];
+		}
+	}
 
-				if(use_qbvh) {
-					data.x += (data.x < 0)? -noffset_leaf: noffset;
-					data.y += (data.y < 0)? -noffset_leaf: noffset;
-				}
+	if(block.nodes_size) {
+		pack_instance_nodes(&top->nodes[0],
+		                    block.nodes_size,
+		                    &pack.nodes[block.nodes_offset],
+		                    block.nodes_offset,
+		                    block.leaf_nodes_offset);
+	}
+}
 
-				pack_nodes[pack_nodes_offset + nsize_bbox] = data;
+void BVH::pack_instance_nodes(const int4 *bvh_nodes,
+                              size_t bvh_nodes_size,
+                              int4 *pack_nodes,
+                              int noffset,
+                              int noffset_leaf)
+{
+	const BVHLayout bvh_layout = params.bvh_layout;
+	const bool use_qbvh = (bvh_layout == BVH_LAYOUT_BVH4);
+	size_t pack_nodes_offset = 0;
+
+	for(size_t i = 0; i < bvh_nodes_size; ) {
+		size_t nsize, nsize_bbox, nsize_child = 1;
+		if(bvh_layout == BVH_LAYOUT_BVH8) {
+			/* Octo nodes are always aligned, and have eight child
+			 * indexes stored in two int4. */
+			nsize = BVH_ONODE_SIZE;
+			nsize_bbox = 13;
+			nsize_child = 2;
+		}
+		else if(bvh_nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
+			nsize = use_qbvh
+			            ? BVH_UNALIGNED_QNODE_SIZE
+			            : BVH_UNALIGNED_NODE_SIZE;
+			nsize_bbox = (use_qbvh)? 13: 0;
+		}
+		else {
+			nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
+			nsize_bbox = (use_qbvh)? 7: 0;
+		}
 
-				/* Usually this copies nothing, but we better
-				 * be prepared for possible node size extension.
-				 */
-				memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox+1],
-				       &bvh_nodes[i + nsize_bbox+1],
-				       sizeof(int4) * (nsize - (nsize_bbox+1)));
+		memcpy(pack_nodes + pack_nodes_offset,
+		       bvh_nodes + i,
+		       nsize_bbox*sizeof(int4));
 
-				pack_nodes_offset += nsize;
-				i += nsize;
+		/* Modify offsets into arrays */
+		for(size_t k = 0; k < nsize_child; k++) {
+			int4 data = bvh_nodes[i + nsize_bbox + k];
+
+			data.z += (data.z < 0)? -noffset_leaf: noffset;
+			data.w += (data.w < 0)? -noffset_leaf: noffset;
+
+			if(bvh_layout != BVH_LAYOUT_BVH2) {
+				data.x += (data.x < 0)? -noffset_leaf: noffset;
+				data.y += (data.y < 0)? -noffset_leaf: noffset;
 			}
+
+			pack_nodes[pack_nodes_offset + nsize_bbox + k] = data;
 		}
 
-		nodes_offset += bvh->pack.nodes.size();
-		nodes_leaf_offset += bvh->pack.leaf_nodes.size();
-		prim_offset += bvh->pack.prim_index.size();
+		/* Usually this copies nothing, but we better
+		 * be prepared for possible node size extension.
+		 */
+		memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox + nsize_child],
+		       &bvh_nodes[i + nsize_bbox + nsize_child],
+		       sizeof(int4) * (nsize - (nsize_bbox + nsize_child)));
+
+		pack_nodes_offset += nsize;
+		i += nsize;
 	}
 }
 
@@ -27,10 +27,12 @@ CCL_NAMESPACE_BEGIN
 
 class Stats;
 class BVHNode;
+class CacheData;
 struct BVHStackEntry;
 class BVHParams;
 class BoundBox;
 class LeafNode;
+class Mesh;
 class Object;
 class Progress;
 
@@ -39,6 +41,9 @@ class Progress;
 
 #define BVH_CUSTOM -1
 
+/* Minimal number of primitives to refit a BVH with multiple threads. */
+#define BVH_REFIT_PARALLEL_SIZE 65536
+
 /* Packed BVH
  *
  * BVH stored as it will be used for traversal on the rendering device. */
@@ -76,6 +81,23 @@ struct PackedBVH {
 	}
 };
 
+/* Instance BVH packed into the arrays of the top level BVH. */
+
+struct BVHInstanceBlock {
+	const Mesh *mesh;
+	uint64_t revision;
+	int tri_offset;
+	int curve_offset;
+
+	/* Location in the global arrays. */
+	size_t nodes_offset, nodes_size;
+	size_t leaf_nodes_offset, leaf_nodes_size;
+	size_t prim_offset, prim_size;
+	size_t prim_tri_verts_offset, prim_tri_verts_size;
+
+	bool operator==(const BVHInstanceBlock& other) const;
+};
+
 /* BVH */
 
 class BVH
@@ -85,25 +107,84 @@ public:
 	BVHParams params;
 	vector<Object*> objects;
 
+	/* Changes every time the packed data is built or refitted. */
+	uint64_t revision;
+
 	static BVH *create(const BVHParams& params, const vector<Object*>& objects);
 	virtual ~BVH() {}
 
+	/* Take over the packed instances of the previous top level BVH, so that
+	 * building this one only packs instances which changed since. */
+	void steal_instances(BVH *from);
+
 	virtual void build(Progress& progress, Stats *stats=NULL);
-	void refit(Progress& progress);
+
+	/* Update bounds of all nodes for moved geometry, keeping the hierarchy.
+	 * Returns false when the refitted BVH got too slow to trace compared to
+	 * the built one, in which case it should be rebuilt. */
+	bool refit(Progress& progress);
 
 protected:
 	BVH(const BVHParams& params, const vector<Object*>& objects);
 
+	/* SAH cost of the leaves relative to the root bounds, of the BVH as it
+	 * was built. Zero when unknown. */
+	float build_leaf_sah_cost;
+	/* Children of nodes above this depth are refitted in parallel. */
+	int refit_parallel_depth;
+
+	/* disk cache */
+	void cache_key(CacheData& key);
+	bool cache_read(CacheData& key);
+	void cache_write(CacheData& key);
+
 	/* triangles and strands */
 	void pack_primitives();
 	void pack_triangle(int idx, float4 storage[3]);
 
 	/* merge instance BVH's */
-	void pack_instances(size_t nodes_size, size_t leaf_nodes_size);
+	void pack_instances();
+	void pack_instance(const BVHInstanceBlock& block);
+	void pack_instance_nodes(const int4 *bvh_nodes,
+	                         size_t bvh_nodes_size,
+	                         int4 *pack_nodes,
+	                         int noffset,
+	                         int noffset_leaf);
+	void pack_top_level(const PackedBVH *top, const BVHInstanceBlock& block);
+
+	/* Instances packed at the start of the arrays of a top level BVH, and
+	 * the arrays of the previous top level BVH which they were taken from. */
+	vector<BVHInstanceBlock> instance_blocks;
+	PackedBVH instance_pack;
+
+	/* refit */
+	float leaf_sah_cost();
+	void leaf_sah_cost_range(size_t start, size_t end, BoundBox *bounds, float *cost);
+	void refit_primitives(int start, int end, BoundBox& bbox, uint& visibility);
+	void refit_children(const int *child,
+	                    int num,
+	                    BoundBox *child_bbox,
+	                    uint *child_visibility,
+	                    float& leaf_cost,
+	                    int level);
+	void refit_child(int child,
+	                 BoundBox *bbox,
+	                 uint *visibility,
+	                 float *leaf_cost,
+	                 int level);
 
 	/* for subclasses to implement */
 	virtual void pack_nodes(const BVHNode *root) = 0;
-	virtual void refit_nodes() = 0;
+	/* Refit the whole tree, returns SAH cost of the leaves relative to the
+	 * root bounds. */
+	virtual float refit_nodes() = 0;
+	/* Refit a subtree, adding SAH cost of its leaves to leaf_cost. */
+	virtual void refit_node(int idx,
+	                        bool leaf,
+	                        BoundBox& bbox,
+	                        uint& visibility,
+	                        float& leaf_cost,
+	                        int level) = 0;
 };
 
 /* Pack Utility */
@@ -177,14 +177,8 @@ void BVH2::pack_nodes(const BVHNode *root)
 	/* Resize arrays */
 	pack.nodes.clear();
 	pack.leaf_nodes.clear();
-	/* For top level BVH, first merge existing BVH's so we know the offsets. */
-	if(params.top_level) {
-		pack_instances(node_size, num_leaf_nodes*BVH_NODE_LEAF_SIZE);
-	}
-	else {
-		pack.nodes.resize(node_size);
-		pack.leaf_nodes.resize(num_leaf_nodes*BVH_NODE_LEAF_SIZE);
-	}
+	pack.nodes.resize(node_size);
+	pack.leaf_nodes.resize(num_leaf_nodes*BVH_NODE_LEAF_SIZE);
 
 	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
 
@@ -233,88 +227,41 @@ void BVH2::pack_nodes(const BVHNode *root)
 	assert(node_size == nextNodeIdx);
 	/* root index to start traversal at, to handle case of single leaf node */
 	pack.root_index = (root->is_leaf())? -1: 0;
+
+	/* For top level BVH, merge instance BVH's in front of it. */
+	if(params.top_level) {
+		pack_instances();
+	}
 }
 
-void BVH2::refit_nodes()
+float BVH2::refit_nodes()
 {
 	assert(!params.top_level);
 
 	BoundBox bbox = BoundBox::empty;
 	uint visibility = 0;
-	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+	float leaf_cost = 0.0f;
+	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility, leaf_cost, 0);
+
+	const float area = bbox.safe_area();
+	return (area > 0.0f)? leaf_cost / area: 0.0f;
 }
 
-void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+void BVH2::refit_node(int idx,
+                      bool leaf,
+                      BoundBox& bbox,
+                      uint& visibility,
+                      float& leaf_cost,
+                      int level)
 {
 	if(leaf) {
 		assert(idx + BVH_NODE_LEAF_SIZE <= pack.leaf_nodes.size());
 		const int4 *data = &pack.leaf_nodes[idx];
 		const int c0 = data[0].x;
 		const int c1 = data[0].y;
-		/* refit leaf node */
-		for(int prim = c0; prim < c1; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* primitives */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* curves */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* motion curves */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *key_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
-						}
-					}
-				}
-				else {
-					/* triangles */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* motion triangles */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		/* Refit leaf node. */
+		refit_primitives(c0, c1, bbox, visibility);
+		leaf_cost += bbox.safe_area() * (c1 - c0);
 
 		/* TODO(sergey): De-duplicate with pack_leaf(). */
 		float4 leaf_data[BVH_NODE_LEAF_SIZE];
@@ -332,32 +279,32 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		const int c0 = data[0].z;
 		const int c1 = data[0].w;
 		/* refit inner node, set bbox from children */
-		BoundBox bbox0 = BoundBox::empty, bbox1 = BoundBox::empty;
-		uint visibility0 = 0, visibility1 = 0;
+		const int child[2] = {c0, c1};
+		BoundBox child_bbox[2] = {BoundBox::empty, BoundBox::empty};
+		uint child_visibility[2] = {0, 0};
 
-		refit_node((c0 < 0)? -c0-1: c0, (c0 < 0), bbox0, visibility0);
-		refit_node((c1 < 0)? -c1-1: c1, (c1 < 0), bbox1, visibility1);
+		refit_children(child, 2, child_bbox, child_visibility, leaf_cost, level);
 
 		if(is_unaligned) {
 			Transform aligned_space = transform_identity();
 			pack_unaligned_node(idx,
 			                    aligned_space, aligned_space,
-			                    bbox0, bbox1,
+			                    child_bbox[0], child_bbox[1],
 			                    c0, c1,
-			                    visibility0,
-			                    visibility1);
+			                    child_visibility[0],
+			                    child_visibility[1]);
 		}
 		else {
 			pack_aligned_node(idx,
-			                  bbox0, bbox1,
+			                  child_bbox[0], child_bbox[1],
 			                  c0, c1,
-			                  visibility0,
-			                  visibility1);
+			                  child_visibility[0],
+			                  child_visibility[1]);
 		}
 
-		bbox.grow(bbox0);
-		bbox.grow(bbox1);
-		visibility = visibility0|visibility1;
+		bbox.grow(child_bbox[0]);
+		bbox.grow(child_bbox[1]);
+		visibility = child_visibility[0]|child_visibility[1];
 	}
 }
 
@@ -78,8 +78,13 @@ protected:
 	                         uint visibility0, uint visibility1);
 
 	/* refit */
-	void refit_nodes();
-	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+	float refit_nodes();
+	void refit_node(int idx,
+	                bool leaf,
+	                BoundBox& bbox,
+	                uint& visibility,
+	                float& leaf_cost,
+	                int level);
 };
 
 CCL_NAMESPACE_END
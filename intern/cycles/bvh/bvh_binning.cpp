@@ -23,6 +23,8 @@
 
 #include "util/util_algorithm.h"
 #include "util/util_boundbox.h"
+#include "util/util_foreach.h"
+#include "util/util_task.h"
 #include "util/util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -55,13 +57,15 @@ __forceinline int get_best_dimension(const float4& bestSAH)
 BVHObjectBinning::BVHObjectBinning(const BVHRange& job,
                                    BVHReference *prims,
                                    const BVHUnaligned *unaligned_heuristic,
-                                   const Transform *aligned_space)
+                                   const Transform *aligned_space,
+                                   size_t parallel_threshold)
 : BVHRange(job),
   splitSAH(FLT_MAX),
   dim(0),
   pos(0),
   unaligned_heuristic_(unaligned_heuristic),
-  aligned_space_(aligned_space)
+  aligned_space_(aligned_space),
+  parallel_threshold_(parallel_threshold)
 {
 	if(aligned_space_ == NULL) {
 		bounds_ = bounds();
@@ -83,56 +87,24 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange& job,
 	scale = rcp(cent_bounds_.size()) * make_float3((float)num_bins);
 
 	/* initialize binning counter and bounds */
-	BoundBox bin_bounds[MAX_BINS][4];	/* bounds for every bin in every dimension */
-	int4 bin_count[MAX_BINS];			/* number of primitives mapped to bin */
+	Bins bins;
 
 	for(size_t i = 0; i < num_bins; i++) {
-		bin_count[i] = make_int4(0);
-		bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
+		bins.count[i] = make_int4(0);
+		bins.bounds[i][0] = bins.bounds[i][1] = bins.bounds[i][2] = BoundBox::empty;
 	}
 
-	/* map geometry to bins, unrolled once */
-	{
-		ssize_t i;
-
-		for(i = 0; i < ssize_t(size()) - 1; i += 2) {
-			prefetch_L2(&prims[start() + i + 8]);
-
-			/* map even and odd primitive to bin */
-			const BVHReference& prim0 = prims[start() + i + 0];
-			const BVHReference& prim1 = prims[start() + i + 1];
-
-			BoundBox bounds0 = get_prim_bounds(prim0);
-			BoundBox bounds1 = get_prim_bounds(prim1);
-
-			int4 bin0 = get_bin(bounds0);
-			int4 bin1 = get_bin(bounds1);
-
-			/* increase bounds for bins for even primitive */
-			int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
-			int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
-			int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
-
-			/* increase bounds of bins for odd primitive */
-			int b10 = (int)extract<0>(bin1); bin_count[b10][0]++; bin_bounds[b10][0].grow(bounds1);
-			int b11 = (int)extract<1>(bin1); bin_count[b11][1]++; bin_bounds[b11][1].grow(bounds1);
-			int b12 = (int)extract<2>(bin1); bin_count[b12][2]++; bin_bounds[b12][2].grow(bounds1);
-		}
-
-		/* for uneven number of primitives */
-		if(i < ssize_t(size())) {
-			/* map primitive to bin */
-			const BVHReference& prim0 = prims[start() + i];
-			BoundBox bounds0 = get_prim_bounds(prim0);
-			int4 bin0 = get_bin(bounds0);
-
-			/* increase bounds of bins */
-			int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
-			int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
-			int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
-		}
+	/* map geometry to bins */
+	if(parallel_threshold_ && size() >= parallel_threshold_) {
+		bin_prims_parallel(prims, &bins);
+	}
+	else {
+		bin_prims(prims, start(), end(), &bins);
 	}
 
+	const BoundBox (*bin_bounds)[4] = bins.bounds;
+	const int4 *bin_count = bins.count;
+
 	/* sweep from right to left and compute parallel prefix of merged bounds */
 	float4 r_area[MAX_BINS];	/* area of bounds of primitives on the right */
 	float4 r_count[MAX_BINS];	/* number of primitives on the right */
@@ -199,33 +171,32 @@ void BVHObjectBinning::split(BVHReference* prims,
 	BoundBox lcent_bounds = BoundBox::empty;
 	BoundBox rcent_bounds = BoundBox::empty;
 
-	ssize_t l = 0, r = N-1;
-
-	while(l <= r) {
-		prefetch_L2(&prims[start() + l + 8]);
-		prefetch_L2(&prims[start() + r - 8]);
-
-		BVHReference prim = prims[start() + l];
-		BoundBox unaligned_bounds = get_prim_bounds(prim);
-		float3 unaligned_center = unaligned_bounds.center2();
-		float3 center = prim.bounds().center2();
+	size_t num_left;
 
-		if(get_bin(unaligned_center)[dim] < pos) {
-			lgeom_bounds.grow(prim.bounds());
-			lcent_bounds.grow(center);
-			l++;
-		}
-		else {
-			rgeom_bounds.grow(prim.bounds());
-			rcent_bounds.grow(center);
-			swap(prims[start()+l],prims[start()+r]);
-			r--;
-		}
+	if(parallel_threshold_ && N >= parallel_threshold_) {
+		num_left = partition_parallel(prims,
+		                              lgeom_bounds, rgeom_bounds,
+		                              lcent_bounds, rcent_bounds);
+	}
+	else {
+		PartitionBlock block;
+		block.start = start();
+		block.end = end();
+		partition_block(prims, &block);
+
+		num_left = block.num_left;
+		lgeom_bounds = block.lgeom_bounds;
+		rgeom_bounds = block.rgeom_bounds;
+		lcent_bounds = block.lcent_bounds;
+		rcent_bounds = block.rcent_bounds;
 	}
+
 	/* finish */
-	if(l != 0 && N-1-r != 0) {
-		right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + l, N-1-r), prims);
-		left_o  = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), l), prims);
+	if(num_left != 0 && num_left != N) {
+		right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + num_left, N - num_left),
+		                           prims, NULL, NULL, parallel_threshold_);
+		left_o  = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), num_left),
+		                           prims, NULL, NULL, parallel_threshold_);
 		return;
 	}
 
@@ -246,8 +217,226 @@ void BVHObjectBinning::split(BVHReference* prims,
 		rcent_bounds.grow(prims[start()+i].bounds().center2());
 	}
 
-	right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + N/2, N/2 + N%2), prims);
-	left_o  = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), N/2), prims);
+	right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + N/2, N/2 + N%2),
+	                           prims, NULL, NULL, parallel_threshold_);
+	left_o  = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), N/2),
+	                           prims, NULL, NULL, parallel_threshold_);
+}
+
+void BVHObjectBinning::bin_prims(const BVHReference *prims,
+                                 size_t start,
+                                 size_t end,
+                                 Bins *bins) const
+{
+	BoundBox (*bin_bounds)[4] = bins->bounds;
+	int4 *bin_count = bins->count;
+
+	/* map geometry to bins, unrolled once */
+	size_t i;
+
+	for(i = start; i + 1 < end; i += 2) {
+		prefetch_L2(&prims[i + 8]);
+
+		/* map even and odd primitive to bin */
+		const BVHReference& prim0 = prims[i + 0];
+		const BVHReference& prim1 = prims[i + 1];
+
+		BoundBox bounds0 = get_prim_bounds(prim0);
+		BoundBox bounds1 = get_prim_bounds(prim1);
+
+		int4 bin0 = get_bin(bounds0);
+		int4 bin1 = get_bin(bounds1);
+
+		/* increase bounds for bins for even primitive */
+		int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
+		int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
+		int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
+
+		/* increase bounds of bins for odd primitive */
+		int b10 = (int)extract<0>(bin1); bin_count[b10][0]++; bin_bounds[b10][0].grow(bounds1);
+		int b11 = (int)extract<1>(bin1); bin_count[b11][1]++; bin_bounds[b11][1].grow(bounds1);
+		int b12 = (int)extract<2>(bin1); bin_count[b12][2]++; bin_bounds[b12][2].grow(bounds1);
+	}
+
+	/* for uneven number of primitives */
+	if(i < end) {
+		/* map primitive to bin */
+		const BVHReference& prim0 = prims[i];
+		BoundBox bounds0 = get_prim_bounds(prim0);
+		int4 bin0 = get_bin(bounds0);
+
+		/* increase bounds of bins */
+		int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
+		int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
+		int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
+	}
+}
+
+void BVHObjectBinning::bin_prims_parallel(const BVHReference *prims,
+                                          Bins *bins) const
+{
+	/* Bin every block into its own bins. */
+	size_t num_blocks = divide_up(size(), PARALLEL_BLOCK_SIZE);
+	vector<Bins> block_bins(num_blocks);
+	TaskPool pool;
+
+	for(size_t b = 0; b < num_blocks; b++) {
+		Bins *block = &block_bins[b];
+		for(size_t i = 0; i < num_bins; i++) {
+			block->count[i] = make_int4(0);
+			block->bounds[i][0] = block->bounds[i][1] = block->bounds[i][2] = BoundBox::empty;
+		}
+
+		size_t block_start = start() + b*PARALLEL_BLOCK_SIZE;
+		size_t block_end = min(block_start + PARALLEL_BLOCK_SIZE, (size_t)end());
+		pool.push(function_bind(&BVHObjectBinning::bin_prims,
+		                        this,
+		                        prims,
+		                        block_start,
+		                        block_end,
+		                        block));
+	}
+
+	pool.wait_work();
+
+	/* Reduce. */
+	foreach(const Bins& block, block_bins) {
+		for(size_t i = 0; i < num_bins; i++) {
+			bins->count[i] = bins->count[i] + block.count[i];
+			for(int d = 0; d < 3; d++) {
+				bins->bounds[i][d].grow(block.bounds[i][d]);
+			}
+		}
+	}
+}
+
+void BVHObjectBinning::partition_block(BVHReference *prims,
+                                       PartitionBlock *block) const
+{
+	block->lgeom_bounds = BoundBox::empty;
+	block->rgeom_bounds = BoundBox::empty;
+	block->lcent_bounds = BoundBox::empty;
+	block->rcent_bounds = BoundBox::empty;
+
+	ssize_t l = block->start, r = (ssize_t)block->end - 1;
+
+	while(l <= r) {
+		prefetch_L2(&prims[l + 8]);
+		prefetch_L2(&prims[r - 8]);
+
+		BVHReference prim = prims[l];
+		BoundBox unaligned_bounds = get_prim_bounds(prim);
+		float3 unaligned_center = unaligned_bounds.center2();
+		float3 center = prim.bounds().center2();
+
+		if(get_bin(unaligned_center)[dim] < pos) {
+			block->lgeom_bounds.grow(prim.bounds());
+			block->lcent_bounds.grow(center);
+			l++;
+		}
+		else {
+			block->rgeom_bounds.grow(prim.bounds());
+			block->rcent_bounds.grow(center);
+			swap(prims[l],prims[r]);
+			r--;
+		}
+	}
+
+	block->num_left = l - block->start;
+}
+
+static void swap_prims(BVHReference *a, BVHReference *b, size_t num)
+{
+	for(size_t i = 0; i < num; i++) {
+		swap(a[i], b[i]);
+	}
+}
+
+size_t BVHObjectBinning::partition_parallel(BVHReference *prims,
+                                            BoundBox& lgeom_bounds,
+                                            BoundBox& rgeom_bounds,
+                                            BoundBox& lcent_bounds,
+                                            BoundBox& rcent_bounds) const
+{
+	/* Partition every block on its own. */
+	size_t num_blocks = divide_up(size(), PARALLEL_BLOCK_SIZE);
+	vector<PartitionBlock> blocks(num_blocks);
+
+	{
+		TaskPool pool;
+
+		for(size_t b = 0; b < num_blocks; b++) {
+			PartitionBlock *block = &blocks[b];
+			block->start = start() + b*PARALLEL_BLOCK_SIZE;
+			block->end = min(block->start + PARALLEL_BLOCK_SIZE, (size_t)end());
+			pool.push(function_bind(&BVHObjectBinning::partition_block,
+			                        this,
+			                        prims,
+			                        block));
+		}
+
+		pool.wait_work();
+	}
+
+	size_t num_left = 0;
+	foreach(const PartitionBlock& block, blocks) {
+		num_left += block.num_left;
+		lgeom_bounds.grow(block.lgeom_bounds);
+		rgeom_bounds.grow(block.rgeom_bounds);
+		lcent_bounds.grow(block.lcent_bounds);
+		rcent_bounds.grow(block.rcent_bounds);
+	}
+
+	/* Right primitives before the middle and left primitives after it are
+	 * misplaced, there is the same number of both. Pair them up in order and
+	 * swap them, in pieces no longer than a block. */
+	const size_t mid = start() + num_left;
+	vector<size_t> right_start, right_end, left_start, left_end;
+
+	foreach(const PartitionBlock& block, blocks) {
+		size_t block_mid = block.start + block.num_left;
+		if(block_mid < mid) {
+			size_t e = min(block.end, mid);
+			if(block_mid < e) {
+				right_start.push_back(block_mid);
+				right_end.push_back(e);
+			}
+		}
+		if(block_mid > mid) {
+			size_t s = max(block.start, mid);
+			if(s < block_mid) {
+				left_start.push_back(s);
+				left_end.push_back(block_mid);
+			}
+		}
+	}
+
+	TaskPool pool;
+	size_t ri = 0, li = 0;
+
+	while(ri < right_start.size() && li < left_start.size()) {
+		size_t num = min(right_end[ri] - right_start[ri],
+		                 left_end[li] - left_start[li]);
+		num = min(num, (size_t)PARALLEL_BLOCK_SIZE);
+
+		pool.push(function_bind(&swap_prims,
+		                        prims + right_start[ri],
+		                        prims + left_start[li],
+		                        num));
+
+		if((right_start[ri] += num) == right_end[ri]) {
+			ri++;
+		}
+		if((left_start[li] += num) == left_end[li]) {
+			li++;
+		}
+	}
+
+	assert(ri == right_start.size() && li == left_start.size());
+
+	pool.wait_work();
+
+	return num_left;
 }
 
 CCL_NAMESPACE_END
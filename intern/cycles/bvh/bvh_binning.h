@@ -27,22 +27,29 @@ CCL_NAMESPACE_BEGIN
 
 class BVHBuild;
 
-/* Single threaded object binner. Finds the split with the best SAH heuristic
- * by testing for each dimension multiple partitionings for regular spaced
- * partition locations. A partitioning for a partition location is computed,
- * by putting primitives whose centroid is on the left and right of the split
- * location to different sets. The SAH is evaluated by computing the number of
- * blocks occupied by the primitives in the partitions. */
+/* Object binner. Finds the split with the best SAH heuristic by testing for
+ * each dimension multiple partitionings for regular spaced partition
+ * locations. A partitioning for a partition location is computed, by putting
+ * primitives whose centroid is on the left and right of the split location to
+ * different sets. The SAH is evaluated by computing the number of blocks
+ * occupied by the primitives in the partitions.
+ *
+ * Ranges of at least parallel_threshold primitives are binned and split by
+ * multiple threads: every block of primitives is binned and partitioned on
+ * its own, then the bins are merged and misplaced primitives are swapped
+ * between blocks. Blocks have a fixed size, so the result doesn't depend on
+ * the number of threads. */
 
 class BVHObjectBinning : public BVHRange
 {
 public:
-	__forceinline BVHObjectBinning() : leafSAH(FLT_MAX) {}
+	__forceinline BVHObjectBinning() : leafSAH(FLT_MAX), parallel_threshold_(0) {}
 
 	BVHObjectBinning(const BVHRange& job,
 	                 BVHReference *prims,
 	                 const BVHUnaligned *unaligned_heuristic = NULL,
-	                 const Transform *aligned_space = NULL);
+	                 const Transform *aligned_space = NULL,
+	                 size_t parallel_threshold = 0);
 
 	void split(BVHReference *prims,
 	           BVHObjectBinning& left_o,
@@ -66,8 +73,40 @@ protected:
 	const BVHUnaligned *unaligned_heuristic_;
 	const Transform *aligned_space_;
 
+	/* Minimal number of primitives to bin and split with multiple threads,
+	 * zero means always single threaded. */
+	size_t parallel_threshold_;
+
 	enum { MAX_BINS = 32 };
 	enum { LOG_BLOCK_SIZE = 2 };
+	enum { PARALLEL_BLOCK_SIZE = 32*1024 };
+
+	/* Counters and bounds of all bins in every dimension. */
+	struct Bins {
+		BoundBox bounds[MAX_BINS][4];
+		int4 count[MAX_BINS];
+	};
+
+	/* A block of primitives partitioned on its own, left primitives first. */
+	struct PartitionBlock {
+		size_t start, end;
+		size_t num_left;
+		BoundBox lgeom_bounds, rgeom_bounds;
+		BoundBox lcent_bounds, rcent_bounds;
+	};
+
+	void bin_prims(const BVHReference *prims,
+	               size_t start,
+	               size_t end,
+	               Bins *bins) const;
+	void bin_prims_parallel(const BVHReference *prims, Bins *bins) const;
+
+	void partition_block(BVHReference *prims, PartitionBlock *block) const;
+	size_t partition_parallel(BVHReference *prims,
+	                          BoundBox& lgeom_bounds,
+	                          BoundBox& rgeom_bounds,
+	                          BoundBox& lcent_bounds,
+	                          BoundBox& rcent_bounds) const;
 
 	/* computes the bin numbers for each dimension for a box. */
 	__forceinline int4 get_bin(const BoundBox& box) const
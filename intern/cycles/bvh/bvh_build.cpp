@@ -488,6 +488,13 @@ BVHNode* BVHBuild::run()
 		prim_time.resize(0);
 	}
 
+	parallel_level_nodes.clear();
+	parallel_level_nodes.resize(BVHParams::MAX_DEPTH + 1, 0);
+	parallel_level_size.clear();
+	parallel_level_size.resize(BVHParams::MAX_DEPTH + 1, 0);
+	parallel_level_time.clear();
+	parallel_level_time.resize(BVHParams::MAX_DEPTH + 1, 0.0);
+
 	/* build recursively */
 	BVHNode *rootnode;
 
@@ -498,7 +505,17 @@ BVHNode* BVHBuild::run()
 	}
 	else {
 		/* Perform multithreaded binning build. */
-		BVHObjectBinning rootbin(root, (references.size())? &references[0]: NULL);
+		double bin_start_time = time_dt();
+		BVHObjectBinning rootbin(root,
+		                         (references.size())? &references[0]: NULL,
+		                         NULL,
+		                         NULL,
+		                         params.parallel_build_threshold);
+		if(params.parallel_build_threshold &&
+		   rootbin.size() >= params.parallel_build_threshold)
+		{
+			parallel_stats_add(0, 0, time_dt() - bin_start_time);
+		}
 		rootnode = build_node(rootbin, 0);
 		task_pool.wait_work();
 	}
@@ -530,6 +547,16 @@ BVHNode* BVHBuild::run()
 			               << ((prim_type.capacity() != 0)
 			                       ? (float)prim_type.size() / prim_type.capacity()
 			                       : 1.0f) << "\n";
+			for(int level = 0; level < parallel_level_nodes.size(); level++) {
+				if(parallel_level_nodes[level] == 0) {
+					continue;
+				}
+				VLOG(1) << "  Parallel split level " << level << ": "
+				        << parallel_level_nodes[level] << " nodes, "
+				        << string_human_readable_number(parallel_level_size[level])
+				        << " references, "
+				        << parallel_level_time[level] << " seconds";
+			}
 		}
 	}
 
@@ -552,6 +579,18 @@ void BVHBuild::progress_update()
 	progress_start_time = time_dt();
 }
 
+void BVHBuild::parallel_stats_add(int level, size_t size, double time)
+{
+	thread_scoped_lock lock(build_mutex);
+
+	level = min(level, (int)parallel_level_nodes.size() - 1);
+	if(size) {
+		parallel_level_nodes[level]++;
+		parallel_level_size[level] += size;
+	}
+	parallel_level_time[level] += time;
+}
+
 void BVHBuild::thread_build_node(InnerNode *inner,
                                  int child,
                                  BVHObjectBinning *range,
@@ -678,6 +717,10 @@ BVHNode* BVHBuild::build_node(const BVHObjectBinning& range, int level)
 	}
 
 	/* Perform split. */
+	const bool parallel_split = params.parallel_build_threshold &&
+	                            size >= params.parallel_build_threshold;
+	double split_start_time = (parallel_split)? time_dt(): 0.0;
+
 	BVHObjectBinning left, right;
 	if(do_unalinged_split) {
 		unaligned_range.split(&references[0], left, right);
@@ -686,6 +729,10 @@ BVHNode* BVHBuild::build_node(const BVHObjectBinning& range, int level)
 		range.split(&references[0], left, right);
 	}
 
+	if(parallel_split) {
+		parallel_stats_add(level, size, time_dt() - split_start_time);
+	}
+
 	BoundBox bounds;
 	if(do_unalinged_split) {
 		bounds = unaligned_heuristic.compute_aligned_boundbox(
@@ -745,6 +792,10 @@ BVHNode* BVHBuild::build_node(const BVHRange& range,
 	}
 
 	/* Perform splitting test. */
+	const bool parallel_split = params.parallel_build_threshold &&
+	                            range.size() >= params.parallel_build_threshold;
+	double split_start_time = (parallel_split)? time_dt(): 0.0;
+
 	BVHSpatialStorage *storage = &spatial_storage[thread_id];
 	BVHMixedSplit split(this, storage, range, references, level);
 
@@ -794,6 +845,10 @@ BVHNode* BVHBuild::build_node(const BVHRange& range,
 		split.split(this, left, right, range);
 	}
 
+	if(parallel_split) {
+		parallel_stats_add(level, range.size(), time_dt() - split_start_time);
+	}
+
 	progress_total += left.size() + right.size() - range.size();
 
 	BoundBox bounds;
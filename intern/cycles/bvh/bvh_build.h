@@ -100,6 +100,9 @@ protected:
 	/* Progress. */
 	void progress_update();
 
+	/* Statistics of nodes which are binned and split by multiple threads. */
+	void parallel_stats_add(int level, size_t size, double time);
+
 	/* Tree rotations. */
 	void rotate(BVHNode *node, int max_depth);
 	void rotate(BVHNode *node, int max_depth, int iterations);
@@ -136,6 +139,12 @@ protected:
 	/* Threads. */
 	TaskPool task_pool;
 
+	/* Number of nodes, references and time spent binning and splitting them
+	 * for each level built by multiple threads together. */
+	vector<int> parallel_level_nodes;
+	vector<size_t> parallel_level_size;
+	vector<double> parallel_level_time;
+
 	/* Unaligned building. */
 	BVHUnaligned unaligned_heuristic;
 };
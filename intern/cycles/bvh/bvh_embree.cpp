@@ -870,7 +870,7 @@ void BVHEmbree::pack_nodes(const BVHNode *)
 	}
 }
 
-void BVHEmbree::refit_nodes()
+float BVHEmbree::refit_nodes()
 {
 	unsigned geom_id = 0;
 
@@ -889,6 +889,8 @@ void BVHEmbree::refit_nodes()
 		geom_id += 2;
 	}
 	rtcCommit(scene);
+
+	return 0.0f;
 }
 CCL_NAMESPACE_END
 
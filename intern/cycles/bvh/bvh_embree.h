@@ -47,7 +47,14 @@ protected:
 	BVHEmbree(const BVHParams& params, const vector<Object*>& objects);
 
 	virtual void pack_nodes(const BVHNode *root);
-	virtual void refit_nodes();
+	virtual float refit_nodes();
+	/* Embree refits its own scene, there are no packed nodes. */
+	virtual void refit_node(int /*idx*/,
+	                        bool /*leaf*/,
+	                        BoundBox& /*bbox*/,
+	                        uint& /*visibility*/,
+	                        float& /*leaf_cost*/,
+	                        int /*level*/) {}
 
 	unsigned add_object(Object *ob, int i);
 	unsigned add_instance(Object *ob, int i);
@@ -19,6 +19,7 @@
 #define __BVH_PARAMS_H__
 
 #include "util/util_boundbox.h"
+#include "util/util_string.h"
 
 #include "kernel/kernel_types.h"
 
@@ -50,8 +51,8 @@ public:
 	/* object or mesh level bvh */
 	bool top_level;
 
-	/* QBVH */
-	bool use_qbvh;
+	/* Layout of the packed nodes, BVH4 and BVH8 are CPU only. */
+	BVHLayout bvh_layout;
 
 	/* Mask of primitives to be included into the BVH. */
 	int primitive_mask;
@@ -80,6 +81,22 @@ public:
 	int curve_flags;
 	int curve_subdivisions;
 
+	/* Read mesh BVHs from the disk cache when the geometry didn't change,
+	 * and write them there after building. Empty path means the user cache
+	 * directory. */
+	bool use_cache;
+	string cache_path;
+
+	/* Nodes with at least this many references are binned and partitioned
+	 * by all threads together, smaller ones by a single thread. Zero disables
+	 * the data-parallel path. */
+	int parallel_build_threshold;
+
+	/* Rebuild instead of refitting once the SAH cost of the leaves grew by
+	 * more than this factor compared to the freshly built BVH, zero disables
+	 * the check. */
+	float refit_sah_threshold;
+
 	/* fixed parameters */
 	enum {
 		MAX_DEPTH = 64,
@@ -106,7 +123,7 @@ public:
 		max_motion_curve_leaf_size = 4;
 
 		top_level = false;
-		use_qbvh = false;
+		bvh_layout = BVH_LAYOUT_BVH2;
 		use_unaligned_nodes = false;
 
 		primitive_mask = PRIMITIVE_ALL;
@@ -119,6 +136,12 @@ public:
 		use_bvh_embree = false;
 		curve_flags = 0;
 		curve_subdivisions = 4;
+
+		use_cache = false;
+
+		parallel_build_threshold = 256*1024;
+
+		refit_sah_threshold = 0.0f;
 	}
 
 	/* SAH costs */
@@ -133,6 +156,17 @@ public:
 
 	__forceinline bool small_enough_for_leaf(int size, int level)
 	{ return (size <= min_leaf_size || level >= MAX_DEPTH); }
+
+	/* Human readable name of the layout, for logs. */
+	static const char *bvh_layout_name(BVHLayout layout)
+	{
+		switch(layout) {
+			case BVH_LAYOUT_BVH2: return "BVH2";
+			case BVH_LAYOUT_BVH4: return "BVH4";
+			case BVH_LAYOUT_BVH8: return "BVH8";
+		}
+		return "UNKNOWN";
+	}
 };
 
 /* BVH Reference
@@ -24,6 +24,8 @@
 #include "render/object.h"
 
 #include "util/util_algorithm.h"
+#include "util/util_foreach.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -174,36 +176,63 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild& builder,
 	}
 
 	/* chop references into bins. */
-	for(unsigned int refIdx = range.start(); refIdx < range.end(); refIdx++) {
-		const BVHReference& ref = references_->at(refIdx);
-		BoundBox prim_bounds = get_prim_bounds(ref);
-		float3 firstBinf = (prim_bounds.min - origin) * invBinSize;
-		float3 lastBinf = (prim_bounds.max - origin) * invBinSize;
-		int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
-		int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+	const size_t threshold = builder.params.parallel_build_threshold;
+	if(threshold && range.size() >= threshold) {
+		/* Bin blocks of references into their own bins, then merge them. */
+		const size_t block_size = 32*1024;
+		size_t num_blocks = divide_up(range.size(), block_size);
+		vector<SpatialBins> block_bins(num_blocks);
+		TaskPool pool;
+
+		for(size_t b = 0; b < num_blocks; b++) {
+			SpatialBins *bins = &block_bins[b];
+			for(int dim = 0; dim < 3; dim++) {
+				for(int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+					BVHSpatialBin& bin = bins->bins[dim][i];
+
+					bin.bounds = BoundBox::empty;
+					bin.enter = 0;
+					bin.exit = 0;
+				}
+			}
 
-		firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
-		lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
+			size_t block_start = range.start() + b*block_size;
+			size_t block_end = min(block_start + block_size, (size_t)range.end());
+			pool.push(function_bind(&BVHSpatialSplit::bin_references,
+			                        this,
+			                        &builder,
+			                        block_start,
+			                        block_end,
+			                        origin,
+			                        binSize,
+			                        invBinSize,
+			                        bins->bins));
+		}
 
-		for(int dim = 0; dim < 3; dim++) {
-			BVHReference currRef(get_prim_bounds(ref),
-			                     ref.prim_index(),
-			                     ref.prim_object(),
-			                     ref.prim_type());
+		pool.wait_work();
 
-			for(int i = firstBin[dim]; i < lastBin[dim]; i++) {
-				BVHReference leftRef, rightRef;
+		foreach(const SpatialBins& bins, block_bins) {
+			for(int dim = 0; dim < 3; dim++) {
+				for(int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+					const BVHSpatialBin& block_bin = bins.bins[dim][i];
+					BVHSpatialBin& bin = storage_->bins[dim][i];
 
-				split_reference(builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
-				storage_->bins[dim][i].bounds.grow(leftRef.bounds());
-				currRef = rightRef;
+					bin.bounds.grow(block_bin.bounds);
+					bin.enter += block_bin.enter;
+					bin.exit += block_bin.exit;
+				}
 			}
-
-			storage_->bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
-			storage_->bins[dim][firstBin[dim]].enter++;
-			storage_->bins[dim][lastBin[dim]].exit++;
 		}
 	}
+	else {
+		bin_references(&builder,
+		               range.start(),
+		               range.end(),
+		               origin,
+		               binSize,
+		               invBinSize,
+		               storage_->bins);
+	}
 
 	/* select best split plane. */
 	storage_->right_bounds.resize(BVHParams::NUM_SPATIAL_BINS);
@@ -238,6 +267,46 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild& builder,
 	}
 }
 
+void BVHSpatialSplit::bin_references(const BVHBuild *builder,
+                                     size_t start,
+                                     size_t end,
+                                     float3 origin,
+                                     float3 binSize,
+                                     float3 invBinSize,
+                                     BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS])
+{
+	for(size_t refIdx = start; refIdx < end; refIdx++) {
+		const BVHReference& ref = references_->at(refIdx);
+		BoundBox prim_bounds = get_prim_bounds(ref);
+		float3 firstBinf = (prim_bounds.min - origin) * invBinSize;
+		float3 lastBinf = (prim_bounds.max - origin) * invBinSize;
+		int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
+		int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+
+		firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
+		lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
+
+		for(int dim = 0; dim < 3; dim++) {
+			BVHReference currRef(get_prim_bounds(ref),
+			                     ref.prim_index(),
+			                     ref.prim_object(),
+			                     ref.prim_type());
+
+			for(int i = firstBin[dim]; i < lastBin[dim]; i++) {
+				BVHReference leftRef, rightRef;
+
+				split_reference(*builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
+				bins[dim][i].bounds.grow(leftRef.bounds());
+				currRef = rightRef;
+			}
+
+			bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
+			bins[dim][firstBin[dim]].enter++;
+			bins[dim][lastBin[dim]].exit++;
+		}
+	}
+}
+
 void BVHSpatialSplit::split(BVHBuild *builder,
                             BVHRange& left,
                             BVHRange& right,
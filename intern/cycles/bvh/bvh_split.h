@@ -108,6 +108,20 @@ protected:
 	const BVHUnaligned *unaligned_heuristic_;
 	const Transform *aligned_space_;
 
+	/* Bins of one block of references when binning with multiple threads. */
+	struct SpatialBins {
+		BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS];
+	};
+
+	/* Chop references from the given range into bins. */
+	void bin_references(const BVHBuild *builder,
+	                    size_t start,
+	                    size_t end,
+	                    float3 origin,
+	                    float3 binSize,
+	                    float3 invBinSize,
+	                    BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS]);
+
 	/* Lower-level functions which calculates boundaries of left and right nodes
 	 * needed for spatial split.
 	 *
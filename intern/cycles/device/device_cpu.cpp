@@ -35,12 +35,14 @@
 #include "kernel/kernel_types.h"
 #include "kernel/split/kernel_split_data.h"
 #include "kernel/kernel_globals.h"
+#include "kernel/kernel_adaptive_sampling.h"
 
 #include "kernel/osl/osl_shader.h"
 #include "kernel/osl/osl_globals.h"
 
 #include "render/buffers.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_debug.h"
 #include "util/util_foreach.h"
 #include "util/util_function.h"
@@ -57,87 +59,105 @@ CCL_NAMESPACE_BEGIN
  * Temprorarily moved here to get it to build on Linux (gcc?)
  */
 
+static bool crypomatte_comp(const CoverageSlot& i, const CoverageSlot& j) { return i.weight > j.weight; }
 
-static inline void kernel_write_id_slots(float *buffer, int num_slots, float id, float weight, bool init)
+int flatten_coverage(KernelGlobals *kg, const CoverageBuffer& coverage, const RenderTile &tile, const int aov_index)
 {
-	kernel_assert(id != ID_NONE);
+	/* sort the coverage of every pixel and write it to the output */
+	int num_slots = 2 * (kg->__data.film.use_cryptomatte & 255);
+	int pass_stride = kg->__data.film.pass_stride;
+	int pass_offset = (kg->__data.film.pass_aov[aov_index] & ~(1 << 31));
 
-	if(weight == 0.0f) {
-		return;
-	}
+	/* scratch space for one pixel, reused so sorting doesn't allocate */
+	vector<CoverageSlot> sorted_pixel;
+	sorted_pixel.reserve(COVERAGE_PIXEL_SLOTS * 2);
+
+	int index = 0;
+	for(int y = 0; y < tile.h; y++) {
+		for(int x = 0; x < tile.w; x++, index++) {
+			sorted_pixel.clear();
+			int num_ids = coverage.gather(index, sorted_pixel);
+			if(num_ids == 0) {
+				continue;
+			}
+
+			/* buffer offset */
+			int buffer_index = x + y*tile.stride;
+			float *buffer = (float*)tile.buffer + buffer_index*pass_stride + pass_offset;
+
+			/* sort the cryptomatte pixel, IDs are unique so the sorted list can
+			 * be written to the slots as is */
+			sort(sorted_pixel.begin(), sorted_pixel.end(), crypomatte_comp);
+			if(num_ids > num_slots) {
+				float leftover = 0.0f;
+				for(int i = num_slots; i < num_ids; i++) {
+					leftover += sorted_pixel[i].weight;
+				}
+				sorted_pixel[num_slots-1].weight += leftover;
+			}
 
-	if(init) {
-		for(int slot = 0; slot < num_slots; slot++) {
-			buffer[slot*ID_SLOT_SIZE + 0] = ID_NONE;
-			buffer[slot*ID_SLOT_SIZE + 1] = 0.0f;
+			int limit = min(num_slots, num_ids);
+			for(int slot = 0; slot < num_slots; slot++) {
+				buffer[slot*ID_SLOT_SIZE + 0] = (slot < limit)? sorted_pixel[slot].id: ID_NONE;
+				buffer[slot*ID_SLOT_SIZE + 1] = (slot < limit)? sorted_pixel[slot].weight: 0.0f;
+			}
 		}
-	} else {
-		init = false;
 	}
 
-	for(int slot = 0; slot < num_slots; slot++) {
-		float *slot_id = (&buffer[slot*ID_SLOT_SIZE + 0]);
-		float *slot_weight = &buffer[slot*ID_SLOT_SIZE + 1];
+	return kernel_data.film.use_cryptomatte & 255;
+}
+
+/* End coverage.cpp */
+
+/* Adaptive sampling of a tile, see kernel_adaptive_sampling.h. */
 
-		/* If the loop reaches an empty slot, the ID isn't in any slot yet - so add it! */
-		if(*slot_weight == 0.0f) {
-			kernel_assert(*slot_id == ID_NONE);
-			*slot_id = id;
-			*slot_weight = weight;
-			break;
+static float *adaptive_pixel_buffer(KernelGlobals *kg, const RenderTile& tile, int x, int y)
+{
+	int index = tile.offset + x + y*tile.stride;
+	return (float*)tile.buffer + index*kernel_data.film.pass_stride;
+}
+
+static void adaptive_scale_pixel(KernelGlobals *kg, const RenderTile& tile, int x, int y, float scale)
+{
+	kernel_adaptive_pixel_scale(kg, adaptive_pixel_buffer(kg, tile, x, y), scale);
+
+	/* accurate cryptomatte is only written to the buffer when the tile is done */
+	int use_cryptomatte = kernel_data.film.use_cryptomatte;
+	if(use_cryptomatte & CRYPT_ACCURATE) {
+		int pixel = tile.w * (y - tile.y) + x - tile.x;
+		if(use_cryptomatte & CRYPT_OBJECT) {
+			kg->coverage_object->scale(pixel, scale);
+		}
+		if(use_cryptomatte & CRYPT_OBJECT_PASS_INDEX) {
+			kg->coverage_object_index->scale(pixel, scale);
+		}
+		if(use_cryptomatte & CRYPT_MATERIAL) {
+			kg->coverage_material->scale(pixel, scale);
+		}
+		if(use_cryptomatte & CRYPT_MATERIAL_PASS_INDEX) {
+			kg->coverage_material_index->scale(pixel, scale);
 		}
-		/* If there already is a slot for that ID, add the weight. */
-		else if(*slot_id == id) {
-			*slot_weight += weight;
-			break;
+		if(use_cryptomatte & CRYPT_ASSET) {
+			kg->coverage_asset->scale(pixel, scale);
 		}
 	}
 }
 
-static bool crypomatte_comp(const std::pair<float, float>& i, const std::pair<float, float> j) { return i.first > j.first; }
-
-int flatten_coverage(KernelGlobals *kg, vector<map<float, float> > & coverage, const RenderTile &tile, const int aov_index)
+/* Test all pixels of the tile for convergence, returns true when every
+ * pixel converged. */
+static bool adaptive_check_tile(KernelGlobals *kg, const RenderTile& tile, int num_samples)
 {
-	/* sort the coverage map and write it to the output */
-	int index = 0;
-	for(int y = 0; y < tile.h; y++) {
-		for(int x = 0; x < tile.w; x++) {
-			const map<float, float>& pixel = coverage[index];
-			if(!pixel.empty()) {
-				/* buffer offset */
-				int index = x + y*tile.stride;
-				int pass_stride = kg->__data.film.pass_stride;
-				float *buffer = (float*)tile.buffer + index*pass_stride;
-
-				/* sort the cryptomatte pixel */
-				vector<std::pair<float, float> > sorted_pixel;
-				for(map<float, float>::const_iterator it = pixel.begin(); it != pixel.end(); ++it) {
-					sorted_pixel.push_back(std::make_pair(it->second, it->first));
-				}
-				sort(sorted_pixel.begin(), sorted_pixel.end(), crypomatte_comp);
-				int num_slots = 2 * (kg->__data.film.use_cryptomatte & 255);
-				if(sorted_pixel.size() > num_slots) {
-					float leftover = 0.0f;
-					for(vector<pair<float, float> >::iterator it = sorted_pixel.begin()+num_slots; it != sorted_pixel.end(); it++) {
-						leftover += it->first;
-					}
-					sorted_pixel[num_slots-1].first += leftover;
-				}
-				int limit = min(num_slots, sorted_pixel.size());
-				for(int i = 0; i < limit; i++) {
-					int pass_offset = (kg->__data.film.pass_aov[aov_index] & ~(1 << 31));
-					kernel_write_id_slots(buffer + pass_offset, 2 * (kg->__data.film.use_cryptomatte & 255), sorted_pixel[i].second, sorted_pixel[i].first, i == 0);
-				}
+	bool converged = true;
+	for(int y = tile.y; y < tile.y + tile.h; y++) {
+		for(int x = tile.x; x < tile.x + tile.w; x++) {
+			if(!kernel_adaptive_pixel_check(kg, adaptive_pixel_buffer(kg, tile, x, y), num_samples)) {
+				converged = false;
 			}
-			index++;
 		}
 	}
-
-	return kernel_data.film.use_cryptomatte & 255;
+	return converged;
 }
 
-/* End coverage.cpp */
-
 class CPUDevice;
 
 class CPUSplitKernel : public DeviceSplitKernel {
@@ -492,42 +512,41 @@ public:
 		}
 
 		/* cryptomatte data. This needs a better place than here. */
-		vector<map<float, float> >coverage_object;
-		vector<map<float, float> >coverage_object_index;
-		vector<map<float, float> >coverage_material;
-		vector<map<float, float> >coverage_material_index;
-		vector<map<float, float> >coverage_asset;
-
-		kg.coverage_object = kg.coverage_material = kg.coverage_asset = NULL;
-		kg.coverage_object_index = kg.coverage_material_index = NULL;
+		CoverageBuffer coverage_object;
+		CoverageBuffer coverage_object_index;
+		CoverageBuffer coverage_material;
+		CoverageBuffer coverage_material_index;
+		CoverageBuffer coverage_asset;
 
 		while(task.acquire_tile(this, tile)) {
 			if(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE) {
 				if(kg.__data.film.use_cryptomatte & CRYPT_OBJECT) {
-					coverage_object.clear();
-					coverage_object.resize(tile.w * tile.h);
+					coverage_object.reset(tile.w * tile.h);
+					kg.coverage_object = &coverage_object;
 				}
 				if(kg.__data.film.use_cryptomatte & CRYPT_OBJECT_PASS_INDEX) {
-					coverage_object_index.clear();
-					coverage_object_index.resize(tile.w * tile.h);
+					coverage_object_index.reset(tile.w * tile.h);
+					kg.coverage_object_index = &coverage_object_index;
 				}
 				if(kg.__data.film.use_cryptomatte & CRYPT_MATERIAL) {
-					coverage_material.clear();
-					coverage_material.resize(tile.w * tile.h);
+					coverage_material.reset(tile.w * tile.h);
+					kg.coverage_material = &coverage_material;
 				}
 				if(kg.__data.film.use_cryptomatte & CRYPT_MATERIAL_PASS_INDEX) {
-					coverage_material_index.clear();
-					coverage_material_index.resize(tile.w * tile.h);
+					coverage_material_index.reset(tile.w * tile.h);
+					kg.coverage_material_index = &coverage_material_index;
 				}
 				if(kg.__data.film.use_cryptomatte & CRYPT_ASSET) {
-					coverage_asset.clear();
-					coverage_asset.resize(tile.w * tile.h);
+					coverage_asset.reset(tile.w * tile.h);
+					kg.coverage_asset = &coverage_asset;
 				}
 			}
 			float *render_buffer = (float*)tile.buffer;
 			uint *rng_state = (uint*)tile.rng_state;
 			int start_sample = tile.start_sample;
 			int end_sample = tile.start_sample + tile.num_samples;
+			const bool use_adaptive = (kg.__data.film.pass_adaptive != 0 &&
+			                           kg.__data.integrator.adaptive_threshold > 0.0f);
 
 			for(int sample = start_sample; sample < end_sample; sample++) {
 				if(task.get_cancel() || task_pool.canceled()) {
@@ -535,25 +554,22 @@ public:
 						break;
 				}
 
+				/* remaining samples were taken over by another device */
+				if(task.reserve_tile_samples(tile, sample, 1) == 0) {
+					break;
+				}
+
 				for(int y = tile.y; y < tile.y + tile.h; y++) {
 					for(int x = tile.x; x < tile.x + tile.w; x++) {
-						if(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE) {
-							if(kg.__data.film.use_cryptomatte & CRYPT_OBJECT) {
-								kg.coverage_object = &coverage_object[tile.w * (y - tile.y) + x - tile.x];
-							}
-							if(kg.__data.film.use_cryptomatte & CRYPT_OBJECT_PASS_INDEX) {
-								kg.coverage_object_index = &coverage_object_index[tile.w * (y - tile.y) + x - tile.x];
-							}
-							if(kg.__data.film.use_cryptomatte & CRYPT_MATERIAL) {
-								kg.coverage_material = &coverage_material[tile.w * (y - tile.y) + x - tile.x];
-							}
-							if(kg.__data.film.use_cryptomatte & CRYPT_MATERIAL_PASS_INDEX) {
-								kg.coverage_material_index = &coverage_material_index[tile.w * (y - tile.y) + x - tile.x];
-							}
-							if(kg.__data.film.use_cryptomatte & CRYPT_ASSET) {
-								kg.coverage_asset = &coverage_asset[tile.w * (y - tile.y) + x - tile.x];
-							}
+						if(use_adaptive &&
+						   kernel_adaptive_pixel_converged(&kg, adaptive_pixel_buffer(&kg, tile, x, y), sample))
+						{
+							int num_samples = kernel_adaptive_num_samples(&kg, sample);
+							adaptive_scale_pixel(&kg, tile, x, y, (float)(num_samples + 1) / num_samples);
+							continue;
 						}
+
+						kg.coverage_pixel = tile.w * (y - tile.y) + x - tile.x;
 						path_trace_kernel(&kg, render_buffer, rng_state,
 						                  sample, x, y, tile.offset, tile.stride);
 					}
@@ -561,6 +577,30 @@ public:
 
 				tile.sample = sample + 1;
 
+				int pixel_samples = tile.w*tile.h;
+				bool tile_converged = false;
+
+				if(use_adaptive && tile.sample < end_sample) {
+					int num_samples = kernel_adaptive_num_samples(&kg, tile.sample);
+					if(num_samples >= kg.__data.integrator.adaptive_min_samples &&
+					   (num_samples & 1) == 0 &&
+					   adaptive_check_tile(&kg, tile, num_samples))
+					{
+						/* Skip remaining samples of the tile, scaling all pixels
+						 * as if they were taken. */
+						float scale = (float)kernel_adaptive_num_samples(&kg, end_sample) / num_samples;
+						for(int y = tile.y; y < tile.y + tile.h; y++) {
+							for(int x = tile.x; x < tile.x + tile.w; x++) {
+								adaptive_scale_pixel(&kg, tile, x, y, scale);
+							}
+						}
+
+						pixel_samples *= end_sample - sample;
+						tile.sample = end_sample;
+						tile_converged = true;
+					}
+				}
+
 				if(tile.sample == end_sample) {
 					int aov_index = 0;
 					if(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE) {
@@ -582,7 +622,11 @@ public:
 					}
 				}
 
-				task.update_progress(&tile, tile.w*tile.h);
+				task.update_progress(&tile, pixel_samples);
+
+				if(tile_converged) {
+					break;
+				}
 			}
 
 			task.release_tile(tile);
@@ -845,6 +889,9 @@ protected:
 			kg.decoupled_volume_steps[i] = NULL;
 		}
 		kg.decoupled_volume_steps_index = 0;
+		kg.coverage_object = kg.coverage_material = kg.coverage_asset = NULL;
+		kg.coverage_object_index = kg.coverage_material_index = NULL;
+		kg.coverage_pixel = 0;
 #ifdef WITH_OSL
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
@@ -1321,6 +1321,10 @@ public:
 								break;
 						}
 
+						if(task->reserve_tile_samples(tile, sample, 1) == 0) {
+							break;
+						}
+
 						path_trace(tile, sample, branched);
 
 						tile.sample = sample + 1;
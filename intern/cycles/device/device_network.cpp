@@ -28,6 +28,8 @@ CCL_NAMESPACE_BEGIN
 typedef map<device_ptr, device_ptr> PtrMap;
 typedef vector<uint8_t> DataVector;
 typedef map<device_ptr, DataVector> DataMap;
+typedef map<device_ptr, string> HashMap;
+typedef map<string, DataVector> HashDataMap;
 
 /* tile list */
 typedef vector<RenderTile> TileList;
@@ -85,6 +87,8 @@ public:
 	{
 		RPCSend snd(socket, &error_func, "stop");
 		snd.write();
+
+		VLOG(1) << stats.full_report();
 	}
 
 	void mem_alloc(const char *name, device_memory& mem, MemoryType type)
@@ -114,7 +118,7 @@ public:
 
 		snd.add(mem);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+		snd.write_buffer_compressed((void*)mem.data_pointer, mem.memory_size(), &stats);
 	}
 
 	void mem_copy_from(device_memory& mem, int y, int w, int h, int elem)
@@ -133,7 +137,7 @@ public:
 		snd.write();
 
 		RPCReceive rcv(socket, &error_func);
-		rcv.read_buffer((void*)mem.data_pointer, data_size);
+		rcv.read_buffer_compressed((void*)mem.data_pointer, data_size);
 	}
 
 	void mem_zero(device_memory& mem)
@@ -183,6 +187,8 @@ public:
 		        << string_human_readable_number(mem.memory_size()) << " bytes. ("
 		        << string_human_readable_size(mem.memory_size()) << ")";
 
+		string hash = network_buffer_hash((void*)mem.data_pointer, mem.memory_size());
+
 		thread_scoped_lock lock(rpc_lock);
 
 		mem.device_pointer = ++mem_counter;
@@ -195,8 +201,25 @@ public:
 		snd.add(mem);
 		snd.add(interpolation);
 		snd.add(extension);
+		snd.add(hash);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+
+		/* the server tells whether it still has the data from a previous
+		 * allocation, textures and BVH arrays often don't change between
+		 * frames */
+		if(!hash.empty()) {
+			bool cached;
+			RPCReceive rcv(socket, &error_func);
+			rcv.read(cached);
+
+			if(cached) {
+				stats.bytes_raw += mem.memory_size();
+				stats.bytes_cached += mem.memory_size();
+				return;
+			}
+		}
+
+		snd.write_buffer_compressed((void*)mem.data_pointer, mem.memory_size(), &stats);
 	}
 
 	void tex_free(device_memory& mem)
@@ -326,8 +349,14 @@ public:
 		return 1;
 	}
 
+	const NetworkStats& network_stats() const
+	{
+		return stats;
+	}
+
 private:
 	NetworkError error_func;
+	NetworkStats stats;
 };
 
 Device *device_network_create(DeviceInfo& info, Stats &stats, const char *address)
@@ -335,6 +364,11 @@ Device *device_network_create(DeviceInfo& info, Stats &stats, const char *addres
 	return new NetworkDevice(info, stats, address);
 }
 
+const NetworkStats& device_network_stats(Device *device)
+{
+	return static_cast<NetworkDevice*>(device)->network_stats();
+}
+
 void device_network_info(vector<DeviceInfo>& devices)
 {
 	DeviceInfo info;
@@ -359,8 +393,9 @@ public:
 
 	bool have_error() { return error_func.have_error(); }
 
-	DeviceServer(Device *device_, tcp::socket& socket_)
-	: device(device_), socket(socket_), stop(false), blocked_waiting(false)
+	DeviceServer(Device *device_, tcp::socket& socket_, size_t data_cache_max_size_)
+	: device(device_), socket(socket_), data_cache_size(0), data_cache_max_size(data_cache_max_size_),
+	  stop(false), blocked_waiting(false)
 	{
 		error_func = NetworkError();
 	}
@@ -458,6 +493,63 @@ protected:
 		return result;
 	}
 
+	/* look up texture data by hash in the cache of freed textures, and tell
+	 * the client whether it still needs to send the data */
+	bool data_cache_lookup(device_ptr client_pointer, const string& hash, DataVector& data_v)
+	{
+		if(hash.empty())
+			return false;
+
+		tex_hash[client_pointer] = hash;
+
+		bool found = false;
+		HashDataMap::iterator i = data_cache.find(hash);
+
+		if(i != data_cache.end() && i->second.size() == data_v.size()) {
+			/* texture memory is not handed to the device yet, swap is safe */
+			data_v.swap(i->second);
+			data_cache_size -= data_v.size();
+			data_cache.erase(i);
+			data_cache_order.remove(hash);
+			found = true;
+		}
+
+		RPCSend snd(socket, &error_func, "data_cached");
+		snd.add(found);
+		snd.write();
+
+		return found;
+	}
+
+	/* keep data of a freed texture in the cache, evicting the oldest
+	 * entries when it gets too big */
+	void data_cache_insert(device_ptr client_pointer)
+	{
+		HashMap::iterator i = tex_hash.find(client_pointer);
+
+		if(i == tex_hash.end())
+			return;
+
+		string hash = i->second;
+		tex_hash.erase(i);
+
+		DataVector &data_v = data_vector_find(client_pointer);
+
+		if(data_v.size() > data_cache_max_size || data_cache.find(hash) != data_cache.end())
+			return;
+
+		while(data_cache_size + data_v.size() > data_cache_max_size) {
+			HashDataMap::iterator oldest = data_cache.find(data_cache_order.front());
+			data_cache_size -= oldest->second.size();
+			data_cache.erase(oldest);
+			data_cache_order.pop_front();
+		}
+
+		data_cache[hash].swap(data_v);
+		data_cache_order.push_back(hash);
+		data_cache_size += data_cache[hash].size();
+	}
+
 	/* note that the lock must be already acquired upon entry.
 	 * This is necessary because the caller often peeks at
 	 * the header and delegates control to here when it doesn't
@@ -508,7 +600,7 @@ protected:
 			mem.data_pointer = (device_ptr)&data_v[0];
 
 			/* copy data from network into memory buffer */
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			rcv.read_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
 
 			/* translate the client pointer to a real device pointer */
 			mem.device_pointer = device_ptr_from_client_pointer(client_pointer);
@@ -539,7 +631,7 @@ protected:
 
 			RPCSend snd(socket, &error_func, "mem_copy_from");
 			snd.write();
-			snd.write_buffer((uint8_t*)mem.data_pointer, data_size);
+			snd.write_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
 			lock.unlock();
 		}
 		else if(rcv.name == "mem_zero") {
@@ -588,13 +680,14 @@ protected:
 			string name;
 			InterpolationType interpolation;
 			ExtensionType extension_type;
+			string hash;
 			device_ptr client_pointer;
 
 			rcv.read(name);
 			rcv.read(mem);
 			rcv.read(interpolation);
 			rcv.read(extension_type);
-			lock.unlock();
+			rcv.read(hash);
 
 			client_pointer = mem.device_pointer;
 
@@ -602,12 +695,16 @@ protected:
 
 			DataVector &data_v = data_vector_insert(client_pointer, data_size);
 
+			bool cached = data_cache_lookup(client_pointer, hash, data_v);
+			lock.unlock();
+
 			if(data_size)
 				mem.data_pointer = (device_ptr)&(data_v[0]);
 			else
 				mem.data_pointer = 0;
 
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			if(!cached)
+				rcv.read_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
 
 			device->tex_alloc(name.c_str(), mem, interpolation, extension_type);
 
@@ -622,6 +719,8 @@ protected:
 
 			client_pointer = mem.device_pointer;
 
+			data_cache_insert(client_pointer);
+
 			mem.device_pointer = device_ptr_from_client_pointer_erase(client_pointer);
 
 			device->tex_free(mem);
@@ -816,6 +915,14 @@ protected:
 	PtrMap ptr_imap;
 	DataMap mem_data;
 
+	/* hash of texture data by client pointer, and data of freed textures
+	 * by hash, oldest first in the order list */
+	HashMap tex_hash;
+	HashDataMap data_cache;
+	list<string> data_cache_order;
+	size_t data_cache_size;
+	size_t data_cache_max_size;
+
 	struct AcquireEntry {
 		string name;
 		RenderTile tile;
@@ -833,6 +940,12 @@ private:
 
 };
 
+void device_network_server_listen(Device *device, tcp::socket& socket, size_t cache_size)
+{
+	DeviceServer server(device, socket, cache_size);
+	server.listen();
+}
+
 void Device::server_run()
 {
 	try {
@@ -850,8 +963,7 @@ void Device::server_run()
 			string remote_address = socket.remote_endpoint().address().to_string();
 			printf("Connected to remote client at: %s\n", remote_address.c_str());
 
-			DeviceServer server(this, socket);
-			server.listen();
+			device_network_server_listen(this, socket, NETWORK_CACHE_MAX_SIZE);
 
 			printf("Disconnected.\n");
 		}
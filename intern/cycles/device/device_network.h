@@ -33,12 +33,17 @@
 #include <sstream>
 #include <deque>
 
+#include <zlib.h>
+
 #include "render/buffers.h"
 
 #include "util/util_foreach.h"
 #include "util/util_list.h"
 #include "util/util_map.h"
+#include "util/util_md5.h"
 #include "util/util_string.h"
+#include "util/util_task.h"
+#include "util/util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -55,6 +60,16 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
+/* Buffers are sent in compressed chunks of this size, so the next chunks can
+ * be compressed on other threads while previous ones are being written. */
+static const size_t NETWORK_CHUNK_SIZE = 1024*1024;
+/* Textures smaller than this are always sent, a cache lookup costs a round
+ * trip to the server. */
+static const size_t NETWORK_CACHE_MIN_SIZE = 64*1024;
+/* Maximum size of freed textures the server keeps, for when the client
+ * allocates the same data again, for example on the next frame. */
+static const size_t NETWORK_CACHE_MAX_SIZE = (size_t)1024*1024*1024;
+
 #if 0
 typedef boost::archive::text_oarchive o_archive;
 typedef boost::archive::text_iarchive i_archive;
@@ -74,6 +89,89 @@ public:
 	vector<char> local_data;
 };
 
+/* Statistics of buffers written to the socket */
+
+class NetworkStats {
+public:
+	NetworkStats()
+	: bytes_raw(0), bytes_sent(0), bytes_cached(0), time(0.0)
+	{
+	}
+
+	string full_report() const
+	{
+		return string_printf("Sent %s of %s buffers in %.2f seconds, %s found in server cache.",
+		                     string_human_readable_size(bytes_sent).c_str(),
+		                     string_human_readable_size(bytes_raw).c_str(),
+		                     time,
+		                     string_human_readable_size(bytes_cached).c_str());
+	}
+
+	/* Size of buffers before compression, including cached ones. */
+	size_t bytes_raw;
+	/* Bytes written to the socket for buffers, including chunk headers. */
+	size_t bytes_sent;
+	/* Size of buffers the server had in its cache. */
+	size_t bytes_cached;
+	/* Time spent compressing and writing buffers. */
+	double time;
+};
+
+/* Compression of buffer chunks */
+
+class NetworkChunk {
+public:
+	NetworkChunk()
+	: data(NULL), size(0), compressed_size(0)
+	{
+	}
+
+	/* Compress with the fastest level, the network is slow enough that
+	 * higher levels do not pay off. Chunks which do not get smaller are
+	 * sent as is, marked by their compressed size being equal to size. */
+	void compress()
+	{
+		uLongf dest_size = compressBound(size);
+		compressed.resize(dest_size);
+
+		if(compress2(&compressed[0], &dest_size, data, size, 1) == Z_OK && dest_size < size) {
+			compressed_size = dest_size;
+		}
+		else {
+			compressed_size = size;
+		}
+	}
+
+	const uint8_t *payload() const
+	{
+		return (compressed_size == size)? data: &compressed[0];
+	}
+
+	const uint8_t *data;
+	uint32_t size;
+	vector<uint8_t> compressed;
+	uint32_t compressed_size;
+};
+
+/* Hash of buffer contents, to find textures the server already has. Small
+ * buffers are not worth the round trip and get an empty hash. */
+static inline string network_buffer_hash(const void *buffer, size_t size)
+{
+	if(size < NETWORK_CACHE_MIN_SIZE) {
+		return "";
+	}
+
+	const uint8_t *data = (const uint8_t*)buffer;
+	const size_t max_append = (size_t)1 << 30;
+	MD5Hash md5;
+
+	for(size_t offset = 0; offset < size; offset += max_append) {
+		md5.append(data + offset, (int)std::min(size - offset, max_append));
+	}
+
+	return md5.get_hex();
+}
+
 /* Common netowrk error function / object for both DeviceNetwork and DeviceServer*/
 class NetworkError {
 public:
@@ -187,7 +285,66 @@ public:
 			error_func->network_error(error.message());
 	}
 
+	/* Write buffer as compressed chunks, each preceded by its size and
+	 * compressed size. A batch of chunks is compressed in parallel while
+	 * the previous batch is written. */
+	void write_buffer_compressed(const void *buffer, size_t size, NetworkStats *stats = NULL)
+	{
+		double start_time = time_dt();
+		const uint8_t *data = (const uint8_t*)buffer;
+		size_t offset = 0;
+		size_t bytes_sent = 0;
+
+		TaskPool pool;
+		vector<NetworkChunk> batch, next_batch;
+
+		compress_batch(pool, data, size, offset, batch);
+		pool.wait_work();
+
+		while(!batch.empty()) {
+			compress_batch(pool, data, size, offset, next_batch);
+
+			foreach(NetworkChunk& chunk, batch) {
+				uint32_t header[2] = {chunk.size, chunk.compressed_size};
+				write_buffer(header, sizeof(header));
+				write_buffer((void*)chunk.payload(), chunk.compressed_size);
+				bytes_sent += sizeof(header) + chunk.compressed_size;
+			}
+
+			pool.wait_work();
+			batch.swap(next_batch);
+		}
+
+		if(stats) {
+			stats->bytes_raw += size;
+			stats->bytes_sent += bytes_sent;
+			stats->time += time_dt() - start_time;
+		}
+	}
+
 protected:
+	void compress_batch(TaskPool& pool,
+	                    const uint8_t *data,
+	                    size_t size,
+	                    size_t& offset,
+	                    vector<NetworkChunk>& chunks)
+	{
+		size_t num_chunks = (size - offset + NETWORK_CHUNK_SIZE - 1) / NETWORK_CHUNK_SIZE;
+		num_chunks = std::min(num_chunks, (size_t)max(TaskScheduler::num_threads(), 1));
+
+		/* Size the batch before pushing, the tasks point into it. */
+		chunks.clear();
+		chunks.resize(num_chunks);
+
+		foreach(NetworkChunk& chunk, chunks) {
+			chunk.data = data + offset;
+			chunk.size = (uint32_t)std::min(size - offset, NETWORK_CHUNK_SIZE);
+			offset += chunk.size;
+
+			pool.push(function_bind(&NetworkChunk::compress, &chunk));
+		}
+	}
+
 	string name;
 	tcp::socket& socket;
 	ostringstream archive_stream;
@@ -284,6 +441,51 @@ public:
 			cout << "Network receive error: buffer size doesn't match expected size\n";
 	}
 
+	/* Read buffer written by RPCSend::write_buffer_compressed(). */
+	void read_buffer_compressed(void *buffer, size_t size)
+	{
+		uint8_t *data = (uint8_t*)buffer;
+		vector<uint8_t> compressed;
+		size_t offset = 0;
+
+		while(offset < size) {
+			uint32_t header[2];
+			read_buffer(header, sizeof(header));
+
+			if(error_func->have_error()) {
+				return;
+			}
+
+			uint32_t chunk_size = header[0];
+			uint32_t compressed_size = header[1];
+
+			if(chunk_size == 0 || chunk_size > size - offset ||
+			   compressed_size == 0 || compressed_size > chunk_size)
+			{
+				error_func->network_error("Network receive error: invalid chunk size");
+				return;
+			}
+
+			if(compressed_size == chunk_size) {
+				read_buffer(data + offset, chunk_size);
+			}
+			else {
+				compressed.resize(compressed_size);
+				read_buffer(&compressed[0], compressed_size);
+
+				uLongf dest_size = chunk_size;
+				if(uncompress(data + offset, &dest_size, &compressed[0], compressed_size) != Z_OK ||
+				   dest_size != chunk_size)
+				{
+					error_func->network_error("Network receive error: failed to decompress chunk");
+					return;
+				}
+			}
+
+			offset += chunk_size;
+		}
+	}
+
 	void read(DeviceTask& task)
 	{
 		int type;
@@ -464,6 +666,15 @@ private:
 	vector<string> servers;
 };
 
+class Device;
+
+/* Answer remote calls of a connected client on device until the client
+ * stops, keeping freed textures of up to cache_size bytes in total. */
+void device_network_server_listen(Device *device, tcp::socket& socket, size_t cache_size);
+
+/* Transfer statistics of a device created by device_network_create(). */
+const NetworkStats& device_network_stats(Device *device);
+
 CCL_NAMESPACE_END
 
 #endif
@@ -198,6 +198,12 @@ bool DeviceSplitKernel::path_trace(DeviceTask *task,
 		RenderTile subtile = tile;
 		subtile.start_sample = tile.sample;
 		subtile.num_samples = min(samples_per_second, tile.start_sample + tile.num_samples - tile.sample);
+		subtile.num_samples = task->reserve_tile_samples(tile, subtile.start_sample, subtile.num_samples);
+
+		/* remaining samples were taken over by another device */
+		if(subtile.num_samples == 0) {
+			break;
+		}
 
 		if(device->have_error()) {
 			return false;
@@ -125,5 +125,14 @@ void DeviceTask::update_progress(RenderTile *rtile, int pixel_samples)
 	}
 }
 
+int DeviceTask::reserve_tile_samples(RenderTile& rtile, int sample, int num_samples)
+{
+	if(reserve_samples) {
+		return reserve_samples(rtile, sample, num_samples);
+	}
+
+	return num_samples;
+}
+
 CCL_NAMESPACE_END
 
@@ -60,10 +60,16 @@ public:
 
 	void update_progress(RenderTile *rtile, int pixel_samples = -1);
 
+	/* Reserve samples of a tile before rendering them, returns how many of
+	 * the samples from sample on may be rendered. Fewer are returned once an
+	 * idle device took over the last samples of the tile. */
+	int reserve_tile_samples(RenderTile& rtile, int sample, int num_samples);
+
 	function<bool(Device *device, RenderTile&)> acquire_tile;
 	function<void(long, int)> update_progress_sample;
 	function<void(RenderTile&)> update_tile_sample;
 	function<void(RenderTile&)> release_tile;
+	function<int(RenderTile&, int, int)> reserve_samples;
 	function<bool(void)> get_cancel;
 
 	bool need_finish_queue;
@@ -20,6 +20,9 @@
 #ifdef __QBVH__
 #  include "kernel/bvh/qbvh_shadow_all.h"
 #endif
+#ifdef __OBVH__
+#  include "kernel/bvh/obvh_shadow_all.h"
+#endif
 
 #if BVH_FEATURE(BVH_HAIR)
 #  define NODE_INTERSECT bvh_node_intersect
@@ -402,8 +405,20 @@ ccl_device_inline bool BVH_FUNCTION_NAME(KernelGlobals *kg,
                                          uint *num_hits,
                                          uint shadow_linking)
 {
+#ifdef __OBVH__
+	if(kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH8) {
+		return BVH_FUNCTION_FULL_NAME(OBVH)(kg,
+		                                    ray,
+		                                    isect_array,
+											0,
+		                                    max_hits,
+		                                    num_hits,
+                                            shadow_linking);
+	}
+	else
+#endif
 #ifdef __QBVH__
-	if(kernel_data.bvh.use_qbvh) {
+	if(kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH4) {
 		return BVH_FUNCTION_FULL_NAME(QBVH)(kg,
 		                                    ray,
 		                                    isect_array,
@@ -415,7 +430,7 @@ ccl_device_inline bool BVH_FUNCTION_NAME(KernelGlobals *kg,
 	else
 #endif
 	{
-		kernel_assert(kernel_data.bvh.use_qbvh == false);
+		kernel_assert(kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH2);
 		return BVH_FUNCTION_FULL_NAME(BVH)(kg,
 		                                   ray,
 		                                   isect_array,
@@ -20,6 +20,9 @@
 #ifdef __QBVH__
 #  include "kernel/bvh/qbvh_subsurface.h"
 #endif
+#ifdef __OBVH__
+#  include "kernel/bvh/obvh_subsurface.h"
+#endif
 
 #if BVH_FEATURE(BVH_HAIR)
 #  define NODE_INTERSECT bvh_node_intersect
@@ -250,8 +253,20 @@ ccl_device_inline void BVH_FUNCTION_NAME(KernelGlobals *kg,
                                          int max_hits,
                                          uint shadow_linking)
 {
+#ifdef __OBVH__
+	if(kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH8) {
+		return BVH_FUNCTION_FULL_NAME(OBVH)(kg,
+		                                    ray,
+		                                    ss_isect,
+		                                    subsurface_object,
+		                                    lcg_state,
+		                                    max_hits,
+                                            shadow_linking);
+	}
+	else
+#endif
 #ifdef __QBVH__
-	if(kernel_data.bvh.use_qbvh) {
+	if(kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH4) {
 		return BVH_FUNCTION_FULL_NAME(QBVH)(kg,
 		                                    ray,
 		                                    ss_isect,
@@ -263,7 +278,7 @@ ccl_device_inline void BVH_FUNCTION_NAME(KernelGlobals *kg,
 	else
 #endif
 	{
-		kernel_assert(kernel_data.bvh.use_qbvh == false);
+		kernel_assert(kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH2);
 		return BVH_FUNCTION_FULL_NAME(BVH)(kg,
 		                                   ray,
 		                                   ss_isect,
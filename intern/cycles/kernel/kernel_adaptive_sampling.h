@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_ADAPTIVE_SAMPLING_H__
+#define __KERNEL_ADAPTIVE_SAMPLING_H__
+
+CCL_NAMESPACE_BEGIN
+
+/* Adaptive Sampling (CPU only)
+ *
+ * The combined pass is compared against the adaptive pass, which is a second
+ * estimate made from every other sample only. Once both agree within the
+ * threshold the pixel has converged and is not sampled anymore. Instead all
+ * of its passes are scaled as if it was, so the render buffers can still be
+ * read with the number of samples of the tile.
+ *
+ * The last component of the adaptive pass is the number of samples at which
+ * the pixel converged, or zero while it's still sampled. */
+
+ccl_device_inline int kernel_adaptive_num_samples(KernelGlobals *kg, int sample)
+{
+	return sample - kernel_data.integrator.start_sample;
+}
+
+/* Pixel converged before the given sample. A pixel converging at a later
+ * sample is left over from an earlier render into the same buffers. */
+ccl_device_inline bool kernel_adaptive_pixel_converged(KernelGlobals *kg,
+                                                       const float *buffer,
+                                                       int sample)
+{
+	float converged = buffer[kernel_data.film.pass_adaptive + 3];
+	return converged > 0.0f && converged <= (float)kernel_adaptive_num_samples(kg, sample);
+}
+
+/* Test pixel for convergence once the given number of samples are written,
+ * which must be even for the adaptive pass to hold half of them. Error
+ * estimate from section 2.1 of "A hierarchical automatic stopping condition
+ * for Monte Carlo global illumination". */
+ccl_device bool kernel_adaptive_pixel_check(KernelGlobals *kg,
+                                            float *buffer,
+                                            int num_samples)
+{
+	float *adaptive = buffer + kernel_data.film.pass_adaptive;
+	if(adaptive[3] != 0.0f) {
+		return true;
+	}
+
+	float3 I = make_float3(buffer[0], buffer[1], buffer[2]);
+	float3 A = make_float3(adaptive[0], adaptive[1], adaptive[2]);
+	float error = (fabsf(I.x - A.x) + fabsf(I.y - A.y) + fabsf(I.z - A.z)) /
+	              (num_samples * 0.0001f + sqrtf(max(I.x + I.y + I.z, 0.0f)));
+
+	if(error < kernel_data.integrator.adaptive_threshold * (float)num_samples) {
+		adaptive[3] = (float)num_samples;
+		return true;
+	}
+
+	return false;
+}
+
+/* Scale all passes of the pixel, for samples it skipped after converging. */
+ccl_device void kernel_adaptive_pixel_scale(KernelGlobals *kg,
+                                            float *buffer,
+                                            float scale)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+	int pass_converged = kernel_data.film.pass_adaptive + 3;
+
+	/* Cryptomatte passes come first among the AOVs, and store pairs of ID
+	 * and weight of which only the weights are accumulated. */
+	int use_cryptomatte = kernel_data.film.use_cryptomatte;
+	int num_crypto_types = ((use_cryptomatte & CRYPT_OBJECT) != 0) +
+	                       ((use_cryptomatte & CRYPT_OBJECT_PASS_INDEX) != 0) +
+	                       ((use_cryptomatte & CRYPT_MATERIAL) != 0) +
+	                       ((use_cryptomatte & CRYPT_MATERIAL_PASS_INDEX) != 0) +
+	                       ((use_cryptomatte & CRYPT_ASSET) != 0);
+	int crypto_begin = kernel_data.film.pass_aov[0] & ~(1 << 31);
+	int crypto_end = crypto_begin + num_crypto_types * (use_cryptomatte & 255) * 4;
+
+	for(int i = 0; i < pass_stride; i++) {
+		if(i == pass_converged) {
+			continue;
+		}
+		if(i >= crypto_begin && i < crypto_end && !((i - crypto_begin) & 1)) {
+			continue;
+		}
+		buffer[i] *= scale;
+	}
+}
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_ADAPTIVE_SAMPLING_H__ */
@@ -589,6 +589,9 @@ typedef texture_image<ushort4> texture_image_ushort4;
 typedef vector3<sseb> sse3b;
 typedef vector3<ssef> sse3f;
 typedef vector3<ssei> sse3i;
+#  ifdef __KERNEL_AVX__
+typedef vector3<avxf> avx3f;
+#  endif
 
 ccl_device_inline void print_sse3b(const char *label, sse3b& a)
 {
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_COVERAGE_H__
+#define __KERNEL_COVERAGE_H__
+
+#include "util/util_algorithm.h"
+#include "util/util_math.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Per-tile accumulator for accurate Cryptomatte coverage (CPU only).
+ *
+ * Every pixel owns a fixed number of open-addressed slots in one contiguous
+ * array, so accumulating a sample never allocates. IDs which don't fit into
+ * the pixel's slots go to a per-pixel chain in a shared spill array. All the
+ * arrays keep their capacity between tiles, so once the first few tiles are
+ * done a render thread does no allocations at all for coverage.
+ *
+ * A slot with zero weight is empty, same as in kernel_write_id_slots(). */
+
+#define COVERAGE_PIXEL_SLOTS 8
+
+typedef struct CoverageSlot {
+	float id;
+	float weight;
+} CoverageSlot;
+
+typedef struct CoverageSpill {
+	CoverageSlot slot;
+	int next;
+} CoverageSpill;
+
+class CoverageBuffer {
+public:
+	CoverageBuffer() : num_pixels(0) {}
+
+	/* Prepare for a tile of the given size, all pixels are left empty. */
+	void reset(int num_pixels_)
+	{
+		num_pixels = num_pixels_;
+		CoverageSlot empty_slot = {0.0f, 0.0f};
+		slots.resize(num_pixels * COVERAGE_PIXEL_SLOTS);
+		std::fill(slots.begin(), slots.end(), empty_slot);
+		spill_head.resize(num_pixels);
+		std::fill(spill_head.begin(), spill_head.end(), -1);
+		spill.clear();
+	}
+
+	/* Add weight of the given ID to the pixel. With init set the weight
+	 * replaces whatever was accumulated for that ID so far. */
+	ccl_always_inline void accumulate(int pixel, float id, float weight, bool init)
+	{
+		kernel_assert(pixel >= 0 && pixel < num_pixels);
+
+		if(weight == 0.0f) {
+			return;
+		}
+
+		CoverageSlot *pixel_slots = &slots[pixel * COVERAGE_PIXEL_SLOTS];
+		/* IDs are hashes already, so their low bits are good enough to pick
+		 * the first probe. */
+		uint start = __float_as_uint(id);
+		for(int i = 0; i < COVERAGE_PIXEL_SLOTS; i++) {
+			CoverageSlot *slot = &pixel_slots[(start + i) & (COVERAGE_PIXEL_SLOTS - 1)];
+			if(slot->weight == 0.0f) {
+				slot->id = id;
+				slot->weight = weight;
+				return;
+			}
+			else if(slot->id == id) {
+				slot->weight = init? weight: slot->weight + weight;
+				return;
+			}
+		}
+
+		/* All slots of the pixel are taken, look in the spill chain. */
+		int *link = &spill_head[pixel];
+		while(*link != -1) {
+			CoverageSlot *slot = &spill[*link].slot;
+			if(slot->id == id) {
+				slot->weight = init? weight: slot->weight + weight;
+				return;
+			}
+			link = &spill[*link].next;
+		}
+
+		CoverageSpill entry;
+		entry.slot.id = id;
+		entry.slot.weight = weight;
+		entry.next = -1;
+		*link = (int)spill.size();
+		spill.push_back(entry);
+	}
+
+	/* Scale weights of all IDs of the pixel. */
+	void scale(int pixel, float scale)
+	{
+		CoverageSlot *pixel_slots = &slots[pixel * COVERAGE_PIXEL_SLOTS];
+		for(int i = 0; i < COVERAGE_PIXEL_SLOTS; i++) {
+			pixel_slots[i].weight *= scale;
+		}
+		for(int link = spill_head[pixel]; link != -1; link = spill[link].next) {
+			spill[link].slot.weight *= scale;
+		}
+	}
+
+	/* Append all IDs of the pixel with non-zero weight to the array, returns
+	 * the number of IDs appended. */
+	int gather(int pixel, vector<CoverageSlot>& r_slots) const
+	{
+		size_t num_slots = r_slots.size();
+		const CoverageSlot *pixel_slots = &slots[pixel * COVERAGE_PIXEL_SLOTS];
+		for(int i = 0; i < COVERAGE_PIXEL_SLOTS; i++) {
+			if(pixel_slots[i].weight != 0.0f) {
+				r_slots.push_back(pixel_slots[i]);
+			}
+		}
+		for(int link = spill_head[pixel]; link != -1; link = spill[link].next) {
+			r_slots.push_back(spill[link].slot);
+		}
+		return (int)(r_slots.size() - num_slots);
+	}
+
+protected:
+	int num_pixels;
+	vector<CoverageSlot> slots;
+	vector<int> spill_head;
+	vector<CoverageSpill> spill;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_COVERAGE_H__ */
@@ -21,7 +21,7 @@
 #ifdef __KERNEL_CPU__
 #include <vector>
 #include "util/util_vector.h"
-#include "util/util_map.h"
+#include "kernel/kernel_coverage.h"
 #endif
 
 CCL_NAMESPACE_BEGIN
@@ -83,12 +83,14 @@ typedef struct KernelGlobals {
 	VolumeStep *decoupled_volume_steps[2];
 	int decoupled_volume_steps_index;
 
-	/* A buffer for storing per-pixel coverage for Cryptomatte. */
-	map<float, float> *coverage_object;
-	map<float, float> *coverage_object_index;
-	map<float, float> *coverage_material;
-	map<float, float> *coverage_material_index;
-	map<float, float> *coverage_asset;
+	/* Buffers for storing per-pixel coverage for Cryptomatte, and the index
+	 * of the pixel currently being rendered inside the tile. */
+	CoverageBuffer *coverage_object;
+	CoverageBuffer *coverage_object_index;
+	CoverageBuffer *coverage_material;
+	CoverageBuffer *coverage_material_index;
+	CoverageBuffer *coverage_asset;
+	int coverage_pixel;
 
 	/* split kernel */
 	SplitData split_data;
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include "kernel/kernel_light_tree.h"
+
 CCL_NAMESPACE_BEGIN
 
 /* Light Sample result */
@@ -828,7 +830,7 @@ ccl_device_inline float triangle_light_pdf_area(KernelGlobals *kg, const float3
 	return t*t*pdf/cos_pi;
 }
 
-ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *sd, float t)
+ccl_device_forceinline float triangle_light_distribution_pdf(KernelGlobals *kg, ShaderData *sd, float t)
 {
 	/* A naive heuristic to decide between costly solid angle sampling
 	 * and simple area sampling, comparing the distance to the triangle plane
@@ -895,6 +897,19 @@ ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *s
 	}
 }
 
+ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *sd, float t)
+{
+	float pdf = triangle_light_distribution_pdf(kg, sd, t);
+
+	if(kernel_data.integrator.use_light_tree && pdf != 0.0f) {
+		/* sd contains the point on the light source, the tree picks the
+		 * triangle based on the point that we're shading */
+		pdf *= light_tree_triangle_pdf_scale(kg, sd->object, sd->prim, sd->P + sd->I * t);
+	}
+
+	return pdf;
+}
+
 ccl_device_forceinline void triangle_light_sample(KernelGlobals *kg, int prim, int object,
 	float randu, float randv, float time, LightSample *ls, const float3 P)
 {
@@ -1091,11 +1106,23 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
                                       uint light_linking,
                                       LightSample *ls)
 {
-	/* sample index */
-	int index = light_distribution_sample(kg, randt);
+	float4 l;
+	float pick_pdf = 1.0f;
+	bool in_tree = false;
+
+	if(kernel_data.integrator.use_light_tree) {
+		int index = light_tree_sample(kg, P, randt, &pick_pdf);
+		in_tree = (index < kernel_data.integrator.light_tree_num_emitters);
+		l = kernel_tex_fetch(__light_tree_emitters, index*LIGHT_TREE_EMITTER_SIZE);
+	}
+	else {
+		/* sample index */
+		int index = light_distribution_sample(kg, randt);
+
+		/* fetch light data */
+		l = kernel_tex_fetch(__light_distribution, index);
+	}
 
-	/* fetch light data */
-	float4 l = kernel_tex_fetch(__light_distribution, index);
 	int prim = __float_as_int(l.y);
 
 	if(prim >= 0) {
@@ -1104,6 +1131,12 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 
 		triangle_light_sample(kg, prim, object, randu, randv, time, ls, P);
 		ls->shader |= shader_flag;
+
+		if(in_tree) {
+			/* replace probability of picking the triangle from the distribution */
+			ls->pdf *= pick_pdf / l.x;
+		}
+
 		return (ls->pdf > 0.0f);
 	}
 	else {
@@ -1118,7 +1151,16 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 			return false;
 		}
 
-		return lamp_light_sample(kg, lamp, randu, randv, P, ls);
+		if(!lamp_light_sample(kg, lamp, randu, randv, P, ls)) {
+			return false;
+		}
+
+		if(in_tree) {
+			/* replace uniform probability of picking the lamp */
+			ls->eval_fac *= kernel_data.integrator.pdf_lights / pick_pdf;
+		}
+
+		return true;
 	}
 }
 
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Tree
+ *
+ * Picks an emitter proportional to its estimated contribution at the shading
+ * point, by walking down a hierarchy built over all emissive triangles and
+ * lamps with a position. Infinite lamps keep the probability they have in
+ * the light distribution, and are picked uniformly.
+ *
+ * Node layout, in float4 units:
+ *   0  bounding box min, energy
+ *   1  bounding box max, right child, or -emitter-1 for leaves
+ *   2  cone axis, theta_o
+ *   3  theta_e, parent
+ *
+ * Emitter layout, in float4 units:
+ *   0  distribution pdf, prim (~lamp for lamps), shader flag, object
+ *   1  leaf node
+ */
+
+ccl_device float light_tree_node_importance(KernelGlobals *kg, float3 P, int node)
+{
+	float4 data0 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0);
+	float energy = data0.w;
+
+	if(energy == 0.0f) {
+		return 0.0f;
+	}
+
+	float4 data1 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1);
+	float3 bbox_min = make_float3(data0.x, data0.y, data0.z);
+	float3 bbox_max = make_float3(data1.x, data1.y, data1.z);
+
+	float3 D = P - 0.5f*(bbox_min + bbox_max);
+	float distance_squared = len_squared(D);
+	float radius_squared = 0.25f*len_squared(bbox_max - bbox_min);
+
+	/* Bound the angle between the emission cone and the shading point, there
+	 * is no useful bound once the point is inside the bounding sphere. */
+	float cos_theta = 1.0f;
+
+	if(distance_squared > radius_squared) {
+		float4 data2 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2);
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+		float3 axis = make_float3(data2.x, data2.y, data2.z);
+		float theta_o = data2.w;
+		float theta_e = data3.x;
+
+		float distance = sqrtf(distance_squared);
+		float theta = safe_acosf(dot(axis, D) / distance);
+		float theta_u = safe_asinf(sqrtf(radius_squared / distance_squared));
+		float theta_p = max(theta - theta_o - theta_u, 0.0f);
+
+		if(theta_p >= theta_e) {
+			return 0.0f;
+		}
+
+		cos_theta = cosf(theta_p);
+	}
+
+	return energy * cos_theta / max(max(distance_squared, radius_squared), 1e-8f);
+}
+
+/* Probability of going down the left child of an inner node. */
+ccl_device float light_tree_left_probability(KernelGlobals *kg, float3 P, int left, int right)
+{
+	float importance_left = light_tree_node_importance(kg, P, left);
+	float importance_right = light_tree_node_importance(kg, P, right);
+
+	if(importance_left + importance_right == 0.0f) {
+		/* Fall back to energy when both are culled or too far to estimate. */
+		importance_left = kernel_tex_fetch(__light_tree_nodes, left*LIGHT_TREE_NODE_SIZE).w;
+		importance_right = kernel_tex_fetch(__light_tree_nodes, right*LIGHT_TREE_NODE_SIZE).w;
+
+		if(importance_left + importance_right == 0.0f) {
+			return 0.5f;
+		}
+	}
+
+	return importance_left / (importance_left + importance_right);
+}
+
+/* Pick an emitter, returning the probability of picking it. Emitters after
+ * light_tree_num_emitters are infinite lamps outside of the tree. */
+ccl_device int light_tree_sample(KernelGlobals *kg, float3 P, float randt, float *pick_pdf)
+{
+	float infinite_pdf = kernel_data.integrator.light_tree_infinite_pdf;
+	int num_emitters = kernel_data.integrator.light_tree_num_emitters;
+
+	if(randt < infinite_pdf) {
+		int num_infinite = kernel_data.integrator.light_tree_num_infinite;
+		int index = min((int)(randt / infinite_pdf * num_infinite), num_infinite - 1);
+		*pick_pdf = kernel_data.integrator.pdf_lights;
+		return num_emitters + index;
+	}
+
+	randt = (randt - infinite_pdf) / (1.0f - infinite_pdf);
+	float pdf = 1.0f - infinite_pdf;
+	int node = 0;
+
+	while(true) {
+		int child = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1).w);
+
+		if(child < 0) {
+			*pick_pdf = pdf;
+			return -child-1;
+		}
+
+		float prob_left = light_tree_left_probability(kg, P, node + 1, child);
+
+		/* Reuse the random number for the next level. */
+		if(randt < prob_left) {
+			randt = randt / prob_left;
+			pdf *= prob_left;
+			node = node + 1;
+		}
+		else {
+			randt = (randt - prob_left) / (1.0f - prob_left);
+			pdf *= 1.0f - prob_left;
+			node = child;
+		}
+
+		randt = min(randt, 1.0f - 1e-6f);
+	}
+}
+
+/* Probability of picking an emitter in the tree, walking up from its leaf. */
+ccl_device float light_tree_emitter_pdf(KernelGlobals *kg, float3 P, int emitter)
+{
+	float pdf = 1.0f - kernel_data.integrator.light_tree_infinite_pdf;
+	int node = __float_as_int(kernel_tex_fetch(__light_tree_emitters, emitter*LIGHT_TREE_EMITTER_SIZE + 1).x);
+
+	while(node != 0) {
+		int parent = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3).y);
+		int right = __float_as_int(kernel_tex_fetch(__light_tree_nodes, parent*LIGHT_TREE_NODE_SIZE + 1).w);
+		float prob_left = light_tree_left_probability(kg, P, parent + 1, right);
+
+		pdf *= (node == parent + 1) ? prob_left : 1.0f - prob_left;
+		node = parent;
+	}
+
+	return pdf;
+}
+
+/* Factor to go from the probability of picking an emissive triangle from the
+ * light distribution to picking it from the tree, zero for triangles which
+ * are not in the tree. */
+ccl_device float light_tree_triangle_pdf_scale(KernelGlobals *kg, int object, int prim, float3 P)
+{
+	uint base = kernel_tex_fetch(__light_tree_triangles, object*2 + 0);
+
+	if(base == ~0u) {
+		return 0.0f;
+	}
+
+	uint tri_offset = kernel_tex_fetch(__light_tree_triangles, object*2 + 1);
+	uint emitter = kernel_tex_fetch(__light_tree_triangles, base + prim - tri_offset);
+
+	if(emitter == ~0u) {
+		return 0.0f;
+	}
+
+	float distribution_pdf = kernel_tex_fetch(__light_tree_emitters, emitter*LIGHT_TREE_EMITTER_SIZE).x;
+	return light_tree_emitter_pdf(kg, P, emitter) / distribution_pdf;
+}
+
+CCL_NAMESPACE_END
@@ -239,11 +239,7 @@ ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global fl
 				float id = object_cryptomatte_name(kg, ccl_fetch(sd, object));
 		#ifdef __KERNEL_CPU__
 				if(kg->coverage_object) {
-					if(initialize_slots) {
-						(*kg->coverage_object)[id] = matte_weight;
-					} else {
-						(*kg->coverage_object)[id] += matte_weight;
-					}
+					kg->coverage_object->accumulate(kg->coverage_pixel, id, matte_weight, initialize_slots);
 				}
 				else {
 		#endif /* __KERNEL_CPU__ */
@@ -260,11 +256,7 @@ ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global fl
 				float id = object_cryptomatte_pass(kg, ccl_fetch(sd, object));
 #ifdef __KERNEL_CPU__
 				if(kg->coverage_object_index) {
-					if(initialize_slots) {
-						(*kg->coverage_object_index)[id] = matte_weight;
-					} else {
-						(*kg->coverage_object_index)[id] += matte_weight;
-					}
+					kg->coverage_object_index->accumulate(kg->coverage_pixel, id, matte_weight, initialize_slots);
 				}
 				else {
 #endif /* __KERNEL_CPU__ */
@@ -281,11 +273,7 @@ ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global fl
 				float id = shader_cryptomatte_name(kg, ccl_fetch(sd, shader));
 		#ifdef __KERNEL_CPU__
 				if(kg->coverage_material) {
-					if(initialize_slots) {
-						(*kg->coverage_material)[id] = matte_weight;
-					} else {
-						(*kg->coverage_material)[id] += matte_weight;
-					}
+					kg->coverage_material->accumulate(kg->coverage_pixel, id, matte_weight, initialize_slots);
 				}
 				else {
 		#endif /* __KERNEL_CPU__ */
@@ -302,11 +290,7 @@ ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global fl
 				float id = shader_cryptomatte_pass(kg, ccl_fetch(sd, shader));
 #ifdef __KERNEL_CPU__
 				if(kg->coverage_material_index) {
-					if(initialize_slots) {
-						(*kg->coverage_material_index)[id] = matte_weight;
-					} else {
-						(*kg->coverage_material_index)[id] += matte_weight;
-					}
+					kg->coverage_material_index->accumulate(kg->coverage_pixel, id, matte_weight, initialize_slots);
 				}
 				else {
 #endif /* __KERNEL_CPU__ */
@@ -323,11 +307,7 @@ ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global fl
 				float id = object_cryptomatte_asset_name(kg, ccl_fetch(sd, object));
 #ifdef __KERNEL_CPU__
 				if(kg->coverage_asset) {
-					if(initialize_slots) {
-						(*kg->coverage_asset)[id] = matte_weight;
-					} else {
-						(*kg->coverage_asset)[id] += matte_weight;
-					}
+					kg->coverage_asset->accumulate(kg->coverage_pixel, id, matte_weight, initialize_slots);
 				}
 				else {
 #endif /* __KERNEL_CPU__ */
@@ -429,10 +409,26 @@ ccl_device_inline void kernel_write_light_passes(KernelGlobals *kg, ccl_global f
 #endif
 }
 
+/* Second estimate of the combined pass for adaptive sampling, made from every
+ * other sample only and scaled to match the number of samples of the combined
+ * pass. The last component is left to the adaptive sampling on the host. */
+ccl_device_inline void kernel_write_adaptive_pass(KernelGlobals *kg, ccl_global float *buffer, int sample, float3 L_sum)
+{
+	int index = sample - kernel_data.integrator.start_sample;
+	if(index & 1) {
+		kernel_write_pass_float4(buffer + kernel_data.film.pass_adaptive,
+		                         index/2,
+		                         make_float4(2.0f*L_sum.x, 2.0f*L_sum.y, 2.0f*L_sum.z, 0.0f));
+	}
+}
+
 ccl_device_inline void kernel_write_result(KernelGlobals *kg, ccl_global float *buffer, int sample, PathRadiance *L, float L_transparent, bool is_shadowcatcher)
 {
 	if(!L) {
 		kernel_write_pass_float4(buffer, sample, make_float4(0.0f, 0.0f, 0.0f, 0.0f));
+		if(kernel_data.film.pass_adaptive) {
+			kernel_write_adaptive_pass(kg, buffer, sample, make_float3(0.0f, 0.0f, 0.0f));
+		}
 		return;
 	}
 
@@ -468,6 +464,10 @@ ccl_device_inline void kernel_write_result(KernelGlobals *kg, ccl_global float *
 		kernel_write_pass_float3_variance(buffer + kernel_data.film.pass_denoising + 20, sample, ensure_finite3(L_sum));
 	}
 
+	if(kernel_data.film.pass_adaptive) {
+		kernel_write_adaptive_pass(kg, buffer, sample, L_sum);
+	}
+
 	kernel_write_pass_float4(buffer, sample, make_float4(L_sum.x, L_sum.y, L_sum.z, 1.0f - L_transparent));
 }
 
@@ -44,6 +44,8 @@ CCL_NAMESPACE_BEGIN
 #define OBJECT_SIZE 		17
 #define OBJECT_VECTOR_SIZE	6
 #define LIGHT_SIZE		13
+#define LIGHT_TREE_NODE_SIZE	4
+#define LIGHT_TREE_EMITTER_SIZE	2
 #define FILTER_TABLE_SIZE	1024
 #define RAMP_TABLE_SIZE		256
 #define SHUTTER_TABLE_SIZE		256
@@ -79,6 +81,9 @@ CCL_NAMESPACE_BEGIN
 #  ifdef __KERNEL_SSE2__
 #    define __QBVH__
 #  endif
+#  ifdef __KERNEL_AVX2__
+#    define __OBVH__
+#  endif
 #  define __KERNEL_SHADING__
 #  define __KERNEL_ADV_SHADING__
 #  ifndef __SPLIT_KERNEL__
@@ -1193,7 +1198,7 @@ typedef struct KernelFilm {
 	float mist_falloff;
 
 	int pass_denoising;
-	int pass_pad0;
+	int pass_adaptive;
 	int pass_pad1;
 	int pass_pad2;
 
@@ -1238,6 +1243,12 @@ typedef struct KernelIntegrator {
 	int num_portals;
 	int portal_offset;
 
+	/* light tree, emitters with a position followed by infinite lamps */
+	int use_light_tree;
+	int light_tree_num_emitters;
+	int light_tree_num_infinite;
+	float light_tree_infinite_pdf;
+
 	/* bounces */
 	int min_bounce;
 	int max_bounce;
@@ -1293,10 +1304,23 @@ typedef struct KernelIntegrator {
 	float light_inv_rr_threshold;
 
 	int start_sample;
-	int pad1, pad2, pad3;
+
+	/* adaptive sampling, disabled with zero threshold */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+	int pad1;
 } KernelIntegrator;
 static_assert_align(KernelIntegrator, 16);
 
+/* Memory layout of BVH nodes, which also selects the traversal code used by
+ * the kernel. Wider layouts are only supported by CPU kernels with the
+ * matching instruction set: BVH4 needs SSE2 and BVH8 needs AVX2. */
+typedef enum BVHLayout {
+	BVH_LAYOUT_BVH2 = 0,
+	BVH_LAYOUT_BVH4 = 1,
+	BVH_LAYOUT_BVH8 = 2,
+} BVHLayout;
+
 typedef struct KernelBVH {
 	/* root node */
 	int root;
@@ -1304,7 +1328,7 @@ typedef struct KernelBVH {
 	int have_motion;
 	int have_curves;
 	int have_instancing;
-	int use_qbvh;
+	int bvh_layout;
 	int use_bvh_steps;
 	int pad1;
 #ifdef __EMBREE__
@@ -20,12 +20,17 @@ CCL_NAMESPACE_BEGIN
 
 ccl_device void svm_node_math(KernelGlobals *kg, ShaderData *sd, float *stack, uint itype, uint f1_offset, uint f2_offset, int *offset)
 {
+	uint4 node1 = read_node(kg, offset);
+	uint use_clamp = node1.x;
+
 	NodeMath type = (NodeMath)itype;
-	float f1 = stack_load_float(stack, f1_offset);
-	float f2 = stack_load_float(stack, f2_offset);
+	float f1 = (stack_valid(f1_offset))? stack_load_float(stack, f1_offset): __uint_as_float(node1.z);
+	float f2 = (stack_valid(f2_offset))? stack_load_float(stack, f2_offset): __uint_as_float(node1.w);
 	float f = svm_math(type, f1, f2);
 
-	uint4 node1 = read_node(kg, offset);
+	if(use_clamp) {
+		f = saturate(f);
+	}
 
 	stack_store_float(stack, node1.y, f);
 }
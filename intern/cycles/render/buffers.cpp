@@ -139,6 +139,30 @@ bool RenderBuffers::copy_from_device()
 	return true;
 }
 
+bool RenderBuffers::copy_to_device()
+{
+	if(!buffer.device_pointer)
+		return false;
+
+	device->mem_copy_to(buffer);
+
+	return true;
+}
+
+void RenderBuffers::accumulate(const RenderBuffers& other)
+{
+	assert(buffer.data_size == other.buffer.data_size);
+
+	/* All passes are sums over samples, only divided when read. */
+	float *data = buffer.get_data();
+	const float *other_data = (const float*)other.buffer.data_pointer;
+	size_t size = buffer.size();
+
+	for(size_t i = 0; i < size; i++) {
+		data[i] += other_data[i];
+	}
+}
+
 bool RenderBuffers::get_denoising_pass_rect(string passname, float exposure, int sample, int components, float *pixels)
 {
 	float invsample = 1.0f/sample;
@@ -79,6 +79,11 @@ public:
 	void reset(Device *device, BufferParams& params);
 
 	bool copy_from_device();
+	bool copy_to_device();
+
+	/* Add samples rendered into other buffers of the same size, both must
+	 * have been copied from the device. */
+	void accumulate(const RenderBuffers& other);
 	bool get_denoising_pass_rect(string passname, float exposure, int sample, int components, float *pixels);
 	bool get_pass_rect(PassType type, float exposure, int sample, int components, float *pixels);
 	bool get_aov_rect(ustring name, float exposure, int sample, int components, float *pixels);
@@ -28,78 +28,48 @@
 
 CCL_NAMESPACE_BEGIN
 
-static inline void kernel_write_id_slots(float *buffer, int num_slots, float id, float weight, bool init)
-{
-	kernel_assert(id != ID_NONE);
-
-	if(weight == 0.0f) {
-		return;
-	}
-
-	if(init) {
-		for(int slot = 0; slot < num_slots; slot++) {
-			buffer[slot*ID_SLOT_SIZE + 0] = ID_NONE;
-			buffer[slot*ID_SLOT_SIZE + 1] = 0.0f;
-		}
-	} else {
-		init = false;
-	}
-
-	for(int slot = 0; slot < num_slots; slot++) {
-		float *slot_id = (&buffer[slot*ID_SLOT_SIZE + 0]);
-		float *slot_weight = &buffer[slot*ID_SLOT_SIZE + 1];
+static bool crypomatte_comp(const CoverageSlot& i, const CoverageSlot& j) { return i.weight > j.weight; }
 
-		/* If the loop reaches an empty slot, the ID isn't in any slot yet - so add it! */
-		if(*slot_weight == 0.0f) {
-			kernel_assert(*slot_id == ID_NONE);
-			*slot_id = id;
-			*slot_weight = weight;
-			break;
-		}
-		/* If there already is a slot for that ID, add the weight. */
-		else if(*slot_id == id) {
-			*slot_weight += weight;
-			break;
-		}
-	}
-}
+int flatten_coverage(KernelGlobals *kg, const CoverageBuffer& coverage, const RenderTile &tile, const int aov_index)
+{
+	/* sort the coverage of every pixel and write it to the output */
+	int num_slots = 2 * (kg->__data.film.use_cryptomatte & 255);
+	int pass_stride = kg->__data.film.pass_stride;
+	int pass_offset = (kg->__data.film.pass_aov[aov_index] & ~(1 << 31));
 
-static bool crypomatte_comp(const std::pair<float, float>& i, const std::pair<float, float> j) { return i.first > j.first; }
+	/* scratch space for one pixel, reused so sorting doesn't allocate */
+	vector<CoverageSlot> sorted_pixel;
+	sorted_pixel.reserve(COVERAGE_PIXEL_SLOTS * 2);
 
-int flatten_coverage(KernelGlobals *kg, vector<map<float, float> > & coverage, const RenderTile &tile, const int aov_index)
-{
-	/* sort the coverage map and write it to the output */
 	int index = 0;
 	for(int y = 0; y < tile.h; y++) {
-		for(int x = 0; x < tile.w; x++) {
-			const map<float, float>& pixel = coverage[index];
-			if(!pixel.empty()) {
-				/* buffer offset */
-				int index = x + y*tile.stride;
-				int pass_stride = kg->__data.film.pass_stride;
-				float *buffer = (float*)tile.buffer + index*pass_stride;
+		for(int x = 0; x < tile.w; x++, index++) {
+			sorted_pixel.clear();
+			int num_ids = coverage.gather(index, sorted_pixel);
+			if(num_ids == 0) {
+				continue;
+			}
 
-				/* sort the cryptomatte pixel */
-				vector<std::pair<float, float> > sorted_pixel;
-				for(map<float, float>::const_iterator it = pixel.begin(); it != pixel.end(); ++it) {
-					sorted_pixel.push_back(std::make_pair(it->second, it->first));
-				}
-				sort(sorted_pixel.begin(), sorted_pixel.end(), crypomatte_comp);
-				int num_slots = 2 * (kg->__data.film.use_cryptomatte & 255);
-				if(sorted_pixel.size() > num_slots) {
-					float leftover = 0.0f;
-					for(vector<pair<float, float> >::iterator it = sorted_pixel.begin()+num_slots; it != sorted_pixel.end(); it++) {
-						leftover += it->first;
-					}
-					sorted_pixel[num_slots-1].first += leftover;
-				}
-				int limit = min(num_slots, sorted_pixel.size());
-				for(int i = 0; i < limit; i++) {
-					int pass_offset = (kg->__data.film.pass_aov[aov_index] & ~(1 << 31));
-					kernel_write_id_slots(buffer + pass_offset, 2 * (kg->__data.film.use_cryptomatte & 255), sorted_pixel[i].second, sorted_pixel[i].first, i == 0);
+			/* buffer offset */
+			int buffer_index = x + y*tile.stride;
+			float *buffer = (float*)tile.buffer + buffer_index*pass_stride + pass_offset;
+
+			/* sort the cryptomatte pixel, IDs are unique so the sorted list can
+			 * be written to the slots as is */
+			sort(sorted_pixel.begin(), sorted_pixel.end(), crypomatte_comp);
+			if(num_ids > num_slots) {
+				float leftover = 0.0f;
+				for(int i = num_slots; i < num_ids; i++) {
+					leftover += sorted_pixel[i].weight;
 				}
+				sorted_pixel[num_slots-1].weight += leftover;
+			}
+
+			int limit = min(num_slots, num_ids);
+			for(int slot = 0; slot < num_slots; slot++) {
+				buffer[slot*ID_SLOT_SIZE + 0] = (slot < limit)? sorted_pixel[slot].id: ID_NONE;
+				buffer[slot*ID_SLOT_SIZE + 1] = (slot < limit)? sorted_pixel[slot].weight: 0.0f;
 			}
-			index++;
 		}
 	}
 
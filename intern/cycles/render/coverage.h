@@ -14,8 +14,6 @@
  * limitations under the License.
  */
 
-#include "util/util_map.h"
-#include "util/util_vector.h"
 #include "render/buffers.h"
 
 #ifndef __COVERAGE_H__
@@ -24,8 +22,9 @@
 CCL_NAMESPACE_BEGIN
 
 struct KernelGlobals;
+class CoverageBuffer;
 
-int flatten_coverage(KernelGlobals *kg, vector<map<float, float> >&coverage, const RenderTile &tile, const int aov_index);
+int flatten_coverage(KernelGlobals *kg, const CoverageBuffer& coverage, const RenderTile &tile, const int aov_index);
 
 CCL_NAMESPACE_END
 
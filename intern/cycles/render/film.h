@@ -95,7 +95,12 @@ public:
 	void add(PassType type);
 	void add(AOV aov);
 
+	const array<Pass>& get_passes() const { return passes; }
+	const array<AOV>& get_aovs() const { return aovs; }
+
 	bool denoising_passes;
+	/* second estimate of the combined pass for adaptive sampling */
+	bool adaptive_passes;
 
 protected:
 	array<Pass> passes;
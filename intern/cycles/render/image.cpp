@@ -20,9 +20,11 @@
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
+#include "util/util_md5.h"
 #include "util/util_path.h"
 #include "util/util_progress.h"
 #include "util/util_texture.h"
+#include "util/util_time.h"
 
 #ifdef WITH_OSL
 #include <OSL/oslexec.h>
@@ -250,6 +252,20 @@ ImageDataType ImageManager::get_image_metadata(const string& filename,
 	return type;
 }
 
+/* A converted file is only used while it's not older than its source. Files
+ * in the cache directory are named after the contents of their source, they
+ * are always current but may come from a source with another time stamp on
+ * a different computer. */
+static bool tx_is_current(const string& filename, const string& tx_filename, const string& cache_path)
+{
+	if(!path_exists(tx_filename)) {
+		return false;
+	}
+
+	return !cache_path.empty() ||
+	       path_modified_time(tx_filename) >= path_modified_time(filename);
+}
+
 const string ImageManager::get_mip_map_path(const string& filename)
 {
 	if(!path_exists(filename)) {
@@ -265,7 +281,7 @@ const string ImageManager::get_mip_map_path(const string& filename)
 	}
 	
 	string tx_name = filename.substr(0, idx) + ".tx";
-	if(path_exists(tx_name)) {
+	if(tx_is_current(filename, tx_name, "")) {
 		return tx_name;
 	}
 
@@ -768,7 +784,10 @@ void ImageManager::device_load_image(Device *device,
 	if(oiio_texture_system && !img->builtin_data) {
 		/* Get or generate a mip mapped tile image file.
 		 * If we have a mip map, assume it's linear, not sRGB. */
-		bool have_mip = get_tx(img, progress, scene->params.texture.auto_convert);
+		bool have_mip = get_tx(img,
+		                       progress,
+		                       scene->params.texture.auto_convert,
+		                       scene->params.texture.tx_cache_path);
 
 		/* When using OIIO directly from SVM, store the TextureHandle
 		 * in an array for quicker lookup at shading time */
@@ -1235,6 +1254,8 @@ void ImageManager::device_update(Device *device,
 	/* Make sure arrays are proper size. */
 	device_prepare_update(dscene);
 
+	device_update_tx(scene, progress);
+
 	TaskPool pool;
 	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
 		for(size_t slot = 0; slot < images[type].size(); slot++) {
@@ -1540,7 +1561,83 @@ bool ImageManager::make_tx(const string &filename, const string &outputfilename,
 	return ImageBufAlgo::make_texture(ImageBufAlgo::MakeTxTexture, filename, outputfilename, config);
 }
 
-bool ImageManager::get_tx(Image *image, Progress *progress, bool auto_convert)
+string ImageManager::get_tx_filename(const string& filename, bool srgb, const string& cache_path)
+{
+	string::size_type idx = filename.rfind('.');
+	string base = filename.substr(0, idx);
+
+	if(cache_path.empty()) {
+		return base + ".tx";
+	}
+
+	/* Hashing reads the full source image, only redo it when the size or
+	 * time stamp of the file change. */
+	size_t size = path_file_size(filename);
+	uint64_t mtime = path_modified_time(filename);
+	string hash;
+
+	{
+		thread_scoped_lock lock(tx_mutex);
+		map<string, TxSource>::iterator it = tx_sources.find(filename);
+		if(it != tx_sources.end() && it->second.size == size && it->second.mtime == mtime) {
+			hash = it->second.hash;
+		}
+	}
+
+	if(hash.empty()) {
+		MD5Hash md5;
+		if(!md5.append_file(filename)) {
+			return "";
+		}
+		hash = md5.get_hex();
+
+		thread_scoped_lock lock(tx_mutex);
+		TxSource& source = tx_sources[filename];
+		source.size = size;
+		source.mtime = mtime;
+		source.hash = hash;
+	}
+
+	return path_join(cache_path, path_filename(base) + "-" + hash + ((srgb)? "-srgb.tx": ".tx"));
+}
+
+bool ImageManager::convert_tx(const string& filename, const string& tx_filename, bool srgb)
+{
+	/* Don't retry failed conversions until the source changes. */
+	string failed_key = string_printf("%s %llu",
+	                                  tx_filename.c_str(),
+	                                  (unsigned long long)path_modified_time(filename));
+
+	{
+		thread_scoped_lock lock(tx_mutex);
+		if(tx_failed.find(failed_key) != tx_failed.end()) {
+			return false;
+		}
+	}
+
+	/* Write to a temporary file first, so other threads and processes using
+	 * the same file never see a partial conversion. */
+	string tmp_filename = string_printf("%s.%p.%llx.tx",
+	                                    tx_filename.c_str(),
+	                                    (void*)&failed_key,
+	                                    (unsigned long long)(time_dt() * 1e6));
+
+	path_create_directories(tx_filename);
+
+	if(!make_tx(filename, tmp_filename, srgb) || !path_rename(tmp_filename, tx_filename)) {
+		VLOG(1) << "Failed to convert " << filename << " to " << tx_filename << ".";
+		path_remove(tmp_filename);
+
+		thread_scoped_lock lock(tx_mutex);
+		tx_failed.insert(failed_key);
+		return false;
+	}
+
+	VLOG(2) << "Converted " << filename << " to " << tx_filename << ".";
+	return true;
+}
+
+bool ImageManager::get_tx(Image *image, Progress *progress, bool auto_convert, const string& cache_path)
 {
 	if(!path_exists(image->filename)) {
 		return false;
@@ -1554,22 +1651,134 @@ bool ImageManager::get_tx(Image *image, Progress *progress, bool auto_convert)
 		}
 	}
 	
-	string tx_name = image->filename.substr(0, idx) + ".tx";
-	if(path_exists(tx_name)) {
-		image->filename = tx_name;
-		return true;
+	string tx_name = get_tx_filename(image->filename, image->srgb, cache_path);
+	if(tx_name.empty()) {
+		return false;
 	}
-	
-	if(auto_convert) {
+
+	if(!tx_is_current(image->filename, tx_name, cache_path)) {
+		if(!auto_convert) {
+			return false;
+		}
+
 		progress->set_status("Updating Images", "Converting " + image->filename);
-	
-		bool ok = make_tx(image->filename, tx_name, image->srgb);
-		if(ok) {
-			image->filename = tx_name;
-		return true;
+
+		if(!convert_tx(image->filename, tx_name, image->srgb)) {
+			return false;
 		}
 	}
-	return false;
+
+	image->filename = tx_name;
+	return true;
+}
+
+/* Convert all images that are about to be loaded in parallel, before any of
+ * them is loaded, rather than one after the other from the loading tasks. */
+void ImageManager::device_update_tx(Scene *scene, Progress& progress)
+{
+	const TextureCacheParams& params = scene->params.texture;
+
+	if(!oiio_texture_system || !params.auto_convert) {
+		return;
+	}
+
+	vector<TxConversion> conversions;
+	set<string> sources;
+
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		foreach(Image *img, images[type]) {
+			if(!img || img->users == 0 || !img->need_load || img->builtin_data) {
+				continue;
+			}
+			if(string_endswith(img->filename, ".tx")) {
+				continue;
+			}
+			if(!sources.insert(img->filename + ((img->srgb)? " srgb": "")).second) {
+				continue;
+			}
+
+			TxConversion conversion;
+			conversion.filename = img->filename;
+			conversion.srgb = img->srgb;
+			conversion.convert = false;
+			conversions.push_back(conversion);
+		}
+	}
+
+	if(conversions.empty()) {
+		return;
+	}
+
+	/* Hashing sources for the cache directory is slow too. */
+	progress.set_status("Updating Images", "Checking converted textures");
+
+	TaskPool pool;
+	foreach(TxConversion& conversion, conversions) {
+		pool.push(function_bind(&ImageManager::device_check_tx,
+		                        this,
+		                        &conversion,
+		                        params.tx_cache_path));
+	}
+	pool.wait_work();
+
+	int num_convert = 0;
+	foreach(TxConversion& conversion, conversions) {
+		num_convert += conversion.convert;
+	}
+
+	if(num_convert == 0 || progress.get_cancel()) {
+		return;
+	}
+
+	progress.set_status("Updating Images",
+	                    string_printf("Converting textures 0/%d", num_convert));
+
+	int num_done = 0;
+	foreach(TxConversion& conversion, conversions) {
+		if(conversion.convert) {
+			pool.push(function_bind(&ImageManager::device_convert_tx,
+			                        this,
+			                        &conversion,
+			                        &progress,
+			                        &num_done,
+			                        num_convert));
+		}
+	}
+	pool.wait_work();
+
+	VLOG(1) << "Converted " << num_convert << " textures to .tx files.";
+}
+
+void ImageManager::device_check_tx(TxConversion *conversion, const string& cache_path)
+{
+	if(!path_exists(conversion->filename)) {
+		return;
+	}
+
+	conversion->tx_filename = get_tx_filename(conversion->filename,
+	                                          conversion->srgb,
+	                                          cache_path);
+	conversion->convert = !conversion->tx_filename.empty() &&
+	                      !tx_is_current(conversion->filename,
+	                                     conversion->tx_filename,
+	                                     cache_path);
+}
+
+void ImageManager::device_convert_tx(TxConversion *conversion,
+                                     Progress *progress,
+                                     int *num_done,
+                                     int num_convert)
+{
+	if(progress->get_cancel()) {
+		return;
+	}
+
+	convert_tx(conversion->filename, conversion->tx_filename, conversion->srgb);
+
+	thread_scoped_lock lock(tx_mutex);
+	(*num_done)++;
+	progress->set_status("Updating Images",
+	                     string_printf("Converting textures %d/%d", *num_done, num_convert));
 }
 
 CCL_NAMESPACE_END
@@ -21,6 +21,8 @@
 #include "device/device_memory.h"
 
 #include "util/util_image.h"
+#include "util/util_map.h"
+#include "util/util_set.h"
 #include "util/util_string.h"
 #include "util/util_thread.h"
 #include "util/util_vector.h"
@@ -171,7 +173,34 @@ private:
 	                        DeviceScene *dscene,
 	                        Progress& progess);
 	
-	bool get_tx(Image *image, Progress *progress, bool auto_convert);
+	/* Auto converted .tx files. */
+	struct TxSource {
+		size_t size;
+		uint64_t mtime;
+		string hash;
+	};
+
+	struct TxConversion {
+		string filename;
+		string tx_filename;
+		bool srgb;
+		bool convert;
+	};
+
+	map<string, TxSource> tx_sources;
+	set<string> tx_failed;
+	thread_mutex tx_mutex;
+
+	string get_tx_filename(const string& filename, bool srgb, const string& cache_path);
+	bool convert_tx(const string& filename, const string& tx_filename, bool srgb);
+	bool get_tx(Image *image, Progress *progress, bool auto_convert, const string& cache_path);
+
+	void device_update_tx(Scene *scene, Progress& progress);
+	void device_check_tx(TxConversion *conversion, const string& cache_path);
+	void device_convert_tx(TxConversion *conversion,
+	                       Progress *progress,
+	                       int *num_done,
+	                       int num_convert);
 };
 
 CCL_NAMESPACE_END
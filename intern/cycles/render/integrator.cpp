@@ -66,9 +66,13 @@ NODE_DEFINE(Integrator)
 	SOCKET_INT(volume_samples, "Volume Samples", 1);
 	SOCKET_INT(start_sample, "Start Sample", 0);
 
+	SOCKET_FLOAT(adaptive_threshold, "Adaptive Threshold", 0.0f);
+	SOCKET_INT(adaptive_min_samples, "Adaptive Min Samples", 0);
+
 	SOCKET_BOOLEAN(sample_all_lights_direct, "Sample All Lights Direct", true);
 	SOCKET_BOOLEAN(sample_all_lights_indirect, "Sample All Lights Indirect", true);
 	SOCKET_FLOAT(light_sampling_threshold, "Light Sampling Threshold", 0.05f);
+	SOCKET_BOOLEAN(use_light_tree, "Use Light Tree", false);
 
 	static NodeEnum method_enum;
 	method_enum.insert("path", PATH);
@@ -176,6 +180,16 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 	kintegrator->sampling_pattern = sampling_pattern;
 	kintegrator->aa_samples = aa_samples;
 
+	/* Convergence is tested on an even number of samples, with at least one
+	 * in the adaptive pass. */
+	kintegrator->adaptive_threshold = adaptive_threshold;
+	if(adaptive_min_samples == 0) {
+		kintegrator->adaptive_min_samples = max(4, (int)sqrtf((float)aa_samples));
+	}
+	else {
+		kintegrator->adaptive_min_samples = max(2, adaptive_min_samples);
+	}
+
 	if(light_sampling_threshold > 0.0f) {
 		kintegrator->light_inv_rr_threshold = 1.0f / light_sampling_threshold;
 	}
@@ -228,6 +242,14 @@ bool Integrator::modified(const Integrator& integrator)
 	return !Node::equals(integrator);
 }
 
+bool Integrator::use_light_tree_sampling() const
+{
+	if(method == BRANCHED_PATH && (sample_all_lights_direct || sample_all_lights_indirect)) {
+		return false;
+	}
+	return use_light_tree;
+}
+
 void Integrator::tag_update(Scene *scene)
 {
 	foreach(Shader *shader, scene->shaders) {
@@ -68,10 +68,20 @@ public:
 	int volume_samples;
 	int start_sample;
 
+	/* Stop sampling pixels once their error is below the threshold, which
+	 * is tested after the minimum number of samples, zero picks a minimum
+	 * from the number of AA samples. Disabled with zero threshold. */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+
 	bool sample_all_lights_direct;
 	bool sample_all_lights_indirect;
 	float light_sampling_threshold;
 
+	/* Pick lights from a light tree instead of by area, for scenes with many
+	 * lights. Not used when sampling all lights with branched path. */
+	bool use_light_tree;
+
 	enum Method {
 		BRANCHED_PATH = 0,
 		PATH = 1,
@@ -92,6 +102,7 @@ public:
 	void device_free(Device *device, DeviceScene *dscene);
 
 	bool modified(const Integrator& integrator);
+	bool use_light_tree_sampling() const;
 	void tag_update(Scene *scene);
 };
 
@@ -19,6 +19,7 @@
 #include "render/integrator.h"
 #include "render/film.h"
 #include "render/light.h"
+#include "render/light_tree.h"
 #include "render/mesh.h"
 #include "render/object.h"
 #include "render/scene.h"
@@ -487,6 +488,235 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	}
 }
 
+static float light_tree_shader_energy(Shader *shader)
+{
+	/* Use the emission when it's known, otherwise assume all shaders emit
+	 * about the same. */
+	float3 emission;
+	if(shader->is_constant_emission(&emission)) {
+		return max(average(emission), 0.0f);
+	}
+	return 1.0f;
+}
+
+void LightManager::device_update_light_tree(Device *device,
+                                            DeviceScene *dscene,
+                                            Scene *scene,
+                                            Progress& progress)
+{
+	KernelIntegrator *kintegrator = &dscene->data.integrator;
+
+	kintegrator->use_light_tree = false;
+	kintegrator->light_tree_num_emitters = 0;
+	kintegrator->light_tree_num_infinite = 0;
+	kintegrator->light_tree_infinite_pdf = 0.0f;
+
+	if(!kintegrator->use_direct_light || !scene->integrator->use_light_tree_sampling()) {
+		return;
+	}
+
+	progress.set_status("Updating Lights", "Building light tree");
+
+	vector<LightTreeEmitter> emitters;
+	vector<LightTreeEmitter> infinite;
+
+	/* Map from triangles to emitters, with base and triangle offset for every
+	 * object in front. */
+	vector<uint> triangles(scene->objects.size()*2, ~0u);
+
+	/* triangles, matching the light distribution */
+	int object_id = 0;
+	foreach(Object *object, scene->objects) {
+		if(progress.get_cancel()) return;
+
+		if(!object_usable_as_light(object)) {
+			object_id++;
+			continue;
+		}
+
+		Mesh *mesh = object->mesh;
+		bool transform_applied = mesh->transform_applied;
+		Transform tfm = object->tfm;
+		int shader_flag = 0;
+
+		if(!(object->visibility & PATH_RAY_DIFFUSE))
+			shader_flag |= SHADER_EXCLUDE_DIFFUSE;
+		if(!(object->visibility & PATH_RAY_GLOSSY))
+			shader_flag |= SHADER_EXCLUDE_GLOSSY;
+		if(!(object->visibility & PATH_RAY_TRANSMIT))
+			shader_flag |= SHADER_EXCLUDE_TRANSMIT;
+		if(!(object->visibility & PATH_RAY_VOLUME_SCATTER))
+			shader_flag |= SHADER_EXCLUDE_SCATTER;
+
+		size_t mesh_num_triangles = mesh->num_triangles();
+		triangles[object_id*2 + 0] = triangles.size();
+		triangles[object_id*2 + 1] = mesh->tri_offset;
+		triangles.resize(triangles.size() + mesh_num_triangles, ~0u);
+
+		for(size_t i = 0; i < mesh_num_triangles; i++) {
+			int shader_index = mesh->shader[i];
+			Shader *shader = (shader_index < mesh->used_shaders.size())
+			                         ? mesh->used_shaders[shader_index]
+			                         : scene->default_surface;
+
+			if(!(shader->use_mis && shader->has_surface_emission)) {
+				continue;
+			}
+
+			Mesh::Triangle t = mesh->get_triangle(i);
+			if(!t.valid(&mesh->verts[0])) {
+				continue;
+			}
+
+			float3 p1 = mesh->verts[t.v[0]];
+			float3 p2 = mesh->verts[t.v[1]];
+			float3 p3 = mesh->verts[t.v[2]];
+
+			if(!transform_applied) {
+				p1 = transform_point(&tfm, p1);
+				p2 = transform_point(&tfm, p2);
+				p3 = transform_point(&tfm, p3);
+			}
+
+			float area = triangle_area(p1, p2, p3);
+			if(area == 0.0f) {
+				continue;
+			}
+
+			/* Emits on both sides. */
+			LightTreeEmitter emitter;
+			emitter.bounds = BoundBox::empty;
+			emitter.bounds.grow(p1);
+			emitter.bounds.grow(p2);
+			emitter.bounds.grow(p3);
+			emitter.cone = LightTreeCone(safe_normalize(cross(p2 - p1, p3 - p1)), M_PI_F, M_PI_2_F);
+			emitter.energy = area * light_tree_shader_energy(shader);
+			emitter.prim = i + mesh->tri_offset;
+			emitter.object = object_id;
+			emitter.shader_flag = shader_flag;
+			emitter.distribution_pdf = area * kintegrator->pdf_triangles;
+			emitters.push_back(emitter);
+		}
+
+		object_id++;
+	}
+
+	/* lamps, energy is the intensity towards the axis */
+	int light_index = 0;
+	foreach(Light *light, scene->lights) {
+		if(!light->is_enabled) {
+			continue;
+		}
+
+		Shader *shader = (light->shader) ? light->shader : scene->default_light;
+		float3 dir = safe_normalize(light->dir);
+
+		LightTreeEmitter emitter;
+		emitter.bounds = BoundBox::empty;
+		emitter.energy = light_tree_shader_energy(shader);
+		emitter.prim = ~light_index;
+		emitter.object = 0;
+		emitter.shader_flag = 0;
+		emitter.distribution_pdf = kintegrator->pdf_lights;
+
+		light_index++;
+
+		if(light->type == LIGHT_POINT || light->type == LIGHT_SPOT) {
+			float3 radius = make_float3(light->size, light->size, light->size);
+			emitter.bounds.grow(light->co - radius);
+			emitter.bounds.grow(light->co + radius);
+			emitter.energy *= 0.25f*M_1_PI_F;
+
+			if(light->type == LIGHT_SPOT) {
+				emitter.cone = LightTreeCone(dir, 0.5f*light->spot_angle, M_PI_2_F);
+			}
+			else {
+				emitter.cone = LightTreeCone(dir, M_PI_F, M_PI_2_F);
+			}
+		}
+		else if(light->type == LIGHT_AREA) {
+			float3 axisu = light->axisu*(light->sizeu*light->size);
+			float3 axisv = light->axisv*(light->sizev*light->size);
+			emitter.bounds.grow(light->co - 0.5f*axisu - 0.5f*axisv);
+			emitter.bounds.grow(light->co - 0.5f*axisu + 0.5f*axisv);
+			emitter.bounds.grow(light->co + 0.5f*axisu - 0.5f*axisv);
+			emitter.bounds.grow(light->co + 0.5f*axisu + 0.5f*axisv);
+			emitter.cone = LightTreeCone(dir, 0.0f, M_PI_2_F);
+			emitter.energy *= 0.25f;
+		}
+		else {
+			infinite.push_back(emitter);
+			continue;
+		}
+
+		emitters.push_back(emitter);
+	}
+
+	if(progress.get_cancel()) return;
+
+	LightTree tree(emitters);
+	const vector<LightTreeNode>& nodes = tree.get_nodes();
+
+	/* pack */
+	float4 *knodes = dscene->light_tree_nodes.resize(max(nodes.size(), (size_t)1)*LIGHT_TREE_NODE_SIZE);
+	float4 *kemitters = dscene->light_tree_emitters.resize((emitters.size() + infinite.size())*LIGHT_TREE_EMITTER_SIZE);
+
+	memset(knodes, 0, sizeof(float4)*LIGHT_TREE_NODE_SIZE);
+
+	for(size_t i = 0; i < nodes.size(); i++) {
+		const LightTreeNode& node = nodes[i];
+		int child = (node.is_leaf()) ? -node.emitter-1 : node.child;
+
+		knodes[i*LIGHT_TREE_NODE_SIZE + 0] = make_float4(node.bounds.min.x, node.bounds.min.y, node.bounds.min.z, node.energy);
+		knodes[i*LIGHT_TREE_NODE_SIZE + 1] = make_float4(node.bounds.max.x, node.bounds.max.y, node.bounds.max.z, __int_as_float(child));
+		knodes[i*LIGHT_TREE_NODE_SIZE + 2] = make_float4(node.cone.axis.x, node.cone.axis.y, node.cone.axis.z, node.cone.theta_o);
+		knodes[i*LIGHT_TREE_NODE_SIZE + 3] = make_float4(node.cone.theta_e, __int_as_float(node.parent), 0.0f, 0.0f);
+
+		if(node.is_leaf()) {
+			const LightTreeEmitter& emitter = emitters[node.emitter];
+			kemitters[node.emitter*LIGHT_TREE_EMITTER_SIZE + 0] = make_float4(emitter.distribution_pdf,
+			                                                                  __int_as_float(emitter.prim),
+			                                                                  __int_as_float(emitter.shader_flag),
+			                                                                  __int_as_float(emitter.object));
+			kemitters[node.emitter*LIGHT_TREE_EMITTER_SIZE + 1] = make_float4(__int_as_float(i), 0.0f, 0.0f, 0.0f);
+
+			if(emitter.prim >= 0) {
+				uint base = triangles[emitter.object*2 + 0];
+				uint tri_offset = triangles[emitter.object*2 + 1];
+				triangles[base + emitter.prim - tri_offset] = node.emitter;
+			}
+		}
+	}
+
+	for(size_t i = 0; i < infinite.size(); i++) {
+		size_t index = emitters.size() + i;
+		kemitters[index*LIGHT_TREE_EMITTER_SIZE + 0] = make_float4(infinite[i].distribution_pdf,
+		                                                          __int_as_float(infinite[i].prim),
+		                                                          0.0f,
+		                                                          0.0f);
+		kemitters[index*LIGHT_TREE_EMITTER_SIZE + 1] = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	uint *ktriangles = dscene->light_tree_triangles.resize(max(triangles.size(), (size_t)1));
+	ktriangles[0] = ~0u;
+	if(triangles.size()) {
+		memcpy(ktriangles, &triangles[0], sizeof(uint)*triangles.size());
+	}
+
+	VLOG(1) << "Light tree with " << nodes.size() << " nodes, "
+	        << emitters.size() << " emitters and "
+	        << infinite.size() << " infinite lights.";
+
+	kintegrator->use_light_tree = true;
+	kintegrator->light_tree_num_emitters = emitters.size();
+	kintegrator->light_tree_num_infinite = infinite.size();
+	kintegrator->light_tree_infinite_pdf = (emitters.size()) ? min(infinite.size()*kintegrator->pdf_lights, 1.0f) : 1.0f;
+
+	device->tex_alloc("__light_tree_nodes", dscene->light_tree_nodes);
+	device->tex_alloc("__light_tree_emitters", dscene->light_tree_emitters);
+	device->tex_alloc("__light_tree_triangles", dscene->light_tree_triangles);
+}
+
 static void background_cdf(int start,
                            int end,
                            int res,
@@ -587,23 +817,14 @@ void LightManager::device_update_background(Device *device,
 	}
 	else {
 		/* Threaded evaluation for large resolution. */
-		const int num_blocks = TaskScheduler::num_threads();
-		const int chunk_size = res / num_blocks;
-		int start_row = 0;
-		TaskPool pool;
-		for(int i = 0; i < num_blocks; ++i) {
-			const int current_chunk_size =
-			    (i != num_blocks - 1) ? chunk_size
-			                          : (res - i * chunk_size);
-			pool.push(function_bind(&background_cdf,
-			                        start_row, start_row + current_chunk_size,
-			                        res,
-			                        cdf_count,
-			                        &pixels,
-			                        cond_cdf));
-			start_row += current_chunk_size;
-		}
-		pool.wait_work();
+		parallel_for(0, res,
+		             function_bind(&background_cdf,
+		                           _1, _2,
+		                           res,
+		                           cdf_count,
+		                           &pixels,
+		                           cond_cdf),
+		             16);
 	}
 
 	/* marginal CDFs (column, V direction, sum of rows) */
@@ -860,6 +1081,9 @@ void LightManager::device_update(Device *device, DeviceScene *dscene, Scene *sce
 	device_update_distribution(device, dscene, scene, progress);
 	if(progress.get_cancel()) return;
 
+	device_update_light_tree(device, dscene, scene, progress);
+	if(progress.get_cancel()) return;
+
 	device_update_background(device, dscene, scene, progress);
 	if(progress.get_cancel()) return;
 
@@ -877,11 +1101,17 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->light_data);
 	device->tex_free(dscene->light_background_marginal_cdf);
 	device->tex_free(dscene->light_background_conditional_cdf);
+	device->tex_free(dscene->light_tree_nodes);
+	device->tex_free(dscene->light_tree_emitters);
+	device->tex_free(dscene->light_tree_triangles);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
 	dscene->light_background_marginal_cdf.clear();
 	dscene->light_background_conditional_cdf.clear();
+	dscene->light_tree_nodes.clear();
+	dscene->light_tree_emitters.clear();
+	dscene->light_tree_triangles.clear();
 }
 
 void LightManager::tag_update(Scene * /*scene*/)
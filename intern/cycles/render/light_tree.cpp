@@ -0,0 +1,262 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/light_tree.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+#define LIGHT_TREE_NUM_BINS 12
+
+/* Cone */
+
+float LightTreeCone::measure() const
+{
+	float theta_w = min(theta_o + theta_e, M_PI_F);
+	float cos_theta_o = cosf(theta_o);
+	float sin_theta_o = sinf(theta_o);
+
+	return M_2PI_F * (1.0f - cos_theta_o) +
+	       M_PI_2_F * (2.0f * theta_w * sin_theta_o -
+	                   cosf(theta_o - 2.0f * theta_w) -
+	                   2.0f * theta_o * sin_theta_o +
+	                   cos_theta_o);
+}
+
+LightTreeCone merge(const LightTreeCone& cone_a, const LightTreeCone& cone_b)
+{
+	/* Make a the cone with the widest spread. */
+	const bool swap = cone_b.theta_o > cone_a.theta_o;
+	const LightTreeCone& a = swap ? cone_b : cone_a;
+	const LightTreeCone& b = swap ? cone_a : cone_b;
+
+	float theta_d = safe_acosf(dot(a.axis, b.axis));
+	float theta_e = max(a.theta_e, b.theta_e);
+
+	/* b is already contained in a. */
+	if(min(theta_d + b.theta_o, M_PI_F) <= a.theta_o) {
+		return LightTreeCone(a.axis, a.theta_o, theta_e);
+	}
+
+	float theta_o = 0.5f * (a.theta_o + theta_d + b.theta_o);
+	if(theta_o >= M_PI_F) {
+		return LightTreeCone(a.axis, M_PI_F, theta_e);
+	}
+
+	/* Rotate the axis of a towards b, opposite axes have no unique rotation
+	 * so fall back to all directions. */
+	float3 rotation_axis = cross(a.axis, b.axis);
+	float rotation_len = len(rotation_axis);
+	if(rotation_len < 1e-6f) {
+		return LightTreeCone(a.axis, M_PI_F, theta_e);
+	}
+
+	float3 axis = rotate_around_axis(a.axis,
+	                                 rotation_axis / rotation_len,
+	                                 theta_o - a.theta_o);
+	return LightTreeCone(normalize(axis), theta_o, theta_e);
+}
+
+/* Build */
+
+namespace {
+
+struct LightTreeBin {
+	BoundBox bounds;
+	LightTreeCone cone;
+	float energy;
+	int count;
+
+	LightTreeBin()
+	: bounds(BoundBox::empty), energy(0.0f), count(0) {}
+
+	void add(const BoundBox& bounds_, const LightTreeCone& cone_, float energy_)
+	{
+		cone = (count == 0) ? cone_ : merge(cone, cone_);
+		bounds.grow(bounds_);
+		energy += energy_;
+		count++;
+	}
+
+	void add(const LightTreeEmitter& emitter)
+	{
+		add(emitter.bounds, emitter.cone, emitter.energy);
+	}
+
+	void add(const LightTreeBin& bin)
+	{
+		if(bin.count) {
+			cone = (count == 0) ? bin.cone : merge(cone, bin.cone);
+			bounds.grow(bin.bounds);
+			energy += bin.energy;
+			count += bin.count;
+		}
+	}
+
+	/* Surface area orientation heuristic, point lamps have no area so keep a
+	 * minimum to still account for their energy. */
+	float cost() const
+	{
+		return energy * max(bounds.safe_area(), 1e-8f) * cone.measure();
+	}
+};
+
+struct LightTreeBinIndex {
+	int axis;
+	float min;
+	float scale;
+
+	int operator()(const LightTreeEmitter& emitter) const
+	{
+		int bin = (int)((emitter.centroid()[axis] - min) * scale);
+		return clamp(bin, 0, LIGHT_TREE_NUM_BINS - 1);
+	}
+};
+
+struct LightTreeBinLess {
+	LightTreeBinIndex index;
+	int split;
+
+	bool operator()(const LightTreeEmitter& emitter) const
+	{
+		return index(emitter) < split;
+	}
+};
+
+struct LightTreeCentroidLess {
+	int axis;
+
+	bool operator()(const LightTreeEmitter& a, const LightTreeEmitter& b) const
+	{
+		return a.centroid()[axis] < b.centroid()[axis];
+	}
+};
+
+}  /* namespace */
+
+LightTree::LightTree(vector<LightTreeEmitter>& emitters)
+{
+	if(!emitters.empty()) {
+		nodes.reserve(2 * emitters.size() - 1);
+		build(emitters, 0, emitters.size(), -1);
+	}
+}
+
+int LightTree::build(vector<LightTreeEmitter>& emitters, int start, int end, int parent)
+{
+	LightTreeBin bin;
+	BoundBox centroid_bounds = BoundBox::empty;
+	for(int i = start; i < end; i++) {
+		bin.add(emitters[i]);
+		centroid_bounds.grow(emitters[i].centroid());
+	}
+
+	int index = nodes.size();
+	nodes.push_back(LightTreeNode());
+	LightTreeNode& node = nodes[index];
+	node.bounds = bin.bounds;
+	node.cone = bin.cone;
+	node.energy = bin.energy;
+	node.child = -1;
+	node.emitter = -1;
+	node.parent = parent;
+
+	if(end - start == 1) {
+		node.emitter = start;
+		return index;
+	}
+
+	int mid = split(emitters, start, end, centroid_bounds);
+	build(emitters, start, mid, index);
+	int right = build(emitters, mid, end, index);
+	nodes[index].child = right;
+
+	return index;
+}
+
+int LightTree::split(vector<LightTreeEmitter>& emitters, int start, int end,
+                     const BoundBox& centroid_bounds)
+{
+	float3 extent = centroid_bounds.size();
+	float max_extent = max3(extent);
+
+	float best_cost = FLT_MAX;
+	LightTreeBinLess best_split = {{-1, 0.0f, 0.0f}, 0};
+
+	for(int axis = 0; axis < 3; axis++) {
+		if(extent[axis] <= 0.0f) {
+			continue;
+		}
+
+		LightTreeBinIndex index = {axis,
+		                           centroid_bounds.min[axis],
+		                           LIGHT_TREE_NUM_BINS / extent[axis]};
+
+		LightTreeBin bins[LIGHT_TREE_NUM_BINS];
+		for(int i = start; i < end; i++) {
+			bins[index(emitters[i])].add(emitters[i]);
+		}
+
+		/* Sweep from the right to get costs for all splits. */
+		float right_cost[LIGHT_TREE_NUM_BINS];
+		LightTreeBin right;
+		for(int i = LIGHT_TREE_NUM_BINS - 1; i > 0; i--) {
+			right.add(bins[i]);
+			right_cost[i] = (right.count) ? right.cost() : FLT_MAX;
+		}
+
+		/* Penalize splits along the short axes, for thin nodes. */
+		float regularization = max_extent / extent[axis];
+
+		LightTreeBin left;
+		for(int i = 0; i < LIGHT_TREE_NUM_BINS - 1; i++) {
+			left.add(bins[i]);
+			if(left.count == 0 || left.count == end - start) {
+				continue;
+			}
+
+			float cost = regularization * (left.cost() + right_cost[i + 1]);
+			if(cost < best_cost) {
+				best_cost = cost;
+				best_split.index = index;
+				best_split.split = i + 1;
+			}
+		}
+	}
+
+	if(best_split.index.axis != -1) {
+		int mid = std::partition(emitters.begin() + start,
+		                         emitters.begin() + end,
+		                         best_split) - emitters.begin();
+		if(mid > start && mid < end) {
+			return mid;
+		}
+	}
+
+	/* Coincident centroids or all emitters in one bin, split in the middle. */
+	int mid = (start + end) / 2;
+	LightTreeCentroidLess less = {(extent.x >= extent.y && extent.x >= extent.z) ? 0 :
+	                              (extent.y >= extent.z) ? 1 : 2};
+	std::nth_element(emitters.begin() + start,
+	                 emitters.begin() + mid,
+	                 emitters.begin() + end,
+	                 less);
+	return mid;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "util/util_boundbox.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Tree
+ *
+ * Binary hierarchy over emissive triangles and lamps with a position, for
+ * many-light sampling. Every node bounds the position, emission direction and
+ * power of the emitters below it, from which the kernel estimates the
+ * importance of both children at the shading point while walking down the
+ * tree to pick an emitter.
+ *
+ * Built with the surface area orientation heuristic from "Importance Sampling
+ * of Many Lights with Adaptive Tree Splitting" by Estevez and Kulla. */
+
+/* Bounds of emission directions, all emitters emit within theta_e of some
+ * direction which is within theta_o of the axis. */
+struct LightTreeCone {
+	float3 axis;
+	float theta_o;
+	float theta_e;
+
+	LightTreeCone()
+	: axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(0.0f), theta_e(0.0f) {}
+
+	LightTreeCone(const float3& axis_, float theta_o_, float theta_e_)
+	: axis(axis_), theta_o(theta_o_), theta_e(theta_e_) {}
+
+	/* Solid angle measure used by the build heuristic. */
+	float measure() const;
+};
+
+LightTreeCone merge(const LightTreeCone& a, const LightTreeCone& b);
+
+struct LightTreeEmitter {
+	BoundBox bounds;
+	LightTreeCone cone;
+	float energy;
+
+	/* Triangle index, or ~lamp for lamps. */
+	int prim;
+	int object;
+	int shader_flag;
+	/* Probability of picking a triangle from the light distribution. */
+	float distribution_pdf;
+
+	float3 centroid() const { return bounds.center(); }
+};
+
+struct LightTreeNode {
+	BoundBox bounds;
+	LightTreeCone cone;
+	float energy;
+
+	/* Right child for inner nodes, the left child directly follows its
+	 * parent. Index of the emitter for leaves. */
+	int child;
+	int emitter;
+	int parent;
+
+	bool is_leaf() const { return emitter != -1; }
+};
+
+class LightTree {
+public:
+	/* Emitters are reordered to match the leaves of the tree. */
+	explicit LightTree(vector<LightTreeEmitter>& emitters);
+
+	const vector<LightTreeNode>& get_nodes() const { return nodes; }
+
+protected:
+	int build(vector<LightTreeEmitter>& emitters, int start, int end, int parent);
+	int split(vector<LightTreeEmitter>& emitters, int start, int end,
+	          const BoundBox& centroid_bounds);
+
+	vector<LightTreeNode> nodes;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
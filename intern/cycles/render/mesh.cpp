@@ -859,6 +859,16 @@ void Mesh::add_vertex_normals()
 	}
 }
 
+void Mesh::update_normals(Scene *scene)
+{
+	add_face_normals();
+	add_vertex_normals();
+
+	if(need_attribute(scene, ATTR_STD_POSITION_UNDISPLACED)) {
+		add_undisplaced();
+	}
+}
+
 void Mesh::add_undisplaced()
 {
 	AttributeSet& attrs = (subdivision_type == SUBDIVISION_NONE) ? attributes : subd_attributes;
@@ -1064,17 +1074,20 @@ void Mesh::compute_bvh(DeviceScene *dscene,
 		vector<Object*> objects;
 		objects.push_back(&object);
 
-		if(bvh && !need_update_rebuild) {
+		bool rebuild = (bvh == NULL) || need_update_rebuild;
+
+		if(!rebuild) {
 			progress->set_status(msg, "Refitting BVH");
 			bvh->objects = objects;
-			bvh->refit(*progress);
+			rebuild = !bvh->refit(*progress);
 		}
-		else {
+
+		if(rebuild) {
 			progress->set_status(msg, "Building BVH");
 
 			BVHParams bparams;
 			bparams.use_spatial_split = params->use_bvh_spatial_split;
-			bparams.use_qbvh = params->use_qbvh;
+			bparams.bvh_layout = params->bvh_layout;
 			bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
 			                              params->use_bvh_unaligned_nodes;
 			bparams.num_motion_triangle_steps = params->num_bvh_time_steps;
@@ -1083,6 +1096,13 @@ void Mesh::compute_bvh(DeviceScene *dscene,
 			bparams.use_bvh_embree = params->use_bvh_embree;
 			bparams.curve_flags = dscene->data.curve.curveflags;
 			bparams.curve_subdivisions = dscene->data.curve.subdivisions;
+			bparams.use_cache = params->use_bvh_cache;
+			bparams.cache_path = params->bvh_cache_path;
+			bparams.parallel_build_threshold = params->bvh_parallel_build_threshold;
+			/* Only BVHs which stay around for the next update get refitted. */
+			if(params->bvh_type == SceneParams::BVH_DYNAMIC || params->persistent_data) {
+				bparams.refit_sah_threshold = params->bvh_refit_sah_threshold;
+			}
 
 			delete bvh;
 			bvh = BVH::create(bparams, objects);
@@ -1157,6 +1177,10 @@ MeshManager::MeshManager()
 MeshManager::~MeshManager()
 {
 	delete bvh;
+
+	for(map<ustring, DiceCache*>::iterator it = dice_caches.begin(); it != dice_caches.end(); it++) {
+		delete it->second;
+	}
 }
 
 void MeshManager::update_osl_attributes(Device *device, Scene *scene, vector<AttributeRequestSet>& mesh_attributes)
@@ -1847,12 +1871,13 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	/* bvh build */
 	progress.set_status("Updating Scene BVH", "Building");
 
-	VLOG(1) << (scene->params.use_qbvh ? "Using QBVH optimization structure"
-	                                   : "Using regular BVH optimization structure");
+	VLOG(1) << "Using "
+	        << BVHParams::bvh_layout_name(scene->params.bvh_layout)
+	        << " layout for the optimization structure.";
 
 	BVHParams bparams;
 	bparams.top_level = true;
-	bparams.use_qbvh = scene->params.use_qbvh;
+	bparams.bvh_layout = scene->params.bvh_layout;
 	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
 	bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
 	                              scene->params.use_bvh_unaligned_nodes;
@@ -1862,9 +1887,16 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	bparams.use_bvh_embree = scene->params.use_bvh_embree;
 	bparams.curve_flags = dscene->data.curve.curveflags;
 	bparams.curve_subdivisions = dscene->data.curve.subdivisions;
+	bparams.parallel_build_threshold = scene->params.bvh_parallel_build_threshold;
 
-	delete bvh;
+	/* Instance BVHs which didn't change are kept in place from the previous
+	 * top level BVH, so only changed ones need to be packed again. */
+	BVH *prev_bvh = bvh;
 	bvh = BVH::create(bparams, scene->objects);
+	if(prev_bvh) {
+		bvh->steal_instances(prev_bvh);
+		delete prev_bvh;
+	}
 	bvh->build(progress, &device->stats);
 
 	if(progress.get_cancel()) return;
@@ -1916,7 +1948,7 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	}
 
 	dscene->data.bvh.root = pack.root_index;
-	dscene->data.bvh.use_qbvh = scene->params.use_qbvh;
+	dscene->data.bvh.bvh_layout = scene->params.bvh_layout;
 	dscene->data.bvh.use_bvh_steps = (scene->params.num_bvh_time_steps != 0);
 
 #ifdef WITH_EMBREE
@@ -2078,7 +2110,9 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	VLOG(1) << "Total " << scene->meshes.size() << " meshes.";
 
-	/* Update normals. */
+	/* Update normals, in parallel for all meshes. */
+	TaskPool normals_pool;
+
 	foreach(Mesh *mesh, scene->meshes) {
 		foreach(Shader *shader, mesh->used_shaders) {
 			if(shader->need_update_attributes)
@@ -2086,20 +2120,20 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		}
 
 		if(mesh->need_update) {
-			mesh->add_face_normals();
-			mesh->add_vertex_normals();
-
-			if(mesh->need_attribute(scene, ATTR_STD_POSITION_UNDISPLACED)) {
-				mesh->add_undisplaced();
-			}
-
-			if(progress.get_cancel()) return;
+			normals_pool.push(function_bind(&Mesh::update_normals, mesh, scene));
 		}
 	}
 
+	normals_pool.wait_work();
+	if(progress.get_cancel()) return;
+
 	/* Tessellate meshes that are using subdivision */
 	size_t total_tess_needed = 0;
+	set<ustring> subd_mesh_names;
 	foreach(Mesh *mesh, scene->meshes) {
+		if(mesh->subdivision_type != Mesh::SUBDIVISION_NONE) {
+			subd_mesh_names.insert(mesh->name);
+		}
 		if(mesh->need_update &&
 		   mesh->subdivision_type != Mesh::SUBDIVISION_NONE &&
 		   mesh->num_subd_verts == 0 &&
@@ -2109,6 +2143,22 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		}
 	}
 
+	/* Meshes are diced in parallel, and each mesh dices its faces in
+	 * parallel too, so a few large meshes still use all threads. */
+	TaskPool tess_pool;
+
+	/* Free dice caches of meshes that are gone or no longer subdivided. */
+	for(map<ustring, DiceCache*>::iterator it = dice_caches.begin(); it != dice_caches.end();) {
+		if(subd_mesh_names.find(it->first) == subd_mesh_names.end()) {
+			delete it->second;
+			dice_caches.erase(it++);
+		}
+		else {
+			it++;
+		}
+	}
+
+	set<ustring> diced_mesh_names;
 	size_t i = 0;
 	foreach(Mesh *mesh, scene->meshes) {
 		if(mesh->need_update &&
@@ -2116,23 +2166,35 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		   mesh->num_subd_verts == 0 &&
 		   mesh->subd_params)
 		{
-			string msg = "Tessellating ";
-			if(mesh->name == "")
-				msg += string_printf("%u/%u", (uint)(i+1), (uint)total_tess_needed);
-			else
-				msg += string_printf("%s %u/%u", mesh->name.c_str(), (uint)(i+1), (uint)total_tess_needed);
-
-			progress.set_status("Updating Mesh", msg);
-
-			DiagSplit dsplit(*mesh->subd_params);
-			mesh->tessellate(&dsplit);
+			/* Unnamed meshes and meshes sharing a name with another mesh
+			 * diced in this update get no cache, tessellation runs in
+			 * parallel and a cache can only be used by one mesh at a time. */
+			DiceCache *dice_cache = NULL;
+			if(mesh->name != "" && diced_mesh_names.insert(mesh->name).second) {
+				DiceCache *&cache = dice_caches[mesh->name];
+				if(!cache) {
+					cache = new DiceCache();
+				}
+				dice_cache = cache;
+			}
 
+			tess_pool.push(function_bind(&Mesh::tessellate,
+			                             mesh,
+			                             dice_cache,
+			                             &progress,
+			                             i,
+			                             total_tess_needed));
 			i++;
-
-			if(progress.get_cancel()) return;
 		}
 	}
 
+	TaskPool::Summary tess_summary;
+	tess_pool.wait_work(&tess_summary);
+	VLOG(2) << "Tessellation pool statistics:\n"
+	        << tess_summary.full_report();
+
+	if(progress.get_cancel()) return;
+
 	/* Update images needed for true displacement. */
 	bool true_displacement_used = false;
 	bool old_need_object_flags_update = false;
@@ -2172,15 +2234,15 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	if(progress.get_cancel()) return;
 
 	/* Update displacement. */
-	bool displacement_done = false;
+	vector<Mesh*> displace_meshes;
 	foreach(Mesh *mesh, scene->meshes) {
-		if(mesh->need_update &&
-		   displace(device, dscene, scene, mesh, progress))
-		{
-			displacement_done = true;
+		if(mesh->need_update) {
+			displace_meshes.push_back(mesh);
 		}
 	}
 
+	bool displacement_done = displace(device, dscene, scene, displace_meshes, progress);
+
 	/* TODO: properly handle cancel halfway displacement */
 	if(progress.get_cancel()) return;
 
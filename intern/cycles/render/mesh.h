@@ -42,7 +42,7 @@ class Scene;
 class SceneParams;
 class AttributeRequest;
 struct SubdParams;
-class DiagSplit;
+struct DiceCache;
 struct PackedPatchTable;
 
 /* Mesh */
@@ -276,6 +276,8 @@ public:
 	void add_face_normals();
 	void add_vertex_normals();
 	void add_undisplaced();
+	/* Face and vertex normals and undisplaced positions, as needed. */
+	void update_normals(Scene *scene);
 
 	void pack_shaders(Scene *scene, uint *shader);
 	void pack_normals(Scene *scene, float4 *vnormal);
@@ -315,7 +317,7 @@ public:
 	/* Check if the mesh should be treated as instanced. */
 	bool is_instanced() const;
 
-	void tessellate(DiagSplit *split);
+	void tessellate(DiceCache *dice_cache, Progress *progress, int n, int total);
 };
 
 /* Mesh Manager */
@@ -324,13 +326,22 @@ class MeshManager {
 public:
 	BVH *bvh;
 
+	/* Patches diced by the previous tessellation of each mesh, by mesh name.
+	 * Mesh objects are recreated when the scene is synced again, the cache
+	 * is only reused when the control mesh hash matches. */
+	map<ustring, DiceCache*> dice_caches;
+
 	bool need_update;
 	bool need_flags_update;
 
 	MeshManager();
 	~MeshManager();
 
-	bool displace(Device *device, DeviceScene *dscene, Scene *scene, Mesh *mesh, Progress& progress);
+	bool displace(Device *device,
+	              DeviceScene *dscene,
+	              Scene *scene,
+	              const vector<Mesh*>& meshes,
+	              Progress& progress);
 
 	/* attributes */
 	void update_osl_attributes(Device *device, Scene *scene, vector<AttributeRequestSet>& mesh_attributes);
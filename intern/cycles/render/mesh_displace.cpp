@@ -22,7 +22,9 @@
 #include "render/shader.h"
 
 #include "util/util_foreach.h"
+#include "util/util_map.h"
 #include "util/util_progress.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -41,39 +43,25 @@ static float3 compute_face_normal(const Mesh::Triangle& t, float3 *verts)
 	return norm / normlen;
 }
 
-bool MeshManager::displace(Device *device, DeviceScene *dscene, Scene *scene, Mesh *mesh, Progress& progress)
+static Shader *displace_triangle_shader(Scene *scene, Mesh *mesh, size_t i)
 {
-	/* verify if we have a displacement shader */
-	if(!mesh->has_true_displacement()) {
-		return false;
-	}
-
-	string msg = string_printf("Computing Displacement %s", mesh->name.c_str());
-	progress.set_status("Updating Mesh", msg);
-
-	/* find object index. todo: is arbitrary */
-	size_t object_index = OBJECT_NONE;
-
-	for(size_t i = 0; i < scene->objects.size(); i++) {
-		if(scene->objects[i]->mesh == mesh) {
-			object_index = i;
-			break;
-		}
-	}
+	int shader_index = mesh->shader[i];
+	return (shader_index < mesh->used_shaders.size()) ?
+		mesh->used_shaders[shader_index] : scene->default_surface;
+}
 
-	/* setup input for device task */
+/* Add shader evaluation inputs for the vertices of a mesh with true
+ * displacement, returns the number of inputs. */
+static size_t displace_mesh_input(Scene *scene, Mesh *mesh, int object_index, uint4 *d_input_data)
+{
 	const size_t num_verts = mesh->verts.size();
 	vector<bool> done(num_verts, false);
-	device_vector<uint4> d_input;
-	uint4 *d_input_data = d_input.resize(num_verts);
 	size_t d_input_size = 0;
 
 	size_t num_triangles = mesh->num_triangles();
 	for(size_t i = 0; i < num_triangles; i++) {
 		Mesh::Triangle t = mesh->get_triangle(i);
-		int shader_index = mesh->shader[i];
-		Shader *shader = (shader_index < mesh->used_shaders.size()) ?
-			mesh->used_shaders[shader_index] : scene->default_surface;
+		Shader *shader = displace_triangle_shader(scene, mesh, i);
 
 		if(!shader->has_displacement || shader->displacement_method == DISPLACE_BUMP) {
 			continue;
@@ -111,55 +99,22 @@ bool MeshManager::displace(Device *device, DeviceScene *dscene, Scene *scene, Me
 		}
 	}
 
-	if(d_input_size == 0)
-		return false;
-	
-	/* run device task */
-	device_vector<float4> d_output;
-	d_output.resize(d_input_size);
-
-	/* needs to be up to data for attribute access */
-	device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
-
-	device->mem_alloc("displace_input", d_input, MEM_READ_ONLY);
-	device->mem_copy_to(d_input);
-	device->mem_alloc("displace_output", d_output, MEM_WRITE_ONLY);
-
-	DeviceTask task(DeviceTask::SHADER);
-	task.shader_input = d_input.device_pointer;
-	task.shader_output = d_output.device_pointer;
-	task.shader_eval_type = SHADER_EVAL_DISPLACE;
-	task.shader_x = 0;
-	task.shader_w = d_output.size();
-	task.num_samples = 1;
-	task.get_cancel = function_bind(&Progress::get_cancel, &progress);
-
-	device->task_add(task);
-	device->task_wait();
-
-	if(progress.get_cancel()) {
-		device->mem_free(d_input);
-		device->mem_free(d_output);
-		return false;
-	}
-
-	device->mem_copy_from(d_output, 0, 1, d_output.size(), sizeof(float4));
-	device->mem_free(d_input);
-	device->mem_free(d_output);
+	return d_input_size;
+}
 
-	/* read result */
-	done.clear();
-	done.resize(num_verts, false);
+/* Apply displacement offsets to the vertices of a mesh, in the same order as
+ * the inputs were added, and recompute normals. */
+static void displace_mesh_apply(Scene *scene, Mesh *mesh, const float4 *offset)
+{
+	const size_t num_verts = mesh->verts.size();
+	const size_t num_triangles = mesh->num_triangles();
+	vector<bool> done(num_verts, false);
 	int k = 0;
 
-	float4 *offset = (float4*)d_output.data_pointer;
-
 	Attribute *attr_mP = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
 	for(size_t i = 0; i < num_triangles; i++) {
 		Mesh::Triangle t = mesh->get_triangle(i);
-		int shader_index = mesh->shader[i];
-		Shader *shader = (shader_index < mesh->used_shaders.size()) ?
-			mesh->used_shaders[shader_index] : scene->default_surface;
+		Shader *shader = displace_triangle_shader(scene, mesh, i);
 
 		if(!shader->has_displacement || shader->displacement_method == DISPLACE_BUMP) {
 			continue;
@@ -201,9 +156,7 @@ bool MeshManager::displace(Device *device, DeviceScene *dscene, Scene *scene, Me
 		vector<bool> tri_has_true_disp(num_triangles, false);
 
 		for(size_t i = 0; i < num_triangles; i++) {
-			int shader_index = mesh->shader[i];
-			Shader *shader = (shader_index < mesh->used_shaders.size()) ?
-				mesh->used_shaders[shader_index] : scene->default_surface;
+			Shader *shader = displace_triangle_shader(scene, mesh, i);
 
 			tri_has_true_disp[i] = shader->has_displacement && shader->displacement_method == DISPLACE_TRUE;
 		}
@@ -314,8 +267,117 @@ bool MeshManager::displace(Device *device, DeviceScene *dscene, Scene *scene, Me
 		}
 	}
 
+}
+
+bool MeshManager::displace(Device *device,
+                           DeviceScene *dscene,
+                           Scene *scene,
+                           const vector<Mesh*>& meshes,
+                           Progress& progress)
+{
+	/* find object index of meshes with a displacement shader, all meshes
+	 * are evaluated together in a single shader task. todo: is arbitrary */
+	vector<Mesh*> displace_meshes;
+	vector<size_t> object_index;
+	size_t num_inputs = 0;
+
+	foreach(Mesh *mesh, meshes) {
+		if(mesh->has_true_displacement()) {
+			displace_meshes.push_back(mesh);
+			object_index.push_back(OBJECT_NONE);
+			num_inputs += mesh->verts.size();
+		}
+	}
+
+	if(displace_meshes.empty()) {
+		return false;
+	}
+
+	if(displace_meshes.size() == 1) {
+		string msg = string_printf("Computing Displacement %s", displace_meshes[0]->name.c_str());
+		progress.set_status("Updating Mesh", msg);
+	}
+	else {
+		string msg = string_printf("Computing Displacement %u meshes", (uint)displace_meshes.size());
+		progress.set_status("Updating Mesh", msg);
+	}
+
+	map<Mesh*, size_t> mesh_index;
+	for(size_t i = 0; i < displace_meshes.size(); i++) {
+		mesh_index[displace_meshes[i]] = i;
+	}
+
+	for(size_t i = 0; i < scene->objects.size(); i++) {
+		map<Mesh*, size_t>::iterator it = mesh_index.find(scene->objects[i]->mesh);
+		if(it != mesh_index.end() && object_index[it->second] == OBJECT_NONE) {
+			object_index[it->second] = i;
+		}
+	}
+
+	/* setup input for device task */
+	device_vector<uint4> d_input;
+	uint4 *d_input_data = d_input.resize(num_inputs);
+	size_t d_input_size = 0;
+	vector<size_t> input_offset(displace_meshes.size());
+
+	for(size_t i = 0; i < displace_meshes.size(); i++) {
+		input_offset[i] = d_input_size;
+		d_input_size += displace_mesh_input(scene,
+		                                    displace_meshes[i],
+		                                    object_index[i],
+		                                    d_input_data + d_input_size);
+	}
+
+	if(d_input_size == 0)
+		return false;
+	
+	/* run device task */
+	device_vector<float4> d_output;
+	d_output.resize(d_input_size);
+
+	/* needs to be up to data for attribute access */
+	device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
+
+	device->mem_alloc("displace_input", d_input, MEM_READ_ONLY);
+	device->mem_copy_to(d_input);
+	device->mem_alloc("displace_output", d_output, MEM_WRITE_ONLY);
+
+	DeviceTask task(DeviceTask::SHADER);
+	task.shader_input = d_input.device_pointer;
+	task.shader_output = d_output.device_pointer;
+	task.shader_eval_type = SHADER_EVAL_DISPLACE;
+	task.shader_x = 0;
+	task.shader_w = d_output.size();
+	task.num_samples = 1;
+	task.get_cancel = function_bind(&Progress::get_cancel, &progress);
+
+	device->task_add(task);
+	device->task_wait();
+
+	if(progress.get_cancel()) {
+		device->mem_free(d_input);
+		device->mem_free(d_output);
+		return false;
+	}
+
+	device->mem_copy_from(d_output, 0, 1, d_output.size(), sizeof(float4));
+	device->mem_free(d_input);
+	device->mem_free(d_output);
+
+	/* read result, meshes are independent so apply them in parallel */
+	float4 *offset = (float4*)d_output.data_pointer;
+	TaskPool pool;
+
+	for(size_t i = 0; i < displace_meshes.size(); i++) {
+		pool.push(function_bind(&displace_mesh_apply,
+		                        scene,
+		                        displace_meshes[i],
+		                        offset + input_offset[i]));
+	}
+
+	pool.wait_work();
+
 	return true;
 }
 
 CCL_NAMESPACE_END
-
@@ -24,6 +24,11 @@
 
 #include "util/util_foreach.h"
 #include "util/util_algorithm.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_progress.h"
+#include "util/util_task.h"
+#include "util/util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -335,38 +340,48 @@ struct OsdPatch : Patch {
 
 #endif
 
-void Mesh::tessellate(DiagSplit *split)
-{
-#ifdef WITH_OPENSUBDIV
-	OsdData osd_data;
-	bool need_packed_patch_table = false;
+/* Tessellate Task
+ *
+ * Dices a range of faces into its own output, so faces can be diced in
+ * parallel and then appended to the mesh in face order. */
 
-	if(subdivision_type == SUBDIVISION_CATMULL_CLARK) {
-		if(subd_faces.size()) {
-			osd_data.build_from_mesh(this);
-		}
-	}
-	else
+struct TessellateTask {
+	Mesh *mesh;
+#ifdef WITH_OPENSUBDIV
+	OsdData *osd_data;
 #endif
-	{
-		/* force linear subdivision if OpenSubdiv is unavailable to avoid
-		 * falling into catmull-clark code paths by accident
-		 */
-		subdivision_type = SUBDIVISION_LINEAR;
+	SubdParams params;
+	DiceCache *cache;
+	int start;
+	int end;
 
-		/* force disable attribute subdivision for same reason as above */
-		foreach(Attribute& attr, subd_attributes.attributes) {
-			attr.flags &= ~ATTR_SUBDIVIDED;
-		}
+	DiceOutput output;
+	int num_patches_diced;
+	int num_patches_reused;
+
+	explicit TessellateTask(const SubdParams& params_)
+	: params(params_), cache(NULL), num_patches_diced(0), num_patches_reused(0) {}
+
+	/* Quads are split in four before dicing, so there are four entries per
+	 * patch, ngon corners only use the first. */
+	DicedPatch *cached_patch(int patch_index, int sub = 0)
+	{
+		return (cache)? &cache->patches[patch_index*4 + sub]: NULL;
 	}
 
-	int num_faces = subd_faces.size();
+	void dice();
+	void append(size_t vert_offset, size_t tri_offset);
+};
 
-	Attribute *attr_vN = subd_attributes.find(ATTR_STD_VERTEX_NORMAL);
+void TessellateTask::dice()
+{
+	DiagSplit split(params, &output);
+
+	Attribute *attr_vN = mesh->subd_attributes.find(ATTR_STD_VERTEX_NORMAL);
 	float3* vN = attr_vN->data_float3();
 
-	for(int f = 0; f < num_faces; f++) {
-		SubdFace& face = subd_faces[f];
+	for(int f = start; f < end; f++) {
+		Mesh::SubdFace& face = mesh->subd_faces[f];
 
 		if(face.is_quad()) {
 			/* quad */
@@ -374,9 +389,9 @@ void Mesh::tessellate(DiagSplit *split)
 
 			LinearQuadPatch quad_patch;
 #ifdef WITH_OPENSUBDIV
-			OsdPatch osd_patch(&osd_data);
+			OsdPatch osd_patch(osd_data);
 
-			if(subdivision_type == SUBDIVISION_CATMULL_CLARK) {
+			if(mesh->subdivision_type == Mesh::SUBDIVISION_CATMULL_CLARK) {
 				osd_patch.patch_index = face.ptex_offset;
 
 				subpatch.patch = &osd_patch;
@@ -390,16 +405,16 @@ void Mesh::tessellate(DiagSplit *split)
 				quad_patch.patch_index = face.ptex_offset;
 
 				for(int i = 0; i < 4; i++) {
-					hull[i] = verts[subd_face_corners[face.start_corner+i]];
+					hull[i] = mesh->verts[mesh->subd_face_corners[face.start_corner+i]];
 				}
 
 				if(face.smooth) {
 					for(int i = 0; i < 4; i++) {
-						normals[i] = vN[subd_face_corners[face.start_corner+i]];
+						normals[i] = vN[mesh->subd_face_corners[face.start_corner+i]];
 					}
 				}
 				else {
-					float3 N = face.normal(this);
+					float3 N = face.normal(mesh);
 					for(int i = 0; i < 4; i++) {
 						normals[i] = N;
 					}
@@ -420,38 +435,38 @@ void Mesh::tessellate(DiagSplit *split)
 			subpatch.P10 = make_float2(0.5f, 0.0f);
 			subpatch.P01 = make_float2(0.0f, 0.5f);
 			subpatch.P11 = make_float2(0.5f, 0.5f);
-			split->split_quad(subpatch.patch, &subpatch);
+			split.split_quad(subpatch.patch, &subpatch, cached_patch(face.ptex_offset, 0));
 
 			subpatch.P00 = make_float2(0.5f, 0.0f);
 			subpatch.P10 = make_float2(1.0f, 0.0f);
 			subpatch.P01 = make_float2(0.5f, 0.5f);
 			subpatch.P11 = make_float2(1.0f, 0.5f);
-			split->split_quad(subpatch.patch, &subpatch);
+			split.split_quad(subpatch.patch, &subpatch, cached_patch(face.ptex_offset, 1));
 
 			subpatch.P00 = make_float2(0.0f, 0.5f);
 			subpatch.P10 = make_float2(0.5f, 0.5f);
 			subpatch.P01 = make_float2(0.0f, 1.0f);
 			subpatch.P11 = make_float2(0.5f, 1.0f);
-			split->split_quad(subpatch.patch, &subpatch);
+			split.split_quad(subpatch.patch, &subpatch, cached_patch(face.ptex_offset, 2));
 
 			subpatch.P00 = make_float2(0.5f, 0.5f);
 			subpatch.P10 = make_float2(1.0f, 0.5f);
 			subpatch.P01 = make_float2(0.5f, 1.0f);
 			subpatch.P11 = make_float2(1.0f, 1.0f);
-			split->split_quad(subpatch.patch, &subpatch);
+			split.split_quad(subpatch.patch, &subpatch, cached_patch(face.ptex_offset, 3));
 		}
 		else {
 			/* ngon */
 #ifdef WITH_OPENSUBDIV
-			if(subdivision_type == SUBDIVISION_CATMULL_CLARK) {
-				OsdPatch patch(&osd_data);
+			if(mesh->subdivision_type == Mesh::SUBDIVISION_CATMULL_CLARK) {
+				OsdPatch patch(osd_data);
 
 				patch.shader = face.shader;
 
 				for(int corner = 0; corner < face.num_corners; corner++) {
 					patch.patch_index = face.ptex_offset + corner;
 
-					split->split_quad(&patch);
+					split.split_quad(&patch, NULL, cached_patch(patch.patch_index));
 				}
 			}
 			else
@@ -462,8 +477,8 @@ void Mesh::tessellate(DiagSplit *split)
 
 				float inv_num_corners = 1.0f/float(face.num_corners);
 				for(int corner = 0; corner < face.num_corners; corner++) {
-					center_vert += verts[subd_face_corners[face.start_corner + corner]] * inv_num_corners;
-					center_normal += vN[subd_face_corners[face.start_corner + corner]] * inv_num_corners;
+					center_vert += mesh->verts[mesh->subd_face_corners[face.start_corner + corner]] * inv_num_corners;
+					center_normal += vN[mesh->subd_face_corners[face.start_corner + corner]] * inv_num_corners;
 				}
 
 				for(int corner = 0; corner < face.num_corners; corner++) {
@@ -475,36 +490,260 @@ void Mesh::tessellate(DiagSplit *split)
 
 					patch.shader = face.shader;
 
-					hull[0] = verts[subd_face_corners[face.start_corner + mod(corner + 0, face.num_corners)]];
-					hull[1] = verts[subd_face_corners[face.start_corner + mod(corner + 1, face.num_corners)]];
-					hull[2] = verts[subd_face_corners[face.start_corner + mod(corner - 1, face.num_corners)]];
+					hull[0] = mesh->verts[mesh->subd_face_corners[face.start_corner + mod(corner + 0, face.num_corners)]];
+					hull[1] = mesh->verts[mesh->subd_face_corners[face.start_corner + mod(corner + 1, face.num_corners)]];
+					hull[2] = mesh->verts[mesh->subd_face_corners[face.start_corner + mod(corner - 1, face.num_corners)]];
 					hull[3] = center_vert;
 
 					hull[1] = (hull[1] + hull[0]) * 0.5;
 					hull[2] = (hull[2] + hull[0]) * 0.5;
 
 					if(face.smooth) {
-						normals[0] = vN[subd_face_corners[face.start_corner + mod(corner + 0, face.num_corners)]];
-						normals[1] = vN[subd_face_corners[face.start_corner + mod(corner + 1, face.num_corners)]];
-						normals[2] = vN[subd_face_corners[face.start_corner + mod(corner - 1, face.num_corners)]];
+						normals[0] = vN[mesh->subd_face_corners[face.start_corner + mod(corner + 0, face.num_corners)]];
+						normals[1] = vN[mesh->subd_face_corners[face.start_corner + mod(corner + 1, face.num_corners)]];
+						normals[2] = vN[mesh->subd_face_corners[face.start_corner + mod(corner - 1, face.num_corners)]];
 						normals[3] = center_normal;
 
 						normals[1] = (normals[1] + normals[0]) * 0.5;
 						normals[2] = (normals[2] + normals[0]) * 0.5;
 					}
 					else {
-						float3 N = face.normal(this);
+						float3 N = face.normal(mesh);
 						for(int i = 0; i < 4; i++) {
 							normals[i] = N;
 						}
 					}
 
-					split->split_quad(&patch);
+					split.split_quad(&patch, NULL, cached_patch(patch.patch_index));
 				}
 			}
 		}
 	}
 
+	num_patches_diced = split.num_patches_diced;
+	num_patches_reused = split.num_patches_reused;
+}
+
+void TessellateTask::append(size_t vert_offset, size_t tri_offset)
+{
+	size_t num_verts = output.num_verts();
+	size_t num_triangles = output.num_triangles();
+
+	float3 *P = mesh->verts.data() + vert_offset;
+	float3 *N = mesh->attributes.find(ATTR_STD_VERTEX_NORMAL)->data_float3() + vert_offset;
+	float2 *patch_uv = mesh->vert_patch_uv.data() + vert_offset;
+
+	for(size_t i = 0; i < num_verts; i++) {
+		P[i] = output.P[i];
+		N[i] = output.N[i];
+		patch_uv[i] = output.uv[i];
+	}
+
+	int *triangles = mesh->triangles.data() + tri_offset*3;
+	int *shader = mesh->shader.data() + tri_offset;
+	bool *smooth = mesh->smooth.data() + tri_offset;
+	int *triangle_patch = mesh->triangle_patch.data() + tri_offset;
+
+	for(size_t i = 0; i < num_triangles; i++) {
+		for(int j = 0; j < 3; j++) {
+			triangles[i*3 + j] = output.triangles[i*3 + j] + vert_offset;
+		}
+		shader[i] = output.shader[i];
+		smooth[i] = true;
+		triangle_patch[i] = output.patch_index[i];
+	}
+
+	if(params.ptex) {
+		float3 *ptex_uv = mesh->attributes.find(ATTR_STD_PTEX_UV)->data_float3() + vert_offset;
+		float *ptex_face_id = mesh->attributes.find(ATTR_STD_PTEX_FACE_ID)->data_float() + tri_offset;
+
+		for(size_t i = 0; i < num_verts; i++) {
+			ptex_uv[i] = make_float3(output.uv[i].x, output.uv[i].y, 0.0f);
+		}
+
+		for(size_t i = 0; i < num_triangles; i++) {
+			ptex_face_id[i] = (float)output.ptex_face_id[i];
+		}
+	}
+}
+
+static void md5_append_array(MD5Hash& md5, const void *data, size_t size)
+{
+	/* MD5Hash takes int sizes, feed large arrays in chunks. */
+	const uint8_t *bytes = (const uint8_t*)data;
+	while(size) {
+		int chunk = (int)min(size, (size_t)(1 << 30));
+		md5.append(bytes, chunk);
+		bytes += chunk;
+		size -= chunk;
+	}
+}
+
+/* Hash of everything patches are evaluated from, diced patches can only be
+ * reused while it stays the same. */
+static string tessellate_mesh_hash(Mesh *mesh, const SubdParams& params)
+{
+	MD5Hash md5;
+
+	md5_append_array(md5, &mesh->subdivision_type, sizeof(mesh->subdivision_type));
+	md5_append_array(md5, &params.ptex, sizeof(params.ptex));
+
+	md5_append_array(md5, mesh->verts.data(), mesh->verts.size()*sizeof(float3));
+	md5_append_array(md5, mesh->subd_face_corners.data(), mesh->subd_face_corners.size()*sizeof(int));
+
+	/* Field by field, the struct has padding. */
+	for(size_t i = 0; i < mesh->subd_faces.size(); i++) {
+		const Mesh::SubdFace& face = mesh->subd_faces[i];
+		md5_append_array(md5, &face.start_corner, sizeof(face.start_corner));
+		md5_append_array(md5, &face.num_corners, sizeof(face.num_corners));
+		md5_append_array(md5, &face.shader, sizeof(face.shader));
+		md5_append_array(md5, &face.smooth, sizeof(face.smooth));
+		md5_append_array(md5, &face.ptex_offset, sizeof(face.ptex_offset));
+	}
+
+	md5_append_array(md5, mesh->subd_creases.data(), mesh->subd_creases.size()*sizeof(Mesh::SubdEdgeCrease));
+
+	Attribute *attr_vN = mesh->subd_attributes.find(ATTR_STD_VERTEX_NORMAL);
+	if(attr_vN) {
+		md5_append_array(md5, attr_vN->data(), attr_vN->buffer.size());
+	}
+
+	return md5.get_hex();
+}
+
+void Mesh::tessellate(DiceCache *dice_cache, Progress *progress, int n, int total)
+{
+	if(progress->get_cancel())
+		return;
+
+	string msg = "Tessellating ";
+	if(name == "")
+		msg += string_printf("%u/%u", (uint)(n+1), (uint)total);
+	else
+		msg += string_printf("%s %u/%u", name.c_str(), (uint)(n+1), (uint)total);
+
+	progress->set_status("Updating Mesh", msg);
+
+	double start_time = time_dt();
+
+	SubdParams params = *subd_params;
+	params.mesh = this;
+
+#ifdef WITH_OPENSUBDIV
+	OsdData osd_data;
+	bool need_packed_patch_table = false;
+
+	if(subdivision_type == SUBDIVISION_CATMULL_CLARK) {
+		if(subd_faces.size()) {
+			osd_data.build_from_mesh(this);
+		}
+	}
+	else
+#endif
+	{
+		/* force linear subdivision if OpenSubdiv is unavailable to avoid
+		 * falling into catmull-clark code paths by accident
+		 */
+		subdivision_type = SUBDIVISION_LINEAR;
+
+		/* force disable attribute subdivision for same reason as above */
+		foreach(Attribute& attr, subd_attributes.attributes) {
+			attr.flags &= ~ATTR_SUBDIVIDED;
+		}
+	}
+
+	int num_faces = subd_faces.size();
+
+	attributes.add(ATTR_STD_VERTEX_NORMAL);
+
+	if(params.ptex) {
+		attributes.add(ATTR_STD_PTEX_UV);
+		attributes.add(ATTR_STD_PTEX_FACE_ID);
+	}
+
+	/* Reuse patches from the previous tessellation if the control mesh is
+	 * unchanged, so only patches with new edge factors are diced again. */
+	int num_patches = 0;
+	for(size_t i = 0; i < subd_faces.size(); i++) {
+		num_patches = max(num_patches, subd_faces[i].ptex_offset + subd_faces[i].num_ptex_faces());
+	}
+
+	if(dice_cache) {
+		string mesh_hash = tessellate_mesh_hash(this, params);
+
+		if(dice_cache->mesh_hash != mesh_hash || dice_cache->patches.size() != (size_t)num_patches*4) {
+			dice_cache->mesh_hash = mesh_hash;
+			dice_cache->patches.clear();
+			dice_cache->patches.resize(num_patches*4);
+		}
+	}
+
+	/* Dice faces in parallel, with enough ranges to balance faces that are
+	 * diced much finer than others. */
+	int num_tasks = min(num_faces, max(TaskScheduler::num_threads(), 1) * 16);
+	vector<TessellateTask*> tasks;
+
+	TaskPool pool;
+
+	for(int i = 0; i < num_tasks; i++) {
+		TessellateTask *task = new TessellateTask(params);
+		task->mesh = this;
+		task->cache = dice_cache;
+#ifdef WITH_OPENSUBDIV
+		task->osd_data = &osd_data;
+#endif
+		task->start = (int)(((int64_t)num_faces * i) / num_tasks);
+		task->end = (int)(((int64_t)num_faces * (i + 1)) / num_tasks);
+		tasks.push_back(task);
+
+		pool.push(function_bind(&TessellateTask::dice, task));
+	}
+
+	pool.wait_work();
+
+	/* Append outputs to the mesh, each into its own range. */
+	size_t vert_offset = verts.size();
+	size_t tri_offset = num_triangles();
+	size_t num_diced_verts = 0;
+	size_t num_diced_triangles = 0;
+	int num_patches_diced = 0;
+	int num_patches_reused = 0;
+
+	foreach(TessellateTask *task, tasks) {
+		num_diced_verts += task->output.num_verts();
+		num_diced_triangles += task->output.num_triangles();
+		num_patches_diced += task->num_patches_diced;
+		num_patches_reused += task->num_patches_reused;
+	}
+
+	resize_mesh(vert_offset + num_diced_verts, tri_offset + num_diced_triangles);
+
+	foreach(TessellateTask *task, tasks) {
+		size_t task_num_verts = task->output.num_verts();
+		size_t task_num_triangles = task->output.num_triangles();
+
+		pool.push(function_bind(&TessellateTask::append, task, vert_offset, tri_offset));
+
+		vert_offset += task_num_verts;
+		tri_offset += task_num_triangles;
+	}
+
+	pool.wait_work();
+
+	foreach(TessellateTask *task, tasks) {
+		delete task;
+	}
+
+	num_subd_verts += num_diced_verts;
+
+	VLOG(1) << "Tessellated mesh " << name.c_str() << ": "
+	        << num_faces << " faces diced into "
+	        << num_diced_triangles << " triangles and "
+	        << num_diced_verts << " vertices in "
+	        << time_dt() - start_time << " seconds, "
+	        << num_patches_reused << " of " << num_patches_diced + num_patches_reused
+	        << " patches reused from the previous tessellation.";
+
 	/* interpolate center points for attributes */
 	foreach(Attribute& attr, subd_attributes.attributes) {
 #ifdef WITH_OPENSUBDIV
@@ -1937,10 +1937,12 @@ void BsdfNode::compile(SVMCompiler& compiler, ShaderInput *param1, ShaderInput *
 	int param3_offset = (param3) ? compiler.stack_assign(param3) : SVM_STACK_INVALID;
 	int param4_offset = (param4) ? compiler.stack_assign(param4) : SVM_STACK_INVALID;
 
+	/* Unlinked parameters are read from the node itself, no need to load
+	 * them onto the stack. */
 	compiler.add_node(NODE_CLOSURE_BSDF,
 		compiler.encode_uchar4(closure,
-			(param1)? compiler.stack_assign(param1): SVM_STACK_INVALID,
-			(param2)? compiler.stack_assign(param2): SVM_STACK_INVALID,
+			(param1)? compiler.stack_assign_if_linked(param1): SVM_STACK_INVALID,
+			(param2)? compiler.stack_assign_if_linked(param2): SVM_STACK_INVALID,
 			compiler.closure_mix_weight_offset()),
 		__float_as_int((param1)? get_float(param1->socket_type): 0.0f),
 		__float_as_int((param2)? get_float(param2->socket_type): 0.0f));
@@ -1953,6 +1955,16 @@ void BsdfNode::compile(SVMCompiler& compiler)
 	compile(compiler, NULL, NULL);
 }
 
+void BsdfNode::constant_fold(const ConstantFolder& folder)
+{
+	ShaderInput *color_in = input("Color");
+
+	/* Closures with zero weight are never allocated by the kernel. */
+	if(color_in && !color_in->link && color == make_float3(0.0f, 0.0f, 0.0f)) {
+		folder.discard();
+	}
+}
+
 void BsdfNode::compile(OSLCompiler& /*compiler*/)
 {
 	assert(0);
@@ -2499,8 +2511,8 @@ void PrincipledBsdfNode::compile(SVMCompiler& compiler, ShaderInput *p_metallic,
 
 	compiler.add_node(NODE_CLOSURE_BSDF,
 		compiler.encode_uchar4(closure,
-		compiler.stack_assign(p_metallic),
-		compiler.stack_assign(p_subsurface),
+		compiler.stack_assign_if_linked(p_metallic),
+		compiler.stack_assign_if_linked(p_subsurface),
 		compiler.closure_mix_weight_offset()),
 		__float_as_int((p_metallic) ? get_float(p_metallic->socket_type) : 0.0f),
 		__float_as_int((p_subsurface) ? get_float(p_subsurface->socket_type) : 0.0f));
@@ -2858,8 +2870,8 @@ void VolumeNode::compile(SVMCompiler& compiler, ShaderInput *param1, ShaderInput
 	
 	compiler.add_node(NODE_CLOSURE_VOLUME,
 		compiler.encode_uchar4(closure,
-			(param1)? compiler.stack_assign(param1): SVM_STACK_INVALID,
-			(param2)? compiler.stack_assign(param2): SVM_STACK_INVALID,
+			(param1)? compiler.stack_assign_if_linked(param1): SVM_STACK_INVALID,
+			(param2)? compiler.stack_assign_if_linked(param2): SVM_STACK_INVALID,
 			compiler.closure_mix_weight_offset()),
 		__float_as_int((param1)? get_float(param1->socket_type): 0.0f),
 		__float_as_int((param2)? get_float(param2->socket_type): 0.0f));
@@ -4688,7 +4700,7 @@ void FresnelNode::compile(SVMCompiler& compiler)
 	ShaderOutput *fac_out = output("Fac");
 
 	compiler.add_node(NODE_FRESNEL,
-		compiler.stack_assign(IOR_in),
+		compiler.stack_assign_if_linked(IOR_in),
 		__float_as_int(IOR),
 		compiler.encode_uchar4(
 			compiler.stack_assign_if_linked(normal_in),
@@ -5033,13 +5045,16 @@ void MathNode::compile(SVMCompiler& compiler)
 	ShaderInput *value2_in = input("Value2");
 	ShaderOutput *value_out = output("Value");
 
-	compiler.add_node(NODE_MATH, type, compiler.stack_assign(value1_in), compiler.stack_assign(value2_in));
-	compiler.add_node(NODE_MATH, compiler.stack_assign(value_out));
-
-	if(use_clamp) {
-		compiler.add_node(NODE_MATH, NODE_MATH_CLAMP, compiler.stack_assign(value_out));
-		compiler.add_node(NODE_MATH, compiler.stack_assign(value_out));
-	}
+	/* Constant operands are stored in the node instead of being loaded onto
+	 * the stack, and clamping is done by the same node. */
+	compiler.add_node(NODE_MATH,
+	                  type,
+	                  compiler.stack_assign_if_linked(value1_in),
+	                  compiler.stack_assign_if_linked(value2_in));
+	compiler.add_node(use_clamp,
+	                  compiler.stack_assign(value_out),
+	                  __float_as_int(value1),
+	                  __float_as_int(value2));
 }
 
 void MathNode::compile(OSLCompiler& compiler)
@@ -17,6 +17,8 @@
 #ifndef __SCENE_H__
 #define __SCENE_H__
 
+#include "bvh/bvh_params.h"
+
 #include "render/image.h"
 #include "render/shader.h"
 
@@ -98,6 +100,9 @@ public:
 	device_vector<float4> light_data;
 	device_vector<float2> light_background_marginal_cdf;
 	device_vector<float2> light_background_conditional_cdf;
+	device_vector<float4> light_tree_nodes;
+	device_vector<float4> light_tree_emitters;
+	device_vector<uint> light_tree_triangles;
 
 	/* particles */
 	device_vector<float4> particles;
@@ -150,7 +155,8 @@ public:
 				 && accept_unmipped == params.accept_unmipped
 				 && accept_untiled == params.accept_untiled
 				 && auto_tile == params.auto_tile
-				 && auto_mip == params.auto_mip);
+				 && auto_mip == params.auto_mip
+				 && tx_cache_path == params.tx_cache_path);
 	}
 	
 	int cache_size;
@@ -162,6 +168,8 @@ public:
 	bool accept_untiled;
 	bool auto_tile;
 	bool auto_mip;
+	/* Directory for converted .tx files, next to the source when empty. */
+	string tx_cache_path;
 };
 
 /* Scene Parameters */
@@ -178,8 +186,12 @@ public:
 	bool use_bvh_spatial_split;
 	bool use_bvh_unaligned_nodes;
 	int num_bvh_time_steps;
-	bool use_qbvh;
+	BVHLayout bvh_layout;
 	bool use_bvh_embree;
+	bool use_bvh_cache;
+	string bvh_cache_path;
+	float bvh_refit_sah_threshold;
+	int bvh_parallel_build_threshold;
 	bool persistent_data;
 	int texture_limit;
 	TextureCacheParams texture;
@@ -191,8 +203,11 @@ public:
 		use_bvh_spatial_split = false;
 		use_bvh_unaligned_nodes = true;
 		num_bvh_time_steps = 0;
-		use_qbvh = false;
+		bvh_layout = BVH_LAYOUT_BVH2;
 		use_bvh_embree = false;
+		use_bvh_cache = false;
+		bvh_refit_sah_threshold = 2.0f;
+		bvh_parallel_build_threshold = 256*1024;
 		persistent_data = false;
 		texture_limit = 0;
 	}
@@ -203,10 +218,14 @@ public:
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
 		&& use_bvh_unaligned_nodes == params.use_bvh_unaligned_nodes
 		&& num_bvh_time_steps == params.num_bvh_time_steps
-		&& use_qbvh == params.use_qbvh
+		&& bvh_layout == params.bvh_layout
 		&& persistent_data == params.persistent_data
 		&& texture_limit == params.texture_limit
 		&& use_bvh_embree == params.use_bvh_embree
+		&& use_bvh_cache == params.use_bvh_cache
+		&& bvh_cache_path == params.bvh_cache_path
+		&& bvh_refit_sah_threshold == params.bvh_refit_sah_threshold
+		&& bvh_parallel_build_threshold == params.bvh_parallel_build_threshold
 		&& texture_limit == params.texture_limit)
 		&& !texture.modified(params.texture); }
 };
@@ -27,9 +27,11 @@
 #include "render/scene.h"
 #include "render/session.h"
 #include "render/bake.h"
+#include "render/tile_output.h"
 
 #include "util/util_foreach.h"
 #include "util/util_function.h"
+#include "util/util_hash.h"
 #include "util/util_logging.h"
 #include "util/util_math.h"
 #include "util/util_opengl.h"
@@ -55,7 +57,26 @@ Session::Session(const SessionParams& params_)
 
 	device = Device::create(params.device, stats, params.background);
 
-	if(params.background && params.output_path.empty()) {
+	/* Big stills can be written tile by tile to avoid keeping the full
+	 * frame in memory, not possible when tiles are refined progressively. */
+	if(params.background && params.output_tiles &&
+	   !params.output_path.empty() && !params.progressive_refine)
+	{
+		tile_output = new TileOutput(params.output_path, params.tile_size);
+	}
+	else {
+		tile_output = NULL;
+	}
+
+	/* Split the last tiles when rendering on CPU threads, not when tiles have
+	 * to match the tiles of the output image or are refined progressively. */
+	if(params.background && params.split_tiles && !params.progressive_refine &&
+	   !tile_output && params.device.type == DEVICE_CPU)
+	{
+		tile_manager.tail_split_threshold = TaskScheduler::num_threads();
+	}
+
+	if(params.background && (params.output_path.empty() || tile_output)) {
 		buffers = NULL;
 		display = NULL;
 	}
@@ -69,6 +90,7 @@ Session::Session(const SessionParams& params_)
 
 	reset_time = 0.0;
 	last_update_time = 0.0;
+	tail_start_time = 0.0;
 
 	delayed_reset.do_reset = false;
 	delayed_reset.samples = 0;
@@ -101,7 +123,11 @@ Session::~Session()
 		wait();
 	}
 
-	if(!params.output_path.empty()) {
+	if(tile_output) {
+		progress.set_status("Writing Image", params.output_path);
+		tile_output->close();
+	}
+	else if(!params.output_path.empty()) {
 		/* tonemap and write out image if requested */
 		delete display;
 
@@ -117,6 +143,7 @@ Session::~Session()
 	foreach(RenderBuffers *buffers, tile_buffers)
 		delete buffers;
 
+	delete tile_output;
 	delete buffers;
 	delete display;
 	delete scene;
@@ -272,6 +299,7 @@ void Session::run_gpu()
 			path_trace();
 
 			device->task_wait();
+			update_tail_time();
 
 			if(!device->error_message().empty())
 				progress.set_cancel(device->error_message());
@@ -361,8 +389,20 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	Tile tile;
 	int device_num = device->device_number(tile_device);
 
-	if(!tile_manager.next_tile(tile, device_num))
+	if(!tile_manager.next_tile(tile, device_num)) {
+		if(tail_start_time == 0.0) {
+			tail_start_time = time_dt();
+		}
+
+		tile_lock.unlock();
+
+		/* no tiles left, help finishing the tiles of other devices */
+		if(use_tile_stealing()) {
+			return steal_tile(tile_device, rtile);
+		}
+
 		return false;
+	}
 	
 	/* fill render tile */
 	rtile.x = tile_manager.state.buffer.full_x + tile.x;
@@ -377,7 +417,7 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 
 	/* in case of a permanent buffer, return it, otherwise we will allocate
 	 * a new temporary buffer */
-	if(!(params.background && params.output_path.empty())) {
+	if(buffers) {
 		tile_manager.state.buffer.get_offset_stride(rtile.offset, rtile.stride);
 
 		rtile.buffer = buffers->buffer.device_pointer;
@@ -432,6 +472,18 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	rtile.rng_state = tilebuffers->rng_state.device_pointer;
 	rtile.buffers = tilebuffers;
 
+	if(use_tile_stealing()) {
+		thread_scoped_lock parts_lock(tile_parts_mutex);
+
+		TilePart part;
+		part.rtile = rtile;
+		part.owner = tilebuffers;
+		part.reserved_sample = -1;
+		part.end_sample = rtile.start_sample + rtile.num_samples;
+		part.released = false;
+		tile_parts[tilebuffers] = part;
+	}
+
 	/* this will tag tile as IN PROGRESS in blender-side render pipeline,
 	 * which is needed to highlight currently rendering tile before first
 	 * sample was processed for it
@@ -441,10 +493,182 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	return true;
 }
 
+bool Session::use_tile_stealing()
+{
+	/* Parts of a tile are rendered into buffers of their own and added
+	 * together, which only works for passes that are plain sums over
+	 * samples, and for buffers that are not shared by all tiles. */
+	return params.background &&
+	       !params.progressive_refine &&
+	       buffers == NULL &&
+	       !tile_manager.params.passes.adaptive_passes &&
+	       scene->film->use_cryptomatte == CRYPT_NONE;
+}
+
+bool Session::steal_tile(Device *tile_device, RenderTile& rtile)
+{
+	thread_scoped_lock parts_lock(tile_parts_mutex);
+
+	/* find the tile part with the most samples not reserved yet, parts whose
+	 * device never reserves samples can not be split */
+	TilePart *victim = NULL;
+	int victim_samples = 1;
+
+	for(TilePartMap::iterator it = tile_parts.begin(); it != tile_parts.end(); it++) {
+		TilePart& part = it->second;
+
+		if(part.released || part.reserved_sample < 0)
+			continue;
+
+		int samples = part.end_sample - part.reserved_sample;
+		if(samples > victim_samples) {
+			victim = &part;
+			victim_samples = samples;
+		}
+	}
+
+	if(!victim)
+		return false;
+
+	/* take over the upper half of its samples */
+	int split_sample = victim->end_sample - victim_samples/2;
+
+	rtile = victim->rtile;
+	rtile.start_sample = split_sample;
+	rtile.num_samples = victim->end_sample - split_sample;
+
+	BufferParams buffer_params = victim->owner->params;
+	buffer_params.get_offset_stride(rtile.offset, rtile.stride);
+
+	RenderBuffers *tilebuffers = new RenderBuffers(tile_device);
+	tilebuffers->reset(tile_device, buffer_params);
+
+	/* the kernel only initializes the rng state at the first sample */
+	uint *rng_state = tilebuffers->rng_state.get_data();
+	for(int y = 0; y < rtile.h; y++) {
+		for(int x = 0; x < rtile.w; x++) {
+			rng_state[x + y*rtile.w] = hash_int_2d(rtile.x + x, rtile.y + y);
+		}
+	}
+	tile_device->mem_copy_to(tilebuffers->rng_state);
+
+	rtile.buffer = tilebuffers->buffer.device_pointer;
+	rtile.rng_state = tilebuffers->rng_state.device_pointer;
+	rtile.buffers = tilebuffers;
+
+	VLOG(3) << "Taking over samples " << split_sample << " to " << victim->end_sample
+	        << " of tile at " << rtile.x << ", " << rtile.y << ".";
+
+	TilePart part;
+	part.rtile = rtile;
+	part.owner = victim->owner;
+	part.reserved_sample = -1;
+	part.end_sample = victim->end_sample;
+	part.released = false;
+
+	victim->end_sample = split_sample;
+	tile_parts[tilebuffers] = part;
+
+	stats.num_tiles_split++;
+
+	return true;
+}
+
+int Session::reserve_tile_samples(RenderTile& rtile, int sample, int num_samples)
+{
+	thread_scoped_lock parts_lock(tile_parts_mutex);
+
+	TilePartMap::iterator it = tile_parts.find(rtile.buffers);
+	if(it == tile_parts.end())
+		return num_samples;
+
+	TilePart& part = it->second;
+	num_samples = clamp(part.end_sample - sample, 0, num_samples);
+	part.reserved_sample = sample + num_samples;
+
+	return num_samples;
+}
+
+bool Session::release_tile_part(RenderTile& rtile)
+{
+	thread_scoped_lock parts_lock(tile_parts_mutex);
+
+	TilePartMap::iterator it = tile_parts.find(rtile.buffers);
+	if(it == tile_parts.end())
+		return true;
+
+	RenderBuffers *owner = it->second.owner;
+	it->second.rtile.sample = rtile.sample;
+	it->second.released = true;
+
+	/* the last part to finish releases the whole tile */
+	foreach(TilePartMap::value_type& other, tile_parts) {
+		if(other.second.owner == owner && !other.second.released)
+			return false;
+	}
+
+	TilePart& owner_part = tile_parts[owner];
+	int num_samples = owner_part.rtile.sample - owner_part.rtile.start_sample;
+	bool split = false;
+
+	for(it = tile_parts.begin(); it != tile_parts.end(); ) {
+		RenderBuffers *part_buffers = it->first;
+
+		if(it->second.owner != owner || part_buffers == owner) {
+			it++;
+			continue;
+		}
+
+		if(!split) {
+			owner->copy_from_device();
+			split = true;
+		}
+
+		part_buffers->copy_from_device();
+		owner->accumulate(*part_buffers);
+		num_samples += it->second.rtile.sample - it->second.rtile.start_sample;
+
+		delete part_buffers;
+		tile_parts.erase(it++);
+	}
+
+	if(split) {
+		owner->copy_to_device();
+	}
+
+	rtile = owner_part.rtile;
+	rtile.sample = rtile.start_sample + num_samples;
+	tile_parts.erase(owner);
+
+	return true;
+}
+
+void Session::update_tail_time()
+{
+	if(tail_start_time == 0.0)
+		return;
+
+	double tail_time = time_dt() - tail_start_time;
+	stats.tail_time += tail_time;
+	tail_start_time = 0.0;
+
+	VLOG(2) << "Waited " << tail_time << " seconds for the last tiles, "
+	        << stats.num_tiles_split << " tiles split so far.";
+}
+
 void Session::update_tile_sample(RenderTile& rtile)
 {
 	thread_scoped_lock tile_lock(tile_mutex);
 
+	/* parts taken over by another device only have some of the samples */
+	if(use_tile_stealing()) {
+		thread_scoped_lock parts_lock(tile_parts_mutex);
+
+		TilePartMap::iterator it = tile_parts.find(rtile.buffers);
+		if(it != tile_parts.end() && it->second.owner != rtile.buffers)
+			return;
+	}
+
 	if(update_render_tile_cb) {
 		if(params.progressive_refine == false) {
 			/* todo: optimize this by making it thread safe and removing lock */
@@ -458,6 +682,9 @@ void Session::update_tile_sample(RenderTile& rtile)
 
 void Session::release_tile(RenderTile& rtile)
 {
+	if(use_tile_stealing() && !release_tile_part(rtile))
+		return;
+
 	thread_scoped_lock tile_lock(tile_mutex);
 
 	progress.add_finished_tile();
@@ -470,10 +697,33 @@ void Session::release_tile(RenderTile& rtile)
 			delete rtile.buffers;
 		}
 	}
+	else if(tile_output) {
+		/* Open with the passes and region of the tiles being rendered. */
+		if(!tile_output->is_open() && !tile_output->open(tile_manager.params)) {
+			progress.set_error("Failed to open output image " + params.output_path);
+		}
+
+		/* Tiles are converted and written in parallel, the file is only
+		 * locked while writing. */
+		tile_lock.unlock();
+		write_tile_output(rtile);
+		tile_lock.lock();
+	}
 
 	update_status_time();
 }
 
+void Session::write_tile_output(RenderTile& rtile)
+{
+	if(tile_output->is_open() && rtile.buffers->copy_from_device()) {
+		if(!tile_output->write_tile(rtile, scene->film->exposure)) {
+			progress.set_error("Failed to write tile to " + params.output_path);
+		}
+	}
+
+	delete rtile.buffers;
+}
+
 void Session::run_cpu()
 {
 	bool tiles_written = false;
@@ -572,6 +822,7 @@ void Session::run_cpu()
 		}
 
 		device->task_wait();
+		update_tail_time();
 
 		{
 			thread_scoped_lock reset_lock(delayed_reset.mutex);
@@ -809,11 +1060,12 @@ void Session::update_scene()
 	}
 
 	/* number of samples is needed by multi jittered
-	 * sampling pattern and by baking */
+	 * sampling pattern, by baking and by adaptive sampling */
 	Integrator *integrator = scene->integrator;
 	BakeManager *bake_manager = scene->bake_manager;
 
 	if(integrator->sampling_pattern == SAMPLING_PATTERN_CMJ ||
+	   integrator->adaptive_threshold > 0.0f ||
 	   bake_manager->get_baking())
 	{
 		int aa_samples = tile_manager.num_samples;
@@ -891,6 +1143,8 @@ void Session::path_trace()
 	task.release_tile = function_bind(&Session::release_tile, this, _1);
 	task.get_cancel = function_bind(&Progress::get_cancel, &this->progress);
 	task.update_tile_sample = function_bind(&Session::update_tile_sample, this, _1);
+	if(use_tile_stealing())
+		task.reserve_samples = function_bind(&Session::reserve_tile_samples, this, _1, _2, _3);
 	task.update_progress_sample = function_bind(&Progress::add_samples, &this->progress, _1, _2);
 	task.need_finish_queue = params.progressive_refine;
 	task.integrator_branched = scene->integrator->method == Integrator::BRANCHED_PATH;
@@ -22,6 +22,7 @@
 #include "render/shader.h"
 #include "render/tile.h"
 
+#include "util/util_map.h"
 #include "util/util_progress.h"
 #include "util/util_stats.h"
 #include "util/util_thread.h"
@@ -37,6 +38,7 @@ class DisplayBuffer;
 class Progress;
 class RenderBuffers;
 class Scene;
+class TileOutput;
 
 /* Session Parameters */
 
@@ -46,6 +48,13 @@ public:
 	bool background;
 	bool progressive_refine;
 	string output_path;
+	/* Write tiles to output_path as they finish, instead of keeping the
+	 * full frame in memory until the end. Background only. */
+	bool output_tiles;
+	/* Split the last tiles of a background render into smaller ones, so all
+	 * threads keep working until the end. Tiles then no longer match the
+	 * tiles of the image. */
+	bool split_tiles;
 
 	bool progressive;
 	bool experimental;
@@ -69,6 +78,8 @@ public:
 		background = false;
 		progressive_refine = false;
 		output_path = "";
+		output_tiles = false;
+		split_tiles = true;
 
 		progressive = false;
 		experimental = false;
@@ -93,6 +104,8 @@ public:
 		&& background == params.background
 		&& progressive_refine == params.progressive_refine
 		&& output_path == params.output_path
+		&& output_tiles == params.output_tiles
+		&& split_tiles == params.split_tiles
 		/* && samples == params.samples */
 		&& progressive == params.progressive
 		&& experimental == params.experimental
@@ -177,6 +190,31 @@ protected:
 	void update_tile_sample(RenderTile& tile);
 	void release_tile(RenderTile& tile);
 
+	/* Tile stealing: once no tiles are left, idle devices take over the last
+	 * samples of tiles still in progress, rendering them into buffers of
+	 * their own. All parts are added together when the last one finishes. */
+	struct TilePart {
+		RenderTile rtile;
+		/* buffers of the tile as first acquired, which parts are added to */
+		RenderBuffers *owner;
+		/* first sample not yet reserved for rendering, -1 before the device
+		 * reserved any */
+		int reserved_sample;
+		int end_sample;
+		bool released;
+	};
+	typedef map<RenderBuffers*, TilePart> TilePartMap;
+
+	bool use_tile_stealing();
+	bool steal_tile(Device *tile_device, RenderTile& rtile);
+	int reserve_tile_samples(RenderTile& rtile, int sample, int num_samples);
+	bool release_tile_part(RenderTile& rtile);
+
+	TilePartMap tile_parts;
+	thread_mutex tile_parts_mutex;
+	double tail_start_time;
+	void update_tail_time();
+
 	bool device_use_gl;
 
 	thread *session_thread;
@@ -204,6 +242,10 @@ protected:
 
 	vector<RenderBuffers *> tile_buffers;
 
+	/* tiles written straight to the output file */
+	TileOutput *tile_output;
+	void write_tile_output(RenderTile& rtile);
+
 	DeviceRequestedFeatures get_requested_device_features();
 
 	/* ** Split kernel routines ** */
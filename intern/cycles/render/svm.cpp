@@ -170,6 +170,8 @@ SVMCompiler::SVMCompiler(ShaderManager *shader_manager_, ImageManager *image_man
 	background = false;
 	mix_weight_offset = SVM_STACK_INVALID;
 	compile_failed = false;
+	num_graph_nodes = 0;
+	num_constant_loads = 0;
 }
 
 int SVMCompiler::stack_size(SocketType::Type type)
@@ -252,6 +254,7 @@ int SVMCompiler::stack_assign(ShaderInput *input)
 
 			/* not linked to output -> add nodes to load default value */
 			input->stack_offset = stack_find_offset(input->type());
+			num_constant_loads++;
 
 			if(input->type() == SocketType::FLOAT) {
 				add_node(NODE_VALUE_F, __float_as_int(node->get_float(input->socket_type)), input->stack_offset);
@@ -436,6 +439,7 @@ void SVMCompiler::find_dependencies(ShaderNodeSet& dependencies,
 void SVMCompiler::generate_node(ShaderNode *node, ShaderNodeSet& done)
 {
 	node->compile(*this);
+	num_graph_nodes++;
 	stack_clear_users(node, done);
 	stack_clear_temporary(node);
 
@@ -943,6 +947,8 @@ void SVMCompiler::compile(Scene *scene,
 		summary->time_total = time_dt() - time_start;
 		summary->peak_stack_usage = max_stack_use;
 		summary->num_svm_nodes = svm_nodes.size() - start_num_svm_nodes;
+		summary->num_graph_nodes = num_graph_nodes;
+		summary->num_constant_loads = num_constant_loads;
 	}
 }
 
@@ -950,6 +956,8 @@ void SVMCompiler::compile(Scene *scene,
 
 SVMCompiler::Summary::Summary()
 	: num_svm_nodes(0),
+	  num_graph_nodes(0),
+	  num_constant_loads(0),
 	  peak_stack_usage(0),
 	  time_finalize(0.0),
 	  time_finalize_bump(0.0),
@@ -965,6 +973,9 @@ string SVMCompiler::Summary::full_report() const
 {
 	string report = "";
 	report += string_printf("Number of SVM nodes: %d\n", num_svm_nodes);
+	report += string_printf("Bytecode size:       %d bytes\n", num_svm_nodes * (int)sizeof(int4));
+	report += string_printf("Graph nodes:         %d\n", num_graph_nodes);
+	report += string_printf("Constant loads:      %d\n", num_constant_loads);
 	report += string_printf("Peak stack usage:    %d\n", peak_stack_usage);
 
 	report += string_printf("Time (in seconds):\n");
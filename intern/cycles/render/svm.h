@@ -69,6 +69,12 @@ public:
 		/* Number of SVM nodes shader was compiled into. */
 		int num_svm_nodes;
 
+		/* Number of shader graph nodes compiled, over all shader types. */
+		int num_graph_nodes;
+
+		/* Number of SVM nodes loading constant input values onto the stack. */
+		int num_constant_loads;
+
 		/* Peak stack usage during shader evaluation. */
 		int peak_stack_usage;
 
@@ -221,6 +227,10 @@ protected:
 	int max_stack_use;
 	uint mix_weight_offset;
 	bool compile_failed;
+
+	/* Statistics for the summary. */
+	int num_graph_nodes;
+	int num_constant_loads;
 };
 
 CCL_NAMESPACE_END
@@ -100,6 +100,8 @@ TileManager::TileManager(bool progressive_, int num_samples_, int2 tile_size_, i
 	range_start_sample = 0;
 	range_num_samples = -1;
 
+	tail_split_threshold = 0;
+
 	BufferParams buffer_params;
 	reset(buffer_params, 0);
 }
@@ -340,11 +342,53 @@ bool TileManager::next_tile(Tile& tile, int device)
 	if((logical_device >= state.tiles.size()) || state.tiles[logical_device].empty())
 		return false;
 
-	tile = Tile(state.tiles[logical_device].front());
-	state.tiles[logical_device].pop_front();
+	list<Tile>& tiles = state.tiles[logical_device];
+
+	if(tail_split_threshold > 0)
+		split_tail_tiles(tiles);
+
+	tile = Tile(tiles.front());
+	tiles.pop_front();
 	return true;
 }
 
+void TileManager::split_tail_tiles(list<Tile>& tiles)
+{
+	/* Smallest tile width or height split down to. */
+	const int min_size = 16;
+
+	int num_tiles = 0;
+	for(list<Tile>::iterator it = tiles.begin(); it != tiles.end(); it++) {
+		if(++num_tiles >= tail_split_threshold)
+			return;
+	}
+
+	/* Split along the longest side, keeping both halves in the place of the
+	 * tile in the list. Repeated as tiles get taken, so the last tiles end
+	 * up getting smaller and smaller. */
+	for(list<Tile>::iterator it = tiles.begin(); it != tiles.end(); it++) {
+		Tile& tile = *it;
+		Tile split = tile;
+
+		if(tile.w >= tile.h && tile.w >= 2*min_size) {
+			tile.w /= 2;
+			split.x += tile.w;
+			split.w -= tile.w;
+		}
+		else if(tile.h >= 2*min_size) {
+			tile.h /= 2;
+			split.y += tile.h;
+			split.h -= tile.h;
+		}
+		else {
+			continue;
+		}
+
+		split.index = state.num_tiles++;
+		it = tiles.insert(++it, split);
+	}
+}
+
 bool TileManager::done()
 {
 	int end_sample = (range_num_samples == -1)
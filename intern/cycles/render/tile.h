@@ -96,6 +96,13 @@ public:
 
 	/* Get number of actual samples to render. */
 	int get_num_effective_samples();
+
+	/* ** Tail splitting. ** */
+
+	/* Once fewer tiles than this are left, the remaining tiles are split in
+	 * half to keep this many threads busy until the end. 0 to disable, tiles
+	 * then always match the tiles of the image. */
+	int tail_split_threshold;
 protected:
 
 	void set_tiles();
@@ -127,6 +134,9 @@ protected:
 
 	/* Generate tile list, return number of tiles. */
 	int gen_tiles(bool sliced);
+
+	/* Split the remaining tiles when there are too few left. */
+	void split_tail_tiles(list<Tile>& tiles);
 };
 
 CCL_NAMESPACE_END
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/tile_output.h"
+
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Pass names as used for Blender render results. */
+
+static const struct {
+	PassType type;
+	const char *name;
+	int components;
+	bool color;
+} tile_output_passes[] = {
+	{PASS_COMBINED, "", 4, true},
+	{PASS_DEPTH, "Depth", 1, false},
+	{PASS_MIST, "Mist", 1, false},
+	{PASS_NORMAL, "Normal", 3, false},
+	{PASS_UV, "UV", 3, false},
+	{PASS_MOTION, "Vector", 4, false},
+	{PASS_OBJECT_ID, "IndexOB", 1, false},
+	{PASS_MATERIAL_ID, "IndexMA", 1, false},
+	{PASS_DIFFUSE_COLOR, "DiffCol", 3, true},
+	{PASS_GLOSSY_COLOR, "GlossCol", 3, true},
+	{PASS_TRANSMISSION_COLOR, "TransCol", 3, true},
+	{PASS_SUBSURFACE_COLOR, "SubsurfaceCol", 3, true},
+	{PASS_DIFFUSE_DIRECT, "DiffDir", 3, true},
+	{PASS_GLOSSY_DIRECT, "GlossDir", 3, true},
+	{PASS_TRANSMISSION_DIRECT, "TransDir", 3, true},
+	{PASS_SUBSURFACE_DIRECT, "SubsurfaceDir", 3, true},
+	{PASS_DIFFUSE_INDIRECT, "DiffInd", 3, true},
+	{PASS_GLOSSY_INDIRECT, "GlossInd", 3, true},
+	{PASS_TRANSMISSION_INDIRECT, "TransInd", 3, true},
+	{PASS_SUBSURFACE_INDIRECT, "SubsurfaceInd", 3, true},
+	{PASS_EMISSION, "Emit", 3, true},
+	{PASS_BACKGROUND, "Env", 3, true},
+	{PASS_AO, "AO", 3, true},
+	{PASS_SHADOW, "Shadow", 3, true},
+};
+
+static const struct {
+	const char *name;
+	int components;
+} tile_output_denoising_passes[] = {
+	{"Denoising Normal", 3},
+	{"Denoising Normal Variance", 3},
+	{"Denoising Albedo", 3},
+	{"Denoising Albedo Variance", 3},
+	{"Denoising Depth", 1},
+	{"Denoising Depth Variance", 1},
+	{"Denoising Shadow A", 3},
+	{"Denoising Shadow B", 3},
+	{"Denoising Image", 3},
+	{"Denoising Image Variance", 3},
+};
+
+static void tile_output_add_channel_names(vector<string>& names,
+                                          const string& name,
+                                          int components,
+                                          bool color)
+{
+	const char *suffix = (color)? "RGBA": (components == 1)? "Z": "XYZW";
+	string prefix = (name.empty())? "": name + ".";
+
+	for(int i = 0; i < components; i++) {
+		names.push_back(prefix + suffix[i]);
+	}
+}
+
+TileOutput::TileOutput(const string& filename_, int2 tile_size_)
+: filename(filename_), tile_size(tile_size_)
+{
+	num_components = 0;
+	full_x = full_y = 0;
+	width = height = 0;
+	pad = 0;
+	data_y = 0;
+	out = NULL;
+}
+
+TileOutput::~TileOutput()
+{
+	close();
+}
+
+bool TileOutput::open(const BufferParams& params)
+{
+	thread_scoped_lock lock(mutex);
+
+	if(out) {
+		return true;
+	}
+
+	vector<string> names;
+	add_channels(params, names);
+
+	full_x = params.full_x;
+	full_y = params.full_y;
+	width = params.width;
+	height = params.height;
+
+	/* Tiles are laid out from the bottom of the render and from the top of
+	 * the file, pad the top so both grids line up. */
+	int num_tiles_y = (height + tile_size.y - 1) / tile_size.y;
+	pad = num_tiles_y * tile_size.y - height;
+
+	ImageSpec spec(width, height + pad, num_components, TypeDesc::FLOAT);
+	spec.x = full_x;
+	data_y = params.full_height - (full_y + height) - pad;
+	spec.y = data_y;
+	spec.full_x = 0;
+	spec.full_y = 0;
+	spec.full_width = params.full_width;
+	spec.full_height = params.full_height;
+	spec.tile_width = tile_size.x;
+	spec.tile_height = tile_size.y;
+	spec.channelnames = names;
+	spec.alpha_channel = (channels.size() && channels[0].type == PASS_COMBINED)? 3: -1;
+	spec.attribute("openexr:lineOrder", "randomY");
+
+	out = ImageOutput::create(filename);
+
+	if(!out) {
+		VLOG(1) << "Failed to create tile output for " << filename << ".";
+		return false;
+	}
+
+	if(!out->supports("tiles") || !out->open(filename, spec)) {
+		VLOG(1) << "Failed to open tile output " << filename << ": " << out->geterror();
+		delete out;
+		out = NULL;
+		return false;
+	}
+
+	VLOG(1) << "Writing tiles to " << filename << ", "
+	        << channels.size() << " passes, "
+	        << num_components << " channels.";
+
+	return true;
+}
+
+void TileOutput::add_channels(const BufferParams& params, vector<string>& names)
+{
+	channels.clear();
+	num_components = 0;
+
+	const array<Pass>& passes = params.passes.get_passes();
+
+	for(int i = 0; i < sizeof(tile_output_passes)/sizeof(*tile_output_passes); i++) {
+		bool found = false;
+		for(size_t j = 0; j < passes.size(); j++) {
+			found |= (passes[j].type == tile_output_passes[i].type);
+		}
+
+		if(found) {
+			Channel channel;
+			channel.type = tile_output_passes[i].type;
+			channel.components = tile_output_passes[i].components;
+			channels.push_back(channel);
+
+			tile_output_add_channel_names(names,
+			                              tile_output_passes[i].name,
+			                              channel.components,
+			                              tile_output_passes[i].color);
+		}
+	}
+
+	if(params.passes.denoising_passes) {
+		for(int i = 0; i < sizeof(tile_output_denoising_passes)/sizeof(*tile_output_denoising_passes); i++) {
+			Channel channel;
+			channel.type = PASS_NONE;
+			channel.denoising_name = tile_output_denoising_passes[i].name;
+			channel.components = tile_output_denoising_passes[i].components;
+			channels.push_back(channel);
+
+			tile_output_add_channel_names(names,
+			                              channel.denoising_name,
+			                              channel.components,
+			                              false);
+		}
+	}
+
+	const array<AOV>& aovs = params.passes.get_aovs();
+
+	for(size_t i = 0; i < aovs.size(); i++) {
+		Channel channel;
+		channel.type = PASS_NONE;
+		channel.name = aovs[i].name;
+		channel.components = (aovs[i].type == AOV_FLOAT)? 1:
+		                     (aovs[i].type == AOV_RGB)? 3: 4;
+		channels.push_back(channel);
+
+		tile_output_add_channel_names(names,
+		                              channel.name.string(),
+		                              channel.components,
+		                              aovs[i].type != AOV_FLOAT);
+	}
+
+	foreach(const Channel& channel, channels) {
+		num_components += channel.components;
+	}
+}
+
+bool TileOutput::read_channel(RenderBuffers *buffers, const Channel& channel,
+                              float exposure, int sample, float *pixels)
+{
+	if(!channel.name.empty()) {
+		return buffers->get_aov_rect(channel.name, exposure, sample, channel.components, pixels);
+	}
+	else if(channel.type == PASS_NONE) {
+		return buffers->get_denoising_pass_rect(channel.denoising_name, exposure, sample, channel.components, pixels);
+	}
+	else {
+		return buffers->get_pass_rect(channel.type, exposure, sample, channel.components, pixels);
+	}
+}
+
+bool TileOutput::write_tile(RenderTile& rtile, float exposure)
+{
+	RenderBuffers *buffers = rtile.buffers;
+	int x = rtile.x - full_x;
+	int y = rtile.y - full_y;
+	int w = rtile.w;
+	int h = rtile.h;
+
+	/* The topmost tiles are written with the padding rows. */
+	int file_h = (y + h == height)? h + pad: h;
+	int file_y = height + pad - y - file_h;
+
+	if(x % tile_size.x != 0 || file_y % tile_size.y != 0 ||
+	   (w != tile_size.x && x + w != width) || file_h != tile_size.y)
+	{
+		VLOG(1) << "Tile at " << rtile.x << ", " << rtile.y
+		        << " does not match the tiles of " << filename << ".";
+		return false;
+	}
+
+	/* Convert passes outside of the lock, the file is written one tile at
+	 * a time. */
+	vector<float> pixels(w*h*4);
+	vector<float> tile(w*file_h*num_components, 0.0f);
+	int offset = 0;
+
+	foreach(const Channel& channel, channels) {
+		if(!read_channel(buffers, channel, exposure, rtile.sample, &pixels[0])) {
+			return false;
+		}
+
+		/* Interleave and flip rows. */
+		for(int row = 0; row < h; row++) {
+			const float *in = &pixels[row*w*channel.components];
+			float *out_row = &tile[((file_h - 1 - row)*w)*num_components + offset];
+
+			for(int col = 0; col < w; col++) {
+				for(int c = 0; c < channel.components; c++) {
+					out_row[col*num_components + c] = in[col*channel.components + c];
+				}
+			}
+		}
+
+		offset += channel.components;
+	}
+
+	thread_scoped_lock lock(mutex);
+
+	if(!out) {
+		return false;
+	}
+
+	int xbegin = full_x + x;
+	int ybegin = data_y + file_y;
+
+	if(!out->write_tiles(xbegin, xbegin + w,
+	                     ybegin, ybegin + file_h,
+	                     0, 1,
+	                     TypeDesc::FLOAT,
+	                     &tile[0]))
+	{
+		VLOG(1) << "Failed to write tile to " << filename << ": " << out->geterror();
+		return false;
+	}
+
+	return true;
+}
+
+void TileOutput::close()
+{
+	thread_scoped_lock lock(mutex);
+
+	if(out) {
+		out->close();
+		delete out;
+		out = NULL;
+	}
+}
+
+CCL_NAMESPACE_END
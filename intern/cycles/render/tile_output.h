@@ -0,0 +1,87 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TILE_OUTPUT_H__
+#define __TILE_OUTPUT_H__
+
+#include "render/buffers.h"
+
+#include "util/util_image.h"
+#include "util/util_string.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Tile Output
+ *
+ * Writes finished tiles of a background render straight into a tiled float
+ * EXR, so the full frame never has to be kept in memory. All passes are
+ * written as channels of a single image, with the same tiling as the
+ * render so every tile is written exactly once. */
+
+class TileOutput {
+public:
+	TileOutput(const string& filename, int2 tile_size);
+	~TileOutput();
+
+	/* Open the file for the region of the image described by params,
+	 * which must have the passes of the tiles written to it. */
+	bool open(const BufferParams& params);
+	bool is_open() const { return out != NULL; }
+
+	/* Write tile from its render buffers, which must have been copied
+	 * from the device already. */
+	bool write_tile(RenderTile& rtile, float exposure);
+
+	void close();
+
+protected:
+	struct Channel {
+		/* Pass, or AOV if name is not empty, or denoising pass if type is
+		 * PASS_NONE. */
+		PassType type;
+		ustring name;
+		string denoising_name;
+		int components;
+	};
+
+	void add_channels(const BufferParams& params, vector<string>& names);
+	bool read_channel(RenderBuffers *buffers, const Channel& channel,
+	                  float exposure, int sample, float *pixels);
+
+	string filename;
+	int2 tile_size;
+
+	vector<Channel> channels;
+	int num_components;
+
+	/* Region in the full image, and rows added at the top to align the
+	 * bottom-up tiles to the top-down tiles of the file. */
+	int full_x, full_y;
+	int width, height;
+	int pad;
+	/* Top of the data window of the file. */
+	int data_y;
+
+	ImageOutput *out;
+	thread_mutex mutex;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __TILE_OUTPUT_H__ */
@@ -24,41 +24,44 @@
 
 CCL_NAMESPACE_BEGIN
 
-/* EdgeDice Base */
+/* Dice Output */
 
-EdgeDice::EdgeDice(const SubdParams& params_)
-: params(params_)
+void DiceOutput::append(const DiceOutput& other, size_t vert_offset, size_t tri_offset)
 {
-	mesh_P = NULL;
-	mesh_N = NULL;
-	vert_offset = 0;
+	int index_offset = (int)num_verts() - (int)vert_offset;
 
-	params.mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+	P.insert(P.end(), other.P.begin() + vert_offset, other.P.end());
+	N.insert(N.end(), other.N.begin() + vert_offset, other.N.end());
+	uv.insert(uv.end(), other.uv.begin() + vert_offset, other.uv.end());
 
-	if(params.ptex) {
-		params.mesh->attributes.add(ATTR_STD_PTEX_UV);
-		params.mesh->attributes.add(ATTR_STD_PTEX_FACE_ID);
+	for(size_t i = tri_offset*3; i < other.triangles.size(); i++) {
+		triangles.push_back(other.triangles[i] + index_offset);
 	}
-}
 
-void EdgeDice::reserve(int num_verts)
-{
-	Mesh *mesh = params.mesh;
-
-	vert_offset = mesh->verts.size();
-	tri_offset = mesh->num_triangles();
+	shader.insert(shader.end(), other.shader.begin() + tri_offset, other.shader.end());
+	patch_index.insert(patch_index.end(), other.patch_index.begin() + tri_offset, other.patch_index.end());
 
-	/* todo: optimize so we can reserve in advance, this is like push_back_slow() */
-	if(vert_offset + num_verts > mesh->verts.capacity()) {
-		mesh->reserve_mesh(size_t((vert_offset + num_verts) * 1.2), mesh->num_triangles());
+	if(other.ptex_face_id.size()) {
+		ptex_face_id.insert(ptex_face_id.end(), other.ptex_face_id.begin() + tri_offset, other.ptex_face_id.end());
 	}
+}
 
-	mesh->resize_mesh(vert_offset + num_verts, tri_offset);
+void DiceOutput::clear()
+{
+	P.clear();
+	N.clear();
+	uv.clear();
+	triangles.clear();
+	shader.clear();
+	patch_index.clear();
+	ptex_face_id.clear();
+}
 
-	Attribute *attr_vN = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+/* EdgeDice Base */
 
-	mesh_P = mesh->verts.data();
-	mesh_N = attr_vN->data_float3();
+EdgeDice::EdgeDice(const SubdParams& params_, DiceOutput *output_)
+: params(params_), output(output_)
+{
 }
 
 int EdgeDice::add_vert(Patch *patch, float2 uv)
@@ -67,45 +70,24 @@ int EdgeDice::add_vert(Patch *patch, float2 uv)
 
 	patch->eval(&P, NULL, NULL, &N, uv.x, uv.y);
 
-	assert(vert_offset < params.mesh->verts.size());
-
-	mesh_P[vert_offset] = P;
-	mesh_N[vert_offset] = N;
-	params.mesh->vert_patch_uv[vert_offset] = make_float2(uv.x, uv.y);
-
-	if(params.ptex) {
-		Attribute *attr_ptex_uv = params.mesh->attributes.add(ATTR_STD_PTEX_UV);
-		params.mesh->attributes.resize();
-
-		float3 *ptex_uv = attr_ptex_uv->data_float3();
-		ptex_uv[vert_offset] = make_float3(uv.x, uv.y, 0.0f);
-	}
+	output->P.push_back(P);
+	output->N.push_back(N);
+	output->uv.push_back(uv);
 
-	params.mesh->num_subd_verts++;
-
-	return vert_offset++;
+	return output->P.size() - 1;
 }
 
 void EdgeDice::add_triangle(Patch *patch, int v0, int v1, int v2)
 {
-	Mesh *mesh = params.mesh;
-
-	/* todo: optimize so we can reserve in advance, this is like push_back_slow() */
-	if(mesh->triangles.size() == mesh->triangles.capacity())
-		mesh->reserve_mesh(mesh->verts.size(), size_t(max(mesh->num_triangles() + 1, 1) * 1.2));
-
-	mesh->add_triangle(v0, v1, v2, patch->shader, true);
-	params.mesh->triangle_patch[params.mesh->num_triangles()-1] = patch->patch_index;
+	output->triangles.push_back(v0);
+	output->triangles.push_back(v1);
+	output->triangles.push_back(v2);
+	output->shader.push_back(patch->shader);
+	output->patch_index.push_back(patch->patch_index);
 
 	if(params.ptex) {
-		Attribute *attr_ptex_face_id = params.mesh->attributes.add(ATTR_STD_PTEX_FACE_ID);
-		params.mesh->attributes.resize();
-
-		float *ptex_face_id = attr_ptex_face_id->data_float();
-		ptex_face_id[tri_offset] = (float)patch->ptex_face_id();
+		output->ptex_face_id.push_back(patch->ptex_face_id());
 	}
-
-	tri_offset++;
 }
 
 void EdgeDice::stitch_triangles(Patch *patch, vector<int>& outer, vector<int>& inner)
@@ -131,8 +113,8 @@ void EdgeDice::stitch_triangles(Patch *patch, vector<int>& outer, vector<int>& i
 		}
 		else {
 			/* length of diagonals */
-			float len1 = len_squared(mesh_P[inner[i]] - mesh_P[outer[j+1]]);
-			float len2 = len_squared(mesh_P[outer[j]] - mesh_P[inner[i+1]]);
+			float len1 = len_squared(output->P[inner[i]] - output->P[outer[j+1]]);
+			float len2 = len_squared(output->P[outer[j]] - output->P[inner[i+1]]);
 
 			/* use smallest diagonal */
 			if(len1 < len2)
@@ -147,16 +129,9 @@ void EdgeDice::stitch_triangles(Patch *patch, vector<int>& outer, vector<int>& i
 
 /* QuadDice */
 
-QuadDice::QuadDice(const SubdParams& params_)
-: EdgeDice(params_)
-{
-}
-
-void QuadDice::reserve(EdgeFactors& ef, int Mu, int Mv)
+QuadDice::QuadDice(const SubdParams& params_, DiceOutput *output_)
+: EdgeDice(params_, output_)
 {
-	/* XXX need to make this also work for edge factor 0 and 1 */
-	int num_verts = (ef.tu0 + ef.tu1 + ef.tv0 + ef.tv1) + (Mu - 1)*(Mv - 1);
-	EdgeDice::reserve(num_verts);
 }
 
 float2 QuadDice::map_uv(SubPatch& sub, float u, float v)
@@ -320,9 +295,7 @@ void QuadDice::dice(SubPatch& sub, EdgeFactors& ef)
 	Mu = max((int)ceil(S*Mu), 2); // XXX handle 0 & 1?
 	Mv = max((int)ceil(S*Mv), 2); // XXX handle 0 & 1?
 
-	/* reserve space for new verts */
-	int offset = params.mesh->verts.size();
-	reserve(ef, Mu, Mv);
+	int offset = output->num_verts();
 
 	/* corners and inner grid */
 	add_corners(sub);
@@ -345,8 +318,6 @@ void QuadDice::dice(SubPatch& sub, EdgeFactors& ef)
 	/* right side */
 	add_side_v(sub, outer, inner, Mu, Mv, ef.tv1, 1, offset);
 	stitch_triangles(sub.patch, outer, inner);
-
-	assert(vert_offset == params.mesh->verts.size());
 }
 
 CCL_NAMESPACE_END
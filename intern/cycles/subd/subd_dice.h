@@ -56,19 +56,39 @@ struct SubdParams {
 
 };
 
+/* Dice Output
+ *
+ * Vertices and triangles created by dicing, with triangles indexing into the
+ * vertices of the same output. Patches are diced into separate outputs in
+ * parallel, which are appended to the mesh afterwards. */
+
+struct DiceOutput {
+	vector<float3> P;
+	vector<float3> N;
+	vector<float2> uv;
+
+	vector<int> triangles;
+	vector<int> shader;
+	vector<int> patch_index;
+	vector<int> ptex_face_id;
+
+	size_t num_verts() const { return P.size(); }
+	size_t num_triangles() const { return shader.size(); }
+
+	/* Append vertices and triangles of other, starting at the given offsets
+	 * which must be where the vertices of those triangles start. */
+	void append(const DiceOutput& other, size_t vert_offset = 0, size_t tri_offset = 0);
+	void clear();
+};
+
 /* EdgeDice Base */
 
 class EdgeDice {
 public:
 	SubdParams params;
-	float3 *mesh_P;
-	float3 *mesh_N;
-	size_t vert_offset;
-	size_t tri_offset;
-
-	explicit EdgeDice(const SubdParams& params);
+	DiceOutput *output;
 
-	void reserve(int num_verts);
+	EdgeDice(const SubdParams& params, DiceOutput *output);
 
 	int add_vert(Patch *patch, float2 uv);
 	void add_triangle(Patch *patch, int v0, int v1, int v2);
@@ -107,9 +127,8 @@ public:
 		int tv1;
 	};
 
-	explicit QuadDice(const SubdParams& params);
+	QuadDice(const SubdParams& params, DiceOutput *output);
 
-	void reserve(EdgeFactors& ef, int Mu, int Mv);
 	float3 eval_projected(SubPatch& sub, float u, float v);
 
 	float2 map_uv(SubPatch& sub, float u, float v);
@@ -29,9 +29,11 @@ CCL_NAMESPACE_BEGIN
 
 /* DiagSplit */
 
-DiagSplit::DiagSplit(const SubdParams& params_)
-: params(params_)
+DiagSplit::DiagSplit(const SubdParams& params_, DiceOutput *output_)
+: params(params_), output(output_)
 {
+	num_patches_diced = 0;
+	num_patches_reused = 0;
 }
 
 void DiagSplit::dispatch(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef)
@@ -106,6 +108,41 @@ void DiagSplit::partition_edge(Patch *patch, float2 *P, int *t0, int *t1, float2
 	}
 }
 
+static bool subpatches_equal(const vector<QuadDice::SubPatch>& a, const vector<QuadDice::SubPatch>& b)
+{
+	if(a.size() != b.size()) {
+		return false;
+	}
+
+	/* Exact comparison, splitting is deterministic for the same patch. */
+	for(size_t i = 0; i < a.size(); i++) {
+		if(a[i].P00 != b[i].P00 || a[i].P10 != b[i].P10 ||
+		   a[i].P01 != b[i].P01 || a[i].P11 != b[i].P11)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool edgefactors_equal(const vector<QuadDice::EdgeFactors>& a, const vector<QuadDice::EdgeFactors>& b)
+{
+	if(a.size() != b.size()) {
+		return false;
+	}
+
+	for(size_t i = 0; i < a.size(); i++) {
+		if(a[i].tu0 != b[i].tu0 || a[i].tu1 != b[i].tu1 ||
+		   a[i].tv0 != b[i].tv0 || a[i].tv1 != b[i].tv1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static void limit_edge_factors(const QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef, int max_t)
 {
 	float2 P00 = sub.P00;
@@ -215,7 +252,7 @@ void DiagSplit::split(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef, int de
 	}
 }
 
-void DiagSplit::split_quad(Patch *patch, QuadDice::SubPatch *subpatch)
+void DiagSplit::split_quad(Patch *patch, QuadDice::SubPatch *subpatch, DicedPatch *cached)
 {
 	QuadDice::SubPatch sub_split;
 	QuadDice::EdgeFactors ef_split;
@@ -240,18 +277,42 @@ void DiagSplit::split_quad(Patch *patch, QuadDice::SubPatch *subpatch)
 
 	split(sub_split, ef_split);
 
-	QuadDice dice(params);
-
-	for(size_t i = 0; i < subpatches_quad.size(); i++) {
-		QuadDice::SubPatch& sub = subpatches_quad[i];
+	for(size_t i = 0; i < edgefactors_quad.size(); i++) {
 		QuadDice::EdgeFactors& ef = edgefactors_quad[i];
 
 		ef.tu0 = max(ef.tu0, 1);
 		ef.tu1 = max(ef.tu1, 1);
 		ef.tv0 = max(ef.tv0, 1);
 		ef.tv1 = max(ef.tv1, 1);
+	}
+
+	/* Reuse the previous output if the patch is diced the same way. */
+	if(cached && cached->valid &&
+	   subpatches_equal(cached->subpatches, subpatches_quad) &&
+	   edgefactors_equal(cached->edgefactors, edgefactors_quad))
+	{
+		output->append(cached->output);
+		num_patches_reused++;
+	}
+	else {
+		size_t vert_offset = output->num_verts();
+		size_t tri_offset = output->num_triangles();
+
+		QuadDice dice(params, output);
+
+		for(size_t i = 0; i < subpatches_quad.size(); i++) {
+			dice.dice(subpatches_quad[i], edgefactors_quad[i]);
+		}
+
+		if(cached) {
+			cached->subpatches = subpatches_quad;
+			cached->edgefactors = edgefactors_quad;
+			cached->output.clear();
+			cached->output.append(*output, vert_offset, tri_offset);
+			cached->valid = true;
+		}
 
-		dice.dice(sub, ef);
+		num_patches_diced++;
 	}
 
 	subpatches_quad.clear();
@@ -24,6 +24,7 @@
 
 #include "subd/subd_dice.h"
 
+#include "util/util_string.h"
 #include "util/util_types.h"
 #include "util/util_vector.h"
 
@@ -34,14 +35,45 @@ class Patch;
 
 #define DSPLIT_NON_UNIFORM -1
 
+/* Diced Patch
+ *
+ * Subpatches, edge factors and diced output of a patch from a previous
+ * tessellation. When the patch is split the same way again, with the same
+ * edge factors, the output is reused instead of dicing the patch again. */
+
+struct DicedPatch {
+	vector<QuadDice::SubPatch> subpatches;
+	vector<QuadDice::EdgeFactors> edgefactors;
+	DiceOutput output;
+	bool valid;
+
+	DicedPatch() : valid(false) {}
+};
+
+/* Dice Cache
+ *
+ * Diced patches of a mesh, valid for as long as its control mesh does not
+ * change. Camera and dicing rate changes only re-dice patches with new edge
+ * factors. */
+
+struct DiceCache {
+	string mesh_hash;
+	vector<DicedPatch> patches;
+};
+
 class DiagSplit {
 public:
 	vector<QuadDice::SubPatch> subpatches_quad;
 	vector<QuadDice::EdgeFactors> edgefactors_quad;
 
 	SubdParams params;
+	DiceOutput *output;
+
+	/* Statistics for patches diced through the cache. */
+	int num_patches_diced;
+	int num_patches_reused;
 
-	explicit DiagSplit(const SubdParams& params);
+	DiagSplit(const SubdParams& params, DiceOutput *output);
 
 	float3 to_world(Patch *patch, float2 uv);
 	int T(Patch *patch, float2 Pstart, float2 Pend);
@@ -51,7 +83,7 @@ public:
 	void dispatch(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef);
 	void split(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef, int depth=0);
 
-	void split_quad(Patch *patch, QuadDice::SubPatch *subpatch=NULL);
+	void split_quad(Patch *patch, QuadDice::SubPatch *subpatch=NULL, DicedPatch *cached=NULL);
 };
 
 CCL_NAMESPACE_END
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "bvh/bvh.h"
+#include "bvh/bvh_params.h"
+#include "render/mesh.h"
+#include "render/object.h"
+#include "util/util_progress.h"
+#include "util/util_transform.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Two triangles in the XY plane at height z. */
+void fill_quad_mesh(Mesh *mesh, float z)
+{
+	mesh->reserve_mesh(4, 2);
+	mesh->add_vertex(make_float3(0.0f, 0.0f, z));
+	mesh->add_vertex(make_float3(1.0f, 0.0f, z));
+	mesh->add_vertex(make_float3(1.0f, 1.0f, z));
+	mesh->add_vertex(make_float3(0.0f, 1.0f, z));
+	mesh->add_triangle(0, 1, 2, 0, false);
+	mesh->add_triangle(0, 2, 3, 0, false);
+	mesh->compute_bounds();
+}
+
+void build_mesh_bvh(Mesh *mesh, const BVHParams& params)
+{
+	Object object;
+	object.mesh = mesh;
+
+	vector<Object*> objects;
+	objects.push_back(&object);
+
+	Progress progress;
+	mesh->bvh = BVH::create(params, objects);
+	mesh->bvh->build(progress);
+}
+
+/* Check every top level leaf the way the kernel reads it: object leaves
+ * store ~prim in x and must resolve to an instanced object, primitive leaves
+ * must only cover primitives of meshes with their transform applied or of
+ * the instance BVHs. */
+void check_leaves(const PackedBVH& pack, const vector<Object*>& objects)
+{
+	vector<int> num_object_leaves(objects.size(), 0);
+
+	for(size_t i = 0; i < pack.leaf_nodes.size(); i++) {
+		const int4 data = pack.leaf_nodes[i];
+
+		if(data.x < 0) {
+			const int prim = -data.x - 1;
+			ASSERT_LT(prim, (int)pack.prim_object.size());
+			EXPECT_EQ(pack.prim_index[prim], -1);
+
+			const int object = pack.prim_object[prim];
+			ASSERT_GE(object, 0);
+			ASSERT_LT(object, (int)objects.size());
+			EXPECT_TRUE(objects[object]->mesh->is_instanced());
+			num_object_leaves[object]++;
+		}
+		else {
+			ASSERT_LE(data.x, data.y);
+			ASSERT_LE(data.y, (int)pack.prim_index.size());
+			for(int prim = data.x; prim < data.y; prim++) {
+				EXPECT_NE(pack.prim_index[prim], -1);
+			}
+		}
+	}
+
+	for(size_t i = 0; i < objects.size(); i++) {
+		EXPECT_EQ(num_object_leaves[i], objects[i]->mesh->is_instanced()? 1: 0);
+	}
+}
+
+void test_instanced_scene(BVHLayout layout)
+{
+	BVHParams params;
+	params.bvh_layout = layout;
+
+	/* The instanced mesh is packed in front of the top level BVH, so top
+	 * level leaves get a non-zero primitive offset. */
+	Mesh instanced_mesh;
+	fill_quad_mesh(&instanced_mesh, 0.0f);
+	instanced_mesh.transform_applied = false;
+	instanced_mesh.tri_offset = 0;
+	build_mesh_bvh(&instanced_mesh, params);
+
+	Mesh applied_mesh;
+	fill_quad_mesh(&applied_mesh, 5.0f);
+	applied_mesh.transform_applied = true;
+	applied_mesh.tri_offset = instanced_mesh.num_triangles();
+
+	Object objects_data[4];
+	vector<Object*> objects;
+	for(int i = 0; i < 4; i++) {
+		Object *ob = &objects_data[i];
+		ob->mesh = (i == 3)? &applied_mesh: &instanced_mesh;
+		ob->tfm = transform_translate(make_float3(2.0f * i, 0.0f, 0.0f));
+		if(ob->mesh->transform_applied) {
+			ob->tfm = transform_identity();
+		}
+		ob->compute_bounds(false);
+		objects.push_back(ob);
+	}
+
+	BVHParams top_params = params;
+	top_params.top_level = true;
+
+	Progress progress;
+	BVH *top = BVH::create(top_params, objects);
+	top->build(progress);
+	check_leaves(top->pack, objects);
+
+	/* Rebuild reusing the packed instances, as done on scene updates. */
+	BVH *top_next = BVH::create(top_params, objects);
+	top_next->steal_instances(top);
+	delete top;
+	top_next->build(progress);
+	check_leaves(top_next->pack, objects);
+	delete top_next;
+}
+
+}  // namespace
+
+TEST(bvh_instance, top_level_leaves_bvh2)
+{
+	test_instanced_scene(BVH_LAYOUT_BVH2);
+}
+
+TEST(bvh_instance, top_level_leaves_bvh4)
+{
+	test_instanced_scene(BVH_LAYOUT_BVH4);
+}
+
+CCL_NAMESPACE_END
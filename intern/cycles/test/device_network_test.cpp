@@ -0,0 +1,270 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "device/device.h"
+#include "device/device_intern.h"
+#include "device/device_network.h"
+
+#include "util/util_thread.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Receiving end of the loopback connection, like the server would read a
+ * buffer sent along with an RPC. */
+void receive_buffer(boost::asio::io_service *io_service,
+                    tcp::acceptor *acceptor,
+                    vector<uint8_t> *result,
+                    bool *error)
+{
+	tcp::socket socket(*io_service);
+	acceptor->accept(socket);
+
+	NetworkError error_func;
+	RPCReceive rcv(socket, &error_func);
+
+	size_t size;
+	rcv.read(size);
+
+	result->resize(size);
+	rcv.read_buffer_compressed(&(*result)[0], size);
+
+	*error = error_func.have_error();
+}
+
+/* Send buffer to a receiver on another thread over loopback, and return the
+ * buffer it got. */
+vector<uint8_t> transfer_buffer(const vector<uint8_t>& data, NetworkStats *stats)
+{
+	boost::asio::io_service io_service;
+	tcp::acceptor acceptor(io_service,
+	                       tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+	vector<uint8_t> result;
+	bool receive_error = true;
+	thread receive_thread(function_bind(receive_buffer,
+	                                    &io_service,
+	                                    &acceptor,
+	                                    &result,
+	                                    &receive_error));
+
+	tcp::socket socket(io_service);
+	socket.connect(acceptor.local_endpoint());
+
+	NetworkError error_func;
+	RPCSend snd(socket, &error_func, "buffer");
+	size_t size = data.size();
+	snd.add(size);
+	snd.write();
+	snd.write_buffer_compressed(&data[0], size, stats);
+
+	receive_thread.join();
+
+	EXPECT_FALSE(error_func.have_error());
+	EXPECT_FALSE(receive_error);
+
+	/* Buffers sent outside of a device are never looked up in the server cache. */
+	EXPECT_EQ(stats->bytes_raw, data.size());
+	EXPECT_EQ(stats->bytes_cached, (size_t)0);
+	EXPECT_GE(stats->time, 0.0);
+
+	return result;
+}
+
+/* Device on the server side, keeping a copy of every texture allocated on
+ * it to check what the server handed to the device. */
+class TextureDevice : public Device {
+public:
+	TextureDevice(DeviceInfo& info, Stats& stats)
+	: Device(info, stats, true), mem_counter(0)
+	{
+	}
+
+	void mem_alloc(const char * /*name*/, device_memory& mem, MemoryType /*type*/)
+	{
+		mem.device_pointer = ++mem_counter;
+	}
+	void mem_copy_to(device_memory& /*mem*/) {}
+	void mem_copy_from(device_memory& /*mem*/, int /*y*/, int /*w*/, int /*h*/, int /*elem*/) {}
+	void mem_zero(device_memory& /*mem*/) {}
+	void mem_free(device_memory& /*mem*/) {}
+	void const_copy_to(const char * /*name*/, void * /*host*/, size_t /*size*/) {}
+
+	void tex_alloc(const char * /*name*/,
+	               device_memory& mem,
+	               InterpolationType /*interpolation*/,
+	               ExtensionType /*extension*/)
+	{
+		const uint8_t *data = (const uint8_t*)mem.data_pointer;
+		textures.push_back(vector<uint8_t>(data, data + mem.memory_size()));
+		mem.device_pointer = ++mem_counter;
+	}
+	void tex_free(device_memory& /*mem*/) {}
+
+	int get_split_task_count(DeviceTask& /*task*/) { return 1; }
+	void task_add(DeviceTask& /*task*/) {}
+	void task_wait() {}
+	void task_cancel() {}
+
+	device_ptr mem_counter;
+	vector<vector<uint8_t> > textures;
+};
+
+void serve_device(boost::asio::io_service *io_service,
+                  tcp::acceptor *acceptor,
+                  Device *device,
+                  size_t cache_size)
+{
+	tcp::socket socket(*io_service);
+	acceptor->accept(socket);
+
+	device_network_server_listen(device, socket, cache_size);
+}
+
+vector<uint8_t> make_texture(size_t size, uint8_t seed)
+{
+	vector<uint8_t> data(size);
+	for(size_t i = 0; i < size; i++) {
+		data[i] = (uint8_t)(seed + (i / 64) % 251);
+	}
+	return data;
+}
+
+/* Allocate a texture with the data, and free it again right away, like a
+ * texture that is unchanged between two frames. */
+void tex_alloc_free(Device *device, const vector<uint8_t>& data)
+{
+	device_vector<uchar> tex;
+	tex.copy((uchar*)&data[0], data.size());
+
+	device->tex_alloc("texture", tex);
+	device->tex_free(tex);
+}
+
+}  // namespace
+
+TEST(device_network, compressed_transfer) {
+	TaskScheduler::init(0);
+
+	/* Smooth data with some repetition, like typical texture and BVH
+	 * arrays, with a size that does not line up with chunks. */
+	vector<uint8_t> data(16*NETWORK_CHUNK_SIZE + 123);
+	for(size_t i = 0; i < data.size(); i++) {
+		data[i] = (uint8_t)((i / 64) % 251);
+	}
+
+	NetworkStats stats;
+	vector<uint8_t> result = transfer_buffer(data, &stats);
+
+	TaskScheduler::exit();
+
+	EXPECT_TRUE(result == data);
+	EXPECT_LT(stats.bytes_sent, data.size() / 4);
+}
+
+TEST(device_network, incompressible_transfer) {
+	TaskScheduler::init(0);
+
+	vector<uint8_t> data(4*NETWORK_CHUNK_SIZE);
+	uint state = 12345;
+	for(size_t i = 0; i < data.size(); i++) {
+		state = state * 1103515245u + 12345u;
+		data[i] = (uint8_t)(state >> 24);
+	}
+
+	NetworkStats stats;
+	vector<uint8_t> result = transfer_buffer(data, &stats);
+
+	TaskScheduler::exit();
+
+	/* Chunks that don't get smaller are sent as is, only adding headers. */
+	EXPECT_TRUE(result == data);
+	EXPECT_EQ(stats.bytes_sent, data.size() + 4*2*sizeof(uint32_t));
+}
+
+TEST(device_network, texture_cache) {
+	TaskScheduler::init(0);
+
+	const size_t size = 4*NETWORK_CACHE_MIN_SIZE;
+	vector<uint8_t> data_a = make_texture(size, 1);
+	vector<uint8_t> data_b = make_texture(size, 2);
+	vector<uint8_t> data_c = make_texture(size, 3);
+
+	DeviceInfo info;
+	info.type = DEVICE_NETWORK;
+	Stats stats;
+	TextureDevice server_device(info, stats);
+
+	/* Server keeping at most two freed textures. */
+	boost::asio::io_service io_service;
+	tcp::acceptor acceptor(io_service,
+	                       tcp::endpoint(boost::asio::ip::address_v4::loopback(), SERVER_PORT));
+	thread server_thread(function_bind(serve_device,
+	                                   &io_service,
+	                                   &acceptor,
+	                                   &server_device,
+	                                   2*size));
+
+	Device *device = device_network_create(info, stats, "127.0.0.1");
+
+	/* Second allocation of the same data is found in the server cache. */
+	tex_alloc_free(device, data_a);
+	EXPECT_EQ(device_network_stats(device).bytes_cached, (size_t)0);
+	tex_alloc_free(device, data_a);
+	EXPECT_EQ(device_network_stats(device).bytes_cached, size);
+
+	/* Freeing a third texture evicts the oldest one, A. */
+	tex_alloc_free(device, data_b);
+	tex_alloc_free(device, data_c);
+	EXPECT_EQ(device_network_stats(device).bytes_cached, size);
+
+	tex_alloc_free(device, data_a);
+	EXPECT_EQ(device_network_stats(device).bytes_cached, size);
+	tex_alloc_free(device, data_c);
+	EXPECT_EQ(device_network_stats(device).bytes_cached, 2*size);
+
+	EXPECT_EQ(device_network_stats(device).bytes_raw, 6*size);
+
+	delete device;
+	server_thread.join();
+
+	TaskScheduler::exit();
+
+	/* The device got the right data, whether it was sent or cached. */
+	ASSERT_EQ(server_device.textures.size(), 6);
+	EXPECT_TRUE(server_device.textures[0] == data_a);
+	EXPECT_TRUE(server_device.textures[1] == data_a);
+	EXPECT_TRUE(server_device.textures[2] == data_b);
+	EXPECT_TRUE(server_device.textures[3] == data_c);
+	EXPECT_TRUE(server_device.textures[4] == data_a);
+	EXPECT_TRUE(server_device.textures[5] == data_c);
+}
+
+TEST(device_network, buffer_hash) {
+	vector<uint8_t> data(NETWORK_CACHE_MIN_SIZE, 1);
+	vector<uint8_t> other(NETWORK_CACHE_MIN_SIZE, 2);
+
+	EXPECT_EQ(network_buffer_hash(&data[0], data.size()),
+	          network_buffer_hash(&data[0], data.size()));
+	EXPECT_NE(network_buffer_hash(&data[0], data.size()),
+	          network_buffer_hash(&other[0], other.size()));
+	EXPECT_EQ(network_buffer_hash(&data[0], data.size() - 1), "");
+}
+
+CCL_NAMESPACE_END
@@ -20,6 +20,8 @@
 #include "render/graph.h"
 #include "render/scene.h"
 #include "render/nodes.h"
+#include "render/shader.h"
+#include "render/svm.h"
 #include "util/util_logging.h"
 #include "util/util_string.h"
 #include "util/util_vector.h"
@@ -153,6 +155,23 @@ protected:
 	map<string, ShaderNode *> node_map_;
 };
 
+/* Compile the graph into SVM nodes the way SVMShaderManager does, the
+ * shader takes ownership of the graph. */
+void compile_svm(Scene *scene,
+                 ShaderGraph *graph,
+                 vector<int4> *svm_nodes,
+                 SVMCompiler::Summary *summary)
+{
+	Shader shader;
+	shader.set_graph(graph);
+	shader.used = true;
+
+	svm_nodes->push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+
+	SVMCompiler compiler(scene->shader_manager, scene->image_manager, scene->film);
+	compiler.compile(scene, &shader, *svm_nodes, 0, summary);
+}
+
 }  // namespace
 
 #define DEFINE_COMMON_VARIABLES(builder_name, mock_log_name) \
@@ -298,6 +317,32 @@ TEST(render_graph, constant_fold_background2)
 	graph.finalize(&scene);
 }
 
+/*
+ * Tests:
+ *  - folding of BSDF nodes with zero weight to nothing.
+ *  - folding of Add Closure with the remaining input.
+ */
+TEST(render_graph, constant_fold_bsdf)
+{
+	DEFINE_COMMON_VARIABLES(builder, log);
+
+	EXPECT_ANY_MESSAGE(log);
+	CORRECT_INFO_MESSAGE(log, "Discarding closure Black.");
+	CORRECT_INFO_MESSAGE(log, "Folding AddClosure::Closure to socket Diffuse::BSDF.");
+	INVALID_INFO_MESSAGE(log, "Discarding closure Diffuse.");
+
+	builder
+		.add_node(ShaderNodeBuilder<GlossyBsdfNode>("Black")
+		          .set("Color", make_float3(0.0f, 0.0f, 0.0f)))
+		.add_node(ShaderNodeBuilder<DiffuseBsdfNode>("Diffuse"))
+		.add_node(ShaderNodeBuilder<AddClosureNode>("AddClosure"))
+		.add_connection("Black::BSDF", "AddClosure::Closure1")
+		.add_connection("Diffuse::BSDF", "AddClosure::Closure2")
+		.output_closure("AddClosure::Closure");
+
+	graph.finalize(&scene);
+}
+
 /*
  * Tests:
  *  - Folding of Add Closure with only one input.
@@ -1677,4 +1722,79 @@ TEST(render_graph, constant_fold_convert_color_float_color)
 	graph.finalize(&scene);
 }
 
+/*
+ * Tests:
+ *  - Math nodes with constant operands compile to a single SVM node, without
+ *    loading the constants onto the stack or a separate clamp node.
+ *  - Encoding of the constant operands and the clamp flag in NODE_MATH.
+ */
+TEST(render_graph, svm_compile_math)
+{
+	util_logging_start();
+	DeviceInfo device_info;
+	SceneParams scene_params;
+	Scene scene(scene_params, device_info);
+
+	/* Same shader without the math nodes. */
+	ShaderGraph *graph_ref = new ShaderGraph();
+	ShaderGraphBuilder(graph_ref)
+		.add_attribute("Attribute")
+		.output_value("Attribute::Fac");
+
+	vector<int4> svm_nodes_ref;
+	SVMCompiler::Summary summary_ref;
+	compile_svm(&scene, graph_ref, &svm_nodes_ref, &summary_ref);
+
+	ShaderGraph *graph = new ShaderGraph();
+	ShaderGraphBuilder(graph)
+		.add_attribute("Attribute")
+		.add_node(ShaderNodeBuilder<MathNode>("MathAdd")
+		          .set(&MathNode::type, NODE_MATH_ADD)
+		          .set(&MathNode::use_clamp, true)
+		          .set("Value2", 0.5f))
+		.add_node(ShaderNodeBuilder<MathNode>("MathMultiply")
+		          .set(&MathNode::type, NODE_MATH_MULTIPLY)
+		          .set("Value1", 2.0f))
+		.add_connection("Attribute::Fac", "MathAdd::Value1")
+		.add_connection("MathAdd::Value", "MathMultiply::Value2")
+		.output_value("MathMultiply::Value");
+
+	vector<int4> svm_nodes;
+	SVMCompiler::Summary summary;
+	compile_svm(&scene, graph, &svm_nodes, &summary);
+
+	/* Each math node is two int4. Before, every constant operand was also
+	 * loaded with a NODE_VALUE_F and clamping took another NODE_MATH. */
+	EXPECT_EQ(summary.num_constant_loads, summary_ref.num_constant_loads);
+	EXPECT_EQ(summary.num_svm_nodes, summary_ref.num_svm_nodes + 2 * 2);
+
+	int add = -1, multiply = -1;
+	for(size_t i = 1; i + 1 < svm_nodes.size(); i++) {
+		if(svm_nodes[i].x == NODE_MATH && svm_nodes[i].y == NODE_MATH_ADD) {
+			add = i;
+		}
+		else if(svm_nodes[i].x == NODE_MATH && svm_nodes[i].y == NODE_MATH_MULTIPLY) {
+			multiply = i;
+		}
+	}
+	ASSERT_NE(add, -1);
+	ASSERT_NE(multiply, -1);
+
+	/* Linked Value1, constant Value2, clamped. */
+	const int4 add_node = svm_nodes[add];
+	const int4 add_node1 = svm_nodes[add + 1];
+	EXPECT_NE(add_node.z, (int)SVM_STACK_INVALID);
+	EXPECT_EQ(add_node.w, (int)SVM_STACK_INVALID);
+	EXPECT_EQ(add_node1.x, 1);
+	EXPECT_EQ(__int_as_float(add_node1.w), 0.5f);
+
+	/* Constant Value1, Value2 linked to the add output, not clamped. */
+	const int4 multiply_node = svm_nodes[multiply];
+	const int4 multiply_node1 = svm_nodes[multiply + 1];
+	EXPECT_EQ(multiply_node.z, (int)SVM_STACK_INVALID);
+	EXPECT_EQ(multiply_node.w, add_node1.y);
+	EXPECT_EQ(multiply_node1.x, 0);
+	EXPECT_EQ(__int_as_float(multiply_node1.z), 2.0f);
+}
+
 CCL_NAMESPACE_END
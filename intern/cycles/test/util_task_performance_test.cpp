@@ -0,0 +1,110 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_atomic.h"
+#include "util/util_math.h"
+#include "util/util_system.h"
+#include "util/util_task.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Task that counts itself and pushes two children to the front, like the
+ * recursive tasks of the BVH build. */
+void task_tree(TaskPool *pool, int depth, uint32_t *count)
+{
+	atomic_add_and_fetch_uint32(count, 1);
+	if(depth > 0) {
+		pool->push(function_bind(task_tree, pool, depth - 1, count), true);
+		pool->push(function_bind(task_tree, pool, depth - 1, count), true);
+	}
+}
+
+/* Some work to make tasks take time, the result is stored so it is not
+ * optimized away. */
+void task_work(int iterations, float *result)
+{
+	float x = 0.0f;
+	for(int i = 0; i < iterations; i++) {
+		x = x * 0.999f + 1.0f;
+	}
+	*result = x;
+}
+
+double time_flat(int num_tasks, int iterations)
+{
+	float result;
+	double time_start = time_dt();
+	TaskPool pool;
+	for(int i = 0; i < num_tasks; ++i) {
+		pool.push(function_bind(task_work, iterations, &result));
+	}
+	pool.wait_work();
+	return time_dt() - time_start;
+}
+
+double time_tree(int depth, uint32_t *count)
+{
+	double time_start = time_dt();
+	TaskPool pool;
+	pool.push(function_bind(task_tree, &pool, depth, count));
+	pool.wait_work();
+	return time_dt() - time_start;
+}
+
+}  // namespace
+
+/* Throughput of many small tasks pushed from the main thread, and of a tree
+ * of tasks pushed by the tasks themselves, for increasing thread counts. */
+TEST(util_task, scaling) {
+	const int num_tasks = 100000;
+	const int depth = 16;
+	const int max_threads = system_cpu_thread_count();
+	double time_flat_single = 0.0, time_tree_single = 0.0;
+
+	for(int num_threads = 1; ; num_threads = min(num_threads * 2, max_threads)) {
+		TaskScheduler::init(num_threads);
+
+		uint32_t count = 0;
+		double flat = time_flat(num_tasks, 1000);
+		double tree = time_tree(depth, &count);
+
+		TaskScheduler::exit();
+
+		EXPECT_EQ(count, (1 << (depth + 1)) - 1);
+
+		if(num_threads == 1) {
+			time_flat_single = flat;
+			time_tree_single = tree;
+		}
+
+		printf("%d threads: flat %.3fs (%.0f tasks/s, speedup %.2f), "
+		       "tree %.3fs (%.0f tasks/s, speedup %.2f)\n",
+		       num_threads,
+		       flat, num_tasks / flat, time_flat_single / flat,
+		       tree, count / tree, time_tree_single / tree);
+
+		if(num_threads == max_threads) {
+			break;
+		}
+	}
+}
+
+CCL_NAMESPACE_END
@@ -16,6 +16,7 @@
 
 #include "testing/testing.h"
 
+#include "util/util_atomic.h"
 #include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
@@ -25,6 +26,24 @@ namespace {
 void task_run() {
 }
 
+/* Task that counts itself and pushes two children to the front, like the
+ * recursive tasks of the BVH build. */
+void task_tree(TaskPool *pool, int depth, uint32_t *count)
+{
+	atomic_add_and_fetch_uint32(count, 1);
+	if(depth > 0) {
+		pool->push(function_bind(task_tree, pool, depth - 1, count), true);
+		pool->push(function_bind(task_tree, pool, depth - 1, count), true);
+	}
+}
+
+void task_range(int start, int end, vector<uint32_t> *hits)
+{
+	for(int i = start; i < end; i++) {
+		atomic_add_and_fetch_uint32(&(*hits)[i], 1);
+	}
+}
+
 }  // namespace
 
 TEST(util_task, basic) {
@@ -53,4 +72,47 @@ TEST(util_task, multiple_times) {
 	}
 }
 
+TEST(util_task, tree) {
+	TaskScheduler::init(4);
+	uint32_t count = 0;
+	TaskPool pool;
+	pool.push(function_bind(task_tree, &pool, 12, &count));
+	TaskPool::Summary summary;
+	pool.wait_work(&summary);
+	TaskScheduler::exit();
+	EXPECT_EQ(count, (1 << 13) - 1);
+	EXPECT_EQ(summary.num_tasks_handled, (1 << 13) - 1);
+}
+
+TEST(util_task, parallel_for) {
+	TaskScheduler::init(4);
+	const int size = 10007;
+	for(int grain_size = 1; grain_size <= 4096; grain_size *= 8) {
+		vector<uint32_t> hits(size, 0);
+		parallel_for(3, size, function_bind(task_range, _1, _2, &hits), grain_size);
+		EXPECT_EQ(hits[0] + hits[1] + hits[2], 0);
+		for(int i = 3; i < size; i++) {
+			EXPECT_EQ(hits[i], 1);
+		}
+	}
+	TaskScheduler::exit();
+}
+
+/* Many short parallel_for calls, each with its pool on the stack, so the
+ * pool is destroyed right after the last task notified it. */
+TEST(util_task, parallel_for_stress) {
+	TaskScheduler::init(4);
+	const int size = 64;
+	for(int n = 0; n < 10000; n++) {
+		vector<uint32_t> hits(size, 0);
+		parallel_for(0, size, function_bind(task_range, _1, _2, &hits), 1);
+		bool all_hit = true;
+		for(int i = 0; i < size; i++) {
+			all_hit &= (hits[i] == 1);
+		}
+		EXPECT_TRUE(all_hit);
+	}
+	TaskScheduler::exit();
+}
+
 CCL_NAMESPACE_END
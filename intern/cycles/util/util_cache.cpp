@@ -0,0 +1,185 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_cache.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Written at the start of every cache file, bump the version whenever the
+ * layout of cached data changes. */
+static const char cache_file_magic[8] = {'C', 'Y', 'C', 'A', 'C', 'H', 'E', '1'};
+
+/* Cache Data */
+
+CacheData::CacheData()
+: f(NULL), remaining(0)
+{
+}
+
+CacheData::~CacheData()
+{
+	if(f) {
+		fclose(f);
+	}
+}
+
+void CacheData::add(const void *data, size_t size)
+{
+	if(size) {
+		buffers.push_back(CacheBuffer(data, size));
+	}
+}
+
+bool CacheData::read(void *data, size_t size)
+{
+	if(!f || size > remaining) {
+		return false;
+	}
+	if(size && fread(data, 1, size, f) != size) {
+		return false;
+	}
+	remaining -= size;
+	return true;
+}
+
+string CacheData::hash() const
+{
+	MD5Hash md5;
+
+	foreach(const CacheBuffer& buffer, buffers) {
+		/* MD5Hash takes int sizes, feed large buffers in chunks. */
+		const uint8_t *data = (const uint8_t*)buffer.data;
+		size_t size = buffer.size;
+		while(size) {
+			int chunk = (int)min(size, (size_t)(1 << 30));
+			md5.append(data, chunk);
+			data += chunk;
+			size -= chunk;
+		}
+	}
+
+	return md5.get_hex();
+}
+
+bool CacheData::open_read(const string& filename)
+{
+	if(!path_exists(filename)) {
+		return false;
+	}
+
+	size_t size = path_file_size(filename);
+	if(size == (size_t)-1 || size < sizeof(cache_file_magic)) {
+		return false;
+	}
+
+	f = path_fopen(filename, "rb");
+	if(!f) {
+		return false;
+	}
+
+	char magic[sizeof(cache_file_magic)];
+	remaining = size;
+	if(!read(magic, sizeof(magic)) ||
+	   memcmp(magic, cache_file_magic, sizeof(magic)) != 0)
+	{
+		fclose(f);
+		f = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool CacheData::write(const string& filename) const
+{
+	FILE *out = path_fopen(filename, "wb");
+	if(!out) {
+		return false;
+	}
+
+	bool ok = (fwrite(cache_file_magic, 1, sizeof(cache_file_magic), out) ==
+	           sizeof(cache_file_magic));
+	foreach(const CacheBuffer& buffer, buffers) {
+		if(!ok) {
+			break;
+		}
+		ok = (fwrite(buffer.data, 1, buffer.size, out) == buffer.size);
+	}
+
+	if(fclose(out) != 0) {
+		ok = false;
+	}
+
+	return ok;
+}
+
+/* Cache */
+
+Cache::Cache(const string& directory_)
+: directory(directory_)
+{
+	if(directory.empty()) {
+		directory = path_cache_get("cache");
+	}
+}
+
+string Cache::data_filename(const CacheData& key) const
+{
+	return path_join(directory, key.hash());
+}
+
+bool Cache::lookup(CacheData& key, CacheData& value)
+{
+	string filename = data_filename(key);
+
+	if(!value.open_read(filename)) {
+		return false;
+	}
+
+	VLOG(2) << "Found cached data in " << filename << ".";
+	return true;
+}
+
+bool Cache::insert(CacheData& key, CacheData& value)
+{
+	string filename = data_filename(key);
+	/* Unique enough to not clash with other threads and processes writing
+	 * the same key at the same time. */
+	string tmp_filename = string_printf("%s.%p.%llx.tmp",
+	                                    filename.c_str(),
+	                                    (void*)&value,
+	                                    (unsigned long long)(time_dt() * 1e6));
+
+	path_create_directories(filename);
+
+	if(!value.write(tmp_filename) || !path_rename(tmp_filename, filename)) {
+		VLOG(1) << "Failed to write cached data to " << filename << ".";
+		path_remove(tmp_filename);
+		return false;
+	}
+
+	VLOG(2) << "Written cached data to " << filename << ".";
+	return true;
+}
+
+CCL_NAMESPACE_END
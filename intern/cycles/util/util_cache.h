@@ -0,0 +1,134 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_CACHE_H__
+#define __UTIL_CACHE_H__
+
+/* Disk Cache
+ *
+ * Content addressed cache of binary data on disk. A key is built from any
+ * number of buffers and is hashed with MD5, the value is stored in a file
+ * named after that hash inside the cache directory.
+ *
+ * Values are written to a temporary file first and then renamed, so several
+ * processes sharing one cache directory (e.g. render farm nodes) never see a
+ * partially written file. */
+
+#include <deque>
+#include <stdio.h>
+
+#include "util/util_string.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class CacheBuffer {
+public:
+	const void *data;
+	size_t size;
+
+	CacheBuffer(const void *data_, size_t size_)
+	: data(data_), size(size_) {}
+};
+
+class CacheData {
+public:
+	CacheData();
+	~CacheData();
+
+	/* Add buffers to a key or to a value which is to be inserted. Data is not
+	 * copied, so it must stay valid until the key or value is used. */
+	void add(const void *data, size_t size);
+
+	template<typename T> void add(const array<T>& data)
+	{
+		sizes.push_back(data.size());
+		add(&sizes.back(), sizeof(size_t));
+		add(data.data(), data.size()*sizeof(T));
+	}
+
+	template<typename T> void add(const vector<T>& data)
+	{
+		sizes.push_back(data.size());
+		add(&sizes.back(), sizeof(size_t));
+		add((data.size())? &data[0]: NULL, data.size()*sizeof(T));
+	}
+
+	/* Read back a value found by Cache::lookup(), in the same order the
+	 * buffers were added when it was inserted. */
+	bool read(void *data, size_t size);
+
+	template<typename T> bool read(array<T>& data)
+	{
+		size_t size;
+		if(!read(&size, sizeof(size)) || size*sizeof(T) > remaining) {
+			return false;
+		}
+		data.resize(size);
+		return read(data.data(), size*sizeof(T));
+	}
+
+	template<typename T> bool read(vector<T>& data)
+	{
+		size_t size;
+		if(!read(&size, sizeof(size)) || size*sizeof(T) > remaining) {
+			return false;
+		}
+		data.resize(size);
+		return read((size)? &data[0]: NULL, size*sizeof(T));
+	}
+
+	/* MD5 hash of all buffers added so far. */
+	string hash() const;
+
+protected:
+	friend class Cache;
+
+	bool open_read(const string& filename);
+	bool write(const string& filename) const;
+
+	vector<CacheBuffer> buffers;
+	/* Sizes of added arrays, std::deque so pointers to them stay valid. */
+	std::deque<size_t> sizes;
+
+	FILE *f;
+	size_t remaining;
+};
+
+class Cache {
+public:
+	/* Empty directory means the user cache directory of Cycles. */
+	explicit Cache(const string& directory = "");
+
+	/* Find the value for the key, returns false when there is none or it can't
+	 * be read. On success value is ready for CacheData::read(). */
+	bool lookup(CacheData& key, CacheData& value);
+
+	/* Store the value for the key, replacing an existing value. */
+	bool insert(CacheData& key, CacheData& value);
+
+	const string& get_directory() const { return directory; }
+
+protected:
+	string data_filename(const CacheData& key) const;
+
+	string directory;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_CACHE_H__ */
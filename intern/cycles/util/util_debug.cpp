@@ -29,7 +29,7 @@ DebugFlags::CPU::CPU()
     sse41(true),
     sse3(true),
     sse2(true),
-    qbvh(true),
+    bvh_layout(BVH8),
     split_kernel(false)
 {
 	reset();
@@ -55,7 +55,7 @@ void DebugFlags::CPU::reset()
 #undef STRINGIFY
 #undef CHECK_CPU_FLAGS
 
-	qbvh = true;
+	bvh_layout = BVH8;
 	split_kernel = false;
 }
 
@@ -135,13 +135,25 @@ void DebugFlags::reset()
 std::ostream& operator <<(std::ostream &os,
                           DebugFlagsConstRef debug_flags)
 {
+	const char *bvh_layout;
+	switch(debug_flags.cpu.bvh_layout) {
+		case DebugFlags::CPU::BVH2:
+			bvh_layout = "BVH2";
+			break;
+		case DebugFlags::CPU::BVH4:
+			bvh_layout = "BVH4";
+			break;
+		case DebugFlags::CPU::BVH8:
+			bvh_layout = "BVH8";
+			break;
+	}
 	os << "CPU flags:\n"
 	   << "  AVX2   : " << string_from_bool(debug_flags.cpu.avx2)  << "\n"
 	   << "  AVX    : " << string_from_bool(debug_flags.cpu.avx)   << "\n"
 	   << "  SSE4.1 : " << string_from_bool(debug_flags.cpu.sse41) << "\n"
 	   << "  SSE3   : " << string_from_bool(debug_flags.cpu.sse3)  << "\n"
 	   << "  SSE2   : " << string_from_bool(debug_flags.cpu.sse2)  << "\n"
-	   << "  QBVH   : " << string_from_bool(debug_flags.cpu.qbvh)  << "\n"
+	   << "  BVH    : " << bvh_layout << "\n"
 	   << "  Split  : " << string_from_bool(debug_flags.cpu.split_kernel) << "\n";
 
 	os << "CUDA flags:\n"
@@ -44,8 +44,17 @@ public:
 		bool sse3;
 		bool sse2;
 
-		/* Whether QBVH usage is allowed or not. */
-		bool qbvh;
+		/* Available BVH layouts, wider ones are only used when the CPU
+		 * supports them.
+		 */
+		enum BVHLayout {
+			BVH2,
+			BVH4,
+			BVH8,
+		};
+
+		/* Requested BVH layout. */
+		BVHLayout bvh_layout;
 
 		/* Whether split kernel is used */
 		bool split_kernel;
@@ -25,7 +25,7 @@ class Stats {
 public:
 	enum static_init_t { static_init = 0 };
 
-	Stats() : mem_used(0), mem_peak(0) {}
+	Stats() : mem_used(0), mem_peak(0), tail_time(0.0), num_tiles_split(0) {}
 	explicit Stats(static_init_t) {}
 
 	void mem_alloc(size_t size) {
@@ -40,6 +40,12 @@ public:
 
 	size_t mem_used;
 	size_t mem_peak;
+
+	/* Render time after the last tile was handed out, spent waiting for the
+	 * slowest devices to finish, and the number of times an idle device took
+	 * over samples of a tile in progress. */
+	double tail_time;
+	int num_tiles_split;
 };
 
 CCL_NAMESPACE_END
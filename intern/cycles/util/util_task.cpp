@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "util/util_atomic.h"
 #include "util/util_debug.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
@@ -38,6 +39,7 @@ TaskPool::TaskPool()
 {
 	num_tasks_handled = 0;
 	num = 0;
+	num_waiting = 0;
 	do_cancel = false;
 }
 
@@ -63,36 +65,37 @@ void TaskPool::push(const TaskRunFunction& run, bool front)
 
 void TaskPool::wait_work(Summary *stats)
 {
-	thread_scoped_lock num_lock(num_mutex);
-
-	while(num != 0) {
-		num_lock.unlock();
-
-		thread_scoped_lock queue_lock(TaskScheduler::queue_mutex);
-
-		/* find task from this pool. if we get a task from another pool,
+	while(atomic_add_and_fetch_uint32((uint32_t *)&num, 0) != 0) {
+		/* find task from this pool, in the deque of this thread, the queue or
+		 * the deques of other threads. if we get a task from another pool,
 		 * we can get into deadlock */
 		TaskScheduler::Entry work_entry;
-		bool found_entry = false;
-		list<TaskScheduler::Entry>::iterator it;
-
-		for(it = TaskScheduler::queue.begin(); it != TaskScheduler::queue.end(); it++) {
-			TaskScheduler::Entry& entry = *it;
+		bool found_entry = TaskScheduler::find_entry(work_entry, this);
 
-			if(entry.pool == this) {
-				work_entry = entry;
-				found_entry = true;
-				TaskScheduler::queue.erase(it);
-				break;
+		if(!found_entry) {
+			/* look again after announcing we are waiting, so tasks pushed
+			 * in the meantime either show up here or wake us up */
+			thread_scoped_lock num_lock(num_mutex);
+			atomic_add_and_fetch_uint32((uint32_t *)&num_waiting, 1);
+
+			if(num != 0) {
+				found_entry = TaskScheduler::find_entry(work_entry, this);
+
+				if(!found_entry) {
+					THREADING_DEBUG("num==%d, Waiting for condition in TaskPool::wait_work !found_entry\n", num);
+					num_cond.wait(num_lock);
+					THREADING_DEBUG("num==%d, condition wait done in TaskPool::wait_work !found_entry\n", num);
+				}
 			}
-		}
 
-		queue_lock.unlock();
+			atomic_sub_and_fetch_uint32((uint32_t *)&num_waiting, 1);
+		}
 
 		/* if found task, do it, otherwise wait until other tasks are done */
 		if(found_entry) {
 			/* run task */
-			work_entry.task->run(0);
+			if(!do_cancel)
+				work_entry.task->run(0);
 
 			/* delete task */
 			delete work_entry.task;
@@ -100,16 +103,6 @@ void TaskPool::wait_work(Summary *stats)
 			/* notify pool task was done */
 			num_decrease(1);
 		}
-
-		num_lock.lock();
-		if(num == 0)
-			break;
-
-		if(!found_entry) {
-			THREADING_DEBUG("num==%d, Waiting for condition in TaskPool::wait_work !found_entry\n", num);
-			num_cond.wait(num_lock);
-			THREADING_DEBUG("num==%d, condition wait done in TaskPool::wait_work !found_entry\n", num);
-		}
 	}
 
 	if(stats != NULL) {
@@ -122,6 +115,8 @@ void TaskPool::cancel()
 {
 	do_cancel = true;
 
+	/* tasks in deques can't be removed, they are skipped by the thread that
+	 * takes them while do_cancel is set */
 	TaskScheduler::clear(this);
 	
 	{
@@ -141,6 +136,9 @@ void TaskPool::stop()
 {
 	TaskScheduler::clear(this);
 
+	/* a thread that finished the pool may still hold the lock to notify,
+	 * wait for it before the pool is destroyed */
+	thread_scoped_lock num_lock(num_mutex);
 	assert(num == 0);
 }
 
@@ -151,28 +149,149 @@ bool TaskPool::canceled()
 
 void TaskPool::num_decrease(int done)
 {
-	num_mutex.lock();
-	num -= done;
+	uint32_t num_cur = num;
+
+	/* no locking needed as long as tasks are left, nobody has to be notified
+	 * and the pool can't be destroyed */
+	while(num_cur > (uint32_t)done) {
+		const uint32_t num_prev = atomic_cas_uint32((uint32_t *)&num, num_cur, num_cur - (uint32_t)done);
+		if(num_prev == num_cur) {
+			return;
+		}
+		num_cur = num_prev;
+	}
 
-	assert(num >= 0);
-	if(num == 0) {
-		THREADING_DEBUG("num==%d, notifying all in TaskPool::num_decrease\n", num);
+	/* finishing the pool, decrease and notify in one critical section. stop()
+	 * takes the lock before the pool is destroyed, so it can't be destroyed
+	 * while we still use the mutex */
+	thread_scoped_lock num_lock(num_mutex);
+	assert(num >= done);
+	int num_left = (int)atomic_sub_and_fetch_uint32((uint32_t *)&num, done);
+
+	if(num_left == 0) {
+		THREADING_DEBUG("num==%d, notifying all in TaskPool::num_decrease\n", num_left);
 		num_cond.notify_all();
 	}
-
-	num_mutex.unlock();
 }
 
 void TaskPool::num_increase()
 {
-	thread_scoped_lock num_lock(num_mutex);
-	if(num_tasks_handled == 0) {
+	if(atomic_fetch_and_add_uint32((uint32_t *)&num_tasks_handled, 1) == 0) {
 		start_time = time_dt();
 	}
-	num++;
-	num_tasks_handled++;
-	THREADING_DEBUG("num==%d, notifying all in TaskPool::num_increase\n", num);
-	num_cond.notify_all();
+	atomic_add_and_fetch_uint32((uint32_t *)&num, 1);
+}
+
+void TaskPool::wake_waiting()
+{
+	/* only called after the task is visible to other threads, the atomic
+	 * read makes sure a thread that is about to wait either finds the task
+	 * or is seen here */
+	if(atomic_add_and_fetch_uint32((uint32_t *)&num_waiting, 0) != 0) {
+		thread_scoped_lock num_lock(num_mutex);
+		THREADING_DEBUG("num==%d, notifying all in TaskPool::wake_waiting\n", num);
+		num_cond.notify_all();
+	}
+}
+
+/* Task Scheduler Deque */
+
+bool TaskScheduler::Deque::push(const Entry& entry)
+{
+	const uint32_t b = bottom;
+
+	if(b - top >= SIZE) {
+		return false;
+	}
+
+	entries[b & (SIZE - 1)] = entry;
+
+	/* publish the entry, the atomic operation is also a memory barrier so
+	 * the entry is written before thieves see it */
+	atomic_add_and_fetch_uint32((uint32_t *)&bottom, 1);
+
+	return true;
+}
+
+bool TaskScheduler::Deque::pop(Entry& entry, TaskPool *pool)
+{
+	/* reserve the bottom entry before reading top, so thieves either see
+	 * the reservation or we see their steal */
+	const uint32_t b = atomic_sub_and_fetch_uint32((uint32_t *)&bottom, 1);
+	const uint32_t t = top;
+	const int32_t num_other = (int32_t)(b - t);
+
+	if(num_other < 0) {
+		/* deque is empty */
+		atomic_add_and_fetch_uint32((uint32_t *)&bottom, 1);
+		return false;
+	}
+
+	Entry found = entries[b & (SIZE - 1)];
+
+	if(num_other > 0) {
+		/* more entries above this one, thieves can't reach it */
+		if(pool != NULL && found.pool != pool) {
+			atomic_add_and_fetch_uint32((uint32_t *)&bottom, 1);
+			return false;
+		}
+		entry = found;
+		return true;
+	}
+
+	/* last entry, race against thieves for it */
+	bool won = (atomic_cas_uint32((uint32_t *)&top, t, t + 1) == t);
+	atomic_add_and_fetch_uint32((uint32_t *)&bottom, 1);
+
+	if(!won) {
+		return false;
+	}
+
+	if(pool != NULL && found.pool != pool) {
+		/* put it back, can't fail since the deque is empty now */
+		push(found);
+		return false;
+	}
+
+	entry = found;
+	return true;
+}
+
+bool TaskScheduler::Deque::steal(Entry& entry, TaskPool *pool)
+{
+	/* cheap check first, to not write to the cache lines of idle deques */
+	if(bottom == top) {
+		return false;
+	}
+
+	/* read top before bottom, the atomic operation acts as a barrier */
+	const uint32_t t = atomic_fetch_and_add_uint32((uint32_t *)&top, 0);
+	const uint32_t b = bottom;
+
+	if((int32_t)(b - t) <= 0) {
+		return false;
+	}
+
+	/* the entry can only be overwritten after top moved on, in which case
+	 * the compare and swap below fails */
+	Entry found = entries[t & (SIZE - 1)];
+
+	if(pool != NULL && found.pool != pool) {
+		return false;
+	}
+
+	if(atomic_cas_uint32((uint32_t *)&top, t, t + 1) != t) {
+		/* lost the race against the owner or another thief */
+		return false;
+	}
+
+	entry = found;
+	return true;
+}
+
+bool TaskScheduler::Deque::empty()
+{
+	return (int32_t)(bottom - top) <= 0;
 }
 
 /* Task Scheduler */
@@ -185,6 +304,11 @@ bool TaskScheduler::do_exit = false;
 list<TaskScheduler::Entry> TaskScheduler::queue;
 thread_mutex TaskScheduler::queue_mutex;
 thread_condition_variable TaskScheduler::queue_cond;
+int TaskScheduler::num_queued = 0;
+
+TaskScheduler::Deque *TaskScheduler::deques = NULL;
+pthread_key_t TaskScheduler::deque_key;
+int TaskScheduler::num_sleeping = 0;
 
 void TaskScheduler::init(int num_threads)
 {
@@ -202,6 +326,10 @@ void TaskScheduler::init(int num_threads)
 		}
 		VLOG(1) << "Creating pool of " << num_threads << " threads.";
 
+		/* deques must exist before threads start looking for work */
+		deques = new Deque[num_threads];
+		pthread_key_create(&deque_key, NULL);
+
 		/* launch threads that will be waiting for work */
 		threads.resize(num_threads);
 
@@ -276,6 +404,11 @@ void TaskScheduler::exit()
 		}
 
 		threads.clear();
+
+		/* threads only exit once all deques are empty */
+		pthread_key_delete(deque_key);
+		delete [] deques;
+		deques = NULL;
 	}
 }
 
@@ -285,22 +418,104 @@ void TaskScheduler::free_memory()
 	threads.free_memory();
 }
 
-bool TaskScheduler::thread_wait_pop(Entry& entry)
+TaskScheduler::Deque *TaskScheduler::thread_deque()
 {
-	thread_scoped_lock queue_lock(queue_mutex);
+	/* NULL for threads that are not workers of the scheduler */
+	return (Deque*)pthread_getspecific(deque_key);
+}
 
-	while(queue.empty() && !do_exit)
-		queue_cond.wait(queue_lock);
+bool TaskScheduler::find_entry(Entry& entry, TaskPool *pool)
+{
+	/* own deque first, the most recently pushed task is most likely to
+	 * still be in the cache */
+	Deque *deque = thread_deque();
 
-	if(queue.empty()) {
-		assert(do_exit);
-		return false;
+	if(deque && deque->pop(entry, pool)) {
+		return true;
 	}
-	
-	entry = queue.front();
-	queue.pop_front();
 
-	return true;
+	/* shared queue, only locked when it has entries. an entry pushed right
+	 * after the check is found by thread_wait_pop() before sleeping. */
+	if(atomic_add_and_fetch_uint32((uint32_t *)&num_queued, 0) != 0) {
+		thread_scoped_lock queue_lock(queue_mutex);
+		list<Entry>::iterator it;
+
+		for(it = queue.begin(); it != queue.end(); it++) {
+			if(pool == NULL || it->pool == pool) {
+				entry = *it;
+				queue.erase(it);
+				atomic_sub_and_fetch_uint32((uint32_t *)&num_queued, 1);
+				return true;
+			}
+		}
+	}
+
+	/* steal from other workers, starting after our own deque so thieves
+	 * spread over the deques. our own deque is tried last, a pool filtered
+	 * pop only sees its bottom entry. */
+	const int num_deques = threads.size();
+	const int first = (deque)? (int)(deque - deques) + 1: 0;
+
+	for(int i = 0; i < num_deques; i++) {
+		Deque *other = &deques[(first + i) % num_deques];
+
+		if(other->steal(entry, pool)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool TaskScheduler::has_entries()
+{
+	/* must be called with queue_mutex locked */
+	if(!queue.empty()) {
+		return true;
+	}
+
+	for(int i = 0; i < threads.size(); i++) {
+		if(!deques[i].empty()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TaskScheduler::wake()
+{
+	/* only called after the entry is visible to other threads, so a thread
+	 * that is about to sleep either finds the entry or is seen here */
+	if(atomic_add_and_fetch_uint32((uint32_t *)&num_sleeping, 0) != 0) {
+		thread_scoped_lock queue_lock(queue_mutex);
+		queue_cond.notify_one();
+	}
+}
+
+bool TaskScheduler::thread_wait_pop(Entry& entry)
+{
+	while(true) {
+		if(find_entry(entry, NULL)) {
+			return true;
+		}
+
+		thread_scoped_lock queue_lock(queue_mutex);
+
+		if(do_exit) {
+			return false;
+		}
+
+		/* look again after announcing we sleep, pushes to deques don't
+		 * lock the queue */
+		atomic_add_and_fetch_uint32((uint32_t *)&num_sleeping, 1);
+
+		if(!has_entries()) {
+			queue_cond.wait(queue_lock);
+		}
+
+		atomic_sub_and_fetch_uint32((uint32_t *)&num_sleeping, 1);
+	}
 }
 
 void TaskScheduler::thread_run(int thread_id)
@@ -309,10 +524,13 @@ void TaskScheduler::thread_run(int thread_id)
 
 	/* todo: test affinity/denormal mask */
 
+	pthread_setspecific(deque_key, &deques[thread_id - 1]);
+
 	/* keep popping off tasks */
 	while(thread_wait_pop(entry)) {
-		/* run task */
-		entry.task->run(thread_id);
+		/* run task, unless its pool was canceled while it was in a deque */
+		if(!entry.pool->do_cancel)
+			entry.task->run(thread_id);
 
 		/* delete task */
 		delete entry.task;
@@ -324,17 +542,35 @@ void TaskScheduler::thread_run(int thread_id)
 
 void TaskScheduler::push(Entry& entry, bool front)
 {
-	entry.pool->num_increase();
+	/* the task may be done and the pool destroyed once the task is pushed,
+	 * hold an extra count until waiting threads are woken up */
+	TaskPool *pool = entry.pool;
+	pool->num_increase();
+	atomic_add_and_fetch_uint32((uint32_t *)&pool->num, 1);
+
+	/* tasks pushed to the front by a worker go to its own deque, without
+	 * locking. other threads don't own a deque. */
+	Deque *deque = (front)? thread_deque(): NULL;
+
+	if(deque && deque->push(entry)) {
+		wake();
+	}
+	else {
+		/* add entry to queue */
+		TaskScheduler::queue_mutex.lock();
+		if(front)
+			TaskScheduler::queue.push_front(entry);
+		else
+			TaskScheduler::queue.push_back(entry);
+		atomic_add_and_fetch_uint32((uint32_t *)&TaskScheduler::num_queued, 1);
 
-	/* add entry to queue */
-	TaskScheduler::queue_mutex.lock();
-	if(front)
-		TaskScheduler::queue.push_front(entry);
-	else
-		TaskScheduler::queue.push_back(entry);
+		TaskScheduler::queue_cond.notify_one();
+		TaskScheduler::queue_mutex.unlock();
+	}
 
-	TaskScheduler::queue_cond.notify_one();
-	TaskScheduler::queue_mutex.unlock();
+	/* wake threads waiting for work in wait_work() of the pool */
+	pool->wake_waiting();
+	pool->num_decrease(1);
 }
 
 void TaskScheduler::clear(TaskPool *pool)
@@ -358,12 +594,62 @@ void TaskScheduler::clear(TaskPool *pool)
 			it++;
 	}
 
+	atomic_sub_and_fetch_uint32((uint32_t *)&num_queued, done);
+
 	queue_lock.unlock();
 
 	/* notify done */
 	pool->num_decrease(done);
 }
 
+/* Parallel For */
+
+static void parallel_for_range(TaskPool *pool,
+                               int start,
+                               int end,
+                               const TaskRangeFunction *func,
+                               int grain_size)
+{
+	/* split off the upper half while the range is large, pushed to the front
+	 * so it stays in the deque of this thread unless an idle thread steals it */
+	while(end - start > grain_size) {
+		const int middle = start + (end - start) / 2;
+		pool->push(function_bind(&parallel_for_range,
+		                         pool,
+		                         middle,
+		                         end,
+		                         func,
+		                         grain_size),
+		           true);
+		end = middle;
+	}
+
+	if(!pool->canceled()) {
+		(*func)(start, end);
+	}
+}
+
+void parallel_for(int start, int end, const TaskRangeFunction& func, int grain_size)
+{
+	if(grain_size < 1) {
+		grain_size = 1;
+	}
+
+	if(end - start <= grain_size) {
+		func(start, end);
+		return;
+	}
+
+	TaskPool pool;
+	pool.push(function_bind(&parallel_for_range,
+	                        &pool,
+	                        start,
+	                        end,
+	                        &func,
+	                        grain_size));
+	pool.wait_work();
+}
+
 /* Dedicated Task Pool */
 
 DedicatedTaskPool::DedicatedTaskPool()
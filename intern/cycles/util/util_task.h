@@ -43,6 +43,7 @@ class TaskScheduler;
  */
 
 typedef function<void(int thread_id)> TaskRunFunction;
+typedef function<void(int start, int end)> TaskRangeFunction;
 
 /* Task
  *
@@ -101,11 +102,16 @@ protected:
 
 	void num_decrease(int done);
 	void num_increase();
+	void wake_waiting();
 
 	thread_mutex num_mutex;
 	thread_condition_variable num_cond;
 
+	/* Number of tasks not done yet, changed atomically. The mutex is only
+	 * held to wait for the pool to be done or for new tasks. */
 	int num;
+	/* Number of threads in wait_work() waiting for new tasks. */
+	int num_waiting;
 	bool do_cancel;
 
 	/* ** Statistics ** */
@@ -120,7 +126,10 @@ protected:
 /* Task Scheduler
  * 
  * Central scheduler that holds running threads ready to execute tasks. A singe
- * queue holds the task from all pools. */
+ * queue holds the task from all pools, and every worker thread has its own
+ * deque for tasks it pushes to the front. Workers pop from their own deque
+ * without locking, and steal from the deques of other workers when they run
+ * out of tasks. */
 
 class TaskScheduler
 {
@@ -143,6 +152,26 @@ protected:
 		TaskPool *pool;
 	};
 
+	/* Fixed size Chase-Lev deque. Only the owner pushes and pops at the
+	 * bottom, other threads steal from the top. When pool is not NULL only
+	 * tasks from that pool are taken. */
+	struct Deque {
+		enum { SIZE = 1024 };
+
+		Deque() : top(0), bottom(0) {}
+
+		bool push(const Entry& entry);
+		bool pop(Entry& entry, TaskPool *pool);
+		bool steal(Entry& entry, TaskPool *pool);
+		bool empty();
+
+		volatile uint32_t top;
+		/* Keep top and bottom on different cache lines. */
+		char pad[64 - sizeof(uint32_t)];
+		volatile uint32_t bottom;
+		Entry entries[SIZE];
+	};
+
 	static thread_mutex mutex;
 	static int users;
 	static vector<thread*> threads;
@@ -151,14 +180,37 @@ protected:
 	static list<Entry> queue;
 	static thread_mutex queue_mutex;
 	static thread_condition_variable queue_cond;
+	/* Number of entries in the shared queue, changed with queue_mutex held
+	 * but read without it to skip locking an empty queue. */
+	static int num_queued;
+
+	/* One deque for every worker thread, and the key to find the deque of
+	 * the calling thread. */
+	static Deque *deques;
+	static pthread_key_t deque_key;
+	/* Number of worker threads waiting on queue_cond. */
+	static int num_sleeping;
 
 	static void thread_run(int thread_id);
 	static bool thread_wait_pop(Entry& entry);
 
+	static Deque *thread_deque();
+	static bool find_entry(Entry& entry, TaskPool *pool);
+	static bool has_entries();
+	static void wake();
+
 	static void push(Entry& entry, bool front);
 	static void clear(TaskPool *pool);
 };
 
+/* Parallel For
+ *
+ * Run func over the range from start to end, split in parts of at least
+ * grain_size by the worker threads and the calling thread. Ranges are split
+ * in half as they are taken, so idle threads steal large parts first. */
+
+void parallel_for(int start, int end, const TaskRangeFunction& func, int grain_size = 1);
+
 /* Dedicated Task Pool
  *
  * Like a TaskPool, but will launch one dedicated thread to execute all tasks.
@@ -105,6 +105,71 @@ static bool mesh_remap_bvhtree_query_raycast(
 	}
 }
 
+/**
+ * Same as #mesh_remap_bvhtree_query_nearest, for all \a cos at once.
+ *
+ * \return The results, with an index of -1 where there is no hit within \a max_dist_sq.
+ */
+static BVHTreeNearest *mesh_remap_bvhtree_query_nearest_batch(
+        BVHTreeFromMesh *treedata, const float (*cos)[3], const int cos_num, const float max_dist_sq)
+{
+	BVHTreeNearest *nearest = MEM_mallocN(sizeof(*nearest) * (size_t)cos_num, __func__);
+	int i;
+
+	for (i = 0; i < cos_num; i++) {
+		nearest[i].index = -1;
+		nearest[i].dist_sq = max_dist_sq;
+	}
+
+	BLI_bvhtree_find_nearest_batch(treedata->tree, cos, cos_num, nearest, treedata->nearest_callback, treedata);
+
+	return nearest;
+}
+
+/**
+ * Same as #mesh_remap_bvhtree_query_raycast, for all \a cos and \a nos at once.
+ *
+ * \return The results, with an index of -1 where there is no hit within \a max_dist.
+ */
+static BVHTreeRayHit *mesh_remap_bvhtree_query_raycast_batch(
+        BVHTreeFromMesh *treedata, const float (*cos)[3], const float (*nos)[3], const int cos_num,
+        const float radius, const float max_dist)
+{
+	BVHTreeRayHit *rayhit = MEM_mallocN(sizeof(*rayhit) * (size_t)cos_num, __func__);
+	BVHTreeRayHit *rayhit_tmp = MEM_mallocN(sizeof(*rayhit_tmp) * (size_t)cos_num, __func__);
+	float (*inv_nos)[3] = MEM_mallocN(sizeof(*inv_nos) * (size_t)cos_num, __func__);
+	int i;
+
+	for (i = 0; i < cos_num; i++) {
+		rayhit[i].index = -1;
+		rayhit[i].dist = max_dist;
+	}
+	BLI_bvhtree_ray_cast_batch(
+	        treedata->tree, cos, nos, cos_num, radius, rayhit,
+	        treedata->raycast_callback, treedata, BVH_RAYCAST_DEFAULT);
+
+	/* Also cast in the other direction! */
+	for (i = 0; i < cos_num; i++) {
+		negate_v3_v3(inv_nos[i], nos[i]);
+		rayhit_tmp[i].index = -1;
+		rayhit_tmp[i].dist = rayhit[i].dist;
+	}
+	BLI_bvhtree_ray_cast_batch(
+	        treedata->tree, cos, (const float (*)[3])inv_nos, cos_num, radius, rayhit_tmp,
+	        treedata->raycast_callback, treedata, BVH_RAYCAST_DEFAULT);
+
+	for (i = 0; i < cos_num; i++) {
+		if (rayhit_tmp[i].index != -1) {
+			rayhit[i] = rayhit_tmp[i];
+		}
+	}
+
+	MEM_freeN(rayhit_tmp);
+	MEM_freeN(inv_nos);
+
+	return rayhit;
+}
+
 /** \} */
 
 /**
@@ -454,31 +519,36 @@ void BKE_mesh_remap_calc_verts_from_dm(
 	}
 	else {
 		BVHTreeFromMesh treedata = {NULL};
-		BVHTreeNearest nearest = {0};
-		BVHTreeRayHit rayhit = {0};
-		float hit_dist;
-		float tmp_co[3], tmp_no[3];
+		BVHTreeNearest *nearest;
+		BVHTreeRayHit *rayhit;
+		float (*vcos_dst)[3] = MEM_mallocN(sizeof(*vcos_dst) * (size_t)numverts_dst, __func__);
+
+		for (i = 0; i < numverts_dst; i++) {
+			copy_v3_v3(vcos_dst[i], verts_dst[i].co);
+
+			/* Convert the vertex to tree coordinates, if needed. */
+			if (space_transform) {
+				BLI_space_transform_apply(space_transform, vcos_dst[i]);
+			}
+		}
 
 		if (mode == MREMAP_MODE_VERT_NEAREST) {
 			bvhtree_from_mesh_verts(&treedata, dm_src, 0.0f, 2, 6);
-			nearest.index = -1;
+			nearest = mesh_remap_bvhtree_query_nearest_batch(
+			        &treedata, (const float (*)[3])vcos_dst, numverts_dst, max_dist_sq);
 
 			for (i = 0; i < numverts_dst; i++) {
-				copy_v3_v3(tmp_co, verts_dst[i].co);
-
-				/* Convert the vertex to tree coordinates, if needed. */
-				if (space_transform) {
-					BLI_space_transform_apply(space_transform, tmp_co);
-				}
-
-				if (mesh_remap_bvhtree_query_nearest(&treedata, &nearest, tmp_co, max_dist_sq, &hit_dist)) {
-					mesh_remap_item_define(r_map, i, hit_dist, 0, 1, &nearest.index, &full_weight);
+				if (nearest[i].index != -1) {
+					const float hit_dist = sqrtf(nearest[i].dist_sq);
+					mesh_remap_item_define(r_map, i, hit_dist, 0, 1, &nearest[i].index, &full_weight);
 				}
 				else {
 					/* No source for this dest vertex! */
 					BKE_mesh_remap_item_define_invalid(r_map, i);
 				}
 			}
+
+			MEM_freeN(nearest);
 		}
 		else if (ELEM(mode, MREMAP_MODE_VERT_EDGE_NEAREST, MREMAP_MODE_VERT_EDGEINTERP_NEAREST)) {
 			MEdge *edges_src = dm_src->getEdgeArray(dm_src);
@@ -486,24 +556,19 @@ void BKE_mesh_remap_calc_verts_from_dm(
 			dm_src->getVertCos(dm_src, vcos_src);
 
 			bvhtree_from_mesh_edges(&treedata, dm_src, 0.0f, 2, 6);
-			nearest.index = -1;
+			nearest = mesh_remap_bvhtree_query_nearest_batch(
+			        &treedata, (const float (*)[3])vcos_dst, numverts_dst, max_dist_sq);
 
 			for (i = 0; i < numverts_dst; i++) {
-				copy_v3_v3(tmp_co, verts_dst[i].co);
-
-				/* Convert the vertex to tree coordinates, if needed. */
-				if (space_transform) {
-					BLI_space_transform_apply(space_transform, tmp_co);
-				}
-
-				if (mesh_remap_bvhtree_query_nearest(&treedata, &nearest, tmp_co, max_dist_sq, &hit_dist)) {
-					MEdge *me = &edges_src[nearest.index];
+				if (nearest[i].index != -1) {
+					const float hit_dist = sqrtf(nearest[i].dist_sq);
+					MEdge *me = &edges_src[nearest[i].index];
 					const float *v1cos = vcos_src[me->v1];
 					const float *v2cos = vcos_src[me->v2];
 
 					if (mode == MREMAP_MODE_VERT_EDGE_NEAREST) {
-						const float dist_v1 = len_squared_v3v3(tmp_co, v1cos);
-						const float dist_v2 = len_squared_v3v3(tmp_co, v2cos);
+						const float dist_v1 = len_squared_v3v3(vcos_dst[i], v1cos);
+						const float dist_v2 = len_squared_v3v3(vcos_dst[i], v2cos);
 						const int index = (int)((dist_v1 > dist_v2) ? me->v2 : me->v1);
 						mesh_remap_item_define(r_map, i, hit_dist, 0, 1, &index, &full_weight);
 					}
@@ -515,7 +580,7 @@ void BKE_mesh_remap_calc_verts_from_dm(
 						indices[1] = (int)me->v2;
 
 						/* Weight is inverse of point factor here... */
-						weights[0] = line_point_factor_v3(tmp_co, v2cos, v1cos);
+						weights[0] = line_point_factor_v3(vcos_dst[i], v2cos, v1cos);
 						CLAMP(weights[0], 0.0f, 1.0f);
 						weights[1] = 1.0f - weights[0];
 
@@ -528,6 +593,7 @@ void BKE_mesh_remap_calc_verts_from_dm(
 				}
 			}
 
+			MEM_freeN(nearest);
 			MEM_freeN(vcos_src);
 		}
 		else if (ELEM(mode, MREMAP_MODE_VERT_POLY_NEAREST, MREMAP_MODE_VERT_POLYINTERP_NEAREST,
@@ -546,23 +612,28 @@ void BKE_mesh_remap_calc_verts_from_dm(
 			bvhtree_from_mesh_looptri(&treedata, dm_src, (mode & MREMAP_USE_NORPROJ) ? ray_radius : 0.0f, 2, 6);
 
 			if (mode == MREMAP_MODE_VERT_POLYINTERP_VNORPROJ) {
+				float (*vnos_dst)[3] = MEM_mallocN(sizeof(*vnos_dst) * (size_t)numverts_dst, __func__);
+
 				for (i = 0; i < numverts_dst; i++) {
-					copy_v3_v3(tmp_co, verts_dst[i].co);
-					normal_short_to_float_v3(tmp_no, verts_dst[i].no);
+					normal_short_to_float_v3(vnos_dst[i], verts_dst[i].no);
 
-					/* Convert the vertex to tree coordinates, if needed. */
+					/* Convert the vertex normal to tree coordinates, if needed. */
 					if (space_transform) {
-						BLI_space_transform_apply(space_transform, tmp_co);
-						BLI_space_transform_apply_normal(space_transform, tmp_no);
+						BLI_space_transform_apply_normal(space_transform, vnos_dst[i]);
 					}
+				}
+
+				rayhit = mesh_remap_bvhtree_query_raycast_batch(
+				        &treedata, (const float (*)[3])vcos_dst, (const float (*)[3])vnos_dst, numverts_dst,
+				        ray_radius, max_dist);
 
-					if (mesh_remap_bvhtree_query_raycast(
-					        &treedata, &rayhit, tmp_co, tmp_no, ray_radius, max_dist, &hit_dist))
-					{
-						const MLoopTri *lt = &treedata.looptri[rayhit.index];
+				for (i = 0; i < numverts_dst; i++) {
+					if (rayhit[i].index != -1) {
+						const float hit_dist = rayhit[i].dist;
+						const MLoopTri *lt = &treedata.looptri[rayhit[i].index];
 						MPoly *mp_src = &polys_src[lt->poly];
 						const int sources_num = mesh_remap_interp_poly_data_get(
-						        mp_src, loops_src, (const float (*)[3])vcos_src, rayhit.co,
+						        mp_src, loops_src, (const float (*)[3])vcos_src, rayhit[i].co,
 						        &tmp_buff_size, &vcos, false, &indices, &weights, true, NULL);
 
 						mesh_remap_item_define(r_map, i, hit_dist, 0, sources_num, indices, weights);
@@ -572,26 +643,24 @@ void BKE_mesh_remap_calc_verts_from_dm(
 						BKE_mesh_remap_item_define_invalid(r_map, i);
 					}
 				}
+
+				MEM_freeN(rayhit);
+				MEM_freeN(vnos_dst);
 			}
 			else {
-				nearest.index = -1;
+				nearest = mesh_remap_bvhtree_query_nearest_batch(
+				        &treedata, (const float (*)[3])vcos_dst, numverts_dst, max_dist_sq);
 
 				for (i = 0; i < numverts_dst; i++) {
-					copy_v3_v3(tmp_co, verts_dst[i].co);
-
-					/* Convert the vertex to tree coordinates, if needed. */
-					if (space_transform) {
-						BLI_space_transform_apply(space_transform, tmp_co);
-					}
-
-					if (mesh_remap_bvhtree_query_nearest(&treedata, &nearest, tmp_co, max_dist_sq, &hit_dist)) {
-						const MLoopTri *lt = &treedata.looptri[nearest.index];
+					if (nearest[i].index != -1) {
+						const float hit_dist = sqrtf(nearest[i].dist_sq);
+						const MLoopTri *lt = &treedata.looptri[nearest[i].index];
 						MPoly *mp = &polys_src[lt->poly];
 
 						if (mode == MREMAP_MODE_VERT_POLY_NEAREST) {
 							int index;
 							mesh_remap_interp_poly_data_get(
-							        mp, loops_src, (const float (*)[3])vcos_src, nearest.co,
+							        mp, loops_src, (const float (*)[3])vcos_src, nearest[i].co,
 							        &tmp_buff_size, &vcos, false, &indices, &weights, false,
 							        &index);
 
@@ -599,7 +668,7 @@ void BKE_mesh_remap_calc_verts_from_dm(
 						}
 						else if (mode == MREMAP_MODE_VERT_POLYINTERP_NEAREST) {
 							const int sources_num = mesh_remap_interp_poly_data_get(
-							        mp, loops_src, (const float (*)[3])vcos_src, nearest.co,
+							        mp, loops_src, (const float (*)[3])vcos_src, nearest[i].co,
 							        &tmp_buff_size, &vcos, false, &indices, &weights, true,
 							        NULL);
 
@@ -611,6 +680,8 @@ void BKE_mesh_remap_calc_verts_from_dm(
 						BKE_mesh_remap_item_define_invalid(r_map, i);
 					}
 				}
+
+				MEM_freeN(nearest);
 			}
 
 			MEM_freeN(vcos_src);
@@ -623,6 +694,7 @@ void BKE_mesh_remap_calc_verts_from_dm(
 			memset(r_map->items, 0, sizeof(*r_map->items) * (size_t)numverts_dst);
 		}
 
+		MEM_freeN(vcos_dst);
 		free_bvhtree_from_mesh(&treedata);
 	}
 }
@@ -37,6 +37,8 @@
 #include <time.h>
 #include <assert.h>
 
+#include "MEM_guardedalloc.h"
+
 #include "DNA_object_types.h"
 #include "DNA_modifier_types.h"
 #include "DNA_meshdata_types.h"
@@ -70,65 +72,84 @@
 typedef struct ShrinkwrapCalcCBData {
 	ShrinkwrapCalcData *calc;
 
-	void *treeData;
-	void *auxData;
-	BVHTree *targ_tree;
-	BVHTree *aux_tree;
-	void *targ_callback;
-	void *aux_callback;
+	const float *weights;
 
-	float *proj_axis;
-	SpaceTransform *local2aux;
+	/* Nearest vertex and surface point. */
+	const float (*tree_co)[3];
+	const BVHTreeNearest *nearest;
+
+	/* Normal projection. */
+	const float (*proj_no)[3];
+	const BVHTreeRayHit *hits;
 } ShrinkwrapCalcCBData;
 
+/* Vertex group weight of every vertex, zero for the vertices that are not affected. */
+static float *shrinkwrap_calc_weights(const ShrinkwrapCalcData *calc)
+{
+	float *weights = MEM_mallocN(sizeof(*weights) * (size_t)calc->numVerts, __func__);
+	int i;
+
+	for (i = 0; i < calc->numVerts; i++) {
+		float weight = defvert_array_find_weight_safe(calc->dvert, i, calc->vgroup);
+
+		if (calc->invert_vgroup) {
+			weight = 1.0f - weight;
+		}
+
+		weights[i] = weight;
+	}
+
+	return weights;
+}
+
+/**
+ * Find the nearest point on the target for every vertex with a weight,
+ * \a r_tree_co gets the vertices in target space.
+ */
+static BVHTreeNearest *shrinkwrap_calc_nearest(
+        const ShrinkwrapCalcData *calc, BVHTreeFromMesh *treeData, const float *weights, float (*r_tree_co)[3])
+{
+	BVHTreeNearest *nearest = MEM_mallocN(sizeof(*nearest) * (size_t)calc->numVerts, __func__);
+	int i;
+
+	for (i = 0; i < calc->numVerts; i++) {
+		/* Convert the vertex to tree coordinates */
+		if (calc->vert) {
+			copy_v3_v3(r_tree_co[i], calc->vert[i].co);
+		}
+		else {
+			copy_v3_v3(r_tree_co[i], calc->vertexCos[i]);
+		}
+		BLI_space_transform_apply(&calc->local2target, r_tree_co[i]);
+
+		/* A zero search distance skips the vertex. */
+		nearest[i].index = -1;
+		nearest[i].dist_sq = (weights[i] != 0.0f) ? FLT_MAX : 0.0f;
+	}
+
+	BLI_bvhtree_find_nearest_batch(
+	        treeData->tree, (const float (*)[3])r_tree_co, calc->numVerts, nearest,
+	        treeData->nearest_callback, treeData);
+
+	return nearest;
+}
+
 /*
  * Shrinkwrap to the nearest vertex
  *
  * it builds a kdtree of vertexs we can attach to and then
  * for each vertex performs a nearest vertex search on the tree
  */
-static void shrinkwrap_calc_nearest_vertex_cb_ex(
-        void *userdata, void *userdata_chunk, const int i, const int UNUSED(threadid))
+static void shrinkwrap_calc_nearest_vertex_cb(void *userdata, const int i)
 {
 	ShrinkwrapCalcCBData *data = userdata;
 
 	ShrinkwrapCalcData *calc = data->calc;
-	BVHTreeFromMesh *treeData = data->treeData;
-	BVHTreeNearest *nearest = userdata_chunk;
+	const BVHTreeNearest *nearest = &data->nearest[i];
 
 	float *co = calc->vertexCos[i];
 	float tmp_co[3];
-	float weight = defvert_array_find_weight_safe(calc->dvert, i, calc->vgroup);
-
-	if (calc->invert_vgroup) {
-		weight = 1.0f - weight;
-	}
-
-	if (weight == 0.0f) {
-		return;
-	}
-
-	/* Convert the vertex to tree coordinates */
-	if (calc->vert) {
-		copy_v3_v3(tmp_co, calc->vert[i].co);
-	}
-	else {
-		copy_v3_v3(tmp_co, co);
-	}
-	BLI_space_transform_apply(&calc->local2target, tmp_co);
-
-	/* Use local proximity heuristics (to reduce the nearest search)
-	 *
-	 * If we already had an hit before.. we assume this vertex is going to have a close hit to that other vertex
-	 * so we can initiate the "nearest.dist" with the expected value to that last hit.
-	 * This will lead in pruning of the search tree. */
-	if (nearest->index != -1)
-		nearest->dist_sq = len_squared_v3v3(tmp_co, nearest->co);
-	else
-		nearest->dist_sq = FLT_MAX;
-
-	BLI_bvhtree_find_nearest(treeData->tree, tmp_co, nearest, treeData->nearest_callback, treeData);
-
+	float weight = data->weights[i];
 
 	/* Found the nearest vertex */
 	if (nearest->index != -1) {
@@ -150,7 +171,6 @@ static void shrinkwrap_calc_nearest_vertex_cb_ex(
 static void shrinkwrap_calc_nearest_vertex(ShrinkwrapCalcData *calc)
 {
 	BVHTreeFromMesh treeData = NULL_BVHTreeFromMesh;
-	BVHTreeNearest nearest  = NULL_BVHTreeNearest;
 
 
 	TIMEIT_BENCH(bvhtree_from_mesh_verts(&treeData, calc->target, 0.0, 2, 6), bvhtree_verts);
@@ -158,20 +178,57 @@ static void shrinkwrap_calc_nearest_vertex(ShrinkwrapCalcData *calc)
 		OUT_OF_MEMORY();
 		return;
 	}
-	
-	/* Setup nearest */
-	nearest.index = -1;
-	nearest.dist_sq = FLT_MAX;
 
-	ShrinkwrapCalcCBData data = {.calc = calc, .treeData = &treeData};
-	BLI_task_parallel_range_ex(
-	            0, calc->numVerts, &data, &nearest, sizeof(nearest), shrinkwrap_calc_nearest_vertex_cb_ex,
-	            calc->numVerts > BKE_MESH_OMP_LIMIT, false);
+	float *weights = shrinkwrap_calc_weights(calc);
+	float (*tree_co)[3] = MEM_mallocN(sizeof(*tree_co) * (size_t)calc->numVerts, __func__);
+	BVHTreeNearest *nearest = shrinkwrap_calc_nearest(calc, &treeData, weights, tree_co);
+
+	ShrinkwrapCalcCBData data = {.calc = calc, .weights = weights, .nearest = nearest};
+	BLI_task_parallel_range(
+	            0, calc->numVerts, &data, shrinkwrap_calc_nearest_vertex_cb,
+	            calc->numVerts > BKE_MESH_OMP_LIMIT);
 
+	MEM_freeN(weights);
+	MEM_freeN(tree_co);
+	MEM_freeN(nearest);
 	free_bvhtree_from_mesh(&treeData);
 }
 
 
+/**
+ * Check a hit of a ray cast in target space, and convert it back to the space of the ray.
+ * Returns false if the hit must be ignored.
+ */
+static bool shrinkwrap_project_normal_hit_finalize(
+        char options, const float dir[3], const SpaceTransform *transf, BVHTreeRayHit *hit)
+{
+	if (hit->index == -1) {
+		return false;
+	}
+
+	/* invert the normal first so face culling works on rotated objects */
+	if (transf) {
+		BLI_space_transform_invert_normal(transf, hit->no);
+	}
+
+	if (options & (MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE | MOD_SHRINKWRAP_CULL_TARGET_BACKFACE)) {
+		/* apply backface */
+		const float dot = dot_v3v3(dir, hit->no);
+		if (((options & MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE) && dot <= 0.0f) ||
+		    ((options & MOD_SHRINKWRAP_CULL_TARGET_BACKFACE)  && dot >= 0.0f))
+		{
+			return false;  /* Ignore hit */
+		}
+	}
+
+	if (transf) {
+		/* Inverting space transform (TODO make coeherent with the initial dist readjust) */
+		BLI_space_transform_invert(transf, hit->co);
+	}
+
+	return true;
+}
+
 /*
  * This function raycast a single vertex and updates the hit if the "hit" is considered valid.
  * Returns true if "hit" was updated.
@@ -221,29 +278,12 @@ bool BKE_shrinkwrap_project_normal(
 
 	BLI_bvhtree_ray_cast(tree, co, no, 0.0f, &hit_tmp, callback, userdata);
 
-	if (hit_tmp.index != -1) {
-		/* invert the normal first so face culling works on rotated objects */
-		if (transf) {
-			BLI_space_transform_invert_normal(transf, hit_tmp.no);
-		}
-
-		if (options & (MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE | MOD_SHRINKWRAP_CULL_TARGET_BACKFACE)) {
-			/* apply backface */
-			const float dot = dot_v3v3(dir, hit_tmp.no);
-			if (((options & MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE) && dot <= 0.0f) ||
-			    ((options & MOD_SHRINKWRAP_CULL_TARGET_BACKFACE)  && dot >= 0.0f))
-			{
-				return false;  /* Ignore hit */
-			}
-		}
-
-		if (transf) {
-			/* Inverting space transform (TODO make coeherent with the initial dist readjust) */
-			BLI_space_transform_invert(transf, hit_tmp.co);
+	if (shrinkwrap_project_normal_hit_finalize(options, dir, transf, &hit_tmp)) {
 #ifdef USE_DIST_CORRECT
+		if (transf) {
 			hit_tmp.dist = len_v3v3(vert, hit_tmp.co);
-#endif
 		}
+#endif
 
 		BLI_assert(hit_tmp.dist <= hit->dist);
 
@@ -253,104 +293,77 @@ bool BKE_shrinkwrap_project_normal(
 	return false;
 }
 
-static void shrinkwrap_calc_normal_projection_cb_ex(
-        void *userdata, void *userdata_chunk, const int i, const int UNUSED(threadid))
+/**
+ * #BKE_shrinkwrap_project_normal for all vertices at once,
+ * casting a ray from each of \a vert_co along \a vert_no and updating the matching \a hits.
+ *
+ * \param order: Order of the rays from #BLI_bvhtree_batch_order_new on \a vert_co.
+ */
+static void shrinkwrap_project_normal_batch(
+        char options, const float (*vert_co)[3], const float (*vert_no)[3], const int verts_num,
+        const int *order, const SpaceTransform *transf, BVHTree *tree, BVHTreeRayHit *hits,
+        BVHTree_RayCastCallback callback, void *userdata)
 {
-	ShrinkwrapCalcCBData *data = userdata;
-
-	ShrinkwrapCalcData *calc = data->calc;
-	void *treeData = data->treeData;
-	void *auxData = data->auxData;
-	BVHTree *targ_tree = data->targ_tree;
-	BVHTree *aux_tree = data->aux_tree;
-	void *targ_callback = data->targ_callback;
-	void *aux_callback = data->aux_callback;
-
-	float *proj_axis = data->proj_axis;
-	SpaceTransform *local2aux = data->local2aux;
+	float (*ray_co)[3] = MEM_mallocN(sizeof(*ray_co) * (size_t)verts_num, __func__);
+	float (*ray_no)[3] = MEM_mallocN(sizeof(*ray_no) * (size_t)verts_num, __func__);
+	BVHTreeRayHit *hits_tmp = MEM_mallocN(sizeof(*hits_tmp) * (size_t)verts_num, __func__);
+	int i;
 
-	BVHTreeRayHit *hit = userdata_chunk;
+	for (i = 0; i < verts_num; i++) {
+		copy_v3_v3(ray_co[i], vert_co[i]);
+		copy_v3_v3(ray_no[i], vert_no[i]);
 
-	const float proj_limit_squared = calc->smd->projLimit * calc->smd->projLimit;
-	float *co = calc->vertexCos[i];
-	float tmp_co[3], tmp_no[3];
-	float weight = defvert_array_find_weight_safe(calc->dvert, i, calc->vgroup);
+		/* Apply space transform (TODO readjust dist) */
+		if (transf) {
+			BLI_space_transform_apply(transf, ray_co[i]);
+			BLI_space_transform_apply_normal(transf, ray_no[i]);
+		}
 
-	if (calc->invert_vgroup) {
-		weight = 1.0f - weight;
+		hits_tmp[i].index = -1;
+		hits_tmp[i].dist = hits[i].dist;
 	}
 
-	if (weight == 0.0f) {
-		return;
-	}
+	BLI_bvhtree_ray_cast_batch_ex(
+	        tree, (const float (*)[3])ray_co, (const float (*)[3])ray_no, verts_num, 0.0f, hits_tmp,
+	        callback, userdata, BVH_RAYCAST_DEFAULT, order);
 
-	if (calc->vert) {
-		/* calc->vert contains verts from derivedMesh  */
-		/* this coordinated are deformed by vertexCos only for normal projection (to get correct normals) */
-		/* for other cases calc->varts contains undeformed coordinates and vertexCos should be used */
-		if (calc->smd->projAxis == MOD_SHRINKWRAP_PROJECT_OVER_NORMAL) {
-			copy_v3_v3(tmp_co, calc->vert[i].co);
-			normal_short_to_float_v3(tmp_no, calc->vert[i].no);
-		}
-		else {
-			copy_v3_v3(tmp_co, co);
-			copy_v3_v3(tmp_no, proj_axis);
+	for (i = 0; i < verts_num; i++) {
+		if (shrinkwrap_project_normal_hit_finalize(options, vert_no[i], transf, &hits_tmp[i])) {
+			BLI_assert(hits_tmp[i].dist <= hits[i].dist);
+			hits[i] = hits_tmp[i];
 		}
 	}
-	else {
-		copy_v3_v3(tmp_co, co);
-		copy_v3_v3(tmp_no, proj_axis);
-	}
-
 
-	hit->index = -1;
-	hit->dist = BVH_RAYCAST_DIST_MAX; /* TODO: we should use FLT_MAX here, but sweepsphere code isn't prepared for that */
-
-	/* Project over positive direction of axis */
-	if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_POS_DIR) {
-		if (aux_tree) {
-			BKE_shrinkwrap_project_normal(
-			        0, tmp_co, tmp_no,
-			        local2aux, aux_tree, hit,
-			        aux_callback, auxData);
-		}
+	MEM_freeN(ray_co);
+	MEM_freeN(ray_no);
+	MEM_freeN(hits_tmp);
+}
 
-		BKE_shrinkwrap_project_normal(
-		        calc->smd->shrinkOpts, tmp_co, tmp_no,
-		        &calc->local2target, targ_tree, hit,
-		        targ_callback, treeData);
-	}
+static void shrinkwrap_calc_normal_projection_cb(void *userdata, const int i)
+{
+	ShrinkwrapCalcCBData *data = userdata;
 
-	/* Project over negative direction of axis */
-	if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_NEG_DIR) {
-		float inv_no[3];
-		negate_v3_v3(inv_no, tmp_no);
+	ShrinkwrapCalcData *calc = data->calc;
+	const BVHTreeRayHit *hit = &data->hits[i];
 
-		if (aux_tree) {
-			BKE_shrinkwrap_project_normal(
-			        0, tmp_co, inv_no,
-			        local2aux, aux_tree, hit,
-			        aux_callback, auxData);
-		}
+	const float proj_limit_squared = calc->smd->projLimit * calc->smd->projLimit;
+	float *co = calc->vertexCos[i];
+	float tmp_co[3];
 
-		BKE_shrinkwrap_project_normal(
-		        calc->smd->shrinkOpts, tmp_co, inv_no,
-		        &calc->local2target, targ_tree, hit,
-		        targ_callback, treeData);
+	if (hit->index == -1) {
+		return;
 	}
 
 	/* don't set the initial dist (which is more efficient),
 	 * because its calculated in the targets space, we want the dist in our own space */
 	if (proj_limit_squared != 0.0f) {
 		if (len_squared_v3v3(hit->co, co) > proj_limit_squared) {
-			hit->index = -1;
+			return;
 		}
 	}
 
-	if (hit->index != -1) {
-		madd_v3_v3v3fl(hit->co, hit->co, tmp_no, calc->keepDist);
-		interp_v3_v3v3(co, co, hit->co, weight);
-	}
+	madd_v3_v3v3fl(tmp_co, hit->co, data->proj_no[i], calc->keepDist);
+	interp_v3_v3v3(co, co, tmp_co, data->weights[i]);
 }
 
 static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for_render)
@@ -363,7 +376,6 @@ static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for
 	/** \note 'hit.dist' is kept in the targets space, this is only used
 	 * for finding the best hit, to get the real dist,
 	 * measure the len_v3v3() from the input coord to hit.co */
-	BVHTreeRayHit hit;
 	void *treeData = NULL;
 
 	/* auxiliary target */
@@ -450,16 +462,95 @@ static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for
 				}
 			}
 		}
+
 		/* After sucessufuly build the trees, start projection vertexs */
+		const int numVerts = calc->numVerts;
+		float *weights = shrinkwrap_calc_weights(calc);
+		float (*proj_co)[3] = MEM_mallocN(sizeof(*proj_co) * (size_t)numVerts, __func__);
+		float (*proj_no)[3] = MEM_mallocN(sizeof(*proj_no) * (size_t)numVerts, __func__);
+		BVHTreeRayHit *hits = MEM_mallocN(sizeof(*hits) * (size_t)numVerts, __func__);
+		int i;
+
+		for (i = 0; i < numVerts; i++) {
+			if (calc->vert) {
+				/* calc->vert contains verts from derivedMesh  */
+				/* this coordinated are deformed by vertexCos only for normal projection (to get correct normals) */
+				/* for other cases calc->varts contains undeformed coordinates and vertexCos should be used */
+				if (calc->smd->projAxis == MOD_SHRINKWRAP_PROJECT_OVER_NORMAL) {
+					copy_v3_v3(proj_co[i], calc->vert[i].co);
+					normal_short_to_float_v3(proj_no[i], calc->vert[i].no);
+				}
+				else {
+					copy_v3_v3(proj_co[i], calc->vertexCos[i]);
+					copy_v3_v3(proj_no[i], proj_axis);
+				}
+			}
+			else {
+				copy_v3_v3(proj_co[i], calc->vertexCos[i]);
+				copy_v3_v3(proj_no[i], proj_axis);
+			}
+
+			/* A zero ray length skips the vertex. */
+			hits[i].index = -1;
+			/* TODO: we should use FLT_MAX here, but sweepsphere code isn't prepared for that */
+			hits[i].dist = (weights[i] != 0.0f) ? BVH_RAYCAST_DIST_MAX : 0.0f;
+		}
+
+		/* The space transforms keep neighboring vertices together,
+		 * so sort the rays once for all projections. */
+		int *order = BLI_bvhtree_batch_order_new((const float (*)[3])proj_co, numVerts);
+
+		/* Project over positive direction of axis */
+		if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_POS_DIR) {
+			if (aux_tree) {
+				shrinkwrap_project_normal_batch(
+				        0, (const float (*)[3])proj_co, (const float (*)[3])proj_no, numVerts,
+				        order, &local2aux, aux_tree, hits,
+				        aux_callback, auxData);
+			}
+
+			shrinkwrap_project_normal_batch(
+			        calc->smd->shrinkOpts, (const float (*)[3])proj_co, (const float (*)[3])proj_no, numVerts,
+			        order, &calc->local2target, targ_tree, hits,
+			        targ_callback, treeData);
+		}
+
+		/* Project over negative direction of axis */
+		if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_NEG_DIR) {
+			float (*inv_no)[3] = MEM_mallocN(sizeof(*inv_no) * (size_t)numVerts, __func__);
+
+			for (i = 0; i < numVerts; i++) {
+				negate_v3_v3(inv_no[i], proj_no[i]);
+			}
+
+			if (aux_tree) {
+				shrinkwrap_project_normal_batch(
+				        0, (const float (*)[3])proj_co, (const float (*)[3])inv_no, numVerts,
+				        order, &local2aux, aux_tree, hits,
+				        aux_callback, auxData);
+			}
+
+			shrinkwrap_project_normal_batch(
+			        calc->smd->shrinkOpts, (const float (*)[3])proj_co, (const float (*)[3])inv_no, numVerts,
+			        order, &calc->local2target, targ_tree, hits,
+			        targ_callback, treeData);
+
+			MEM_freeN(inv_no);
+		}
+
 		ShrinkwrapCalcCBData data = {
-			.calc = calc,
-			.treeData = treeData, .targ_tree = targ_tree, .targ_callback = targ_callback,
-			.auxData = auxData, .aux_tree = aux_tree, .aux_callback = aux_callback,
-			.proj_axis = proj_axis, .local2aux = &local2aux,
+			.calc = calc, .weights = weights,
+			.proj_no = (const float (*)[3])proj_no, .hits = hits,
 		};
-		BLI_task_parallel_range_ex(
-		            0, calc->numVerts, &data, &hit, sizeof(hit), shrinkwrap_calc_normal_projection_cb_ex,
-		            calc->numVerts > BKE_MESH_OMP_LIMIT, false);
+		BLI_task_parallel_range(
+		            0, numVerts, &data, shrinkwrap_calc_normal_projection_cb,
+		            numVerts > BKE_MESH_OMP_LIMIT);
+
+		MEM_freeN(weights);
+		MEM_freeN(order);
+		MEM_freeN(proj_co);
+		MEM_freeN(proj_no);
+		MEM_freeN(hits);
 	}
 
 	/* free data structures */
@@ -488,47 +579,16 @@ static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for
  * it builds a BVHTree from the target mesh and then performs a
  * NN matches for each vertex
  */
-static void shrinkwrap_calc_nearest_surface_point_cb_ex(
-        void *userdata, void *userdata_chunk, const int i, const int UNUSED(threadid))
+static void shrinkwrap_calc_nearest_surface_point_cb(void *userdata, const int i)
 {
 	ShrinkwrapCalcCBData *data = userdata;
 
 	ShrinkwrapCalcData *calc = data->calc;
-	BVHTreeFromMesh *treeData = data->treeData;
-	BVHTreeNearest *nearest = userdata_chunk;
+	const BVHTreeNearest *nearest = &data->nearest[i];
 
 	float *co = calc->vertexCos[i];
 	float tmp_co[3];
-	float weight = defvert_array_find_weight_safe(calc->dvert, i, calc->vgroup);
-
-	if (calc->invert_vgroup) {
-		weight = 1.0f - weight;
-	}
-
-	if (weight == 0.0f) {
-		return;
-	}
-
-	/* Convert the vertex to tree coordinates */
-	if (calc->vert) {
-		copy_v3_v3(tmp_co, calc->vert[i].co);
-	}
-	else {
-		copy_v3_v3(tmp_co, co);
-	}
-	BLI_space_transform_apply(&calc->local2target, tmp_co);
-
-	/* Use local proximity heuristics (to reduce the nearest search)
-	 *
-	 * If we already had an hit before.. we assume this vertex is going to have a close hit to that other vertex
-	 * so we can initiate the "nearest.dist" with the expected value to that last hit.
-	 * This will lead in pruning of the search tree. */
-	if (nearest->index != -1)
-		nearest->dist_sq = len_squared_v3v3(tmp_co, nearest->co);
-	else
-		nearest->dist_sq = FLT_MAX;
-
-	BLI_bvhtree_find_nearest(treeData->tree, tmp_co, nearest, treeData->nearest_callback, treeData);
+	float weight = data->weights[i];
 
 	/* Found the nearest vertex */
 	if (nearest->index != -1) {
@@ -542,7 +602,7 @@ static void shrinkwrap_calc_nearest_surface_point_cb_ex(
 			const float dist = sasqrt(nearest->dist_sq);
 			if (dist > FLT_EPSILON) {
 				/* linear interpolation */
-				interp_v3_v3v3(tmp_co, tmp_co, nearest->co, (dist - calc->keepDist) / dist);
+				interp_v3_v3v3(tmp_co, data->tree_co[i], nearest->co, (dist - calc->keepDist) / dist);
 			}
 			else {
 				copy_v3_v3(tmp_co, nearest->co);
@@ -558,7 +618,6 @@ static void shrinkwrap_calc_nearest_surface_point_cb_ex(
 static void shrinkwrap_calc_nearest_surface_point(ShrinkwrapCalcData *calc)
 {
 	BVHTreeFromMesh treeData = NULL_BVHTreeFromMesh;
-	BVHTreeNearest nearest  = NULL_BVHTreeNearest;
 
 	/* Create a bvh-tree of the given target */
 	bvhtree_from_mesh_looptri(&treeData, calc->target, 0.0, 2, 6);
@@ -567,16 +626,22 @@ static void shrinkwrap_calc_nearest_surface_point(ShrinkwrapCalcData *calc)
 		return;
 	}
 
-	/* Setup nearest */
-	nearest.index = -1;
-	nearest.dist_sq = FLT_MAX;
-
 	/* Find the nearest vertex */
-	ShrinkwrapCalcCBData data = {.calc = calc, .treeData = &treeData};
-	BLI_task_parallel_range_ex(
-	            0, calc->numVerts, &data, &nearest, sizeof(nearest), shrinkwrap_calc_nearest_surface_point_cb_ex,
-	            calc->numVerts > BKE_MESH_OMP_LIMIT, false);
-
+	float *weights = shrinkwrap_calc_weights(calc);
+	float (*tree_co)[3] = MEM_mallocN(sizeof(*tree_co) * (size_t)calc->numVerts, __func__);
+	BVHTreeNearest *nearest = shrinkwrap_calc_nearest(calc, &treeData, weights, tree_co);
+
+	ShrinkwrapCalcCBData data = {
+		.calc = calc, .weights = weights,
+		.tree_co = (const float (*)[3])tree_co, .nearest = nearest,
+	};
+	BLI_task_parallel_range(
+	            0, calc->numVerts, &data, shrinkwrap_calc_nearest_surface_point_cb,
+	            calc->numVerts > BKE_MESH_OMP_LIMIT);
+
+	MEM_freeN(weights);
+	MEM_freeN(tree_co);
+	MEM_freeN(nearest);
 	free_bvhtree_from_mesh(&treeData);
 }
 
@@ -89,6 +89,13 @@ enum {
 #define BVH_RAYCAST_DEFAULT (BVH_RAYCAST_WATERTIGHT)
 #define BVH_RAYCAST_DIST_MAX (FLT_MAX / 2.0f)
 
+enum {
+	/* build using the surface area heuristic instead of median splits,
+	 * slower to balance but gives faster ray-cast and find-nearest queries
+	 * (only used for trees including the x, y, z axes, falls back to median splits otherwise) */
+	BVH_TREE_SAH		= (1 << 0),
+};
+
 /* callback must update nearest in case it finds a nearest result */
 typedef void (*BVHTree_NearestPointCallback)(void *userdata, int index, const float co[3], BVHTreeNearest *nearest);
 
@@ -111,6 +118,7 @@ typedef bool (*BVHTree_WalkLeafCallback)(const BVHTreeAxisRange *bounds, int ind
 typedef bool (*BVHTree_WalkOrderCallback)(const BVHTreeAxisRange *bounds, char axis, void *userdata);
 
 
+BVHTree *BLI_bvhtree_new_ex(int maxsize, float epsilon, char tree_type, char axis, int flag);
 BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis);
 void BLI_bvhtree_free(BVHTree *tree);
 
@@ -147,6 +155,24 @@ int BLI_bvhtree_ray_cast(
         BVHTree *tree, const float co[3], const float dir[3], float radius, BVHTreeRayHit *hit,
         BVHTree_RayCastCallback callback, void *userdata);
 
+/* run many queries at once, in parallel (callbacks must be thread-safe) */
+int *BLI_bvhtree_batch_order_new(const float (*co)[3], const int co_num);
+void BLI_bvhtree_find_nearest_batch_ex(
+        BVHTree *tree, const float (*co)[3], const int co_num, BVHTreeNearest *r_nearest,
+        BVHTree_NearestPointCallback callback, void *userdata,
+        const int *order);
+void BLI_bvhtree_find_nearest_batch(
+        BVHTree *tree, const float (*co)[3], const int co_num, BVHTreeNearest *r_nearest,
+        BVHTree_NearestPointCallback callback, void *userdata);
+void BLI_bvhtree_ray_cast_batch_ex(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int ray_num, float radius,
+        BVHTreeRayHit *r_hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag, const int *order);
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int ray_num, float radius,
+        BVHTreeRayHit *r_hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag);
+
 void BLI_bvhtree_ray_cast_all_ex(
         BVHTree *tree, const float co[3], const float dir[3], float radius, float hit_dist,
         BVHTree_RayCastCallback callback, void *userdata,
@@ -44,6 +44,12 @@
  *   #BLI_bvhtree_overlap, #BVHOverlapData_Shared, #BVHOverlapData_Thread
  * - Range Query:
  *   #BLI_bvhtree_range_query
+ * - Many nearest point or ray-cast queries at once:
+ *   #BLI_bvhtree_find_nearest_batch, #BLI_bvhtree_ray_cast_batch
+ *
+ * Trees are balanced by median splits, or optionally using the surface area heuristic (#BVH_TREE_SAH).
+ * For trees with up to 4 children per node, ray-cast and find-nearest test all children of a node at once
+ * using a SIMD copy of their bounds (#BVHNodeSIMD).
  */
 
 #include <assert.h>
@@ -61,6 +67,15 @@
 /* used for iterative_raycast */
 // #define USE_SKIP_LINKS
 
+/* test the children of a node 4 at a time in ray-cast and find-nearest */
+#ifdef __SSE2__
+#  define USE_KDOPBVH_SIMD
+#endif
+
+#ifdef USE_KDOPBVH_SIMD
+#  include <xmmintrin.h>
+#endif
+
 #define MAX_TREETYPE 32
 
 /* Setting zero so we can catch bugs in BLI_task/KDOPBVH.
@@ -92,23 +107,41 @@ typedef struct BVHNode {
 	char main_axis; /* Axis used to split this node */
 } BVHNode;
 
+#ifdef USE_KDOPBVH_SIMD
+/**
+ * The x, y, z bounds of the children of a branch, one SIMD lane per child.
+ * Ray-cast and find-nearest only look at these 3 axes, so this is all they need.
+ */
+typedef struct BVHNodeSIMD {
+	float bv[6][4];    /* min/max per axis, for each child */
+	int children[4];   /* branch index (>= 0) or -(leaf index + 1), leaf index into #BVHTree.nodearray */
+	int totnode;
+	int main_axis;
+	int _pad[2];
+} BVHNodeSIMD;
+#endif
+
 /* keep under 26 bytes for speed purposes */
 struct BVHTree {
 	BVHNode **nodes;
 	BVHNode *nodearray;     /* pre-alloc branch nodes */
 	BVHNode **nodechild;    /* pre-alloc childs for nodes */
 	float   *nodebv;        /* pre-alloc bounding-volumes for nodes */
+#ifdef USE_KDOPBVH_SIMD
+	BVHNodeSIMD *nodesimd;  /* SIMD copy of the branches (NULL when not supported by the tree type) */
+#endif
 	float epsilon;          /* epslion is used for inflation of the k-dop	   */
 	int totleaf;            /* leafs */
 	int totbranch;
 	axis_t start_axis, stop_axis;  /* bvhtree_kdop_axes array indices according to axis */
 	axis_t axis;                   /* kdop type (6 => OBB, 7 => AABB, ...) */
 	char tree_type;                /* type of tree (4 => quadtree) */
+	char flag;                     /* BVH_TREE_* flags */
 };
 
 /* optimization, ensure we stay small */
-BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 48) ||
-                  (sizeof(void *) == 4 && sizeof(BVHTree) <= 32),
+BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 64) ||
+                  (sizeof(void *) == 4 && sizeof(BVHTree) <= 40),
                   "over sized")
 
 /* avoid duplicating vars in BVHOverlapData_Thread */
@@ -911,18 +944,330 @@ static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array,
 /** \} */
 
 
+/* -------------------------------------------------------------------- */
+
+/** \name SAH Balance Functions
+ *
+ * Top-down build choosing each split with the surface area heuristic, evaluated on bins of the leaf centroids
+ * along their widest axis. A branch gets up to tree_type children by splitting its biggest range of leafs
+ * until there are enough of them, so unlike the implicit tree, branches have varying numbers of children and
+ * a tree may need up to ``totleaf - 1`` branches.
+ *
+ * Branches are allocated parent first, so children always have a greater index than their parent,
+ * as #BLI_bvhtree_update_tree relies on.
+ * \{ */
+
+#define SAH_BINS 16
+
+/* Past this depth splits are done at the median, bounding the depth on degenerate input. */
+#define SAH_DEPTH_MAX 48
+
+typedef struct BVHSAHBin {
+	float bv[6];
+	int totleaf;
+} BVHSAHBin;
+
+typedef struct BVHSAHBuildData {
+	BVHTree *tree;
+	BVHNode *branches_array;
+	int totbranch;
+} BVHSAHBuildData;
+
+static bool bvhtree_use_sah(const BVHTree *tree)
+{
+	/* the bins are made from the x, y, z bounds */
+	return (tree->flag & BVH_TREE_SAH) && (tree->start_axis == 0) && (tree->totleaf > 1);
+}
+
+static float bv_surface_area(const float bv[6])
+{
+	const float dx = bv[1] - bv[0];
+	const float dy = bv[3] - bv[2];
+	const float dz = bv[5] - bv[4];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void bv_init(float bv[6])
+{
+	bv[0] = bv[2] = bv[4] =  FLT_MAX;
+	bv[1] = bv[3] = bv[5] = -FLT_MAX;
+}
+
+static void bv_join(float bv[6], const float bv_other[6])
+{
+	int i;
+	for (i = 0; i < 6; i += 2) {
+		if (bv_other[i] < bv[i]) bv[i] = bv_other[i];
+		if (bv_other[i + 1] > bv[i + 1]) bv[i + 1] = bv_other[i + 1];
+	}
+}
+
+BLI_INLINE int sah_bin_index(const BVHNode *leaf, int axis, float centroid_min, float scale)
+{
+	/* centroids are kept doubled, there is no need to halve them for binning */
+	const float centroid = leaf->bv[2 * axis] + leaf->bv[2 * axis + 1];
+	const int bin = (int)((centroid - centroid_min) * scale);
+	return CLAMPIS(bin, 0, SAH_BINS - 1);
+}
+
+/**
+ * Partition the leafs between \a begin and \a end in two, returning the index of the first leaf of the second part.
+ */
+static int bvh_sah_split(BVHNode **leafs_array, int begin, int end, int depth, char *r_split_axis)
+{
+	BVHSAHBin bins[SAH_BINS];
+	float cost_right[SAH_BINS];
+	float centroid_min[3], centroid_max[3], extent[3], bv[6];
+	float scale, cost_best = FLT_MAX;
+	int split_best = -1;
+	int totleaf, axis, i, mid;
+
+	INIT_MINMAX(centroid_min, centroid_max);
+	for (i = begin; i < end; i++) {
+		const float *leaf_bv = leafs_array[i]->bv;
+		const float centroid[3] = {leaf_bv[0] + leaf_bv[1], leaf_bv[2] + leaf_bv[3], leaf_bv[4] + leaf_bv[5]};
+		minmax_v3v3_v3(centroid_min, centroid_max, centroid);
+	}
+	sub_v3_v3v3(extent, centroid_max, centroid_min);
+	axis = max_axis_v3(extent);
+	*r_split_axis = (char)axis;
+
+	if (extent[axis] > 0.0f && depth < SAH_DEPTH_MAX) {
+		scale = (float)SAH_BINS / extent[axis];
+
+		for (i = 0; i < SAH_BINS; i++) {
+			bv_init(bins[i].bv);
+			bins[i].totleaf = 0;
+		}
+		for (i = begin; i < end; i++) {
+			BVHSAHBin *bin = &bins[sah_bin_index(leafs_array[i], axis, centroid_min[axis], scale)];
+			bv_join(bin->bv, leafs_array[i]->bv);
+			bin->totleaf++;
+		}
+
+		/* cost of the right part for every split, then sweep the left part along */
+		bv_init(bv);
+		totleaf = 0;
+		for (i = SAH_BINS - 1; i > 0; i--) {
+			if (bins[i].totleaf) {
+				bv_join(bv, bins[i].bv);
+				totleaf += bins[i].totleaf;
+			}
+			cost_right[i] = totleaf ? bv_surface_area(bv) * (float)totleaf : 0.0f;
+		}
+
+		bv_init(bv);
+		totleaf = 0;
+		for (i = 1; i < SAH_BINS; i++) {
+			if (bins[i - 1].totleaf) {
+				bv_join(bv, bins[i - 1].bv);
+				totleaf += bins[i - 1].totleaf;
+			}
+			if (totleaf != 0 && totleaf != end - begin) {
+				const float cost = bv_surface_area(bv) * (float)totleaf + cost_right[i];
+				if (cost < cost_best) {
+					cost_best = cost;
+					split_best = i;
+				}
+			}
+		}
+	}
+
+	if (split_best == -1) {
+		/* all centroids in one bin, split at the median instead */
+		mid = (begin + end) / 2;
+		partition_nth_element(leafs_array, begin, end, mid, 2 * axis);
+		return mid;
+	}
+
+	mid = begin;
+	for (i = begin; i < end; i++) {
+		if (sah_bin_index(leafs_array[i], axis, centroid_min[axis], scale) < split_best) {
+			SWAP(BVHNode *, leafs_array[i], leafs_array[mid]);
+			mid++;
+		}
+	}
+	return mid;
+}
+
+static void bvh_sah_build_branch(BVHSAHBuildData *data, BVHNode *node, int begin, int end, int depth)
+{
+	BVHTree *tree = data->tree;
+	BVHNode **leafs_array = tree->nodes;
+	/* child k takes the leafs from nth_positions[k] to nth_positions[k + 1] */
+	int nth_positions[MAX_TREETYPE + 1];
+	int totchild = 1, k;
+
+	refit_kdop_hull(tree, node, begin, end);
+
+	nth_positions[0] = begin;
+	nth_positions[1] = end;
+
+	while (totchild < tree->tree_type) {
+		int split = -1, split_totleaf = 1;
+		char split_axis;
+
+		for (k = 0; k < totchild; k++) {
+			if (nth_positions[k + 1] - nth_positions[k] > split_totleaf) {
+				split = k;
+				split_totleaf = nth_positions[k + 1] - nth_positions[k];
+			}
+		}
+		if (split == -1) {
+			break;
+		}
+
+		memmove(&nth_positions[split + 2], &nth_positions[split + 1], sizeof(int) * (size_t)(totchild - split));
+		nth_positions[split + 1] = bvh_sah_split(leafs_array, nth_positions[split], nth_positions[split + 2],
+		                                         depth, &split_axis);
+		if (totchild == 1) {
+			node->main_axis = split_axis;
+		}
+		totchild++;
+	}
+
+	for (k = 0; k < tree->tree_type; k++) {
+		BVHNode *child;
+
+		if (k >= totchild) {
+			node->children[k] = NULL;
+			continue;
+		}
+
+		if (nth_positions[k + 1] - nth_positions[k] == 1) {
+			child = leafs_array[nth_positions[k]];
+		}
+		else {
+			child = data->branches_array + data->totbranch++;
+		}
+		child->parent = node;
+		node->children[k] = child;
+	}
+	node->totnode = (char)totchild;
+
+	for (k = 0; k < totchild; k++) {
+		if (nth_positions[k + 1] - nth_positions[k] > 1) {
+			bvh_sah_build_branch(data, node->children[k], nth_positions[k], nth_positions[k + 1], depth + 1);
+		}
+	}
+}
+
+/**
+ * Build the tree on \a branches_array, returning the number of branches used.
+ */
+static int bvh_sah_build(BVHTree *tree, BVHNode *branches_array, int num_leafs)
+{
+	BVHSAHBuildData data = {
+		.tree = tree, .branches_array = branches_array, .totbranch = 1,
+	};
+
+	branches_array->parent = NULL;
+	bvh_sah_build_branch(&data, branches_array, 0, num_leafs, 0);
+
+	return data.totbranch;
+}
+
+/** \} */
+
+
+#ifdef USE_KDOPBVH_SIMD
+
+/* -------------------------------------------------------------------- */
+
+/** \name SIMD Layout
+ * \{ */
+
+static bool bvhtree_use_simd(const BVHTree *tree)
+{
+	return (tree->start_axis == 0) && (tree->tree_type <= 4);
+}
+
+BLI_INLINE int bvhtree_branch_index(const BVHTree *tree, const BVHNode *node)
+{
+	return (int)(node - (tree->nodearray + tree->totleaf));
+}
+
+/**
+ * Copy the bounds of all branch children into #BVHTree.nodesimd,
+ * needed after balancing and every time bounds are updated.
+ */
+static void bvhtree_simd_update(BVHTree *tree)
+{
+	int i, j, k;
+
+	if (!bvhtree_use_simd(tree) || tree->totbranch == 0) {
+		return;
+	}
+
+	if (tree->nodesimd == NULL) {
+		tree->nodesimd = MEM_mallocN_aligned(sizeof(BVHNodeSIMD) * (size_t)tree->totbranch, 16, "BVHNodeSIMD");
+	}
+
+	for (i = 0; i < tree->totbranch; i++) {
+		const BVHNode *node = tree->nodes[tree->totleaf + i];
+		BVHNodeSIMD *node_simd = &tree->nodesimd[i];
+
+		for (j = 0; j < 4; j++) {
+			if (j < node->totnode) {
+				const BVHNode *child = node->children[j];
+				for (k = 0; k < 6; k++) {
+					node_simd->bv[k][j] = child->bv[k];
+				}
+				node_simd->children[j] = child->totnode ?
+				        bvhtree_branch_index(tree, child) : -(int)(child - tree->nodearray) - 1;
+			}
+			else {
+				/* unused lanes get inverted bounds no query can hit */
+				for (k = 0; k < 6; k += 2) {
+					node_simd->bv[k][j] =  FLT_MAX;
+					node_simd->bv[k + 1][j] = -FLT_MAX;
+				}
+				node_simd->children[j] = 0;
+			}
+		}
+		node_simd->totnode = node->totnode;
+		node_simd->main_axis = node->main_axis;
+	}
+}
+
+/**
+ * Order the children in \a mask by \a dist, closest first, returning their number.
+ */
+static int simd_children_sort(const float dist[4], const int mask, int r_order[4])
+{
+	int tot = 0, i, j;
+
+	for (i = 0; i < 4; i++) {
+		if (mask & (1 << i)) {
+			for (j = tot; j > 0 && dist[r_order[j - 1]] > dist[i]; j--) {
+				r_order[j] = r_order[j - 1];
+			}
+			r_order[j] = i;
+			tot++;
+		}
+	}
+	return tot;
+}
+
+/** \} */
+
+#endif  /* USE_KDOPBVH_SIMD */
+
+
 /* -------------------------------------------------------------------- */
 
 /** \name BLI_bvhtree API
  * \{ */
 
 /**
+ * \param flag: #BVH_TREE_SAH to balance with the surface area heuristic.
+ *
  * \note many callers don't check for ``NULL`` return.
  */
-BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis)
+BVHTree *BLI_bvhtree_new_ex(int maxsize, float epsilon, char tree_type, char axis, int flag)
 {
 	BVHTree *tree;
-	int numnodes, i;
+	int numnodes, numbranches, i;
 
 	BLI_assert(tree_type >= 2 && tree_type <= MAX_TREETYPE);
 
@@ -937,6 +1282,7 @@ BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis)
 		tree->epsilon = epsilon;
 		tree->tree_type = tree_type;
 		tree->axis = axis;
+		tree->flag = (char)flag;
 
 		if (axis == 26) {
 			tree->start_axis = 0;
@@ -967,7 +1313,12 @@ BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis)
 
 
 		/* Allocate arrays */
-		numnodes = maxsize + implicit_needed_branches(tree_type, maxsize) + tree_type;
+		numbranches = implicit_needed_branches(tree_type, maxsize);
+		if (flag & BVH_TREE_SAH) {
+			/* branches may have as few as 2 children */
+			numbranches = max_ii(numbranches, maxsize - 1);
+		}
+		numnodes = maxsize + numbranches + tree_type;
 
 		tree->nodes = MEM_callocN(sizeof(BVHNode *) * (size_t)numnodes, "BVHNodes");
 		tree->nodebv = MEM_callocN(sizeof(float) * (size_t)(axis * numnodes), "BVHNodeBV");
@@ -1003,6 +1354,11 @@ fail:
 	return NULL;
 }
 
+BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis)
+{
+	return BLI_bvhtree_new_ex(maxsize, epsilon, tree_type, axis, 0);
+}
+
 void BLI_bvhtree_free(BVHTree *tree)
 {
 	if (tree) {
@@ -1010,6 +1366,9 @@ void BLI_bvhtree_free(BVHTree *tree)
 		MEM_freeN(tree->nodearray);
 		MEM_freeN(tree->nodebv);
 		MEM_freeN(tree->nodechild);
+#ifdef USE_KDOPBVH_SIMD
+		MEM_SAFE_FREE(tree->nodesimd);
+#endif
 		MEM_freeN(tree);
 	}
 }
@@ -1024,12 +1383,17 @@ void BLI_bvhtree_balance(BVHTree *tree)
 	/* This function should only be called once (some big bug goes here if its being called more than once per tree) */
 	BLI_assert(tree->totbranch == 0);
 
-	/* Build the implicit tree */
-	non_recursive_bvh_div_nodes(tree, branches_array, leafs_array, tree->totleaf);
+	if (bvhtree_use_sah(tree)) {
+		tree->totbranch = bvh_sah_build(tree, branches_array, tree->totleaf);
+	}
+	else {
+		/* Build the implicit tree */
+		non_recursive_bvh_div_nodes(tree, branches_array, leafs_array, tree->totleaf);
+		tree->totbranch = implicit_needed_branches(tree->tree_type, tree->totleaf);
+	}
 
 	/* current code expects the branches to be linked to the nodes array
 	 * we perform that linkage here */
-	tree->totbranch = implicit_needed_branches(tree->tree_type, tree->totleaf);
 	for (i = 0; i < tree->totbranch; i++)
 		tree->nodes[tree->totleaf + i] = branches_array + i;
 
@@ -1037,6 +1401,10 @@ void BLI_bvhtree_balance(BVHTree *tree)
 	build_skip_links(tree, tree->nodes[tree->totleaf], NULL, NULL);
 #endif
 
+#ifdef USE_KDOPBVH_SIMD
+	bvhtree_simd_update(tree);
+#endif
+
 	/* bvhtree_info(tree); */
 }
 
@@ -1101,6 +1469,10 @@ void BLI_bvhtree_update_tree(BVHTree *tree)
 
 	for (; index >= root; index--)
 		node_join(tree, *index);
+
+#ifdef USE_KDOPBVH_SIMD
+	bvhtree_simd_update(tree);
+#endif
 }
 /**
  * Number of times #BLI_bvhtree_insert has been called.
@@ -1370,6 +1742,63 @@ static float calc_nearest_point_squared(const float proj[3], BVHNode *node, floa
 	return len_squared_v3v3(proj, nearest);
 }
 
+#ifdef USE_KDOPBVH_SIMD
+/**
+ * #calc_nearest_point_squared for all children of \a node_simd,
+ * returns a mask of the children closer than \a dist_sq_max.
+ */
+static int calc_nearest_point_squared_simd(
+        const float proj[3], const BVHNodeSIMD *node_simd, const float dist_sq_max, float r_dist_sq[4])
+{
+	__m128 dist_sq = _mm_setzero_ps();
+	int i;
+
+	for (i = 0; i != 3; i++) {
+		const __m128 co = _mm_set1_ps(proj[i]);
+		const __m128 nearest = _mm_min_ps(_mm_max_ps(co, _mm_load_ps(node_simd->bv[2 * i])),
+		                                  _mm_load_ps(node_simd->bv[2 * i + 1]));
+		const __m128 delta = _mm_sub_ps(co, nearest);
+		dist_sq = _mm_add_ps(dist_sq, _mm_mul_ps(delta, delta));
+	}
+	_mm_storeu_ps(r_dist_sq, dist_sq);
+
+	return _mm_movemask_ps(_mm_cmplt_ps(dist_sq, _mm_set1_ps(dist_sq_max))) & ((1 << node_simd->totnode) - 1);
+}
+
+static void dfs_find_nearest_simd(BVHNearestData *data, const int branch)
+{
+	const BVHNodeSIMD *node_simd = &data->tree->nodesimd[branch];
+	float dist_sq[4];
+	int order[4], tot, i;
+
+	tot = simd_children_sort(
+	        dist_sq, calc_nearest_point_squared_simd(data->proj, node_simd, data->nearest.dist_sq, dist_sq), order);
+
+	for (i = 0; i < tot; i++) {
+		const int child = node_simd->children[order[i]];
+
+		/* closest first, the others can only be further away */
+		if (dist_sq[order[i]] >= data->nearest.dist_sq) {
+			break;
+		}
+
+		if (child >= 0) {
+			dfs_find_nearest_simd(data, child);
+		}
+		else {
+			BVHNode *leaf = &data->tree->nodearray[-child - 1];
+			if (data->callback) {
+				data->callback(data->userdata, leaf->index, data->co, &data->nearest);
+			}
+			else {
+				data->nearest.index = leaf->index;
+				data->nearest.dist_sq = calc_nearest_point_squared(data->proj, leaf, data->nearest.co);
+			}
+		}
+	}
+}
+#endif  /* USE_KDOPBVH_SIMD */
+
 /* TODO: use a priority queue to reduce the number of nodes looked on */
 static void dfs_find_nearest_dfs(BVHNearestData *data, BVHNode *node)
 {
@@ -1386,6 +1815,13 @@ static void dfs_find_nearest_dfs(BVHNearestData *data, BVHNode *node)
 		int i;
 		float nearest[3];
 
+#ifdef USE_KDOPBVH_SIMD
+		if (data->tree->nodesimd) {
+			dfs_find_nearest_simd(data, bvhtree_branch_index(data->tree, node));
+			return;
+		}
+#endif
+
 		if (data->proj[node->main_axis] <= node->children[0]->bv[node->main_axis * 2 + 1]) {
 
 			for (i = 0; i != node->totnode; i++) {
@@ -1623,6 +2059,119 @@ static float fast_ray_nearest_hit(const BVHRayCastData *data, const BVHNode *nod
 	}
 }
 
+#ifdef USE_KDOPBVH_SIMD
+/**
+ * #ray_nearest_hit for all children of \a node_simd,
+ * returns a mask of the children hit closer than the current hit.
+ */
+static int ray_nearest_hit_simd(const BVHRayCastData *data, const BVHNodeSIMD *node_simd, float r_dist[4])
+{
+	const __m128 radius = _mm_set1_ps(data->ray.radius);
+	__m128 low = _mm_setzero_ps();
+	__m128 upper = _mm_set1_ps(data->hit.dist);
+	__m128 inside = _mm_cmpeq_ps(low, low);
+	int i;
+
+	for (i = 0; i != 3; i++) {
+		const __m128 origin = _mm_set1_ps(data->ray.origin[i]);
+		const __m128 bv_min = _mm_sub_ps(_mm_load_ps(node_simd->bv[2 * i]), radius);
+		const __m128 bv_max = _mm_add_ps(_mm_load_ps(node_simd->bv[2 * i + 1]), radius);
+
+		if (data->ray_dot_axis[i] == 0.0f) {
+			/* axis aligned ray */
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmple_ps(bv_min, origin), _mm_cmple_ps(origin, bv_max)));
+		}
+		else {
+			const __m128 idot = _mm_set1_ps(data->idot_axis[i]);
+			const __m128 ll = _mm_mul_ps(_mm_sub_ps(bv_min, origin), idot);
+			const __m128 lu = _mm_mul_ps(_mm_sub_ps(bv_max, origin), idot);
+
+			if (data->ray_dot_axis[i] > 0.0f) {
+				low = _mm_max_ps(low, ll);
+				upper = _mm_min_ps(upper, lu);
+			}
+			else {
+				low = _mm_max_ps(low, lu);
+				upper = _mm_min_ps(upper, ll);
+			}
+		}
+	}
+	_mm_storeu_ps(r_dist, low);
+
+	inside = _mm_and_ps(inside, _mm_cmple_ps(low, upper));
+	inside = _mm_and_ps(inside, _mm_cmplt_ps(low, _mm_set1_ps(data->hit.dist)));
+	return _mm_movemask_ps(inside) & ((1 << node_simd->totnode) - 1);
+}
+
+static void dfs_raycast_simd(BVHRayCastData *data, const int branch)
+{
+	const BVHNodeSIMD *node_simd = &data->tree->nodesimd[branch];
+	float dist[4];
+	int order[4], tot, i;
+
+	tot = simd_children_sort(dist, ray_nearest_hit_simd(data, node_simd, dist), order);
+
+	for (i = 0; i < tot; i++) {
+		const int child = node_simd->children[order[i]];
+
+		/* closest first, the others can only be further away */
+		if (dist[order[i]] >= data->hit.dist) {
+			break;
+		}
+
+		if (child >= 0) {
+			dfs_raycast_simd(data, child);
+		}
+		else {
+			BVHNode *leaf = &data->tree->nodearray[-child - 1];
+			if (data->callback) {
+				data->callback(data->userdata, leaf->index, &data->ray, &data->hit);
+			}
+			else {
+				/* report the same distance as #dfs_raycast */
+				const float dist_leaf = (data->ray.radius == 0.0f) ?
+				        fast_ray_nearest_hit(data, leaf) : ray_nearest_hit(data, leaf->bv);
+				if (dist_leaf < data->hit.dist) {
+					data->hit.index = leaf->index;
+					data->hit.dist  = dist_leaf;
+					madd_v3_v3v3fl(data->hit.co, data->ray.origin, data->ray.direction, dist_leaf);
+				}
+			}
+		}
+	}
+}
+
+static void dfs_raycast_all_simd(BVHRayCastData *data, const int branch)
+{
+	const BVHNodeSIMD *node_simd = &data->tree->nodesimd[branch];
+	float dist[4];
+	const int mask = ray_nearest_hit_simd(data, node_simd, dist);
+	/* same order as #dfs_raycast_all, callers may depend on it */
+	const bool forward = data->ray_dot_axis[node_simd->main_axis] > 0.0f;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		const int lane = forward ? i : 3 - i;
+		const int child = node_simd->children[lane];
+
+		if ((mask & (1 << lane)) == 0) {
+			continue;
+		}
+
+		if (child >= 0) {
+			dfs_raycast_all_simd(data, child);
+		}
+		else {
+			/* no need to check for 'data->callback' (using 'all' only makes sense with a callback). */
+			const float hit_dist = data->hit.dist;
+			data->callback(data->userdata, data->tree->nodearray[-child - 1].index, &data->ray, &data->hit);
+			data->hit.index = -1;
+			data->hit.dist = hit_dist;
+		}
+	}
+}
+#endif  /* USE_KDOPBVH_SIMD */
+
 static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
 {
 	int i;
@@ -1646,6 +2195,12 @@ static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
 		}
 	}
 	else {
+#ifdef USE_KDOPBVH_SIMD
+		if (data->tree->nodesimd) {
+			dfs_raycast_simd(data, bvhtree_branch_index(data->tree, node));
+			return;
+		}
+#endif
 		/* pick loop direction to dive into the tree (based on ray direction and split axis) */
 		if (data->ray_dot_axis[node->main_axis] > 0.0f) {
 			for (i = 0; i != node->totnode; i++) {
@@ -1683,6 +2238,12 @@ static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node)
 		data->hit.dist = dist;
 	}
 	else {
+#ifdef USE_KDOPBVH_SIMD
+		if (data->tree->nodesimd) {
+			dfs_raycast_all_simd(data, bvhtree_branch_index(data->tree, node));
+			return;
+		}
+#endif
 		/* pick loop direction to dive into the tree (based on ray direction and split axis) */
 		if (data->ray_dot_axis[node->main_axis] > 0.0f) {
 			for (i = 0; i != node->totnode; i++) {
@@ -1875,6 +2436,286 @@ void BLI_bvhtree_ray_cast_all(
 }
 
 
+/* -------------------------------------------------------------------- */
+
+/** \name BLI_bvhtree_find_nearest_batch, BLI_bvhtree_ray_cast_batch
+ *
+ * Run many queries on the same tree. The queries are sorted along a Morton curve
+ * and split into chunks of neighboring queries which run in parallel.
+ * Callers running several batches on the same points can sort them once
+ * with #BLI_bvhtree_batch_order_new and pass the order to the \a _ex functions.
+ * Within a chunk each query is seeded with the result of the previous one,
+ * so most of the tree is pruned right away instead of searching from the root.
+ *
+ * \{ */
+
+/* Number of sorted queries handled by one task. */
+#define KDOPBVH_BATCH_CHUNK_SIZE 256
+
+typedef struct BVHBatchQuery {
+	unsigned int code;
+	int index;
+} BVHBatchQuery;
+
+typedef struct BVHNearestBatchData {
+	BVHTree *tree;
+	const float (*co)[3];
+	BVHTreeNearest *nearest;
+	const int *order;
+	int queries_num;
+	BVHTree_NearestPointCallback callback;
+	void *userdata;
+} BVHNearestBatchData;
+
+typedef struct BVHRayCastBatchData {
+	BVHTree *tree;
+	const float (*co)[3];
+	const float (*dir)[3];
+	float radius;
+	BVHTreeRayHit *hit;
+	const int *order;
+	int queries_num;
+	BVHTree_RayCastCallback callback;
+	void *userdata;
+	int flag;
+} BVHRayCastBatchData;
+
+/* Spread the lower 10 bits of \a x, leaving two zero bits between each. */
+static unsigned int morton_bits_spread(unsigned int x)
+{
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x30000ff;
+	x = (x | (x << 8))  & 0x300f00f;
+	x = (x | (x << 4))  & 0x30c30c3;
+	x = (x | (x << 2))  & 0x9249249;
+	return x;
+}
+
+static int bvh_batch_query_cmp(const void *a_v, const void *b_v)
+{
+	const BVHBatchQuery *a = a_v, *b = b_v;
+
+	if      (a->code < b->code) return -1;
+	else if (a->code > b->code) return  1;
+	else                        return  0;
+}
+
+/**
+ * Order for running queries on the points of \a co in batches,
+ * along a Morton curve through their bounds.
+ *
+ * \return An array of \a co_num indices into \a co, to free with #MEM_freeN.
+ */
+int *BLI_bvhtree_batch_order_new(const float (*co)[3], const int co_num)
+{
+	BVHBatchQuery *queries = MEM_mallocN(sizeof(*queries) * (size_t)co_num, __func__);
+	int *order = MEM_mallocN(sizeof(*order) * (size_t)co_num, __func__);
+	float min[3], max[3], scale[3];
+	int i, j;
+
+	INIT_MINMAX(min, max);
+	for (i = 0; i < co_num; i++) {
+		minmax_v3v3_v3(min, max, co[i]);
+	}
+	for (j = 0; j < 3; j++) {
+		scale[j] = (max[j] > min[j]) ? 1023.0f / (max[j] - min[j]) : 0.0f;
+	}
+
+	for (i = 0; i < co_num; i++) {
+		unsigned int code = 0;
+		for (j = 0; j < 3; j++) {
+			const unsigned int x = (unsigned int)((co[i][j] - min[j]) * scale[j]);
+			code |= morton_bits_spread(x) << j;
+		}
+		queries[i].code = code;
+		queries[i].index = i;
+	}
+
+	qsort(queries, (size_t)co_num, sizeof(*queries), bvh_batch_query_cmp);
+
+	for (i = 0; i < co_num; i++) {
+		order[i] = queries[i].index;
+	}
+	MEM_freeN(queries);
+
+	return order;
+}
+
+static void bvhtree_find_nearest_batch_cb(
+        void *userdata, void *UNUSED(userdata_chunk), const int chunk, const int UNUSED(threadid))
+{
+	const BVHNearestBatchData *data = userdata;
+	const int end = min_ii((chunk + 1) * KDOPBVH_BATCH_CHUNK_SIZE, data->queries_num);
+	const BVHTreeNearest *nearest_prev = NULL;
+	int i;
+
+	for (i = chunk * KDOPBVH_BATCH_CHUNK_SIZE; i < end; i++) {
+		const int index = data->order[i];
+		const float *co = data->co[index];
+		BVHTreeNearest *nearest = &data->nearest[index];
+		const float dist_sq_init = nearest->dist_sq;
+
+		/* The previous nearest point is on the surface too, so it bounds the search.
+		 * Add some margin so its own element is still found despite rounding differences. */
+		if (nearest_prev) {
+			const float dist_sq = len_squared_v3v3(co, nearest_prev->co);
+			nearest->dist_sq = min_ff(dist_sq + (dist_sq + FLT_EPSILON) * 1e-4f, dist_sq_init);
+		}
+
+		BLI_bvhtree_find_nearest(data->tree, co, nearest, data->callback, data->userdata);
+
+		/* The seed can only fail on degenerate input, search again without it. */
+		if (nearest->index == -1 && nearest->dist_sq < dist_sq_init) {
+			nearest->dist_sq = dist_sq_init;
+			BLI_bvhtree_find_nearest(data->tree, co, nearest, data->callback, data->userdata);
+		}
+
+		if (nearest->index != -1) {
+			nearest_prev = nearest;
+		}
+	}
+}
+
+/**
+ * Find the nearest element for each point of \a co, see #BLI_bvhtree_find_nearest.
+ *
+ * \param r_nearest: Array of \a co_num results, they must be initialized as for #BLI_bvhtree_find_nearest,
+ * where \a dist_sq limits the search (zero skips the point).
+ * \param order: Order to run the queries in from #BLI_bvhtree_batch_order_new, or NULL to sort them here.
+ * \note \a callback must be thread-safe.
+ */
+void BLI_bvhtree_find_nearest_batch_ex(
+        BVHTree *tree, const float (*co)[3], const int co_num, BVHTreeNearest *r_nearest,
+        BVHTree_NearestPointCallback callback, void *userdata,
+        const int *order)
+{
+	BVHNearestBatchData data;
+	const int chunks_num = (co_num + KDOPBVH_BATCH_CHUNK_SIZE - 1) / KDOPBVH_BATCH_CHUNK_SIZE;
+
+	if (co_num == 0) {
+		return;
+	}
+
+	data.tree = tree;
+	data.co = co;
+	data.nearest = r_nearest;
+	data.order = order ? order : BLI_bvhtree_batch_order_new(co, co_num);
+	data.queries_num = co_num;
+	data.callback = callback;
+	data.userdata = userdata;
+
+	BLI_task_parallel_range_ex(
+	            0, chunks_num, &data, NULL, 0, bvhtree_find_nearest_batch_cb,
+	            co_num > KDOPBVH_THREAD_LEAF_THRESHOLD, true);
+
+	if (order == NULL) {
+		MEM_freeN((void *)data.order);
+	}
+}
+
+void BLI_bvhtree_find_nearest_batch(
+        BVHTree *tree, const float (*co)[3], const int co_num, BVHTreeNearest *r_nearest,
+        BVHTree_NearestPointCallback callback, void *userdata)
+{
+	BLI_bvhtree_find_nearest_batch_ex(tree, co, co_num, r_nearest, callback, userdata, NULL);
+}
+
+static void bvhtree_ray_cast_batch_cb(
+        void *userdata, void *UNUSED(userdata_chunk), const int chunk, const int UNUSED(threadid))
+{
+	const BVHRayCastBatchData *data = userdata;
+	const int end = min_ii((chunk + 1) * KDOPBVH_BATCH_CHUNK_SIZE, data->queries_num);
+	int index_prev = -1;
+	int i;
+
+	BVHRayCastData raycast;
+	BVHNode *root = data->tree->nodes[data->tree->totleaf];
+
+	raycast.tree = data->tree;
+	raycast.callback = data->callback;
+	raycast.userdata = data->userdata;
+	raycast.ray.radius = data->radius;
+
+	for (i = chunk * KDOPBVH_BATCH_CHUNK_SIZE; i < end; i++) {
+		const int index = data->order[i];
+		BVHTreeRayHit *hit = &data->hit[index];
+
+		BLI_ASSERT_UNIT_V3(data->dir[index]);
+
+		copy_v3_v3(raycast.ray.origin, data->co[index]);
+		copy_v3_v3(raycast.ray.direction, data->dir[index]);
+		bvhtree_ray_cast_data_precalc(&raycast, data->flag);
+
+		memcpy(&raycast.hit, hit, sizeof(*hit));
+
+		/* Neighboring rays tend to hit the same element, when they do it limits the search. */
+		if (index_prev != -1 && raycast.callback) {
+			raycast.callback(raycast.userdata, index_prev, &raycast.ray, &raycast.hit);
+		}
+
+		if (root) {
+			dfs_raycast(&raycast, root);
+		}
+
+		memcpy(hit, &raycast.hit, sizeof(*hit));
+
+		if (hit->index != -1) {
+			index_prev = hit->index;
+		}
+	}
+}
+
+/**
+ * Cast a ray for each origin of \a co along the matching \a dir, see #BLI_bvhtree_ray_cast_ex.
+ *
+ * \param r_hit: Array of \a ray_num results, they must be initialized as for #BLI_bvhtree_ray_cast_ex,
+ * where \a dist limits the ray length (zero skips the ray).
+ * \param order: Order to cast the rays in from #BLI_bvhtree_batch_order_new, or NULL to sort them here.
+ * \note \a callback must be thread-safe.
+ */
+void BLI_bvhtree_ray_cast_batch_ex(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int ray_num, float radius,
+        BVHTreeRayHit *r_hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag, const int *order)
+{
+	BVHRayCastBatchData data;
+	const int chunks_num = (ray_num + KDOPBVH_BATCH_CHUNK_SIZE - 1) / KDOPBVH_BATCH_CHUNK_SIZE;
+
+	if (ray_num == 0) {
+		return;
+	}
+
+	data.tree = tree;
+	data.co = co;
+	data.dir = dir;
+	data.radius = radius;
+	data.hit = r_hit;
+	data.order = order ? order : BLI_bvhtree_batch_order_new(co, ray_num);
+	data.queries_num = ray_num;
+	data.callback = callback;
+	data.userdata = userdata;
+	data.flag = flag;
+
+	BLI_task_parallel_range_ex(
+	            0, chunks_num, &data, NULL, 0, bvhtree_ray_cast_batch_cb,
+	            ray_num > KDOPBVH_THREAD_LEAF_THRESHOLD, true);
+
+	if (order == NULL) {
+		MEM_freeN((void *)data.order);
+	}
+}
+
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int ray_num, float radius,
+        BVHTreeRayHit *r_hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag)
+{
+	BLI_bvhtree_ray_cast_batch_ex(tree, co, dir, ray_num, radius, r_hit, callback, userdata, flag, NULL);
+}
+
+/** \} */
+
+
 /* -------------------------------------------------------------------- */
 
 /** \name BLI_bvhtree_range_query
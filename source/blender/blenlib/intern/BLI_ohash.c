@@ -0,0 +1,1306 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/BLI_ohash.c
+ *  \ingroup bli
+ *
+ * A general (pointer -> pointer) open addressing hash table,
+ * with the same API as #GHash.
+ *
+ * Keys and values are stored in flat arrays, with one control byte per slot.
+ * The control byte of a used slot holds 7 bits of the key hash,
+ * so most slots holding other keys are skipped without calling the compare callback.
+ * Slots are probed in groups of 16, checking all control bytes of a group at once with SSE2.
+ *
+ * Removed slots are marked as deleted (tombstones), unless their group still has an empty slot,
+ * in which case no probe sequence goes past that group and the slot can be marked empty again.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_sys_types.h"  /* for intptr_t support */
+#include "BLI_utildefines.h"
+
+#define GHASH_INTERNAL_API
+#include "BLI_ohash.h"
+#include "BLI_strict_flags.h"
+
+#define OHASH_GROUP_SIZE 16
+#define OHASH_SLOTS_MIN OHASH_GROUP_SIZE
+#define OHASH_SLOTS_MAX (1u << 31)
+
+/* Control bytes, used slots store 7 bits of the hash and are positive. */
+#define OHASH_CTRL_EMPTY   ((signed char)-128)
+#define OHASH_CTRL_DELETED ((signed char)-2)
+
+#define OHASH_SLOT_NONE UINT_MAX
+
+/**
+ * \note Max load is 7/8, much higher than #GHash can use since probing a group is about as fast as testing one slot.
+ * Deleted slots count as used, until the table is rebuilt.
+ */
+#define OHASH_LIMIT_GROW(_nslots)   (((_nslots) / 8) * 7)
+#define OHASH_LIMIT_SHRINK(_nslots) (((_nslots) / 64) * 7)
+
+/* Internal usage only. Whether the OHash is actually used as OSet (no value storage). */
+#define OHASH_FLAG_IS_OSET (1 << 16)
+
+struct OHash {
+	GHashHashFP hashfp;
+	GHashCmpFP cmpfp;
+
+	signed char *ctrl;
+	void **keys;
+	void **vals;  /* NULL for OSet. */
+	unsigned int nslots, group_mask;
+
+	unsigned int nentries;
+	/* Number of empty slots that can still be used before resizing. */
+	unsigned int growth_left;
+	unsigned int flag;
+};
+
+/* -------------------------------------------------------------------- */
+/* OHash API */
+
+/** \name Internal Utility API
+ * \{ */
+
+/**
+ * Bit mask with one bit per slot of a group.
+ */
+typedef unsigned int OHashGroupMask;
+
+BLI_INLINE unsigned int ohash_bitscan_forward(const OHashGroupMask mask)
+{
+	BLI_assert(mask != 0);
+#ifdef _MSC_VER
+	unsigned long ctz;
+	_BitScanForward(&ctz, mask);
+	return (unsigned int)ctz;
+#elif defined(__GNUC__)
+	return (unsigned int)__builtin_ctz(mask);
+#else
+	unsigned int ctz = 0;
+	while ((mask & (1u << ctz)) == 0) {
+		ctz++;
+	}
+	return ctz;
+#endif
+}
+
+/**
+ * Slots of the group at \a ctrl with the given control byte.
+ */
+BLI_INLINE OHashGroupMask ohash_group_match(const signed char *ctrl, const signed char c)
+{
+#ifdef __SSE2__
+	const __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+	return (OHashGroupMask)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), group));
+#else
+	OHashGroupMask mask = 0;
+	unsigned int i;
+	for (i = 0; i < OHASH_GROUP_SIZE; i++) {
+		if (ctrl[i] == c) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Slots of the group at \a ctrl that are empty or deleted (both have the sign bit set).
+ */
+BLI_INLINE OHashGroupMask ohash_group_match_free(const signed char *ctrl)
+{
+#ifdef __SSE2__
+	const __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+	return (OHashGroupMask)_mm_movemask_epi8(group);
+#else
+	OHashGroupMask mask = 0;
+	unsigned int i;
+	for (i = 0; i < OHASH_GROUP_SIZE; i++) {
+		if (ctrl[i] < 0) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Get the full hash for a key, mixed so both the group index and the control byte
+ * get well distributed bits, even for weak hashes like #BLI_ghashutil_ptrhash.
+ */
+BLI_INLINE unsigned int ohash_keyhash(OHash *oh, const void *key)
+{
+	unsigned int hash = oh->hashfp(key);
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/**
+ * Control byte stored for a used slot.
+ */
+BLI_INLINE signed char ohash_hash_ctrl(const unsigned int hash)
+{
+	return (signed char)(hash & 0x7f);
+}
+
+/**
+ * First group to probe.
+ */
+BLI_INLINE unsigned int ohash_hash_group(OHash *oh, const unsigned int hash)
+{
+	return (hash >> 7) & oh->group_mask;
+}
+
+/**
+ * Smallest number of slots that can hold \a nentries.
+ */
+static unsigned int ohash_slots_for_entries(const unsigned int nentries)
+{
+	unsigned int nslots = OHASH_SLOTS_MIN;
+
+	while (OHASH_LIMIT_GROW(nslots) < nentries && nslots < OHASH_SLOTS_MAX) {
+		nslots <<= 1;
+	}
+	return nslots;
+}
+
+/**
+ * Allocate empty slots, previous ones are expected to be freed by the caller.
+ */
+static void ohash_slots_alloc(OHash *oh, const unsigned int nslots)
+{
+	BLI_assert(nslots >= OHASH_SLOTS_MIN && (nslots & (nslots - 1)) == 0);
+
+	oh->nslots = nslots;
+	oh->group_mask = nslots / OHASH_GROUP_SIZE - 1;
+	oh->growth_left = OHASH_LIMIT_GROW(nslots) - oh->nentries;
+
+	oh->ctrl = MEM_mallocN(sizeof(*oh->ctrl) * (size_t)nslots, __func__);
+	oh->keys = MEM_mallocN(sizeof(*oh->keys) * (size_t)nslots, __func__);
+	oh->vals = (oh->flag & OHASH_FLAG_IS_OSET) ? NULL : MEM_mallocN(sizeof(*oh->vals) * (size_t)nslots, __func__);
+
+	memset(oh->ctrl, OHASH_CTRL_EMPTY, sizeof(*oh->ctrl) * (size_t)nslots);
+}
+
+static void ohash_slots_free(OHash *oh)
+{
+	MEM_freeN(oh->ctrl);
+	MEM_freeN(oh->keys);
+	if (oh->vals) {
+		MEM_freeN(oh->vals);
+	}
+}
+
+/**
+ * Find a free slot for a key with the given hash, the key is expected not to be in \a oh.
+ */
+BLI_INLINE unsigned int ohash_find_free_slot(OHash *oh, const unsigned int hash)
+{
+	unsigned int group = ohash_hash_group(oh, hash);
+	unsigned int probe = 0;
+
+	/* There is always an empty slot left, so this terminates. */
+	for (;;) {
+		const OHashGroupMask match = ohash_group_match_free(&oh->ctrl[group * OHASH_GROUP_SIZE]);
+
+		if (match) {
+			return group * OHASH_GROUP_SIZE + ohash_bitscan_forward(match);
+		}
+
+		/* Triangular probing, visits every group since the number of groups is a power of two. */
+		group = (group + ++probe) & oh->group_mask;
+	}
+}
+
+/**
+ * Rebuild the table with \a nslots slots, which also drops all deleted slots.
+ */
+static void ohash_slots_resize(OHash *oh, const unsigned int nslots)
+{
+	signed char *ctrl_old = oh->ctrl;
+	void **keys_old = oh->keys;
+	void **vals_old = oh->vals;
+	const unsigned int nslots_old = oh->nslots;
+	unsigned int i;
+
+	BLI_assert(OHASH_LIMIT_GROW(nslots) >= oh->nentries);
+
+	ohash_slots_alloc(oh, nslots);
+
+	for (i = 0; i < nslots_old; i++) {
+		if (ctrl_old[i] >= 0) {
+			const unsigned int hash = ohash_keyhash(oh, keys_old[i]);
+			const unsigned int slot = ohash_find_free_slot(oh, hash);
+
+			oh->ctrl[slot] = ohash_hash_ctrl(hash);
+			oh->keys[slot] = keys_old[i];
+			if (vals_old) {
+				oh->vals[slot] = vals_old[i];
+			}
+		}
+	}
+
+	MEM_freeN(ctrl_old);
+	MEM_freeN(keys_old);
+	if (vals_old) {
+		MEM_freeN(vals_old);
+	}
+}
+
+/**
+ * Make room for one more entry.
+ */
+static void ohash_slots_expand(OHash *oh)
+{
+	/* When at least half of the used slots are deleted ones, just drop them,
+	 * otherwise grow so a rebuild always leaves room for half the limit of inserts.
+	 * Never shrink here, that is left to #ohash_slots_contract. */
+	if (oh->nentries > OHASH_LIMIT_GROW(oh->nslots) / 2 && oh->nslots < OHASH_SLOTS_MAX) {
+		ohash_slots_resize(oh, oh->nslots * 2);
+	}
+	else {
+		ohash_slots_resize(oh, oh->nslots);
+	}
+}
+
+/**
+ * Shrink the table after removals (only with #GHASH_FLAG_ALLOW_SHRINK).
+ */
+BLI_INLINE void ohash_slots_contract(OHash *oh)
+{
+	if ((oh->flag & GHASH_FLAG_ALLOW_SHRINK) &&
+	    (oh->nslots > OHASH_SLOTS_MIN) &&
+	    (oh->nentries < OHASH_LIMIT_SHRINK(oh->nslots)))
+	{
+		ohash_slots_resize(oh, ohash_slots_for_entries(oh->nentries * 2));
+	}
+}
+
+/**
+ * Internal lookup function, returns the slot of \a key or #OHASH_SLOT_NONE.
+ * Takes the hash argument to avoid calling #ohash_keyhash multiple times.
+ */
+BLI_INLINE unsigned int ohash_lookup_slot_ex(OHash *oh, const void *key, const unsigned int hash)
+{
+	const signed char c = ohash_hash_ctrl(hash);
+	unsigned int group = ohash_hash_group(oh, hash);
+	unsigned int probe = 0;
+
+	for (;;) {
+		const signed char *ctrl = &oh->ctrl[group * OHASH_GROUP_SIZE];
+		OHashGroupMask match = ohash_group_match(ctrl, c);
+
+		while (match) {
+			const unsigned int slot = group * OHASH_GROUP_SIZE + ohash_bitscan_forward(match);
+			if (!oh->cmpfp(key, oh->keys[slot])) {
+				return slot;
+			}
+			match &= match - 1;
+		}
+
+		/* Keys are never placed past a group with an empty slot. */
+		if (ohash_group_match(ctrl, OHASH_CTRL_EMPTY)) {
+			return OHASH_SLOT_NONE;
+		}
+
+		group = (group + ++probe) & oh->group_mask;
+	}
+}
+
+BLI_INLINE unsigned int ohash_lookup_slot(OHash *oh, const void *key)
+{
+	return ohash_lookup_slot_ex(oh, key, ohash_keyhash(oh, key));
+}
+
+/**
+ * Internal insert function, the key is expected not to be in \a oh.
+ * Takes the hash argument to avoid calling #ohash_keyhash multiple times.
+ * \return the slot of the new entry, caller must set the value.
+ */
+BLI_INLINE unsigned int ohash_insert_ex(OHash *oh, void *key, const unsigned int hash)
+{
+	unsigned int slot = ohash_find_free_slot(oh, hash);
+
+	BLI_assert((oh->flag & GHASH_FLAG_ALLOW_DUPES) || (ohash_lookup_slot_ex(oh, key, hash) == OHASH_SLOT_NONE));
+
+	if (oh->ctrl[slot] == OHASH_CTRL_EMPTY) {
+		if (UNLIKELY(oh->growth_left == 0)) {
+			ohash_slots_expand(oh);
+			slot = ohash_find_free_slot(oh, hash);
+		}
+		oh->growth_left--;
+	}
+
+	oh->ctrl[slot] = ohash_hash_ctrl(hash);
+	oh->keys[slot] = key;
+	oh->nentries++;
+
+	return slot;
+}
+
+BLI_INLINE void ohash_insert(OHash *oh, void *key, void *val)
+{
+	const unsigned int slot = ohash_insert_ex(oh, key, ohash_keyhash(oh, key));
+
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+	oh->vals[slot] = val;
+}
+
+BLI_INLINE bool ohash_insert_safe(
+        OHash *oh, void *key, void *val, const bool override,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	const unsigned int hash = ohash_keyhash(oh, key);
+	unsigned int slot = ohash_lookup_slot_ex(oh, key, hash);
+
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+
+	if (slot != OHASH_SLOT_NONE) {
+		if (override) {
+			if (keyfreefp) {
+				keyfreefp(oh->keys[slot]);
+			}
+			if (valfreefp) {
+				valfreefp(oh->vals[slot]);
+			}
+			oh->keys[slot] = key;
+			oh->vals[slot] = val;
+		}
+		return false;
+	}
+	else {
+		slot = ohash_insert_ex(oh, key, hash);
+		oh->vals[slot] = val;
+		return true;
+	}
+}
+
+BLI_INLINE bool ohash_insert_safe_keyonly(
+        OHash *oh, void *key, const bool override,
+        GHashKeyFreeFP keyfreefp)
+{
+	const unsigned int hash = ohash_keyhash(oh, key);
+	const unsigned int slot = ohash_lookup_slot_ex(oh, key, hash);
+
+	BLI_assert((oh->flag & OHASH_FLAG_IS_OSET) != 0);
+
+	if (slot != OHASH_SLOT_NONE) {
+		if (override) {
+			if (keyfreefp) {
+				keyfreefp(oh->keys[slot]);
+			}
+			oh->keys[slot] = key;
+		}
+		return false;
+	}
+	else {
+		ohash_insert_ex(oh, key, hash);
+		return true;
+	}
+}
+
+/**
+ * Free the slot of a removed entry.
+ * \note Doesn't shrink, so the caller can still read the key and value of the slot.
+ */
+BLI_INLINE void ohash_slot_remove(OHash *oh, const unsigned int slot)
+{
+	const signed char *ctrl_group = &oh->ctrl[slot & ~(unsigned int)(OHASH_GROUP_SIZE - 1)];
+
+	BLI_assert(oh->ctrl[slot] >= 0);
+
+	if (ohash_group_match(ctrl_group, OHASH_CTRL_EMPTY)) {
+		oh->ctrl[slot] = OHASH_CTRL_EMPTY;
+		oh->growth_left++;
+	}
+	else {
+		oh->ctrl[slot] = OHASH_CTRL_DELETED;
+	}
+
+	oh->nentries--;
+}
+
+/**
+ * Remove \a key, return its slot or #OHASH_SLOT_NONE.
+ */
+static unsigned int ohash_remove_ex(
+        OHash *oh, const void *key,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	const unsigned int slot = ohash_lookup_slot(oh, key);
+
+	BLI_assert(!valfreefp || !(oh->flag & OHASH_FLAG_IS_OSET));
+
+	if (slot != OHASH_SLOT_NONE) {
+		if (keyfreefp) {
+			keyfreefp(oh->keys[slot]);
+		}
+		if (valfreefp) {
+			valfreefp(oh->vals[slot]);
+		}
+
+		ohash_slot_remove(oh, slot);
+	}
+
+	return slot;
+}
+
+/**
+ * Find the next used slot from \a slot, or #OHASH_SLOT_NONE.
+ */
+BLI_INLINE unsigned int ohash_find_next_slot(OHash *oh, unsigned int slot)
+{
+	while (slot < oh->nslots) {
+		const unsigned int group_slot = slot & ~(unsigned int)(OHASH_GROUP_SIZE - 1);
+		/* Used slots of the group, from 'slot' on. */
+		const OHashGroupMask match =
+		        ~ohash_group_match_free(&oh->ctrl[group_slot]) & (0xffffu << (slot - group_slot)) & 0xffffu;
+
+		if (match) {
+			return group_slot + ohash_bitscan_forward(match);
+		}
+		slot = group_slot + OHASH_GROUP_SIZE;
+	}
+	return OHASH_SLOT_NONE;
+}
+
+/**
+ * Remove a random entry and return its slot (or #OHASH_SLOT_NONE if empty).
+ */
+static unsigned int ohash_pop(OHash *oh, OHashIterState *state)
+{
+	unsigned int slot;
+
+	if (oh->nentries == 0) {
+		return OHASH_SLOT_NONE;
+	}
+
+	slot = ohash_find_next_slot(oh, state->curr_slot);
+	if (slot == OHASH_SLOT_NONE) {
+		slot = ohash_find_next_slot(oh, 0);
+	}
+	BLI_assert(slot != OHASH_SLOT_NONE);
+
+	ohash_slot_remove(oh, slot);
+
+	state->curr_slot = slot;
+	return slot;
+}
+
+/**
+ * Run free callbacks for freeing entries.
+ */
+static void ohash_free_cb(
+        OHash *oh,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	BLI_assert(keyfreefp  || valfreefp);
+	BLI_assert(!valfreefp || !(oh->flag & OHASH_FLAG_IS_OSET));
+
+	for (i = 0; i < oh->nslots; i++) {
+		if (oh->ctrl[i] >= 0) {
+			if (keyfreefp) {
+				keyfreefp(oh->keys[i]);
+			}
+			if (valfreefp) {
+				valfreefp(oh->vals[i]);
+			}
+		}
+	}
+}
+
+static OHash *ohash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                        const unsigned int nentries_reserve, const unsigned int flag)
+{
+	OHash *oh = MEM_mallocN(sizeof(*oh), info);
+
+	oh->hashfp = hashfp;
+	oh->cmpfp = cmpfp;
+
+	oh->nentries = 0;
+	oh->flag = flag;
+
+	ohash_slots_alloc(oh, ohash_slots_for_entries(nentries_reserve));
+
+	return oh;
+}
+
+/**
+ * Copy the OHash, slots are copied as they are so no rehashing is needed.
+ */
+static OHash *ohash_copy(OHash *oh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcopyfp)
+{
+	OHash *oh_new = MEM_mallocN(sizeof(*oh_new), __func__);
+	const size_t nslots = oh->nslots;
+	unsigned int i;
+
+	BLI_assert(!valcopyfp || !(oh->flag & OHASH_FLAG_IS_OSET));
+
+	*oh_new = *oh;
+	oh_new->ctrl = MEM_mallocN(sizeof(*oh_new->ctrl) * nslots, __func__);
+	oh_new->keys = MEM_mallocN(sizeof(*oh_new->keys) * nslots, __func__);
+	oh_new->vals = oh->vals ? MEM_mallocN(sizeof(*oh_new->vals) * nslots, __func__) : NULL;
+
+	memcpy(oh_new->ctrl, oh->ctrl, sizeof(*oh->ctrl) * nslots);
+	memcpy(oh_new->keys, oh->keys, sizeof(*oh->keys) * nslots);
+	if (oh->vals) {
+		memcpy(oh_new->vals, oh->vals, sizeof(*oh->vals) * nslots);
+	}
+
+	if (keycopyfp || valcopyfp) {
+		for (i = 0; i < oh->nslots; i++) {
+			if (oh->ctrl[i] >= 0) {
+				if (keycopyfp) {
+					oh_new->keys[i] = keycopyfp(oh->keys[i]);
+				}
+				if (valcopyfp) {
+					oh_new->vals[i] = valcopyfp(oh->vals[i]);
+				}
+			}
+		}
+	}
+
+	return oh_new;
+}
+
+/** \} */
+
+
+/** \name Public API
+ * \{ */
+
+/**
+ * Creates a new, empty OHash.
+ *
+ * \param hashfp  Hash callback.
+ * \param cmpfp  Comparison callback.
+ * \param info  Identifier string for the OHash.
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold.
+ * Use this to avoid resizing slots if the size is known or can be closely approximated.
+ * \return  An empty OHash.
+ */
+OHash *BLI_ohash_new_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                        const unsigned int nentries_reserve)
+{
+	return ohash_new(hashfp, cmpfp, info, nentries_reserve, 0);
+}
+
+/**
+ * Wraps #BLI_ohash_new_ex with zero entries reserved.
+ */
+OHash *BLI_ohash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info)
+{
+	return BLI_ohash_new_ex(hashfp, cmpfp, info, 0);
+}
+
+/**
+ * Copy given OHash. Keys and values are also copied if relevant callback is provided, else pointers remain the same.
+ */
+OHash *BLI_ohash_copy(OHash *oh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcopyfp)
+{
+	return ohash_copy(oh, keycopyfp, valcopyfp);
+}
+
+/**
+ * Reserve given amount of entries (resize \a oh accordingly if needed).
+ */
+void BLI_ohash_reserve(OHash *oh, const unsigned int nentries_reserve)
+{
+	const unsigned int nslots = ohash_slots_for_entries(MAX2(nentries_reserve, oh->nentries));
+
+	if (nslots != oh->nslots) {
+		ohash_slots_resize(oh, nslots);
+	}
+}
+
+/**
+ * \return size of the OHash.
+ */
+unsigned int BLI_ohash_size(OHash *oh)
+{
+	return oh->nentries;
+}
+
+/**
+ * Insert a key/value pair into the \a oh.
+ *
+ * \note Duplicates are not checked,
+ * the caller is expected to ensure elements are unique unless
+ * GHASH_FLAG_ALLOW_DUPES flag is set.
+ */
+void BLI_ohash_insert(OHash *oh, void *key, void *val)
+{
+	ohash_insert(oh, key, val);
+}
+
+/**
+ * Inserts a new value to a key that may already be in ohash.
+ *
+ * Avoids #BLI_ohash_remove, #BLI_ohash_insert calls (double lookups)
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_ohash_reinsert(OHash *oh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	return ohash_insert_safe(oh, key, val, true, keyfreefp, valfreefp);
+}
+
+/**
+ * Lookup the value of \a key in \a oh.
+ *
+ * \param key  The key to lookup.
+ * \returns the value for \a key or NULL.
+ *
+ * \note When NULL is a valid value, use #BLI_ohash_lookup_p to differentiate a missing key
+ * from a key with a NULL value. (Avoids calling #BLI_ohash_haskey before #BLI_ohash_lookup)
+ */
+void *BLI_ohash_lookup(OHash *oh, const void *key)
+{
+	const unsigned int slot = ohash_lookup_slot(oh, key);
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+	return (slot != OHASH_SLOT_NONE) ? oh->vals[slot] : NULL;
+}
+
+/**
+ * A version of #BLI_ohash_lookup which accepts a fallback argument.
+ */
+void *BLI_ohash_lookup_default(OHash *oh, const void *key, void *val_default)
+{
+	const unsigned int slot = ohash_lookup_slot(oh, key);
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+	return (slot != OHASH_SLOT_NONE) ? oh->vals[slot] : val_default;
+}
+
+/**
+ * Lookup a pointer to the value of \a key in \a oh.
+ *
+ * \param key  The key to lookup.
+ * \returns the pointer to value for \a key or NULL.
+ *
+ * \warning The pointer is only valid until the next insertion into \a oh.
+ */
+void **BLI_ohash_lookup_p(OHash *oh, const void *key)
+{
+	const unsigned int slot = ohash_lookup_slot(oh, key);
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+	return (slot != OHASH_SLOT_NONE) ? &oh->vals[slot] : NULL;
+}
+
+/**
+ * Ensure \a key is exists in \a oh.
+ *
+ * Same as #BLI_ghash_ensure_p.
+ *
+ * \returns true when the value didn't need to be added.
+ * (when false, the caller _must_ initialize the value).
+ *
+ * \warning The pointer is only valid until the next insertion into \a oh.
+ */
+bool BLI_ohash_ensure_p(OHash *oh, void *key, void ***r_val)
+{
+	const unsigned int hash = ohash_keyhash(oh, key);
+	unsigned int slot = ohash_lookup_slot_ex(oh, key, hash);
+	const bool haskey = (slot != OHASH_SLOT_NONE);
+
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+
+	if (!haskey) {
+		slot = ohash_insert_ex(oh, key, hash);
+	}
+
+	*r_val = &oh->vals[slot];
+	return haskey;
+}
+
+/**
+ * A version of #BLI_ohash_ensure_p that allows caller to re-assign the key.
+ * Typically used when the key is to be duplicated.
+ *
+ * \warning Caller _must_ write to \a r_key when returning false,
+ * before the next insertion into \a oh.
+ */
+bool BLI_ohash_ensure_p_ex(
+        OHash *oh, const void *key, void ***r_key, void ***r_val)
+{
+	const unsigned int hash = ohash_keyhash(oh, key);
+	unsigned int slot = ohash_lookup_slot_ex(oh, key, hash);
+	const bool haskey = (slot != OHASH_SLOT_NONE);
+
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+
+	if (!haskey) {
+		/* pass 'key' incase we resize */
+		slot = ohash_insert_ex(oh, (void *)key, hash);
+		oh->keys[slot] = NULL;  /* caller must re-assign */
+	}
+
+	*r_key = &oh->keys[slot];
+	*r_val = &oh->vals[slot];
+	return haskey;
+}
+
+/**
+ * Remove \a key from \a oh, or return false if the key wasn't found.
+ *
+ * \param key  The key to remove.
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ * \return true if \a key was removed from \a oh.
+ */
+bool BLI_ohash_remove(OHash *oh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	if (ohash_remove_ex(oh, key, keyfreefp, valfreefp) != OHASH_SLOT_NONE) {
+		ohash_slots_contract(oh);
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+
+/**
+ * Remove \a key from \a oh, returning the value or NULL if the key wasn't found.
+ *
+ * \param key  The key to remove.
+ * \param keyfreefp  Optional callback to free the key.
+ * \return the value of \a key int \a oh or NULL.
+ */
+void *BLI_ohash_popkey(OHash *oh, const void *key, GHashKeyFreeFP keyfreefp)
+{
+	const unsigned int slot = ohash_remove_ex(oh, key, keyfreefp, NULL);
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+	if (slot != OHASH_SLOT_NONE) {
+		void *val = oh->vals[slot];
+		ohash_slots_contract(oh);
+		return val;
+	}
+	else {
+		return NULL;
+	}
+}
+
+/**
+ * \return true if the \a key is in \a oh.
+ */
+bool BLI_ohash_haskey(OHash *oh, const void *key)
+{
+	return (ohash_lookup_slot(oh, key) != OHASH_SLOT_NONE);
+}
+
+/**
+ * Remove a random entry from \a oh, returning true if a key/value pair could be removed, false otherwise.
+ *
+ * \param r_key: The removed key.
+ * \param r_val: The removed value.
+ * \param state: Used for efficient removal.
+ * \return true if there was something to pop, false if ohash was already empty.
+ */
+bool BLI_ohash_pop(
+        OHash *oh, OHashIterState *state,
+        void **r_key, void **r_val)
+{
+	const unsigned int slot = ohash_pop(oh, state);
+
+	BLI_assert(!(oh->flag & OHASH_FLAG_IS_OSET));
+
+	if (slot != OHASH_SLOT_NONE) {
+		*r_key = oh->keys[slot];
+		*r_val = oh->vals[slot];
+		return true;
+	}
+	else {
+		*r_key = *r_val = NULL;
+		return false;
+	}
+}
+
+/**
+ * Reset \a oh clearing all entries.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold.
+ */
+void BLI_ohash_clear_ex(OHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp,
+                        const unsigned int nentries_reserve)
+{
+	const unsigned int nslots = ohash_slots_for_entries(nentries_reserve);
+
+	if (keyfreefp || valfreefp)
+		ohash_free_cb(oh, keyfreefp, valfreefp);
+
+	oh->nentries = 0;
+
+	if (nslots != oh->nslots) {
+		ohash_slots_free(oh);
+		ohash_slots_alloc(oh, nslots);
+	}
+	else {
+		memset(oh->ctrl, OHASH_CTRL_EMPTY, sizeof(*oh->ctrl) * (size_t)nslots);
+		oh->growth_left = OHASH_LIMIT_GROW(nslots);
+	}
+}
+
+/**
+ * Wraps #BLI_ohash_clear_ex with zero entries reserved.
+ */
+void BLI_ohash_clear(OHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	BLI_ohash_clear_ex(oh, keyfreefp, valfreefp, 0);
+}
+
+/**
+ * Frees the OHash and its members.
+ *
+ * \param oh  The OHash to free.
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ */
+void BLI_ohash_free(OHash *oh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	if (keyfreefp || valfreefp)
+		ohash_free_cb(oh, keyfreefp, valfreefp);
+
+	ohash_slots_free(oh);
+	MEM_freeN(oh);
+}
+
+/**
+ * Sets a OHash flag.
+ */
+void BLI_ohash_flag_set(OHash *oh, unsigned int flag)
+{
+	oh->flag |= flag;
+}
+
+/**
+ * Clear a OHash flag.
+ */
+void BLI_ohash_flag_clear(OHash *oh, unsigned int flag)
+{
+	oh->flag &= ~flag;
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+/* OHash Iterator API */
+
+/** \name Iterator API
+ * \{ */
+
+/**
+ * Create a new OHashIterator. The hash table must not be mutated
+ * while the iterator is in use, except for removing the current entry
+ * (without #GHASH_FLAG_ALLOW_SHRINK).
+ *
+ * \param oh The OHash to iterate over.
+ * \return Pointer to a new iterator.
+ */
+OHashIterator *BLI_ohashIterator_new(OHash *oh)
+{
+	OHashIterator *ohi = MEM_mallocN(sizeof(*ohi), "ohash iterator");
+	BLI_ohashIterator_init(ohi, oh);
+	return ohi;
+}
+
+BLI_INLINE void ohashIterator_set_slot(OHashIterator *ohi, const unsigned int slot)
+{
+	OHash *oh = ohi->oh;
+
+	ohi->curr_slot = slot;
+	if (slot != OHASH_SLOT_NONE) {
+		ohi->curr_key = &oh->keys[slot];
+		ohi->curr_val = oh->vals ? &oh->vals[slot] : NULL;
+	}
+	else {
+		ohi->curr_key = NULL;
+		ohi->curr_val = NULL;
+	}
+}
+
+/**
+ * Init an already allocated OHashIterator.
+ *
+ * \param ohi The OHashIterator to initialize.
+ * \param oh The OHash to iterate over.
+ */
+void BLI_ohashIterator_init(OHashIterator *ohi, OHash *oh)
+{
+	ohi->oh = oh;
+	ohashIterator_set_slot(ohi, oh->nentries ? ohash_find_next_slot(oh, 0) : OHASH_SLOT_NONE);
+}
+
+/**
+ * Steps the iterator to the next index.
+ *
+ * \param ohi The iterator.
+ */
+void BLI_ohashIterator_step(OHashIterator *ohi)
+{
+	if (ohi->curr_key) {
+		ohashIterator_set_slot(ohi, ohash_find_next_slot(ohi->oh, ohi->curr_slot + 1));
+	}
+}
+
+/**
+ * Free a OHashIterator.
+ *
+ * \param ohi The iterator to free.
+ */
+void BLI_ohashIterator_free(OHashIterator *ohi)
+{
+	MEM_freeN(ohi);
+}
+
+/** \} */
+
+
+/** \name Convenience OHash Creation Functions
+ * \{ */
+
+OHash *BLI_ohash_ptr_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_ohash_new_ex(BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, info, nentries_reserve);
+}
+OHash *BLI_ohash_ptr_new(const char *info)
+{
+	return BLI_ohash_ptr_new_ex(info, 0);
+}
+
+OHash *BLI_ohash_str_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_ohash_new_ex(BLI_ghashutil_strhash_p, BLI_ghashutil_strcmp, info, nentries_reserve);
+}
+OHash *BLI_ohash_str_new(const char *info)
+{
+	return BLI_ohash_str_new_ex(info, 0);
+}
+
+OHash *BLI_ohash_int_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_ohash_new_ex(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, info, nentries_reserve);
+}
+OHash *BLI_ohash_int_new(const char *info)
+{
+	return BLI_ohash_int_new_ex(info, 0);
+}
+
+OHash *BLI_ohash_pair_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_ohash_new_ex(BLI_ghashutil_pairhash, BLI_ghashutil_paircmp, info, nentries_reserve);
+}
+OHash *BLI_ohash_pair_new(const char *info)
+{
+	return BLI_ohash_pair_new_ex(info, 0);
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+/* OSet API */
+
+/* Use ohash API to give 'set' functionality */
+
+/** \name OSet Functions
+ * \{ */
+OSet *BLI_oset_new_ex(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info,
+                      const unsigned int nentries_reserve)
+{
+	return (OSet *)ohash_new(hashfp, cmpfp, info, nentries_reserve, OHASH_FLAG_IS_OSET);
+}
+
+OSet *BLI_oset_new(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info)
+{
+	return BLI_oset_new_ex(hashfp, cmpfp, info, 0);
+}
+
+/**
+ * Copy given OSet. Keys are also copied if callback is provided, else pointers remain the same.
+ */
+OSet *BLI_oset_copy(OSet *os, GHashKeyCopyFP keycopyfp)
+{
+	return (OSet *)ohash_copy((OHash *)os, keycopyfp, NULL);
+}
+
+unsigned int BLI_oset_size(OSet *os)
+{
+	return ((OHash *)os)->nentries;
+}
+
+void BLI_oset_reserve(OSet *os, const unsigned int nentries_reserve)
+{
+	BLI_ohash_reserve((OHash *)os, nentries_reserve);
+}
+
+/**
+ * Adds the key to the set (no checks for unique keys!).
+ * Matching #BLI_ohash_insert
+ */
+void BLI_oset_insert(OSet *os, void *key)
+{
+	OHash *oh = (OHash *)os;
+	ohash_insert_ex(oh, key, ohash_keyhash(oh, key));
+}
+
+/**
+ * A version of BLI_oset_insert which checks first if the key is in the set.
+ * \returns true if a new key has been added.
+ *
+ * \note OHash has no equivalent to this because typically the value would be different.
+ */
+bool BLI_oset_add(OSet *os, void *key)
+{
+	return ohash_insert_safe_keyonly((OHash *)os, key, false, NULL);
+}
+
+/**
+ * Set counterpart to #BLI_ohash_ensure_p_ex.
+ * similar to BLI_oset_add, except it returns the key pointer.
+ *
+ * \warning Caller _must_ write to \a r_key when returning false,
+ * before the next insertion into \a os.
+ */
+bool BLI_oset_ensure_p_ex(OSet *os, const void *key, void ***r_key)
+{
+	OHash *oh = (OHash *)os;
+	const unsigned int hash = ohash_keyhash(oh, key);
+	unsigned int slot = ohash_lookup_slot_ex(oh, key, hash);
+	const bool haskey = (slot != OHASH_SLOT_NONE);
+
+	if (!haskey) {
+		/* pass 'key' incase we resize */
+		slot = ohash_insert_ex(oh, (void *)key, hash);
+		oh->keys[slot] = NULL;  /* caller must re-assign */
+	}
+
+	*r_key = &oh->keys[slot];
+	return haskey;
+}
+
+/**
+ * Adds the key to the set (duplicates are managed).
+ * Matching #BLI_ohash_reinsert
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_oset_reinsert(OSet *os, void *key, GSetKeyFreeFP keyfreefp)
+{
+	return ohash_insert_safe_keyonly((OHash *)os, key, true, keyfreefp);
+}
+
+bool BLI_oset_remove(OSet *os, const void *key, GSetKeyFreeFP keyfreefp)
+{
+	return BLI_ohash_remove((OHash *)os, key, keyfreefp, NULL);
+}
+
+
+bool BLI_oset_haskey(OSet *os, const void *key)
+{
+	return (ohash_lookup_slot((OHash *)os, key) != OHASH_SLOT_NONE);
+}
+
+/**
+ * Remove a random entry from \a os, returning true if a key could be removed, false otherwise.
+ *
+ * \param r_key: The removed key.
+ * \param state: Used for efficient removal.
+ * \return true if there was something to pop, false if oset was already empty.
+ */
+bool BLI_oset_pop(
+        OSet *os, OSetIterState *state,
+        void **r_key)
+{
+	OHash *oh = (OHash *)os;
+	const unsigned int slot = ohash_pop(oh, (OHashIterState *)state);
+
+	if (slot != OHASH_SLOT_NONE) {
+		*r_key = oh->keys[slot];
+		return true;
+	}
+	else {
+		*r_key = NULL;
+		return false;
+	}
+}
+
+void BLI_oset_clear_ex(OSet *os, GSetKeyFreeFP keyfreefp,
+                       const unsigned int nentries_reserve)
+{
+	BLI_ohash_clear_ex((OHash *)os, keyfreefp, NULL,
+	                   nentries_reserve);
+}
+
+void BLI_oset_clear(OSet *os, GSetKeyFreeFP keyfreefp)
+{
+	BLI_ohash_clear((OHash *)os, keyfreefp, NULL);
+}
+
+void BLI_oset_free(OSet *os, GSetKeyFreeFP keyfreefp)
+{
+	BLI_ohash_free((OHash *)os, keyfreefp, NULL);
+}
+
+void BLI_oset_flag_set(OSet *os, unsigned int flag)
+{
+	((OHash *)os)->flag |= flag;
+}
+
+void BLI_oset_flag_clear(OSet *os, unsigned int flag)
+{
+	((OHash *)os)->flag &= ~flag;
+}
+
+/** \} */
+
+
+/** \name Convenience OSet Creation Functions
+ * \{ */
+
+OSet *BLI_oset_ptr_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_oset_new_ex(BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, info, nentries_reserve);
+}
+OSet *BLI_oset_ptr_new(const char *info)
+{
+	return BLI_oset_ptr_new_ex(info, 0);
+}
+
+OSet *BLI_oset_str_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_oset_new_ex(BLI_ghashutil_strhash_p, BLI_ghashutil_strcmp, info, nentries_reserve);
+}
+OSet *BLI_oset_str_new(const char *info)
+{
+	return BLI_oset_str_new_ex(info, 0);
+}
+
+OSet *BLI_oset_pair_new_ex(const char *info, const unsigned int nentries_reserve)
+{
+	return BLI_oset_new_ex(BLI_ghashutil_pairhash, BLI_ghashutil_paircmp, info, nentries_reserve);
+}
+OSet *BLI_oset_pair_new(const char *info)
+{
+	return BLI_oset_pair_new_ex(info, 0);
+}
+
+/** \} */
+
+
+/** \name Debugging & Introspection
+ * \{ */
+
+/**
+ * \return number of slots in the OHash.
+ */
+int BLI_ohash_slots_size(OHash *oh)
+{
+	return (int)oh->nslots;
+}
+int BLI_oset_slots_size(OSet *os)
+{
+	return BLI_ohash_slots_size((OHash *)os);
+}
+
+/**
+ * Measure how well the hash function performs (1.0 is approx as good as random distribution),
+ * and return a few other stats like load, proportion of deleted slots and longest probe sequence.
+ *
+ * The quality is the average number of groups a lookup of a key in the table has to look at.
+ */
+double BLI_ohash_calc_quality_ex(
+        OHash *oh, double *r_load, double *r_prop_deleted, int *r_longest_probe)
+{
+	unsigned int i, ndeleted = 0;
+	uint64_t sum = 0;
+	int longest = 0;
+
+	for (i = 0; i < oh->nslots; i++) {
+		if (oh->ctrl[i] >= 0) {
+			const unsigned int hash = ohash_keyhash(oh, oh->keys[i]);
+			const unsigned int slot_group = i / OHASH_GROUP_SIZE;
+			unsigned int group = ohash_hash_group(oh, hash);
+			unsigned int probe = 0;
+
+			while (group != slot_group) {
+				group = (group + ++probe) & oh->group_mask;
+			}
+			sum += probe + 1;
+			longest = MAX2(longest, (int)probe + 1);
+		}
+		else if (oh->ctrl[i] == OHASH_CTRL_DELETED) {
+			ndeleted++;
+		}
+	}
+
+	if (r_load) {
+		*r_load = (double)oh->nentries / (double)oh->nslots;
+	}
+	if (r_prop_deleted) {
+		*r_prop_deleted = (double)ndeleted / (double)oh->nslots;
+	}
+	if (r_longest_probe) {
+		*r_longest_probe = longest;
+	}
+
+	return oh->nentries ? (double)sum / (double)oh->nentries : 0.0;
+}
+double BLI_oset_calc_quality_ex(
+        OSet *os, double *r_load, double *r_prop_deleted, int *r_longest_probe)
+{
+	return BLI_ohash_calc_quality_ex((OHash *)os, r_load, r_prop_deleted, r_longest_probe);
+}
+
+double BLI_ohash_calc_quality(OHash *oh)
+{
+	return BLI_ohash_calc_quality_ex(oh, NULL, NULL, NULL);
+}
+double BLI_oset_calc_quality(OSet *os)
+{
+	return BLI_ohash_calc_quality_ex((OHash *)os, NULL, NULL, NULL);
+}
+
+/** \} */
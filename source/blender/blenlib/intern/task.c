@@ -48,11 +48,12 @@
  */
 #define MEMPOOL_SIZE 256
 
-/* Number of tasks which are pushed directly to local thread queue.
+/* Number of tasks in the work-stealing deque of every thread.
  *
- * This allows thread to fetch next task without locking the whole queue.
+ * Tasks pushed while the deque is full go to the scheduler queue instead.
+ * Must be a power of two.
  */
-#define LOCALQUEUE_SIZE 1
+#define DEQUE_SIZE 1024
 
 #ifndef NDEBUG
 #  define ASSERT_THREAD_ID(scheduler, thread_id)                              \
@@ -130,16 +131,43 @@ typedef struct TaskMemPoolStats {
 
 typedef struct TaskThreadLocalStorage {
 	TaskMemPool task_mempool;
-	int num_local_queue;
-	Task *local_queue[LOCALQUEUE_SIZE];
 } TaskThreadLocalStorage;
 
+/* Work-stealing deque of a thread (Chase-Lev).
+ *
+ * Tasks pushed from a thread go to its own deque without any locks. The thread
+ * pushes and pops tasks at the bottom, so it keeps working on the tasks it just
+ * pushed, while idle threads steal the oldest tasks from the top.
+ *
+ * The deque has a fixed size, so the items never get reallocated while other
+ * threads are reading them.
+ */
+typedef struct TaskDequeItem {
+	Task *task;
+	/* Pool of the task, so thieves can check it before taking the task. */
+	TaskPool *pool;
+} TaskDequeItem;
+
+typedef struct TaskDeque {
+	/* Advanced by the owner and by thieves. */
+	volatile uint32_t top;
+	/* Keep top and bottom in different cache lines. */
+	char pad[64 - sizeof(uint32_t)];
+	/* Only changed by the owner. */
+	volatile uint32_t bottom;
+	TaskDequeItem items[DEQUE_SIZE];
+} TaskDeque;
+
 struct TaskPool {
 	TaskScheduler *scheduler;
 
+	/* Number of tasks not done yet, changed atomically. The mutex and
+	 * condition are only used to wait for it. */
 	volatile size_t num;
 	ThreadMutex num_mutex;
 	ThreadCondition num_cond;
+	/* Number of threads in work_and_wait() waiting for new tasks. */
+	volatile uint32_t num_waiting;
 
 	void *userdata;
 	ThreadMutex user_mutex;
@@ -183,10 +211,18 @@ struct TaskScheduler {
 	int num_threads;
 	bool background_thread_only;
 
+	/* Tasks pushed from outside of the scheduler threads, with low priority
+	 * or to a full deque. */
 	ListBase queue;
 	ThreadMutex queue_mutex;
 	ThreadCondition queue_cond;
 
+	/* Deques are not used when there is only the background thread, it has
+	 * to skip tasks of other pools which can only be done in the queue. */
+	bool use_deques;
+	/* Number of threads waiting on queue_cond for tasks. */
+	volatile uint32_t num_sleeping;
+
 	volatile bool do_exit;
 
 	/* NOTE: In pthread's TLS we store the whole TaskThread structure. */
@@ -197,6 +233,7 @@ typedef struct TaskThread {
 	TaskScheduler *scheduler;
 	int id;
 	TaskThreadLocalStorage tls;
+	TaskDeque deque;
 } TaskThread;
 
 /* Helper */
@@ -299,104 +336,302 @@ static void task_free(TaskPool *pool, Task *task, const int thread_id)
 	}
 }
 
+/* Task Deque */
+
+/* Push task to the bottom of the deque, only called by the owner. Returns
+ * false when the deque is full. */
+static bool task_deque_push(TaskDeque *deque, Task *task)
+{
+	const uint32_t bottom = deque->bottom;
+
+	if (bottom - deque->top >= DEQUE_SIZE) {
+		return false;
+	}
+
+	TaskDequeItem *item = &deque->items[bottom & (DEQUE_SIZE - 1)];
+	item->task = task;
+	item->pool = task->pool;
+
+	/* Publish the task, the atomic operation is also a memory barrier so the
+	 * item is written before thieves see it. */
+	atomic_add_and_fetch_uint32((uint32_t *)&deque->bottom, 1);
+
+	return true;
+}
+
+/* Pop task from the bottom of the deque, only called by the owner. If pool is
+ * not NULL the task is only taken when it belongs to that pool. */
+static Task *task_deque_pop(TaskDeque *deque, TaskPool *pool)
+{
+	/* Reserve the bottom task before reading top, so thieves either see the
+	 * reservation or we see their steal. */
+	const uint32_t bottom = atomic_sub_and_fetch_uint32((uint32_t *)&deque->bottom, 1);
+	const uint32_t top = deque->top;
+	const int32_t num_other = (int32_t)(bottom - top);
+	Task *task;
+
+	if (num_other < 0) {
+		/* Deque is empty. */
+		atomic_add_and_fetch_uint32((uint32_t *)&deque->bottom, 1);
+		return NULL;
+	}
+
+	task = deque->items[bottom & (DEQUE_SIZE - 1)].task;
+
+	if (num_other > 0) {
+		/* More tasks above this one, thieves can't reach it. */
+		if (pool != NULL && task->pool != pool) {
+			atomic_add_and_fetch_uint32((uint32_t *)&deque->bottom, 1);
+			return NULL;
+		}
+		return task;
+	}
+
+	/* Last task, race against thieves for it. */
+	if (atomic_cas_uint32((uint32_t *)&deque->top, top, top + 1) != top) {
+		task = NULL;
+	}
+	atomic_add_and_fetch_uint32((uint32_t *)&deque->bottom, 1);
+
+	if (task != NULL && pool != NULL && task->pool != pool) {
+		/* Put it back, can't fail since the deque is empty now. */
+		task_deque_push(deque, task);
+		return NULL;
+	}
+
+	return task;
+}
+
+/* Steal task from the top of the deque of another thread. If pool is not NULL
+ * the task is only taken when it belongs to that pool. */
+static Task *task_deque_steal(TaskDeque *deque, TaskPool *pool)
+{
+	/* Cheap check first, to not write to the cache lines of idle deques. */
+	if (deque->bottom == deque->top) {
+		return NULL;
+	}
+
+	/* Read top before bottom, the atomic operation acts as a barrier. */
+	const uint32_t top = atomic_fetch_and_add_uint32((uint32_t *)&deque->top, 0);
+	const uint32_t bottom = deque->bottom;
+
+	if ((int32_t)(bottom - top) <= 0) {
+		return NULL;
+	}
+
+	/* The item can only be overwritten after top moved on, in which case the
+	 * compare and swap below fails. */
+	TaskDequeItem item = deque->items[top & (DEQUE_SIZE - 1)];
+
+	if (pool != NULL && item.pool != pool) {
+		return NULL;
+	}
+
+	if (atomic_cas_uint32((uint32_t *)&deque->top, top, top + 1) != top) {
+		/* Lost the race against the owner or another thief. */
+		return NULL;
+	}
+
+	return item.task;
+}
+
+BLI_INLINE bool task_deque_is_empty(TaskDeque *deque)
+{
+	return (int32_t)(deque->bottom - deque->top) <= 0;
+}
+
+/* Deque owned by the calling thread, or NULL when it can't use one. */
+BLI_INLINE TaskDeque *task_scheduler_thread_deque(TaskScheduler *scheduler, const int thread_id)
+{
+	if (!scheduler->use_deques || thread_id < 0) {
+		return NULL;
+	}
+	/* Other threads which are not managed by the scheduler also identify
+	 * themselves as thread 0, but a deque can only have one owner. */
+	if (thread_id == 0 && !BLI_thread_is_main()) {
+		return NULL;
+	}
+	return &scheduler->task_threads[thread_id].deque;
+}
+
 /* Task Scheduler */
 
 static void task_pool_num_decrease(TaskPool *pool, size_t done)
 {
-	BLI_mutex_lock(&pool->num_mutex);
-
-	BLI_assert(pool->num >= done);
+	size_t num = pool->num;
 
-	pool->num -= done;
+	/* No locking needed as long as there are tasks left, the pool can't be
+	 * freed and nobody has to be notified. */
+	while (num > done) {
+		const size_t num_prev = atomic_cas_z((size_t *)&pool->num, num, num - done);
+		if (num_prev == num) {
+			return;
+		}
+		num = num_prev;
+	}
 
-	if (pool->num == 0)
+	/* Finishing the pool: decrease and notify in one critical section. Threads
+	 * freeing the pool wait for the number to be zero with the lock held, so
+	 * they can't free it before we are done with the mutex. */
+	BLI_mutex_lock(&pool->num_mutex);
+	BLI_assert(pool->num >= done);
+	if (atomic_sub_and_fetch_z((size_t *)&pool->num, done) == 0) {
 		BLI_condition_notify_all(&pool->num_cond);
-
+	}
 	BLI_mutex_unlock(&pool->num_mutex);
 }
 
 static void task_pool_num_increase(TaskPool *pool, size_t new)
 {
-	BLI_mutex_lock(&pool->num_mutex);
+	atomic_add_and_fetch_z((size_t *)&pool->num, new);
+}
 
-	pool->num += new;
-	BLI_condition_notify_all(&pool->num_cond);
+/* Wake up threads waiting in work_and_wait() after tasks were pushed. The
+ * caller must make sure the pool can't finish meanwhile. */
+static void task_pool_wake_waiting(TaskPool *pool)
+{
+	/* The atomic operation is a memory barrier, so either the waiting thread
+	 * sees the pushed tasks, or we see it waiting. */
+	if (atomic_add_and_fetch_uint32((uint32_t *)&pool->num_waiting, 0) != 0) {
+		BLI_mutex_lock(&pool->num_mutex);
+		BLI_condition_notify_all(&pool->num_cond);
+		BLI_mutex_unlock(&pool->num_mutex);
+	}
+}
 
-	BLI_mutex_unlock(&pool->num_mutex);
+static Task *task_scheduler_queue_pop(TaskScheduler *scheduler, TaskPool *pool)
+{
+	Task *task;
+
+	for (task = scheduler->queue.first; task; task = task->next) {
+		if (pool != NULL) {
+			/* find task from this pool. if we get a task from another pool,
+			 * we can get into deadlock */
+			if (task->pool != pool) {
+				continue;
+			}
+		}
+		else if (scheduler->background_thread_only && !task->pool->run_in_background) {
+			continue;
+		}
+
+		BLI_remlink(&scheduler->queue, task);
+		return task;
+	}
+
+	return NULL;
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+/* Find a task to run on the given thread: from its own deque first, then
+ * from the queue and last by stealing from other threads. If pool is not NULL
+ * only tasks of that pool are taken. */
+static Task *task_scheduler_find_task(TaskScheduler *scheduler, const int thread_id, TaskPool *pool)
 {
-	bool found_task = false;
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	TaskDeque *deque = task_scheduler_thread_deque(scheduler, thread_id);
+	Task *task;
 
-	while (!scheduler->queue.first && !scheduler->do_exit)
-		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+	if (deque != NULL && (task = task_deque_pop(deque, pool)) != NULL) {
+		return task;
+	}
 
-	do {
-		Task *current_task;
+	/* Unlocked check is only a hint, sleeping threads check again with the
+	 * lock held. */
+	if (scheduler->queue.first != NULL) {
+		BLI_mutex_lock(&scheduler->queue_mutex);
+		task = task_scheduler_queue_pop(scheduler, pool);
+		BLI_mutex_unlock(&scheduler->queue_mutex);
 
-		/* Assuming we can only have a void queue in 'exit' case here seems logical (we should only be here after
-		 * our worker thread has been woken up from a condition_wait(), which only happens after a new task was
-		 * added to the queue), but it is wrong.
-		 * Waiting on condition may wake up the thread even if condition is not signaled (spurious wake-ups), and some
-		 * race condition may also empty the queue **after** condition has been signaled, but **before** awoken thread
-		 * reaches this point...
-		 * See http://stackoverflow.com/questions/8594591
-		 *
-		 * So we only abort here if do_exit is set.
-		 */
-		if (scheduler->do_exit) {
-			BLI_mutex_unlock(&scheduler->queue_mutex);
-			return false;
+		if (task != NULL) {
+			return task;
 		}
+	}
 
-		for (current_task = scheduler->queue.first;
-		     current_task != NULL;
-		     current_task = current_task->next)
-		{
-			TaskPool *pool = current_task->pool;
+	if (scheduler->use_deques) {
+		const int num_deques = scheduler->num_threads + 1;
+		const int start = max_ii(thread_id, 0);
 
-			if (scheduler->background_thread_only && !pool->run_in_background) {
-				continue;
+		for (int i = 1; i <= num_deques; i++) {
+			TaskDeque *victim = &scheduler->task_threads[(start + i) % num_deques].deque;
+
+			if (victim != deque && (task = task_deque_steal(victim, pool)) != NULL) {
+				return task;
 			}
+		}
+	}
+
+	/* Popping only looks at the bottom of our own deque, tasks of the pool we
+	 * wait for can be below tasks of other pools. Take them from the top, the
+	 * way thieves would, so nested waits don't depend on other threads. */
+	if (deque != NULL && pool != NULL && (task = task_deque_steal(deque, pool)) != NULL) {
+		return task;
+	}
+
+	return NULL;
+}
+
+/* Check for tasks a worker thread could run, called with the queue locked. */
+static bool task_scheduler_has_tasks(TaskScheduler *scheduler)
+{
+	Task *task;
 
-			*task = current_task;
-			found_task = true;
-			BLI_remlink(&scheduler->queue, *task);
-			break;
+	for (task = scheduler->queue.first; task; task = task->next) {
+		if (!scheduler->background_thread_only || task->pool->run_in_background) {
+			return true;
 		}
-		if (!found_task)
-			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-	} while (!found_task);
+	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	if (scheduler->use_deques) {
+		for (int i = 0; i < scheduler->num_threads + 1; i++) {
+			if (!task_deque_is_empty(&scheduler->task_threads[i].deque)) {
+				return true;
+			}
+		}
+	}
 
-	return true;
+	return false;
 }
 
-BLI_INLINE void handle_local_queue(TaskThreadLocalStorage *tls,
-                                   const int thread_id)
+/* Wake up a sleeping thread after pushing a task to a deque. */
+static void task_scheduler_wake(TaskScheduler *scheduler)
 {
-	while (tls->num_local_queue > 0) {
-		/* We pop task from queue before handling it so handler of the task can
-		 * push next job to the local queue.
-		 */
-		tls->num_local_queue--;
-		Task *local_task = tls->local_queue[tls->num_local_queue];
-		/* TODO(sergey): Double-check work_and_wait() doesn't handle other's
-		 * pool tasks.
-		 */
-		TaskPool *local_pool = local_task->pool;
-		local_task->run(local_pool, local_task->taskdata, thread_id);
-		task_free(local_pool, local_task, thread_id);
+	/* The atomic operation is a memory barrier, so either the sleeping thread
+	 * sees the pushed task, or we see it sleeping. */
+	if (atomic_add_and_fetch_uint32((uint32_t *)&scheduler->num_sleeping, 0) != 0) {
+		BLI_mutex_lock(&scheduler->queue_mutex);
+		BLI_condition_notify_one(&scheduler->queue_cond);
+		BLI_mutex_unlock(&scheduler->queue_mutex);
+	}
+}
+
+static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, const int thread_id, Task **task)
+{
+	while (!scheduler->do_exit) {
+		*task = task_scheduler_find_task(scheduler, thread_id, NULL);
+
+		if (*task != NULL) {
+			return true;
+		}
+
+		/* Nothing to do, sleep until new tasks are pushed. Waiting on the
+		 * condition may wake up the thread even if it was not signaled, in
+		 * which case we just look for tasks again. */
+		BLI_mutex_lock(&scheduler->queue_mutex);
+		atomic_add_and_fetch_uint32((uint32_t *)&scheduler->num_sleeping, 1);
+
+		if (!scheduler->do_exit && !task_scheduler_has_tasks(scheduler)) {
+			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+		}
+
+		atomic_sub_and_fetch_uint32((uint32_t *)&scheduler->num_sleeping, 1);
+		BLI_mutex_unlock(&scheduler->queue_mutex);
 	}
+
+	return false;
 }
 
 static void *task_scheduler_thread_run(void *thread_p)
 {
 	TaskThread *thread = (TaskThread *) thread_p;
-	TaskThreadLocalStorage *tls = &thread->tls;
 	TaskScheduler *scheduler = thread->scheduler;
 	int thread_id = thread->id;
 	Task *task;
@@ -404,18 +639,17 @@ static void *task_scheduler_thread_run(void *thread_p)
 	pthread_setspecific(scheduler->tls_id_key, thread);
 
 	/* keep popping off tasks */
-	while (task_scheduler_thread_wait_pop(scheduler, &task)) {
+	while (task_scheduler_thread_wait_pop(scheduler, thread_id, &task)) {
 		TaskPool *pool = task->pool;
 
-		/* run task */
-		task->run(pool, task->taskdata, thread_id);
+		/* run task, tasks of canceled pools may still be in the deques */
+		if (!pool->do_cancel) {
+			task->run(pool, task->taskdata, thread_id);
+		}
 
 		/* delete task */
 		task_free(pool, task, thread_id);
 
-		/* Handle all tasks from local queue. */
-		handle_local_queue(tls, thread_id);
-
 		/* notify pool task was done */
 		task_pool_num_decrease(pool, 1);
 	}
@@ -449,7 +683,9 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 		num_threads = 1;
 	}
 
-	scheduler->task_threads = MEM_mallocN(sizeof(TaskThread) * (num_threads + 1),
+	scheduler->use_deques = !scheduler->background_thread_only;
+
+	scheduler->task_threads = MEM_callocN(sizeof(TaskThread) * (num_threads + 1),
 	                                      "TaskScheduler task threads");
 
 	/* Initialize TLS for main thread. */
@@ -508,6 +744,14 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 		for (int i = 0; i < scheduler->num_threads + 1; ++i) {
 			TaskThreadLocalStorage *tls = &scheduler->task_threads[i].tls;
 			free_task_tls(tls);
+
+			/* delete leftover tasks */
+			TaskDeque *deque = &scheduler->task_threads[i].deque;
+			for (uint32_t j = deque->top; j != deque->bottom; j++) {
+				task = deque->items[j & (DEQUE_SIZE - 1)].task;
+				task_data_free(task, 0);
+				MEM_freeN(task);
+			}
 		}
 
 		MEM_freeN(scheduler->task_threads);
@@ -531,20 +775,34 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
 	return scheduler->num_threads + 1;
 }
 
-static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
+static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority, TaskDeque *deque)
 {
-	task_pool_num_increase(task->pool, 1);
+	/* task may already be done and freed once it is pushed */
+	TaskPool *pool = task->pool;
 
-	/* add task to queue */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	/* Count the task and one more for ourselves, so the pool can't finish and
+	 * be freed by another thread before we are done waking its waiting threads. */
+	task_pool_num_increase(pool, 2);
 
-	if (priority == TASK_PRIORITY_HIGH)
-		BLI_addhead(&scheduler->queue, task);
-	else
-		BLI_addtail(&scheduler->queue, task);
+	/* push to the deque of the calling thread without locking if possible */
+	if (deque != NULL && task_deque_push(deque, task)) {
+		task_scheduler_wake(scheduler);
+	}
+	else {
+		/* add task to queue */
+		BLI_mutex_lock(&scheduler->queue_mutex);
 
-	BLI_condition_notify_one(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+		if (priority == TASK_PRIORITY_HIGH)
+			BLI_addhead(&scheduler->queue, task);
+		else
+			BLI_addtail(&scheduler->queue, task);
+
+		BLI_condition_notify_one(&scheduler->queue_cond);
+		BLI_mutex_unlock(&scheduler->queue_mutex);
+	}
+
+	task_pool_wake_waiting(pool);
+	task_pool_num_decrease(pool, 1);
 }
 
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
@@ -554,7 +812,8 @@ static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 
 	BLI_mutex_lock(&scheduler->queue_mutex);
 
-	/* free all tasks from this pool from the queue */
+	/* free all tasks from this pool from the queue, tasks in the deques are
+	 * skipped by the threads popping them since do_cancel is set */
 	for (task = scheduler->queue.first; task; task = nexttask) {
 		nexttask = task->next;
 
@@ -595,6 +854,7 @@ static TaskPool *task_pool_create_ex(TaskScheduler *scheduler,
 
 	pool->scheduler = scheduler;
 	pool->num = 0;
+	pool->num_waiting = 0;
 	pool->do_cancel = false;
 	pool->do_work = false;
 	pool->is_suspended = is_suspended;
@@ -733,20 +993,18 @@ static void task_pool_push(
 		return;
 	}
 
-	if (thread_id != -1 &&
-	    (thread_id != pool->thread_id || pool->do_work))
-	{
+	/* High priority tasks pushed from a scheduler thread go to its deque, to
+	 * be run next by the same thread unless another thread steals them. Low
+	 * priority tasks go to the end of the queue. */
+	TaskDeque *deque = NULL;
+
+	if (thread_id != -1 && priority == TASK_PRIORITY_HIGH) {
 		ASSERT_THREAD_ID(pool->scheduler, thread_id);
 
-		TaskThreadLocalStorage *tls = get_task_tls(pool, thread_id);
-		if (tls->num_local_queue < LOCALQUEUE_SIZE) {
-			tls->local_queue[tls->num_local_queue] = task;
-			tls->num_local_queue++;
-			return;
-		}
+		deque = task_scheduler_thread_deque(pool->scheduler, thread_id);
 	}
 
-	task_scheduler_push(pool->scheduler, task, priority);
+	task_scheduler_push(pool->scheduler, task, priority, deque);
 }
 
 void BLI_task_pool_push_ex(
@@ -770,7 +1028,6 @@ void BLI_task_pool_push_from_thread(TaskPool *pool, TaskRunFunction run,
 
 void BLI_task_pool_work_and_wait(TaskPool *pool)
 {
-	TaskThreadLocalStorage *tls = get_task_tls(pool, pool->thread_id);
 	TaskScheduler *scheduler = pool->scheduler;
 
 	if (atomic_fetch_and_and_uint8((uint8_t *)&pool->is_suspended, 0)) {
@@ -789,56 +1046,44 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
 
 	ASSERT_THREAD_ID(pool->scheduler, pool->thread_id);
 
-	BLI_mutex_lock(&pool->num_mutex);
-
 	while (pool->num != 0) {
-		Task *task, *work_task = NULL;
-		bool found_task = false;
-
-		BLI_mutex_unlock(&pool->num_mutex);
-
-		BLI_mutex_lock(&scheduler->queue_mutex);
-
-		/* find task from this pool. if we get a task from another pool,
-		 * we can get into deadlock */
-
-		for (task = scheduler->queue.first; task; task = task->next) {
-			if (task->pool == pool) {
-				work_task = task;
-				found_task = true;
-				BLI_remlink(&scheduler->queue, task);
-				break;
+		/* find task from this pool, in our own deque, the queue or the deques
+		 * of other threads. if we get a task from another pool, we can get
+		 * into deadlock */
+		Task *task = task_scheduler_find_task(scheduler, pool->thread_id, pool);
+
+		/* if no task found, wait until new tasks are pushed or all tasks are
+		 * done. tasks pushed after we registered as waiting wake us up, tasks
+		 * pushed before are found by looking again */
+		if (task == NULL) {
+			BLI_mutex_lock(&pool->num_mutex);
+			atomic_add_and_fetch_uint32((uint32_t *)&pool->num_waiting, 1);
+
+			if (pool->num != 0) {
+				task = task_scheduler_find_task(scheduler, pool->thread_id, pool);
+
+				if (task == NULL) {
+					BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
+				}
 			}
-		}
 
-		BLI_mutex_unlock(&scheduler->queue_mutex);
+			atomic_sub_and_fetch_uint32((uint32_t *)&pool->num_waiting, 1);
+			BLI_mutex_unlock(&pool->num_mutex);
+		}
 
-		/* if found task, do it, otherwise wait until other tasks are done */
-		if (found_task) {
+		if (task != NULL) {
 			/* run task */
-			work_task->run(pool, work_task->taskdata, pool->thread_id);
+			if (!pool->do_cancel) {
+				task->run(pool, task->taskdata, pool->thread_id);
+			}
 
 			/* delete task */
 			task_free(pool, task, pool->thread_id);
 
-			/* Handle all tasks from local queue. */
-			handle_local_queue(tls, pool->thread_id);
-
 			/* notify pool task was done */
 			task_pool_num_decrease(pool, 1);
 		}
-
-		BLI_mutex_lock(&pool->num_mutex);
-		if (pool->num == 0)
-			break;
-
-		if (!found_task)
-			BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
 	}
-
-	BLI_mutex_unlock(&pool->num_mutex);
-
-	handle_local_queue(tls, pool->thread_id);
 }
 
 void BLI_task_pool_cancel(TaskPool *pool)
@@ -1025,7 +1270,8 @@ static void task_parallel_range_ex(
 		state.chunk_size = max_ii(1, (stop - start) / (num_tasks));
 	}
 
-	num_tasks = min_ii(num_tasks, (stop - start) / state.chunk_size);
+	/* At least one task, ranges shorter than a chunk would not run otherwise. */
+	num_tasks = min_ii(num_tasks, max_ii(1, (stop - start) / state.chunk_size));
 	atomic_fetch_and_add_uint32((uint32_t *)(&state.iter), 0);
 
 	if (use_userdata_chunk) {
@@ -39,6 +39,7 @@
 
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_ohash.h"
 
 #include "intern/depsgraph.h"
 #include "intern/depsgraph_types.h"
@@ -125,7 +126,7 @@ void deg_graph_build_finalize(Depsgraph *graph)
 	 * to do it ahead of a time and don't spend time on flushing updates on
 	 * every frame change.
 	 */
-	GHASH_FOREACH_BEGIN(IDDepsNode *, id_node, graph->id_hash)
+	OHASH_FOREACH_BEGIN(IDDepsNode *, id_node, graph->id_hash)
 	{
 		if (id_node->layers == 0) {
 			ID *id = id_node->id;
@@ -137,19 +138,19 @@ void deg_graph_build_finalize(Depsgraph *graph)
 			}
 		}
 	}
-	GHASH_FOREACH_END();
+	OHASH_FOREACH_END();
 	/* STEP 2: Flush visibility layers from children to parent. */
 	deg_graph_build_flush_layers(graph);
 	/* STEP 3: Re-tag IDs for update if it was tagged before the relations
 	 * update tag.
 	 */
-	GHASH_FOREACH_BEGIN(IDDepsNode *, id_node, graph->id_hash)
+	OHASH_FOREACH_BEGIN(IDDepsNode *, id_node, graph->id_hash)
 	{
-		GHASH_FOREACH_BEGIN(ComponentDepsNode *, comp, id_node->components)
+		OHASH_FOREACH_BEGIN(ComponentDepsNode *, comp, id_node->components)
 		{
 			id_node->layers |= comp->layers;
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 
 		if ((id_node->layers & graph->layers) != 0 || graph->layers == 0) {
 			ID *id = id_node->id;
@@ -169,7 +170,7 @@ void deg_graph_build_finalize(Depsgraph *graph)
 		}
 		id_node->finalize_build();
 	}
-	GHASH_FOREACH_END();
+	OHASH_FOREACH_END();
 }
 
 }  // namespace DEG
@@ -32,6 +32,7 @@
 
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_ohash.h"
 
 extern "C" {
 #include "DNA_listBase.h"
@@ -366,16 +367,16 @@ static void deg_debug_graphviz_node(const DebugContext &ctx,
 		case DEPSNODE_TYPE_ID_REF:
 		{
 			const IDDepsNode *id_node = (const IDDepsNode *)node;
-			if (BLI_ghash_size(id_node->components) == 0) {
+			if (BLI_ohash_size(id_node->components) == 0) {
 				deg_debug_graphviz_node_single(ctx, node);
 			}
 			else {
 				deg_debug_graphviz_node_cluster_begin(ctx, node);
-				GHASH_FOREACH_BEGIN(const ComponentDepsNode *, comp, id_node->components)
+				OHASH_FOREACH_BEGIN(const ComponentDepsNode *, comp, id_node->components)
 				{
 					deg_debug_graphviz_node(ctx, comp);
 				}
-				GHASH_FOREACH_END();
+				OHASH_FOREACH_END();
 				deg_debug_graphviz_node_cluster_end(ctx);
 			}
 			break;
@@ -430,7 +431,7 @@ static bool deg_debug_graphviz_is_cluster(const DepsNode *node)
 		case DEPSNODE_TYPE_ID_REF:
 		{
 			const IDDepsNode *id_node = (const IDDepsNode *)node;
-			return BLI_ghash_size(id_node->components) > 0;
+			return BLI_ohash_size(id_node->components) > 0;
 		}
 		case DEPSNODE_TYPE_SUBGRAPH:
 		{
@@ -520,11 +521,11 @@ static void deg_debug_graphviz_graph_nodes(const DebugContext &ctx,
 	if (graph->root_node) {
 		deg_debug_graphviz_node(ctx, graph->root_node);
 	}
-	GHASH_FOREACH_BEGIN (DepsNode *, node, graph->id_hash)
+	OHASH_FOREACH_BEGIN (DepsNode *, node, graph->id_hash)
 	{
 		deg_debug_graphviz_node(ctx, node);
 	}
-	GHASH_FOREACH_END();
+	OHASH_FOREACH_END();
 	TimeSourceDepsNode *time_source = graph->find_time_source(NULL);
 	if (time_source != NULL) {
 		deg_debug_graphviz_node(ctx, time_source);
@@ -534,17 +535,17 @@ static void deg_debug_graphviz_graph_nodes(const DebugContext &ctx,
 static void deg_debug_graphviz_graph_relations(const DebugContext &ctx,
                                                const Depsgraph *graph)
 {
-	GHASH_FOREACH_BEGIN(IDDepsNode *, id_node, graph->id_hash)
+	OHASH_FOREACH_BEGIN(IDDepsNode *, id_node, graph->id_hash)
 	{
-		GHASH_FOREACH_BEGIN(ComponentDepsNode *, comp_node, id_node->components)
+		OHASH_FOREACH_BEGIN(ComponentDepsNode *, comp_node, id_node->components)
 		{
 			foreach (OperationDepsNode *op_node, comp_node->operations) {
 				deg_debug_graphviz_node_relations(ctx, op_node);
 			}
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 	}
-	GHASH_FOREACH_END();
+	OHASH_FOREACH_END();
 
 	TimeSourceDepsNode *time_source = graph->find_time_source(NULL);
 	if (time_source != NULL) {
@@ -36,6 +36,7 @@
 
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_ohash.h"
 #include "BLI_listbase.h"
 
 extern "C" {
@@ -74,7 +75,7 @@ Depsgraph::Depsgraph()
     layers(0)
 {
 	BLI_spin_init(&lock);
-	id_hash = BLI_ghash_ptr_new("Depsgraph id hash");
+	id_hash = BLI_ohash_ptr_new("Depsgraph id hash");
 	subgraphs = BLI_gset_ptr_new("Depsgraph subgraphs");
 	entry_tags = BLI_gset_ptr_new("Depsgraph entry_tags");
 }
@@ -84,7 +85,7 @@ Depsgraph::~Depsgraph()
 	/* Free root node - it won't have been freed yet... */
 	clear_id_nodes();
 	clear_subgraph_nodes();
-	BLI_ghash_free(id_hash, NULL, NULL);
+	BLI_ohash_free(id_hash, NULL, NULL);
 	BLI_gset_free(subgraphs, NULL);
 	BLI_gset_free(entry_tags, NULL);
 	if (this->root_node != NULL) {
@@ -333,7 +334,7 @@ void Depsgraph::clear_subgraph_nodes()
 
 IDDepsNode *Depsgraph::find_id_node(const ID *id) const
 {
-	return reinterpret_cast<IDDepsNode *>(BLI_ghash_lookup(id_hash, id));
+	return reinterpret_cast<IDDepsNode *>(BLI_ohash_lookup(id_hash, id));
 }
 
 IDDepsNode *Depsgraph::add_id_node(ID *id, const char *name)
@@ -344,7 +345,7 @@ IDDepsNode *Depsgraph::add_id_node(ID *id, const char *name)
 		id_node = (IDDepsNode *)factory->create_node(id, "", name);
 		id->tag |= LIB_TAG_DOIT;
 		/* register */
-		BLI_ghash_insert(id_hash, id, id_node);
+		BLI_ohash_insert(id_hash, id, id_node);
 	}
 	return id_node;
 }
@@ -354,14 +355,14 @@ void Depsgraph::remove_id_node(const ID *id)
 	IDDepsNode *id_node = find_id_node(id);
 	if (id_node) {
 		/* unregister */
-		BLI_ghash_remove(id_hash, id, NULL, NULL);
+		BLI_ohash_remove(id_hash, id, NULL, NULL);
 		OBJECT_GUARDED_DELETE(id_node, IDDepsNode);
 	}
 }
 
 void Depsgraph::clear_id_nodes()
 {
-	BLI_ghash_clear(id_hash, NULL, id_node_deleter);
+	BLI_ohash_clear(id_hash, NULL, id_node_deleter);
 }
 
 /* Add new relationship between two nodes. */
@@ -473,7 +474,7 @@ void Depsgraph::clear_all_nodes()
 {
 	clear_id_nodes();
 	clear_subgraph_nodes();
-	BLI_ghash_clear(id_hash, NULL, NULL);
+	BLI_ohash_clear(id_hash, NULL, NULL);
 	if (this->root_node) {
 		OBJECT_GUARDED_DELETE(this->root_node, RootDepsNode);
 		root_node = NULL;
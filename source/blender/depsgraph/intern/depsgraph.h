@@ -41,7 +41,7 @@
 #include "intern/depsgraph_types.h"
 
 struct ID;
-struct GHash;
+struct OHash;
 struct GSet;
 struct PointerRNA;
 struct PropertyRNA;
@@ -145,7 +145,7 @@ struct Depsgraph {
 
 	/* <ID : IDDepsNode> mapping from ID blocks to nodes representing these blocks
 	 * (for quick lookups). */
-	GHash *id_hash;
+	OHash *id_hash;
 
 	/* "root" node - the one where all evaluation enters from. */
 	RootDepsNode *root_node;
@@ -32,6 +32,7 @@
 
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_ohash.h"
 
 extern "C" {
 #include "DNA_scene_types.h"
@@ -218,19 +219,19 @@ void DEG_stats_simple(const Depsgraph *graph, size_t *r_outer,
 		size_t tot_outer = 0;
 		size_t tot_rels = 0;
 
-		GHASH_FOREACH_BEGIN(DEG::IDDepsNode *, id_node, deg_graph->id_hash)
+		OHASH_FOREACH_BEGIN(DEG::IDDepsNode *, id_node, deg_graph->id_hash)
 		{
 			tot_outer++;
-			GHASH_FOREACH_BEGIN(DEG::ComponentDepsNode *, comp_node, id_node->components)
+			OHASH_FOREACH_BEGIN(DEG::ComponentDepsNode *, comp_node, id_node->components)
 			{
 				tot_outer++;
 				foreach (DEG::OperationDepsNode *op_node, comp_node->operations) {
 					tot_rels += op_node->inlinks.size();
 				}
 			}
-			GHASH_FOREACH_END();
+			OHASH_FOREACH_END();
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 
 		DEG::TimeSourceDepsNode *time_source = deg_graph->find_time_source(NULL);
 		if (time_source != NULL) {
@@ -42,6 +42,7 @@ extern "C" {
 #include "DNA_screen_types.h"
 #include "DNA_windowmanager_types.h"
 
+#include "BLI_ohash.h"
 #include "BLI_task.h"
 
 #include "BKE_idcode.h"
@@ -316,7 +317,7 @@ void DEG_graph_on_visible_update(Main *bmain, Scene *scene)
 		 * This is mainly needed on file load only, after that updates of invisible objects
 		 * will be stored in the pending list.
 		 */
-		GHASH_FOREACH_BEGIN(DEG::IDDepsNode *, id_node, graph->id_hash)
+		OHASH_FOREACH_BEGIN(DEG::IDDepsNode *, id_node, graph->id_hash)
 		{
 			ID *id = id_node->id;
 			if ((id->tag & LIB_TAG_ID_RECALC_ALL) != 0 ||
@@ -343,7 +344,7 @@ void DEG_graph_on_visible_update(Main *bmain, Scene *scene)
 				}
 			}
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 	}
 	scene->lay_updated |= graph->layers;
 	/* Special trick to get local view to work.  */
@@ -361,11 +362,11 @@ void DEG_graph_on_visible_update(Main *bmain, Scene *scene)
 	LINKLIST_FOREACH (Base *, base, &scene->base) {
 		Object *object = base->object;
 		DEG::IDDepsNode *id_node = graph->find_id_node(&object->id);
-		GHASH_FOREACH_BEGIN(DEG::ComponentDepsNode *, comp, id_node->components)
+		OHASH_FOREACH_BEGIN(DEG::ComponentDepsNode *, comp, id_node->components)
 		{
 			id_node->layers |= comp->layers;
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 	}
 }
 
@@ -35,6 +35,7 @@
 
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_ohash.h"
 
 extern "C" {
 #include "DNA_ID.h"
@@ -198,7 +199,7 @@ void IDDepsNode::init(const ID *id, const char *UNUSED(subdata))
 		this->layers = 0;
 	}
 
-	components = BLI_ghash_new(id_deps_node_hash_key,
+	components = BLI_ohash_new(id_deps_node_hash_key,
 	                           id_deps_node_hash_key_cmp,
 	                           "Depsgraph id components hash");
 
@@ -212,14 +213,14 @@ void IDDepsNode::init(const ID *id, const char *UNUSED(subdata))
 IDDepsNode::~IDDepsNode()
 {
 	clear_components();
-	BLI_ghash_free(components, id_deps_node_hash_key_free, NULL);
+	BLI_ohash_free(components, id_deps_node_hash_key_free, NULL);
 }
 
 ComponentDepsNode *IDDepsNode::find_component(eDepsNode_Type type,
                                               const char *name) const
 {
 	ComponentIDKey key(type, name);
-	return reinterpret_cast<ComponentDepsNode *>(BLI_ghash_lookup(components, &key));
+	return reinterpret_cast<ComponentDepsNode *>(BLI_ohash_lookup(components, &key));
 }
 
 ComponentDepsNode *IDDepsNode::add_component(eDepsNode_Type type,
@@ -232,7 +233,7 @@ ComponentDepsNode *IDDepsNode::add_component(eDepsNode_Type type,
 
 		/* Register. */
 		ComponentIDKey *key = OBJECT_GUARDED_NEW(ComponentIDKey, type, name);
-		BLI_ghash_insert(components, key, comp_node);
+		BLI_ohash_insert(components, key, comp_node);
 		comp_node->owner = this;
 	}
 	return comp_node;
@@ -244,7 +245,7 @@ void IDDepsNode::remove_component(eDepsNode_Type type, const char *name)
 	if (comp_node) {
 		/* Unregister. */
 		ComponentIDKey key(type, name);
-		BLI_ghash_remove(components,
+		BLI_ohash_remove(components,
 		                 &key,
 		                 id_deps_node_hash_key_free,
 		                 id_deps_node_hash_value_free);
@@ -253,14 +254,14 @@ void IDDepsNode::remove_component(eDepsNode_Type type, const char *name)
 
 void IDDepsNode::clear_components()
 {
-	BLI_ghash_clear(components,
+	BLI_ohash_clear(components,
 	                id_deps_node_hash_key_free,
 	                id_deps_node_hash_value_free);
 }
 
 void IDDepsNode::tag_update(Depsgraph *graph)
 {
-	GHASH_FOREACH_BEGIN(ComponentDepsNode *, comp_node, components)
+	OHASH_FOREACH_BEGIN(ComponentDepsNode *, comp_node, components)
 	{
 		/* TODO(sergey): What about drievrs? */
 		bool do_component_tag = comp_node->type != DEPSNODE_TYPE_ANIMATION;
@@ -275,16 +276,16 @@ void IDDepsNode::tag_update(Depsgraph *graph)
 			comp_node->tag_update(graph);
 		}
 	}
-	GHASH_FOREACH_END();
+	OHASH_FOREACH_END();
 }
 
 void IDDepsNode::finalize_build()
 {
-	GHASH_FOREACH_BEGIN(ComponentDepsNode *, comp_node, components)
+	OHASH_FOREACH_BEGIN(ComponentDepsNode *, comp_node, components)
 	{
 		comp_node->finalize_build();
 	}
-	GHASH_FOREACH_END();
+	OHASH_FOREACH_END();
 }
 
 DEG_DEPSNODE_DEFINE(IDDepsNode, DEPSNODE_TYPE_ID_REF, "ID Node");
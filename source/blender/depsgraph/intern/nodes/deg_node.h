@@ -35,7 +35,7 @@
 #include "BLI_utildefines.h"
 
 struct ID;
-struct GHash;
+struct OHash;
 struct Scene;
 
 namespace DEG {
@@ -171,7 +171,7 @@ struct IDDepsNode : public DepsNode {
 	ID *id;
 
 	/* Hash to make it faster to look up components. */
-	GHash *components;
+	OHash *components;
 
 	/* Layers of this node with accumulated layers of it's output relations. */
 	unsigned int layers;
@@ -35,6 +35,7 @@
 
 extern "C" {
 #include "BLI_utildefines.h"
+#include "BLI_ohash.h"
 
 #include "DNA_object_types.h"
 
@@ -126,7 +127,7 @@ ComponentDepsNode::ComponentDepsNode() :
     exit_operation(NULL),
     layers(0)
 {
-	operations_map = BLI_ghash_new(comp_node_hash_key,
+	operations_map = BLI_ohash_new(comp_node_hash_key,
 	                               comp_node_hash_key_cmp,
 	                               "Depsgraph id hash");
 }
@@ -144,7 +145,7 @@ ComponentDepsNode::~ComponentDepsNode()
 {
 	clear_operations();
 	if (operations_map != NULL) {
-		BLI_ghash_free(operations_map,
+		BLI_ohash_free(operations_map,
 		               comp_node_hash_key_free,
 		               comp_node_hash_value_free);
 	}
@@ -165,7 +166,7 @@ string ComponentDepsNode::identifier() const
 
 OperationDepsNode *ComponentDepsNode::find_operation(OperationIDKey key) const
 {
-	OperationDepsNode *node = reinterpret_cast<OperationDepsNode *>(BLI_ghash_lookup(operations_map, &key));
+	OperationDepsNode *node = reinterpret_cast<OperationDepsNode *>(BLI_ohash_lookup(operations_map, &key));
 	if (node != NULL) {
 		return node;
 	}
@@ -187,7 +188,7 @@ OperationDepsNode *ComponentDepsNode::find_operation(eDepsOperation_Code opcode,
 
 OperationDepsNode *ComponentDepsNode::has_operation(OperationIDKey key) const
 {
-	return reinterpret_cast<OperationDepsNode *>(BLI_ghash_lookup(operations_map, &key));
+	return reinterpret_cast<OperationDepsNode *>(BLI_ohash_lookup(operations_map, &key));
 }
 
 OperationDepsNode *ComponentDepsNode::has_operation(eDepsOperation_Code opcode,
@@ -211,7 +212,7 @@ OperationDepsNode *ComponentDepsNode::add_operation(eDepsOperation_Type optype,
 
 		/* register opnode in this component's operation set */
 		OperationIDKey *key = OBJECT_GUARDED_NEW(OperationIDKey, opcode, name, name_tag);
-		BLI_ghash_insert(operations_map, key, op_node);
+		BLI_ohash_insert(operations_map, key, op_node);
 
 		/* set as entry/exit node of component (if appropriate) */
 		if (optype == DEPSOP_TYPE_INIT) {
@@ -245,7 +246,7 @@ OperationDepsNode *ComponentDepsNode::add_operation(eDepsOperation_Type optype,
 void ComponentDepsNode::clear_operations()
 {
 	if (operations_map != NULL) {
-		BLI_ghash_clear(operations_map,
+		BLI_ohash_clear(operations_map,
 		                comp_node_hash_key_free,
 		                comp_node_hash_value_free);
 	}
@@ -266,11 +267,11 @@ void ComponentDepsNode::tag_update(Depsgraph *graph)
 	}
 	// It is possible that tag happens before finalization.
 	if (operations_map != NULL) {
-		GHASH_FOREACH_BEGIN(OperationDepsNode *, op_node, operations_map)
+		OHASH_FOREACH_BEGIN(OperationDepsNode *, op_node, operations_map)
 		{
 			op_node->tag_update(graph);
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 	}
 }
 
@@ -279,14 +280,14 @@ OperationDepsNode *ComponentDepsNode::get_entry_operation()
 	if (entry_operation) {
 		return entry_operation;
 	}
-	else if (operations_map != NULL && BLI_ghash_size(operations_map) == 1) {
+	else if (operations_map != NULL && BLI_ohash_size(operations_map) == 1) {
 		OperationDepsNode *op_node = NULL;
 		/* TODO(sergey): This is somewhat slow. */
-		GHASH_FOREACH_BEGIN(OperationDepsNode *, tmp, operations_map)
+		OHASH_FOREACH_BEGIN(OperationDepsNode *, tmp, operations_map)
 		{
 			op_node = tmp;
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 		/* Cache for the subsequent usage. */
 		entry_operation = op_node;
 		return op_node;
@@ -302,14 +303,14 @@ OperationDepsNode *ComponentDepsNode::get_exit_operation()
 	if (exit_operation) {
 		return exit_operation;
 	}
-	else if (operations_map != NULL && BLI_ghash_size(operations_map) == 1) {
+	else if (operations_map != NULL && BLI_ohash_size(operations_map) == 1) {
 		OperationDepsNode *op_node = NULL;
 		/* TODO(sergey): This is somewhat slow. */
-		GHASH_FOREACH_BEGIN(OperationDepsNode *, tmp, operations_map)
+		OHASH_FOREACH_BEGIN(OperationDepsNode *, tmp, operations_map)
 		{
 			op_node = tmp;
 		}
-		GHASH_FOREACH_END();
+		OHASH_FOREACH_END();
 		/* Cache for the subsequent usage. */
 		exit_operation = op_node;
 		return op_node;
@@ -322,13 +323,13 @@ OperationDepsNode *ComponentDepsNode::get_exit_operation()
 
 void ComponentDepsNode::finalize_build()
 {
-	operations.reserve(BLI_ghash_size(operations_map));
-	GHASH_FOREACH_BEGIN(OperationDepsNode *, op_node, operations_map)
+	operations.reserve(BLI_ohash_size(operations_map));
+	OHASH_FOREACH_BEGIN(OperationDepsNode *, op_node, operations_map)
 	{
 		operations.push_back(op_node);
 	}
-	GHASH_FOREACH_END();
-	BLI_ghash_free(operations_map,
+	OHASH_FOREACH_END();
+	BLI_ohash_free(operations_map,
 	               comp_node_hash_key_free,
 	               NULL);
 	operations_map = NULL;
@@ -37,7 +37,7 @@
 
 struct ID;
 struct bPoseChannel;
-struct GHash;
+struct OHash;
 
 struct EvaluationContext;
 
@@ -134,7 +134,7 @@ struct ComponentDepsNode : public DepsNode {
 	/* Operations stored as a hash map, for faster build.
 	 * This hash map will be freed when graph is fully built.
 	 */
-	GHash *operations_map;
+	OHash *operations_map;
 
 	/* This is a "normal" list of operations, used by evaluation
 	 * and other routines after construction.
@@ -57,6 +57,16 @@
 		} \
 	} while(0)
 
+#define OHASH_FOREACH_BEGIN(type, var, what) \
+	do { \
+		OHashIterator oh_iter##var; \
+		OHASH_ITER(oh_iter##var, what) { \
+			type var = reinterpret_cast<type>(BLI_ohashIterator_getValue(&oh_iter##var)); \
+
+#define OHASH_FOREACH_END() \
+		} \
+	} while(0)
+
 #define GSET_FOREACH_BEGIN(type, var, what) \
 	do { \
 		GSetIterator gh_iter##var; \
@@ -32,7 +32,7 @@ typedef struct SDefEdgePolys {
 } SDefEdgePolys;
 
 typedef struct SDefBindCalcData {
-	BVHTreeFromMesh * const treeData;
+	const BVHTreeNearest * const nearest;
 	const SDefAdjacencyArray * const vert_edges;
 	const SDefEdgePolys * const edge_polys;
 	SDefVert * const bind_verts;
@@ -281,22 +281,17 @@ BLI_INLINE void sortPolyVertsTri(unsigned int *indices, const MLoop * const mloo
 	}
 }
 
-BLI_INLINE unsigned int nearestVert(SDefBindCalcData * const data, const float point_co[3])
+BLI_INLINE unsigned int nearestVert(SDefBindCalcData * const data, const int vert_index, const float point_co[3])
 {
-	BVHTreeNearest nearest = {.dist_sq = FLT_MAX, .index = -1};
+	const BVHTreeNearest *nearest = &data->nearest[vert_index];
 	const MPoly *poly;
 	const MEdge *edge;
 	const MLoop *loop;
-	float t_point[3];
 	float max_dist = FLT_MAX;
 	float dist;
 	unsigned int index = 0;
 
-	mul_v3_m4v3(t_point, data->imat, point_co);
-
-	BLI_bvhtree_find_nearest(data->treeData->tree, t_point, &nearest, data->treeData->nearest_callback, data->treeData);
-
-	poly = &data->mpoly[data->looptri[nearest.index].poly];
+	poly = &data->mpoly[data->looptri[nearest->index].poly];
 	loop = &data->mloop[poly->loopstart];
 
 	for (int i = 0; i < poly->totloop; i++, loop++) {
@@ -375,9 +370,10 @@ BLI_INLINE float computeAngularWeight(const float point_angle, const float edgem
 	return sinf(weight);
 }
 
-BLI_INLINE SDefBindWeightData *computeBindWeights(SDefBindCalcData * const data, const float point_co[3])
+BLI_INLINE SDefBindWeightData *computeBindWeights(
+        SDefBindCalcData * const data, const int vert_index, const float point_co[3])
 {
-	const unsigned int nearest = nearestVert(data, point_co);
+	const unsigned int nearest = nearestVert(data, vert_index, point_co);
 	const SDefAdjacency * const vert_edges = data->vert_edges[nearest].first;
 	const SDefEdgePolys * const edge_polys = data->edge_polys;
 
@@ -767,7 +763,7 @@ static void bindVert(void *userdata, void *UNUSED(userdata_chunk), const int ind
 	}
 
 	copy_v3_v3(point_co, data->vertexCos[index]);
-	bwdata = computeBindWeights(data, point_co);
+	bwdata = computeBindWeights(data, index, point_co);
 
 	if (bwdata == NULL) {
 		sdvert->binds = NULL;
@@ -984,7 +980,10 @@ static bool surfacedeformBind(SurfaceDeformModifierData *smd, float (*vertexCos)
 	smd->numverts = numverts;
 	smd->numpoly = tnumpoly;
 
-	SDefBindCalcData data = {.treeData = &treeData,
+	BVHTreeNearest *nearest = MEM_mallocN(sizeof(*nearest) * numverts, "SDefBindNearest");
+	float (*points)[3] = MEM_mallocN(sizeof(*points) * numverts, "SDefBindPoints");
+
+	SDefBindCalcData data = {.nearest = nearest,
 		                     .vert_edges = vert_edges,
 		                     .edge_polys = edge_polys,
 		                     .mpoly = mpoly,
@@ -997,8 +996,13 @@ static bool surfacedeformBind(SurfaceDeformModifierData *smd, float (*vertexCos)
 		                     .falloff = smd->falloff,
 		                     .success = MOD_SDEF_BIND_RESULT_SUCCESS};
 
-	if (data.targetCos == NULL) {
+	if (data.targetCos == NULL || nearest == NULL || points == NULL) {
 		modifier_setError((ModifierData *)smd, "Out of memory");
+		if (data.targetCos) {
+			MEM_freeN(data.targetCos);
+		}
+		MEM_SAFE_FREE(nearest);
+		MEM_SAFE_FREE(points);
 		freeData((ModifierData *)smd);
 		return false;
 	}
@@ -1009,10 +1013,23 @@ static bool surfacedeformBind(SurfaceDeformModifierData *smd, float (*vertexCos)
 		mul_v3_m4v3(data.targetCos[i], smd->mat, mvert[i].co);
 	}
 
+	/* Find the nearest target triangle of all vertices at once. */
+	for (int i = 0; i < numverts; i++) {
+		mul_v3_m4v3(points[i], data.imat, vertexCos[i]);
+		nearest[i].index = -1;
+		nearest[i].dist_sq = FLT_MAX;
+	}
+
+	BLI_bvhtree_find_nearest_batch(
+	        treeData.tree, (const float (*)[3])points, (int)numverts, nearest, treeData.nearest_callback, &treeData);
+
+	MEM_freeN(points);
+
 	BLI_task_parallel_range_ex(0, numverts, &data, NULL, 0, bindVert,
 	                           numverts > 10000, false);
 
 	MEM_freeN(data.targetCos);
+	MEM_freeN(nearest);
 
 	if (data.success == MOD_SDEF_BIND_RESULT_MEM_ERR) {
 		modifier_setError((ModifierData *)smd, "Out of memory");
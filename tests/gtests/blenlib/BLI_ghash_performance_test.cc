@@ -9,6 +9,7 @@ extern "C" {
 #include "MEM_guardedalloc.h"
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_ohash.h"
 #include "BLI_rand.h"
 #include "BLI_string.h"
 #include "PIL_time_utildefines.h"
@@ -27,20 +28,70 @@ extern "C" {
 /* Size of 'small case' ghash (number of entries). */
 #define TESTCASE_SIZE_SMALL 17
 
-#define PRINTF_GHASH_STATS(_gh) \
-{ \
-	double q, lf, var, pempty, poverloaded; \
-	int bigb; \
-	q = BLI_ghash_calc_quality_ex((_gh), &lf, &var, &pempty, &poverloaded, &bigb); \
-	printf("GHash stats (%u entries):\n\t" \
-	       "Quality (the lower the better): %f\n\tVariance (the lower the better): %f\n\tLoad: %f\n\t" \
-	       "Empty buckets: %.2f%%\n\tOverloaded buckets: %.2f%% (biggest bucket: %d)\n", \
-	       BLI_ghash_size(_gh), q, var, lf, pempty * 100.0, poverloaded * 100.0, bigb); \
-} void (0)
+static void test_hash_print_stats(GHash *gh)
+{
+	double q, lf, var, pempty, poverloaded;
+	int bigb;
+	q = BLI_ghash_calc_quality_ex(gh, &lf, &var, &pempty, &poverloaded, &bigb);
+	printf("GHash stats (%u entries):\n\t"
+	       "Quality (the lower the better): %f\n\tVariance (the lower the better): %f\n\tLoad: %f\n\t"
+	       "Empty buckets: %.2f%%\n\tOverloaded buckets: %.2f%% (biggest bucket: %d)\n",
+	       BLI_ghash_size(gh), q, var, lf, pempty * 100.0, poverloaded * 100.0, bigb);
+}
+
+static void test_hash_print_stats(OHash *oh)
+{
+	double q, lf, pdeleted;
+	int longest;
+	q = BLI_ohash_calc_quality_ex(oh, &lf, &pdeleted, &longest);
+	printf("OHash stats (%u entries):\n\t"
+	       "Quality (the lower the better): %f\n\tLoad: %f\n\t"
+	       "Deleted slots: %.2f%%\n\tLongest probe: %d groups\n",
+	       BLI_ohash_size(oh), q, lf, pdeleted * 100.0, longest);
+}
+
+/* The tests below are templated over the hash type, so that both the chained GHash and the open addressing
+ * OHash run the exact same workloads, these map the calls they use to either API. */
+
+static void test_hash_reserve(GHash *gh, const unsigned int nbr) { BLI_ghash_reserve(gh, nbr); }
+static void test_hash_reserve(OHash *oh, const unsigned int nbr) { BLI_ohash_reserve(oh, nbr); }
+static void test_hash_insert(GHash *gh, void *key, void *val) { BLI_ghash_insert(gh, key, val); }
+static void test_hash_insert(OHash *oh, void *key, void *val) { BLI_ohash_insert(oh, key, val); }
+static bool test_hash_haskey(GHash *gh, const void *key) { return BLI_ghash_haskey(gh, key); }
+static bool test_hash_haskey(OHash *oh, const void *key) { return BLI_ohash_haskey(oh, key); }
+static void *test_hash_lookup(GHash *gh, const void *key) { return BLI_ghash_lookup(gh, key); }
+static void *test_hash_lookup(OHash *oh, const void *key) { return BLI_ohash_lookup(oh, key); }
+static unsigned int test_hash_size(GHash *gh) { return BLI_ghash_size(gh); }
+static unsigned int test_hash_size(OHash *oh) { return BLI_ohash_size(oh); }
+static void test_hash_clear(GHash *gh) { BLI_ghash_clear(gh, NULL, NULL); }
+static void test_hash_clear(OHash *oh) { BLI_ohash_clear(oh, NULL, NULL); }
+static void test_hash_free(GHash *gh) { BLI_ghash_free(gh, NULL, NULL); }
+static void test_hash_free(OHash *oh) { BLI_ohash_free(oh, NULL, NULL); }
+
+static void test_hash_pop_all(GHash *gh)
+{
+	void *k, *v;
+	GHashIterState pop_state = {0};
+
+	while (BLI_ghash_pop(gh, &pop_state, &k, &v)) {
+		EXPECT_EQ(k, v);
+	}
+}
+
+static void test_hash_pop_all(OHash *oh)
+{
+	void *k, *v;
+	OHashIterState pop_state = {0};
+
+	while (BLI_ohash_pop(oh, &pop_state, &k, &v)) {
+		EXPECT_EQ(k, v);
+	}
+}
 
 /* Str: whole text, lines and words from a 'corpus' text. */
 
-static void str_ghash_tests(GHash *ghash, const char *id)
+template <typename HashT>
+static void str_ghash_tests(HashT *ghash, const char *id)
 {
 	printf("\n========== STARTING %s ==========\n", id);
 
@@ -80,27 +131,27 @@ static void str_ghash_tests(GHash *ghash, const char *id)
 		TIMEIT_START(string_insert);
 
 #ifdef GHASH_RESERVE
-		BLI_ghash_reserve(ghash, strlen(data) / 32);  /* rough estimation... */
+		test_hash_reserve(ghash, strlen(data) / 32);  /* rough estimation... */
 #endif
 
-		BLI_ghash_insert(ghash, data, SET_INT_IN_POINTER(data[0]));
+		test_hash_insert(ghash, data, SET_INT_IN_POINTER(data[0]));
 
 		for (p = c_p = data_p, w = c_w = data_w; *c_w; c_w++, c_p++) {
 			if (*c_p == '.') {
 				*c_p = *c_w = '\0';
-				if (!BLI_ghash_haskey(ghash, p)) {
-					BLI_ghash_insert(ghash, p, SET_INT_IN_POINTER(p[0]));
+				if (!test_hash_haskey(ghash, p)) {
+					test_hash_insert(ghash, p, SET_INT_IN_POINTER(p[0]));
 				}
-				if (!BLI_ghash_haskey(ghash, w)) {
-					BLI_ghash_insert(ghash, w, SET_INT_IN_POINTER(w[0]));
+				if (!test_hash_haskey(ghash, w)) {
+					test_hash_insert(ghash, w, SET_INT_IN_POINTER(w[0]));
 				}
 				p = c_p + 1;
 				w = c_w + 1;
 			}
 			else if (*c_w == ' ') {
 				*c_w = '\0';
-				if (!BLI_ghash_haskey(ghash, w)) {
-					BLI_ghash_insert(ghash, w, SET_INT_IN_POINTER(w[0]));
+				if (!test_hash_haskey(ghash, w)) {
+					test_hash_insert(ghash, w, SET_INT_IN_POINTER(w[0]));
 				}
 				w = c_w + 1;
 			}
@@ -109,7 +160,7 @@ static void str_ghash_tests(GHash *ghash, const char *id)
 		TIMEIT_END(string_insert);
 	}
 
-	PRINTF_GHASH_STATS(ghash);
+	test_hash_print_stats(ghash);
 
 	{
 		char *p, *w, *c;
@@ -117,21 +168,21 @@ static void str_ghash_tests(GHash *ghash, const char *id)
 
 		TIMEIT_START(string_lookup);
 
-		v = BLI_ghash_lookup(ghash, data_bis);
+		v = test_hash_lookup(ghash, data_bis);
 		EXPECT_EQ(GET_INT_FROM_POINTER(v), data_bis[0]);
 
 		for (p = w = c = data_bis; *c; c++) {
 			if (*c == '.') {
 				*c = '\0';
-				v = BLI_ghash_lookup(ghash, w);
+				v = test_hash_lookup(ghash, w);
 				EXPECT_EQ(GET_INT_FROM_POINTER(v), w[0]);
-				v = BLI_ghash_lookup(ghash, p);
+				v = test_hash_lookup(ghash, p);
 				EXPECT_EQ(GET_INT_FROM_POINTER(v), p[0]);
 				p = w = c + 1;
 			}
 			else if (*c == ' ') {
 				*c = '\0';
-				v = BLI_ghash_lookup(ghash, w);
+				v = test_hash_lookup(ghash, w);
 				EXPECT_EQ(GET_INT_FROM_POINTER(v), w[0]);
 				w = c + 1;
 			}
@@ -140,7 +191,7 @@ static void str_ghash_tests(GHash *ghash, const char *id)
 		TIMEIT_END(string_lookup);
 	}
 
-	BLI_ghash_free(ghash, NULL, NULL);
+	test_hash_free(ghash);
 	MEM_freeN(data);
 	MEM_freeN(data_p);
 	MEM_freeN(data_w);
@@ -163,10 +214,18 @@ TEST(ghash, TextMurmur2a)
 	str_ghash_tests(ghash, "StrGHash - Murmur");
 }
 
+TEST(ohash, TextOHash)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_strhash_p, BLI_ghashutil_strcmp, __func__);
+
+	str_ghash_tests(ohash, "StrGHash - OHash");
+}
+
 
 /* Int: uniform 100M first integers. */
 
-static void int_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr)
+template <typename HashT>
+static void int_ghash_tests(HashT *ghash, const char *id, const unsigned int nbr)
 {
 	printf("\n========== STARTING %s ==========\n", id);
 
@@ -176,17 +235,17 @@ static void int_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr
 		TIMEIT_START(int_insert);
 
 #ifdef GHASH_RESERVE
-		BLI_ghash_reserve(ghash, nbr);
+		test_hash_reserve(ghash, nbr);
 #endif
 
 		while (i--) {
-			BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i));
+			test_hash_insert(ghash, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i));
 		}
 
 		TIMEIT_END(int_insert);
 	}
 
-	PRINTF_GHASH_STATS(ghash);
+	test_hash_print_stats(ghash);
 
 	{
 		unsigned int i = nbr;
@@ -194,7 +253,7 @@ static void int_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr
 		TIMEIT_START(int_lookup);
 
 		while (i--) {
-			void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(i));
+			void *v = test_hash_lookup(ghash, SET_UINT_IN_POINTER(i));
 			EXPECT_EQ(GET_UINT_FROM_POINTER(v), i);
 		}
 
@@ -202,21 +261,15 @@ static void int_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr
 	}
 
 	{
-		void *k, *v;
-
 		TIMEIT_START(int_pop);
 
-		GHashIterState pop_state = {0};
-
-		while (BLI_ghash_pop(ghash, &pop_state, &k, &v)) {
-			EXPECT_EQ(k, v);
-		}
+		test_hash_pop_all(ghash);
 
 		TIMEIT_END(int_pop);
 	}
-	EXPECT_EQ(BLI_ghash_size(ghash), 0);
+	EXPECT_EQ(test_hash_size(ghash), 0);
 
-	BLI_ghash_free(ghash, NULL, NULL);
+	test_hash_free(ghash);
 
 	printf("========== ENDED %s ==========\n\n", id);
 }
@@ -253,9 +306,26 @@ TEST(ghash, IntMurmur2a100000000)
 }
 #endif
 
+TEST(ohash, IntOHash12000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	int_ghash_tests(ohash, "IntGHash - OHash - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ohash, IntOHash100000000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	int_ghash_tests(ohash, "IntGHash - OHash - 100000000", 100000000);
+}
+#endif
+
 /* Int: random 50M integers. */
 
-static void randint_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr)
+template <typename HashT>
+static void randint_ghash_tests(HashT *ghash, const char *id, const unsigned int nbr)
 {
 	printf("\n========== STARTING %s ==========\n", id);
 
@@ -275,30 +345,30 @@ static void randint_ghash_tests(GHash *ghash, const char *id, const unsigned int
 		TIMEIT_START(int_insert);
 
 #ifdef GHASH_RESERVE
-		BLI_ghash_reserve(ghash, nbr);
+		test_hash_reserve(ghash, nbr);
 #endif
 
 		for (i = nbr, dt = data; i--; dt++) {
-			BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt));
+			test_hash_insert(ghash, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt));
 		}
 
 		TIMEIT_END(int_insert);
 	}
 
-	PRINTF_GHASH_STATS(ghash);
+	test_hash_print_stats(ghash);
 
 	{
 		TIMEIT_START(int_lookup);
 
 		for (i = nbr, dt = data; i--; dt++) {
-			void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(*dt));
+			void *v = test_hash_lookup(ghash, SET_UINT_IN_POINTER(*dt));
 			EXPECT_EQ(GET_UINT_FROM_POINTER(v), *dt);
 		}
 
 		TIMEIT_END(int_lookup);
 	}
 
-	BLI_ghash_free(ghash, NULL, NULL);
+	test_hash_free(ghash);
 
 	printf("========== ENDED %s ==========\n\n", id);
 }
@@ -335,6 +405,22 @@ TEST(ghash, IntRandMurmur2a50000000)
 }
 #endif
 
+TEST(ohash, IntRandOHash12000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	randint_ghash_tests(ohash, "RandIntGHash - OHash - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ohash, IntRandOHash50000000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	randint_ghash_tests(ohash, "RandIntGHash - OHash - 50000000", 50000000);
+}
+#endif
+
 static unsigned int ghashutil_tests_nohash_p(const void *p)
 {
 	return GET_UINT_FROM_POINTER(p);
@@ -361,9 +447,17 @@ TEST(ghash, Int4NoHash50000000)
 }
 #endif
 
+TEST(ohash, Int4NoHash12000)
+{
+	OHash *ohash = BLI_ohash_new(ghashutil_tests_nohash_p, ghashutil_tests_cmp_p, __func__);
+
+	randint_ghash_tests(ohash, "RandIntGHash - OHash No Hash - 12000", 12000);
+}
+
 /* Int_v4: 20M of randomly-generated integer vectors. */
 
-static void int4_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr)
+template <typename HashT>
+static void int4_ghash_tests(HashT *ghash, const char *id, const unsigned int nbr)
 {
 	printf("\n========== STARTING %s ==========\n", id);
 
@@ -386,30 +480,30 @@ static void int4_ghash_tests(GHash *ghash, const char *id, const unsigned int nb
 		TIMEIT_START(int_v4_insert);
 
 #ifdef GHASH_RESERVE
-		BLI_ghash_reserve(ghash, nbr);
+		test_hash_reserve(ghash, nbr);
 #endif
 
 		for (i = nbr, dt = data; i--; dt++) {
-			BLI_ghash_insert(ghash, *dt, SET_UINT_IN_POINTER(i));
+			test_hash_insert(ghash, *dt, SET_UINT_IN_POINTER(i));
 		}
 
 		TIMEIT_END(int_v4_insert);
 	}
 
-	PRINTF_GHASH_STATS(ghash);
+	test_hash_print_stats(ghash);
 
 	{
 		TIMEIT_START(int_v4_lookup);
 
 		for (i = nbr, dt = data; i--; dt++) {
-			void *v = BLI_ghash_lookup(ghash, (void *)(*dt));
+			void *v = test_hash_lookup(ghash, (void *)(*dt));
 			EXPECT_EQ(GET_UINT_FROM_POINTER(v), i);
 		}
 
 		TIMEIT_END(int_v4_lookup);
 	}
 
-	BLI_ghash_free(ghash, NULL, NULL);
+	test_hash_free(ghash);
 	MEM_freeN(data);
 
 	printf("========== ENDED %s ==========\n\n", id);
@@ -447,9 +541,26 @@ TEST(ghash, Int4Murmur2a20000000)
 }
 #endif
 
+TEST(ohash, Int4OHash2000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_uinthash_v4_p, BLI_ghashutil_uinthash_v4_cmp, __func__);
+
+	int4_ghash_tests(ohash, "Int4GHash - OHash - 2000", 2000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ohash, Int4OHash20000000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_uinthash_v4_p, BLI_ghashutil_uinthash_v4_cmp, __func__);
+
+	int4_ghash_tests(ohash, "Int4GHash - OHash - 20000000", 20000000);
+}
+#endif
+
 /* MultiSmall: create and manipulate a lot of very small ghashes (90% < 10 items, 9% < 100 items, 1% < 1000 items). */
 
-static void multi_small_ghash_tests_one(GHash *ghash, RNG *rng, const unsigned int nbr)
+template <typename HashT>
+static void multi_small_ghash_tests_one(HashT *ghash, RNG *rng, const unsigned int nbr)
 {
 	unsigned int *data = (unsigned int *)MEM_mallocN(sizeof(*data) * (size_t)nbr, __func__);
 	unsigned int *dt;
@@ -460,22 +571,23 @@ static void multi_small_ghash_tests_one(GHash *ghash, RNG *rng, const unsigned i
 	}
 
 #ifdef GHASH_RESERVE
-	BLI_ghash_reserve(ghash, nbr);
+	test_hash_reserve(ghash, nbr);
 #endif
 
 	for (i = nbr, dt = data; i--; dt++) {
-		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt));
+		test_hash_insert(ghash, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt));
 	}
 
 	for (i = nbr, dt = data; i--; dt++) {
-		void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(*dt));
+		void *v = test_hash_lookup(ghash, SET_UINT_IN_POINTER(*dt));
 		EXPECT_EQ(GET_UINT_FROM_POINTER(v), *dt);
 	}
 
-	BLI_ghash_clear(ghash, NULL, NULL);
+	test_hash_clear(ghash);
 }
 
-static void multi_small_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr)
+template <typename HashT>
+static void multi_small_ghash_tests(HashT *ghash, const char *id, const unsigned int nbr)
 {
 	printf("\n========== STARTING %s ==========\n", id);
 
@@ -501,7 +613,7 @@ static void multi_small_ghash_tests(GHash *ghash, const char *id, const unsigned
 
 	TIMEIT_END(multi_small2_ghash);
 
-	BLI_ghash_free(ghash, NULL, NULL);
+	test_hash_free(ghash);
 	BLI_rng_free(rng);
 
 	printf("========== ENDED %s ==========\n\n", id);
@@ -534,3 +646,17 @@ TEST(ghash, MultiRandIntMurmur2a200000)
 
 	multi_small_ghash_tests(ghash, "MultiSmall RandIntGHash - Murmur2a - 200000", 200000);
 }
+
+TEST(ohash, MultiRandIntOHash2000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	multi_small_ghash_tests(ohash, "MultiSmall RandIntGHash - OHash - 2000", 2000);
+}
+
+TEST(ohash, MultiRandIntOHash200000)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	multi_small_ghash_tests(ohash, "MultiSmall RandIntGHash - OHash - 200000", 200000);
+}
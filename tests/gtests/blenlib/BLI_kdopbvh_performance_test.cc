@@ -0,0 +1,321 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "PIL_time.h"
+}
+
+/* Rings and segments of the UV sphere, giving about 1M triangles.
+ * Triangles get small and thin towards the poles, like on real meshes detail isn't spread evenly. */
+#define SPHERE_RINGS 708
+#define SPHERE_SEGMENTS 708
+
+#define NUM_QUERIES 200000
+
+/* Same as the looptri trees built by bvhutils. */
+#define TREE_TYPE 4
+#define TREE_AXIS 6
+
+typedef struct TestMesh {
+	float (*verts)[3];
+	unsigned int (*tris)[3];
+	int verts_num;
+	int tris_num;
+} TestMesh;
+
+static void test_mesh_sphere(TestMesh *mesh)
+{
+	mesh->verts_num = (SPHERE_RINGS + 1) * SPHERE_SEGMENTS;
+	mesh->tris_num = SPHERE_RINGS * SPHERE_SEGMENTS * 2;
+	mesh->verts = (float (*)[3])MEM_mallocN(sizeof(*mesh->verts) * (size_t)mesh->verts_num, __func__);
+	mesh->tris = (unsigned int (*)[3])MEM_mallocN(sizeof(*mesh->tris) * (size_t)mesh->tris_num, __func__);
+
+	for (int i = 0; i <= SPHERE_RINGS; i++) {
+		const float theta = (float)M_PI * (float)i / (float)SPHERE_RINGS;
+		for (int j = 0; j < SPHERE_SEGMENTS; j++) {
+			const float phi = 2.0f * (float)M_PI * (float)j / (float)SPHERE_SEGMENTS;
+			/* Some bumps so the surface isn't perfectly smooth. */
+			const float radius = 1.0f + 0.05f * sinf(theta * 23.0f) * cosf(phi * 17.0f);
+			float *co = mesh->verts[i * SPHERE_SEGMENTS + j];
+			co[0] = radius * sinf(theta) * cosf(phi);
+			co[1] = radius * sinf(theta) * sinf(phi);
+			co[2] = radius * cosf(theta);
+		}
+	}
+
+	unsigned int (*tri)[3] = mesh->tris;
+	for (int i = 0; i < SPHERE_RINGS; i++) {
+		for (int j = 0; j < SPHERE_SEGMENTS; j++, tri += 2) {
+			const unsigned int v1 = (unsigned int)(i * SPHERE_SEGMENTS + j);
+			const unsigned int v2 = (unsigned int)(i * SPHERE_SEGMENTS + (j + 1) % SPHERE_SEGMENTS);
+			const unsigned int v3 = v2 + SPHERE_SEGMENTS;
+			const unsigned int v4 = v1 + SPHERE_SEGMENTS;
+			ARRAY_SET_ITEMS(tri[0], v1, v2, v3);
+			ARRAY_SET_ITEMS(tri[1], v1, v3, v4);
+		}
+	}
+}
+
+static void test_mesh_free(TestMesh *mesh)
+{
+	MEM_freeN(mesh->verts);
+	MEM_freeN(mesh->tris);
+}
+
+/* Nearest point and ray-cast callbacks, the same as the bvhutils looptri ones. */
+
+static void test_mesh_nearest_point(void *userdata, int index, const float co[3], BVHTreeNearest *nearest)
+{
+	const TestMesh *mesh = (const TestMesh *)userdata;
+	const unsigned int *tri = mesh->tris[index];
+	float nearest_tmp[3], dist_sq;
+
+	closest_on_tri_to_point_v3(nearest_tmp, co, mesh->verts[tri[0]], mesh->verts[tri[1]], mesh->verts[tri[2]]);
+	dist_sq = len_squared_v3v3(co, nearest_tmp);
+
+	if (dist_sq < nearest->dist_sq) {
+		nearest->index = index;
+		nearest->dist_sq = dist_sq;
+		copy_v3_v3(nearest->co, nearest_tmp);
+		normal_tri_v3(nearest->no, mesh->verts[tri[0]], mesh->verts[tri[1]], mesh->verts[tri[2]]);
+	}
+}
+
+static void test_mesh_raycast(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const TestMesh *mesh = (const TestMesh *)userdata;
+	const unsigned int *tri = mesh->tris[index];
+	float dist;
+
+	if (isect_ray_tri_watertight_v3(ray->origin, ray->isect_precalc,
+	                                mesh->verts[tri[0]], mesh->verts[tri[1]], mesh->verts[tri[2]], &dist, NULL) &&
+	    dist >= 0.0f && dist < hit->dist)
+	{
+		hit->index = index;
+		hit->dist = dist;
+		madd_v3_v3v3fl(hit->co, ray->origin, ray->direction, dist);
+		normal_tri_v3(hit->no, mesh->verts[tri[0]], mesh->verts[tri[1]], mesh->verts[tri[2]]);
+	}
+}
+
+static BVHTree *test_mesh_tree(TestMesh *mesh, int flag)
+{
+	BVHTree *tree = BLI_bvhtree_new_ex(mesh->tris_num, 0.0f, TREE_TYPE, TREE_AXIS, flag);
+
+	for (int i = 0; i < mesh->tris_num; i++) {
+		float co[3][3];
+		copy_v3_v3(co[0], mesh->verts[mesh->tris[i][0]]);
+		copy_v3_v3(co[1], mesh->verts[mesh->tris[i][1]]);
+		copy_v3_v3(co[2], mesh->verts[mesh->tris[i][2]]);
+		BLI_bvhtree_insert(tree, i, co[0], 3);
+	}
+
+	const double time_start = PIL_check_seconds_timer();
+	BLI_bvhtree_balance(tree);
+	printf("  balance:      %.3fs\n", PIL_check_seconds_timer() - time_start);
+
+	return tree;
+}
+
+/* Points around the surface, like shrinkwrap or data transfer look up. */
+static float (*test_points_new(void))[3]
+{
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * NUM_QUERIES, __func__);
+	RNG *rng = BLI_rng_new(0);
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		BLI_rng_get_float_unit_v3(rng, points[i]);
+		mul_v3_fl(points[i], 0.75f + 0.5f * BLI_rng_get_float(rng));
+	}
+
+	BLI_rng_free(rng);
+	return points;
+}
+
+/* Rays from outside towards the mesh, like snapping or projecting does. */
+static void test_rays_new(float (**r_origins)[3], float (**r_dirs)[3])
+{
+	float (*origins)[3] = (float (*)[3])MEM_mallocN(sizeof(*origins) * NUM_QUERIES, __func__);
+	float (*dirs)[3] = (float (*)[3])MEM_mallocN(sizeof(*dirs) * NUM_QUERIES, __func__);
+	RNG *rng = BLI_rng_new(0);
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		float target[3];
+		BLI_rng_get_float_unit_v3(rng, origins[i]);
+		mul_v3_fl(origins[i], 3.0f);
+		BLI_rng_get_float_unit_v3(rng, target);
+		mul_v3_fl(target, 0.5f);
+		sub_v3_v3v3(dirs[i], target, origins[i]);
+		normalize_v3(dirs[i]);
+	}
+
+	BLI_rng_free(rng);
+	*r_origins = origins;
+	*r_dirs = dirs;
+}
+
+static void test_find_nearest(BVHTree *tree, TestMesh *mesh, const float (*points)[3], float *r_dist_sq)
+{
+	const double time_start = PIL_check_seconds_timer();
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		BVHTreeNearest nearest;
+		nearest.index = -1;
+		nearest.dist_sq = FLT_MAX;
+		BLI_bvhtree_find_nearest(tree, points[i], &nearest, test_mesh_nearest_point, mesh);
+		r_dist_sq[i] = nearest.dist_sq;
+	}
+
+	printf("  find nearest: %.3fs\n", PIL_check_seconds_timer() - time_start);
+}
+
+static void test_find_nearest_batch(BVHTree *tree, TestMesh *mesh, const float (*points)[3], float *r_dist_sq)
+{
+	BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest) * NUM_QUERIES, __func__);
+
+	const double time_start = PIL_check_seconds_timer();
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		nearest[i].index = -1;
+		nearest[i].dist_sq = FLT_MAX;
+	}
+	BLI_bvhtree_find_nearest_batch(tree, points, NUM_QUERIES, nearest, test_mesh_nearest_point, mesh);
+
+	printf("  find nearest (batch): %.3fs\n", PIL_check_seconds_timer() - time_start);
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		r_dist_sq[i] = nearest[i].dist_sq;
+	}
+	MEM_freeN(nearest);
+}
+
+static void test_ray_cast(
+        BVHTree *tree, TestMesh *mesh, const float (*origins)[3], const float (*dirs)[3], float *r_dist)
+{
+	const double time_start = PIL_check_seconds_timer();
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		BVHTreeRayHit hit;
+		hit.index = -1;
+		hit.dist = BVH_RAYCAST_DIST_MAX;
+		BLI_bvhtree_ray_cast(tree, origins[i], dirs[i], 0.0f, &hit, test_mesh_raycast, mesh);
+		r_dist[i] = hit.dist;
+	}
+
+	printf("  ray cast:     %.3fs\n", PIL_check_seconds_timer() - time_start);
+}
+
+static void test_ray_cast_batch(
+        BVHTree *tree, TestMesh *mesh, const float (*origins)[3], const float (*dirs)[3], float *r_dist)
+{
+	BVHTreeRayHit *hit = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit) * NUM_QUERIES, __func__);
+
+	const double time_start = PIL_check_seconds_timer();
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		hit[i].index = -1;
+		hit[i].dist = BVH_RAYCAST_DIST_MAX;
+	}
+	BLI_bvhtree_ray_cast_batch(
+	        tree, origins, dirs, NUM_QUERIES, 0.0f, hit, test_mesh_raycast, mesh, BVH_RAYCAST_DEFAULT);
+
+	printf("  ray cast (batch):     %.3fs\n", PIL_check_seconds_timer() - time_start);
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		r_dist[i] = hit[i].dist;
+	}
+	MEM_freeN(hit);
+}
+
+TEST(kdopbvh, MeshQueries)
+{
+	TestMesh mesh;
+	test_mesh_sphere(&mesh);
+
+	printf("\n========== STARTING kdopbvh mesh queries (%d triangles) ==========\n", mesh.tris_num);
+
+	float (*points)[3] = test_points_new();
+	float (*origins)[3], (*dirs)[3];
+	test_rays_new(&origins, &dirs);
+
+	float *dist_sq_median = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+	float *dist_sq_sah = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+	float *dist_median = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+	float *dist_sah = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+
+	printf("Median split:\n");
+	BVHTree *tree = test_mesh_tree(&mesh, 0);
+	test_find_nearest(tree, &mesh, points, dist_sq_median);
+	test_ray_cast(tree, &mesh, origins, dirs, dist_median);
+	BLI_bvhtree_free(tree);
+
+	printf("SAH:\n");
+	tree = test_mesh_tree(&mesh, BVH_TREE_SAH);
+	test_find_nearest(tree, &mesh, points, dist_sq_sah);
+	test_ray_cast(tree, &mesh, origins, dirs, dist_sah);
+	BLI_bvhtree_free(tree);
+
+	/* Both trees must find the same nearest points and hits. */
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		EXPECT_EQ(dist_sq_median[i], dist_sq_sah[i]);
+		EXPECT_EQ(dist_median[i], dist_sah[i]);
+	}
+
+	MEM_freeN(dist_sq_median);
+	MEM_freeN(dist_sq_sah);
+	MEM_freeN(dist_median);
+	MEM_freeN(dist_sah);
+	MEM_freeN(points);
+	MEM_freeN(origins);
+	MEM_freeN(dirs);
+	test_mesh_free(&mesh);
+
+	printf("========== ENDED kdopbvh mesh queries ==========\n\n");
+}
+
+TEST(kdopbvh, MeshQueriesBatch)
+{
+	TestMesh mesh;
+	test_mesh_sphere(&mesh);
+
+	printf("\n========== STARTING kdopbvh batched mesh queries (%d triangles) ==========\n", mesh.tris_num);
+
+	float (*points)[3] = test_points_new();
+	float (*origins)[3], (*dirs)[3];
+	test_rays_new(&origins, &dirs);
+
+	float *dist_sq = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+	float *dist_sq_batch = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+	float *dist = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+	float *dist_batch = (float *)MEM_mallocN(sizeof(float) * NUM_QUERIES, __func__);
+
+	BVHTree *tree = test_mesh_tree(&mesh, 0);
+	test_find_nearest(tree, &mesh, points, dist_sq);
+	test_find_nearest_batch(tree, &mesh, points, dist_sq_batch);
+	test_ray_cast(tree, &mesh, origins, dirs, dist);
+	test_ray_cast_batch(tree, &mesh, origins, dirs, dist_batch);
+	BLI_bvhtree_free(tree);
+
+	/* Batched queries must give the same results as single ones. */
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		EXPECT_EQ(dist_sq[i], dist_sq_batch[i]);
+		EXPECT_EQ(dist[i], dist_batch[i]);
+	}
+
+	MEM_freeN(dist_sq);
+	MEM_freeN(dist_sq_batch);
+	MEM_freeN(dist);
+	MEM_freeN(dist_batch);
+	MEM_freeN(points);
+	MEM_freeN(origins);
+	MEM_freeN(dirs);
+	test_mesh_free(&mesh);
+
+	printf("========== ENDED kdopbvh batched mesh queries ==========\n\n");
+}
@@ -0,0 +1,240 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+}
+
+#define TRIS_NUM 20000
+#define QUERIES_NUM 5000
+
+/* More than 4 children per branch, so the tree is only traversed by the scalar code. */
+#define TREE_TYPE_SCALAR 8
+#define TREE_AXIS 6
+
+typedef struct TestMesh {
+	float (*verts)[3];
+	int tris_num;
+} TestMesh;
+
+/* Soup of small triangles with random orientation in the unit cube. */
+static void test_mesh_random(TestMesh *mesh, RNG *rng)
+{
+	mesh->tris_num = TRIS_NUM;
+	mesh->verts = (float (*)[3])MEM_mallocN(sizeof(*mesh->verts) * 3 * TRIS_NUM, __func__);
+
+	for (int i = 0; i < TRIS_NUM; i++) {
+		float center[3];
+		BLI_rng_get_float_unit_v3(rng, center);
+		mul_v3_fl(center, 0.5f);
+		add_v3_fl(center, 0.5f);
+
+		for (int j = 0; j < 3; j++) {
+			float offset[3];
+			BLI_rng_get_float_unit_v3(rng, offset);
+			madd_v3_v3v3fl(mesh->verts[i * 3 + j], center, offset, 0.02f);
+		}
+	}
+}
+
+static void test_mesh_free(TestMesh *mesh)
+{
+	MEM_freeN(mesh->verts);
+}
+
+static void test_mesh_nearest_point(void *userdata, int index, const float co[3], BVHTreeNearest *nearest)
+{
+	const TestMesh *mesh = (const TestMesh *)userdata;
+	const float (*tri)[3] = &mesh->verts[index * 3];
+	float nearest_tmp[3], dist_sq;
+
+	closest_on_tri_to_point_v3(nearest_tmp, co, tri[0], tri[1], tri[2]);
+	dist_sq = len_squared_v3v3(co, nearest_tmp);
+
+	if (dist_sq < nearest->dist_sq) {
+		nearest->index = index;
+		nearest->dist_sq = dist_sq;
+		copy_v3_v3(nearest->co, nearest_tmp);
+	}
+}
+
+static void test_mesh_raycast(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const TestMesh *mesh = (const TestMesh *)userdata;
+	const float (*tri)[3] = &mesh->verts[index * 3];
+	float dist;
+
+	if (isect_ray_tri_watertight_v3(ray->origin, ray->isect_precalc, tri[0], tri[1], tri[2], &dist, NULL) &&
+	    dist >= 0.0f && dist < hit->dist)
+	{
+		hit->index = index;
+		hit->dist = dist;
+		madd_v3_v3v3fl(hit->co, ray->origin, ray->direction, dist);
+	}
+}
+
+static BVHTree *test_mesh_tree(const TestMesh *mesh, int tree_type, int flag)
+{
+	BVHTree *tree = BLI_bvhtree_new_ex(mesh->tris_num, 0.0f, (char)tree_type, TREE_AXIS, flag);
+
+	for (int i = 0; i < mesh->tris_num; i++) {
+		BLI_bvhtree_insert(tree, i, mesh->verts[i * 3], 3);
+	}
+	BLI_bvhtree_balance(tree);
+
+	return tree;
+}
+
+/* Points in and around the mesh, rays from outside through it. */
+static void test_queries_random(RNG *rng, float (*r_points)[3], float (*r_origins)[3], float (*r_dirs)[3])
+{
+	for (int i = 0; i < QUERIES_NUM; i++) {
+		float target[3];
+		BLI_rng_get_float_unit_v3(rng, r_points[i]);
+		madd_v3_v3fl(r_points[i], r_points[i], 0.75f * BLI_rng_get_float(rng));
+		add_v3_fl(r_points[i], 0.5f);
+
+		BLI_rng_get_float_unit_v3(rng, r_origins[i]);
+		mul_v3_fl(r_origins[i], 2.0f);
+		add_v3_fl(r_origins[i], 0.5f);
+		BLI_rng_get_float_unit_v3(rng, target);
+		mul_v3_fl(target, 0.5f * BLI_rng_get_float(rng));
+		add_v3_fl(target, 0.5f);
+		sub_v3_v3v3(r_dirs[i], target, r_origins[i]);
+		normalize_v3(r_dirs[i]);
+	}
+}
+
+static void test_results_init(BVHTreeNearest *r_nearest, BVHTreeRayHit *r_hit)
+{
+	for (int i = 0; i < QUERIES_NUM; i++) {
+		r_nearest[i].index = -1;
+		r_nearest[i].dist_sq = FLT_MAX;
+		r_hit[i].index = -1;
+		r_hit[i].dist = BVH_RAYCAST_DIST_MAX;
+	}
+}
+
+static void test_queries(
+        BVHTree *tree, TestMesh *mesh,
+        const float (*points)[3], const float (*origins)[3], const float (*dirs)[3],
+        BVHTreeNearest *r_nearest, BVHTreeRayHit *r_hit)
+{
+	test_results_init(r_nearest, r_hit);
+
+	for (int i = 0; i < QUERIES_NUM; i++) {
+		BLI_bvhtree_find_nearest(tree, points[i], &r_nearest[i], test_mesh_nearest_point, mesh);
+		BLI_bvhtree_ray_cast(tree, origins[i], dirs[i], 0.0f, &r_hit[i], test_mesh_raycast, mesh);
+	}
+}
+
+/* Same as #test_queries, running all queries at once. */
+static void test_queries_batch(
+        BVHTree *tree, TestMesh *mesh,
+        const float (*points)[3], const float (*origins)[3], const float (*dirs)[3],
+        BVHTreeNearest *r_nearest, BVHTreeRayHit *r_hit)
+{
+	test_results_init(r_nearest, r_hit);
+
+	/* Reuse the order of the points for the rays, as callers sharing an order between batches do,
+	 * any order gives the same results. */
+	int *order = BLI_bvhtree_batch_order_new(points, QUERIES_NUM);
+
+	BLI_bvhtree_find_nearest_batch_ex(
+	        tree, points, QUERIES_NUM, r_nearest, test_mesh_nearest_point, mesh, order);
+	BLI_bvhtree_ray_cast_batch_ex(
+	        tree, origins, dirs, QUERIES_NUM, 0.0f, r_hit, test_mesh_raycast, mesh, BVH_RAYCAST_DEFAULT, order);
+
+	MEM_freeN(order);
+}
+
+typedef void (*TestQueriesFn)(
+        BVHTree *tree, TestMesh *mesh,
+        const float (*points)[3], const float (*origins)[3], const float (*dirs)[3],
+        BVHTreeNearest *r_nearest, BVHTreeRayHit *r_hit);
+
+/**
+ * Compare queries run with \a queries_fn on a tree of \a tree_type built with \a flag against single queries on
+ * a median split tree only traversed by the scalar code, both must find the same nearest points and ray hits.
+ */
+static void test_compare_to_scalar_ex(int tree_type, int flag, TestQueriesFn queries_fn)
+{
+	RNG *rng = BLI_rng_new(0);
+
+	TestMesh mesh;
+	test_mesh_random(&mesh, rng);
+
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * QUERIES_NUM, __func__);
+	float (*origins)[3] = (float (*)[3])MEM_mallocN(sizeof(*origins) * QUERIES_NUM, __func__);
+	float (*dirs)[3] = (float (*)[3])MEM_mallocN(sizeof(*dirs) * QUERIES_NUM, __func__);
+	test_queries_random(rng, points, origins, dirs);
+
+	BVHTreeNearest *nearest_ref = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest_ref) * QUERIES_NUM, __func__);
+	BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest) * QUERIES_NUM, __func__);
+	BVHTreeRayHit *hit_ref = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit_ref) * QUERIES_NUM, __func__);
+	BVHTreeRayHit *hit = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit) * QUERIES_NUM, __func__);
+
+	BVHTree *tree = test_mesh_tree(&mesh, TREE_TYPE_SCALAR, 0);
+	test_queries(tree, &mesh, points, origins, dirs, nearest_ref, hit_ref);
+	BLI_bvhtree_free(tree);
+
+	tree = test_mesh_tree(&mesh, tree_type, flag);
+	queries_fn(tree, &mesh, points, origins, dirs, nearest, hit);
+	BLI_bvhtree_free(tree);
+
+	int hits_num = 0;
+	for (int i = 0; i < QUERIES_NUM; i++) {
+		EXPECT_NE(nearest_ref[i].index, -1);
+		EXPECT_EQ(nearest_ref[i].dist_sq, nearest[i].dist_sq);
+		EXPECT_EQ(hit_ref[i].index == -1, hit[i].index == -1);
+		EXPECT_EQ(hit_ref[i].dist, hit[i].dist);
+
+		if (hit_ref[i].index != -1) {
+			hits_num++;
+		}
+	}
+
+	/* Most rays go through the middle of the mesh. */
+	EXPECT_GT(hits_num, QUERIES_NUM / 2);
+
+	MEM_freeN(nearest_ref);
+	MEM_freeN(nearest);
+	MEM_freeN(hit_ref);
+	MEM_freeN(hit);
+	MEM_freeN(points);
+	MEM_freeN(origins);
+	MEM_freeN(dirs);
+	test_mesh_free(&mesh);
+	BLI_rng_free(rng);
+}
+
+static void test_compare_to_scalar(int tree_type, int flag)
+{
+	test_compare_to_scalar_ex(tree_type, flag, test_queries);
+}
+
+TEST(kdopbvh, MedianQuad)
+{
+	test_compare_to_scalar(4, 0);
+}
+
+TEST(kdopbvh, SAHBinary)
+{
+	test_compare_to_scalar(2, BVH_TREE_SAH);
+}
+
+TEST(kdopbvh, SAHQuad)
+{
+	test_compare_to_scalar(4, BVH_TREE_SAH);
+}
+
+/* The queries make fewer batch chunks than one chunk of a parallel range, which must still run. */
+TEST(kdopbvh, BatchQuad)
+{
+	test_compare_to_scalar_ex(4, 0, test_queries_batch);
+}
@@ -0,0 +1,329 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#define GHASH_INTERNAL_API
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_ohash.h"
+#include "BLI_rand.h"
+}
+
+#define TESTCASE_SIZE 10000
+
+/* Note: same as in BLI_ghash_test.cc, keys are mere random integers stored in pointers. */
+
+static void init_keys(unsigned int keys[TESTCASE_SIZE], const int seed)
+{
+	RNG *rng = BLI_rng_new(seed);
+	unsigned int *k;
+	int i;
+
+	for (i = 0, k = keys; i < TESTCASE_SIZE; ) {
+		/* Risks of collision are low, but they do exist. */
+		unsigned int t = BLI_rng_get_uint(rng);
+		int j;
+		for (j = i; j--; ) {
+			if (keys[j] == t) {
+				break;
+			}
+		}
+		if (j != -1) {
+			continue;
+		}
+		*k = t;
+		i++;
+		k++;
+	}
+	BLI_rng_free(rng);
+}
+
+/* Here we simply insert and then lookup all keys, ensuring we do get back the expected stored 'data'. */
+TEST(ohash, InsertLookup)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 0);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ohash_lookup(ohash, SET_UINT_IN_POINTER(*k));
+		EXPECT_EQ(GET_UINT_FROM_POINTER(v), *k);
+	}
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Here we simply insert and then remove all keys, ensuring we do get an empty, unshrinked ohash. */
+TEST(ohash, InsertRemove)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, slots_size;
+
+	init_keys(keys, 10);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE);
+	slots_size = BLI_ohash_slots_size(ohash);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ohash_popkey(ohash, SET_UINT_IN_POINTER(*k), NULL);
+		EXPECT_EQ(GET_UINT_FROM_POINTER(v), *k);
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), 0);
+	EXPECT_EQ(BLI_ohash_slots_size(ohash), slots_size);
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Same as above, but this time we allow ohash to shrink. */
+TEST(ohash, InsertRemoveShrink)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, slots_size;
+
+	BLI_ohash_flag_set(ohash, GHASH_FLAG_ALLOW_SHRINK);
+	init_keys(keys, 20);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE);
+	slots_size = BLI_ohash_slots_size(ohash);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ohash_popkey(ohash, SET_UINT_IN_POINTER(*k), NULL);
+		EXPECT_EQ(GET_UINT_FROM_POINTER(v), *k);
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), 0);
+	EXPECT_LT(BLI_ohash_slots_size(ohash), slots_size);
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Keep inserting and removing keys, deleted slots must be reused or dropped instead of growing the table. */
+TEST(ohash, InsertRemoveChurn)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE];
+	/* Exactly the load limit of 128 slots (7/8), so every deleted slot left by a removal
+	 * uses up the last free slot and the next insert has to rebuild the table. */
+	const int nentries = 112;
+	int i, j;
+
+	init_keys(keys, 40);
+
+	for (i = 0; i < nentries; i++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(keys[i]));
+	}
+
+	EXPECT_EQ(BLI_ohash_slots_size(ohash), 128);
+
+	for (i = nentries; i < TESTCASE_SIZE; i++) {
+		EXPECT_TRUE(BLI_ohash_remove(ohash, SET_UINT_IN_POINTER(keys[i - nentries]), NULL, NULL));
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(keys[i]));
+
+		/* A table at its limit must grow: rebuilding at 128 slots would leave no free slot,
+		 * and rebuild again on every insert. At 256 slots each rebuild is followed by at least
+		 * nentries inserts, so the total rebuild work stays linear in the number of inserts. */
+		if (i > nentries) {
+			EXPECT_EQ(BLI_ohash_slots_size(ohash), 256);
+		}
+
+		if (i % 1000 == 0) {
+			for (j = i - nentries + 1; j <= i; j++) {
+				void *v = BLI_ohash_lookup(ohash, SET_UINT_IN_POINTER(keys[j]));
+				EXPECT_EQ(GET_UINT_FROM_POINTER(v), keys[j]);
+			}
+			EXPECT_FALSE(BLI_ohash_haskey(ohash, SET_UINT_IN_POINTER(keys[i - nentries])));
+		}
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), nentries);
+	EXPECT_EQ(BLI_ohash_slots_size(ohash), 256);
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Check copy. */
+TEST(ohash, Copy)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	OHash *ohash_copy;
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 30);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE);
+
+	ohash_copy = BLI_ohash_copy(ohash, NULL, NULL);
+
+	EXPECT_EQ(BLI_ohash_size(ohash_copy), TESTCASE_SIZE);
+	EXPECT_EQ(BLI_ohash_slots_size(ohash_copy), BLI_ohash_slots_size(ohash));
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ohash_lookup(ohash_copy, SET_UINT_IN_POINTER(*k));
+		EXPECT_EQ(GET_UINT_FROM_POINTER(v), *k);
+	}
+
+	BLI_ohash_free(ohash, NULL, NULL);
+	BLI_ohash_free(ohash_copy, NULL, NULL);
+}
+
+/* Check pop. */
+TEST(ohash, Pop)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	BLI_ohash_flag_set(ohash, GHASH_FLAG_ALLOW_SHRINK);
+	init_keys(keys, 30);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE);
+
+	OHashIterState pop_state = {0};
+
+	for (i = TESTCASE_SIZE / 2; i--; ) {
+		void *k, *v;
+		bool success = BLI_ohash_pop(ohash, &pop_state, &k, &v);
+		EXPECT_EQ(k, v);
+		EXPECT_TRUE(success);
+
+		if (i % 2) {
+			BLI_ohash_reinsert(ohash, SET_UINT_IN_POINTER(i * 4), SET_UINT_IN_POINTER(i * 4), NULL, NULL);
+		}
+	}
+
+	{
+		void *k, *v;
+		while (BLI_ohash_pop(ohash, &pop_state, &k, &v)) {
+			EXPECT_EQ(k, v);
+		}
+	}
+	EXPECT_EQ(BLI_ohash_size(ohash), 0);
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Check iterating visits every entry once, also when removing the current entry. */
+TEST(ohash, Iterator)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	OHashIterator ohi;
+	unsigned int keys[TESTCASE_SIZE], *k;
+	uint64_t sum = 0, sum_iter = 0;
+	int i;
+
+	init_keys(keys, 50);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ohash_insert(ohash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+		sum += *k;
+	}
+
+	i = 0;
+	OHASH_ITER (ohi, ohash) {
+		EXPECT_EQ(BLI_ohashIterator_getKey(&ohi), BLI_ohashIterator_getValue(&ohi));
+		sum_iter += GET_UINT_FROM_POINTER(BLI_ohashIterator_getKey(&ohi));
+		i++;
+	}
+	EXPECT_EQ(i, TESTCASE_SIZE);
+	EXPECT_EQ(sum_iter, sum);
+
+	/* Remove every other entry while iterating. */
+	i = 0;
+	OHASH_ITER (ohi, ohash) {
+		if (i++ % 2) {
+			EXPECT_TRUE(BLI_ohash_remove(ohash, BLI_ohashIterator_getKey(&ohi), NULL, NULL));
+		}
+	}
+	EXPECT_EQ(i, TESTCASE_SIZE);
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE / 2);
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Check ensure_p, with values written through the returned pointers. */
+TEST(ohash, EnsureP)
+{
+	OHash *ohash = BLI_ohash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 60);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void **val_p;
+		EXPECT_FALSE(BLI_ohash_ensure_p(ohash, SET_UINT_IN_POINTER(*k), &val_p));
+		*val_p = SET_UINT_IN_POINTER(*k);
+	}
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void **val_p;
+		EXPECT_TRUE(BLI_ohash_ensure_p(ohash, SET_UINT_IN_POINTER(*k), &val_p));
+		EXPECT_EQ(GET_UINT_FROM_POINTER(*val_p), *k);
+	}
+
+	EXPECT_EQ(BLI_ohash_size(ohash), TESTCASE_SIZE);
+
+	BLI_ohash_free(ohash, NULL, NULL);
+}
+
+/* Check the set variant. */
+TEST(oset, AddHasKey)
+{
+	OSet *oset = BLI_oset_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	OSetIterator osi;
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 70);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_TRUE(BLI_oset_add(oset, SET_UINT_IN_POINTER(*k)));
+	}
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_FALSE(BLI_oset_add(oset, SET_UINT_IN_POINTER(*k)));
+		EXPECT_TRUE(BLI_oset_haskey(oset, SET_UINT_IN_POINTER(*k)));
+	}
+
+	EXPECT_EQ(BLI_oset_size(oset), TESTCASE_SIZE);
+
+	i = 0;
+	OSET_ITER (osi, oset) {
+		i++;
+	}
+	EXPECT_EQ(i, TESTCASE_SIZE);
+
+	BLI_oset_clear(oset, NULL);
+	EXPECT_EQ(BLI_oset_size(oset), 0);
+	EXPECT_FALSE(BLI_oset_haskey(oset, SET_UINT_IN_POINTER(keys[0])));
+
+	BLI_oset_free(oset, NULL);
+}
@@ -0,0 +1,143 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "atomic_ops.h"
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time.h"
+}
+
+/* Number of tasks of the flat test. */
+#define NUM_TASKS_FLAT 1000000
+
+/* Depth of the task tree, giving 2^(depth + 1) - 1 tasks. */
+#define TREE_DEPTH 19
+
+/* Amount of work done by each task, small enough for scheduling overhead
+ * to show up. */
+#define TASK_WORK 64
+
+typedef struct TaskTestData {
+	uint32_t num_done;
+	float result;
+} TaskTestData;
+
+static void task_work(TaskPool *pool)
+{
+	TaskTestData *data = (TaskTestData *)BLI_task_pool_userdata(pool);
+	float value = 0.0f;
+
+	for (int i = 0; i < TASK_WORK; i++) {
+		value = value * 0.5f + (float)i;
+	}
+
+	/* Avoid the work getting optimized out. */
+	if (value < 0.0f) {
+		data->result = value;
+	}
+
+	atomic_add_and_fetch_uint32(&data->num_done, 1);
+}
+
+static void task_flat_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(thread_id))
+{
+	task_work(pool);
+}
+
+/* Pushes its children from the thread running it, like dependency graph
+ * evaluation does. */
+static void task_tree_func(TaskPool *__restrict pool, void *taskdata, int thread_id)
+{
+	const int depth = GET_INT_FROM_POINTER(taskdata);
+
+	if (depth > 0) {
+		for (int i = 0; i < 2; i++) {
+			BLI_task_pool_push_from_thread(pool, task_tree_func, SET_INT_IN_POINTER(depth - 1),
+			                               false, TASK_PRIORITY_HIGH, thread_id);
+		}
+	}
+
+	task_work(pool);
+}
+
+static double task_flat_test(TaskScheduler *scheduler)
+{
+	TaskTestData data = {0, 0.0f};
+	TaskPool *pool = BLI_task_pool_create(scheduler, &data);
+
+	const double time_start = PIL_check_seconds_timer();
+
+	for (int i = 0; i < NUM_TASKS_FLAT; i++) {
+		BLI_task_pool_push_from_thread(pool, task_flat_func, NULL, false, TASK_PRIORITY_HIGH, 0);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	const double time = PIL_check_seconds_timer() - time_start;
+
+	BLI_task_pool_free(pool);
+
+	EXPECT_EQ(NUM_TASKS_FLAT, data.num_done);
+
+	return time;
+}
+
+static double task_tree_test(TaskScheduler *scheduler)
+{
+	TaskTestData data = {0, 0.0f};
+	TaskPool *pool = BLI_task_pool_create(scheduler, &data);
+
+	const double time_start = PIL_check_seconds_timer();
+
+	BLI_task_pool_push(pool, task_tree_func, SET_INT_IN_POINTER(TREE_DEPTH), false, TASK_PRIORITY_HIGH);
+	BLI_task_pool_work_and_wait(pool);
+
+	const double time = PIL_check_seconds_timer() - time_start;
+
+	BLI_task_pool_free(pool);
+
+	EXPECT_EQ((1u << (TREE_DEPTH + 1)) - 1, data.num_done);
+
+	return time;
+}
+
+TEST(task, Scaling)
+{
+	BLI_threadapi_init();
+
+	const int max_threads = BLI_system_thread_count();
+	double time_flat_single = 0.0, time_tree_single = 0.0;
+
+	printf("\n========== STARTING task scaling ==========\n");
+	printf("threads      flat (speedup)       tree (speedup)\n");
+
+	for (int num_threads = 1; ; num_threads = MIN2(num_threads * 2, max_threads)) {
+		TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+
+		const double time_flat = task_flat_test(scheduler);
+		const double time_tree = task_tree_test(scheduler);
+
+		BLI_task_scheduler_free(scheduler);
+
+		if (num_threads == 1) {
+			time_flat_single = time_flat;
+			time_tree_single = time_tree;
+		}
+
+		printf("%7d   %7.3fs (%5.2fx)   %7.3fs (%5.2fx)\n",
+		       num_threads,
+		       time_flat, time_flat_single / time_flat,
+		       time_tree, time_tree_single / time_tree);
+
+		if (num_threads == max_threads) {
+			break;
+		}
+	}
+
+	printf("========== ENDED task scaling ==========\n\n");
+
+	BLI_threadapi_exit();
+}